@@ -0,0 +1,201 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <stdio.h>
+#include "CommandList.h"
+#include "../GLState/GLState.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+typedef struct
+{
+    GLenum target;
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+    const void* data;
+}
+Upload;
+
+typedef struct
+{
+    uint64_t key;
+    FFRenderQueuePacket packet;
+    float model[16];
+}
+Draw;
+
+struct FFCommandList
+{
+    Upload* uploads;
+    unsigned int numUploads;
+    unsigned int maxUploads;
+
+    Draw* draws;
+    unsigned int numDraws;
+    unsigned int maxDraws;
+};
+
+/*
+** Makes sure that array (of size elements) can hold one more element. 
+** Returns 0 if it fails.
+*/
+static int Grow(void** array, unsigned int* max, unsigned int num, size_t size)
+{
+    void* grown = NULL;
+
+    if (num < *max)
+    {
+        return 1;
+    }
+
+    grown = realloc(*array, 2*(*max)*size);
+
+    if (!grown)
+    {
+        ERR_MSG("Warning: Failed to grow the command list.");
+        return 0;
+    }
+
+    *array = grown;
+    *max *= 2;
+
+    return 1;
+}
+
+FFCommandListPtr FFCommandListCreate(unsigned int capacity)
+{
+    FFCommandListPtr list = malloc(sizeof(struct FFCommandList));
+
+    if (!list)
+    {
+        return NULL;
+    }
+
+    memset(list, 0, sizeof(struct FFCommandList));
+    capacity = capacity ? capacity : 64;
+    list->maxUploads = capacity;
+    list->maxDraws = capacity;
+    list->uploads = malloc(capacity*sizeof(Upload));
+    list->draws = malloc(capacity*sizeof(Draw));
+
+    if (!list->uploads || !list->draws)
+    {
+        FFCommandListDestroy(&list);
+        return NULL;
+    }
+
+    return list;
+}
+
+void FFCommandListDestroy(FFCommandListPtr* list)
+{
+    if (!*list)
+    {
+        return;
+    }
+
+    free((*list)->uploads);
+    free((*list)->draws);
+    free(*list);
+
+    *list = NULL;
+}
+
+int FFCommandListRecordUpload(
+    FFCommandListPtr list,
+    GLenum target,
+    GLuint buffer,
+    GLintptr offset,
+    GLsizeiptr size,
+    const void* data
+)
+{
+    Upload* upload = NULL;
+
+    if (!Grow((void**)&list->uploads, &list->maxUploads, list->numUploads, 
+            sizeof(Upload)))
+    {
+        return 0;
+    }
+
+    upload = &list->uploads[list->numUploads++];
+    upload->target = target;
+    upload->buffer = buffer;
+    upload->offset = offset;
+    upload->size = size;
+    upload->data = data;
+
+    return 1;
+}
+
+int FFCommandListRecordDraw(
+    FFCommandListPtr list,
+    uint64_t key,
+    const FFRenderQueuePacket* packet,
+    const float* model
+)
+{
+    Draw* draw = NULL;
+
+    if (!Grow((void**)&list->draws, &list->maxDraws, list->numDraws, 
+            sizeof(Draw)))
+    {
+        return 0;
+    }
+
+    draw = &list->draws[list->numDraws++];
+    draw->key = key;
+    draw->packet = *packet;
+
+    if (packet->modelLocation != -1)
+    {
+        memcpy(draw->model, model, sizeof(draw->model));
+    }
+
+    return 1;
+}
+
+void FFCommandListExecute(
+    FFCommandListPtr* lists, 
+    unsigned int numLists,
+    FFRenderQueuePtr queue
+)
+{
+    unsigned int i = 0, j = 0;
+    Upload* upload = NULL;
+    Draw* draw = NULL;
+
+    for (i = 0; i < numLists; i++)
+    {
+        for (j = 0; j < lists[i]->numUploads; j++)
+        {
+            upload = &lists[i]->uploads[j];
+            FFGLStateBindBuffer(upload->target, upload->buffer);
+            glBufferSubData(
+                upload->target, 
+                upload->offset, 
+                upload->size, 
+                upload->data
+            );
+        }
+    }
+
+    for (i = 0; i < numLists; i++)
+    {
+        for (j = 0; j < lists[i]->numDraws; j++)
+        {
+            draw = &lists[i]->draws[j];
+            FFRenderQueueSubmit(queue, draw->key, &draw->packet, draw->model);
+        }
+
+        FFCommandListReset(lists[i]);
+    }
+
+    FFRenderQueueFlush(queue);
+}
+
+void FFCommandListReset(FFCommandListPtr list)
+{
+    list->numUploads = 0;
+    list->numDraws = 0;
+}
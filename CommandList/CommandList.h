@@ -0,0 +1,102 @@
+/*
+ * Command lists. Worker threads record opengl free draw commands, the thread
+ * that owns the opengl context replays them.
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef COMMANDLIST_H
+#define COMMANDLIST_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "../RenderQueue/RenderQueue.h"
+
+/*
+** A command list stores two kinds of commands: buffer uploads and draw 
+** packets (see RenderQueue.h). Recording does not issue any opengl calls, so
+** each thread can record into its own list, e.g. from a FFThreadPool loop:
+**
+**      static void RecordRange(void* data, unsigned int first, 
+**          unsigned int count, unsigned int thread)
+**      {
+**          FFCommandListPtr* lists = data;
+**          FFObjRendererRecord(lists[thread], first, count);
+**      }
+**
+**      FFThreadPoolParallelFor(pool, FFObjRendererGetNumMeshes(), 1, 
+**          RecordRange, lists);
+**      FFCommandListExecute(lists, FFThreadPoolGetNumThreads(pool), queue);
+**
+** A list must only be used by one thread at a time.
+*/
+typedef struct FFCommandList* FFCommandListPtr;
+
+/*
+** Creates a command list, capacity is a hint for the # of commands per frame.
+** Returns NULL if it fails.
+*/
+FFCommandListPtr FFCommandListCreate(unsigned int capacity);
+
+/*
+** Records the upload of size bytes of data to buffer (bound to target) at
+** offset. data must stay valid until the list is executed. Returns 0 if it
+** fails.
+*/
+int FFCommandListRecordUpload(
+    FFCommandListPtr list,
+    GLenum target,
+    GLuint buffer,
+    GLintptr offset,
+    GLsizeiptr size,
+    const void* data
+);
+
+/*
+** Records a draw packet with its sort key and model matrix (see 
+** FFRenderQueueSubmit). Returns 0 if it fails.
+*/
+int FFCommandListRecordDraw(
+    FFCommandListPtr list,
+    uint64_t key,
+    const FFRenderQueuePacket* packet,
+    const float* model
+);
+
+/*
+** Replays numLists lists on the opengl thread. The uploads of all lists are
+** executed first (in list order), then the draws of all lists are merged in
+** queue, sorted and flushed. Resets all lists.
+*/
+void FFCommandListExecute(
+    FFCommandListPtr* lists, 
+    unsigned int numLists,
+    FFRenderQueuePtr queue
+);
+
+/*
+** Removes all commands from the list.
+*/
+void FFCommandListReset(FFCommandListPtr list);
+
+void FFCommandListDestroy(FFCommandListPtr* list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: COMMANDLIST_H */
@@ -0,0 +1,125 @@
+#include <stdlib.h>
+#include <math.h>
+#include "Frustum.h"
+
+void FFFrustumMultiplyMatrices(float* result, const float* a, const float* b)
+{
+    int i = 0, j = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            result[4*i + j] = 
+                a[j]*b[4*i] + 
+                a[4 + j]*b[4*i + 1] + 
+                a[8 + j]*b[4*i + 2] + 
+                a[12 + j]*b[4*i + 3];
+        }
+    }
+}
+
+void FFFrustumSetMatrix(FFFrustum* frustum, const float* viewProjection)
+{
+    const float* m = viewProjection;
+    float length = 0.0f;
+    int i = 0, j = 0;
+
+    /* plane 2*i + 0 is row 3 + row i, plane 2*i + 1 is row 3 - row i 
+    ** (Gribb, Hartmann: "Fast Extraction of Viewing Frustum Planes from the 
+    ** World-View-Projection Matrix")
+    */
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            frustum->planes[2*i][j] = m[4*j + 3] + m[4*j + i];
+            frustum->planes[2*i + 1][j] = m[4*j + 3] - m[4*j + i];
+        }
+    }
+
+    for (i = 0; i < 6; i++)
+    {
+        length = sqrtf(
+                frustum->planes[i][0]*frustum->planes[i][0] + 
+                frustum->planes[i][1]*frustum->planes[i][1] + 
+                frustum->planes[i][2]*frustum->planes[i][2]
+            );
+
+        if (length > 0.0f)
+        {
+            for (j = 0; j < 4; j++)
+            {
+                frustum->planes[i][j] /= length;
+            }
+        }
+    }
+}
+
+int FFFrustumTestBox(const FFFrustum* frustum, const float* min, const float* max)
+{
+    const float* plane = NULL;
+    float pVertex[3];
+    float nVertex[3];
+    int result = FF_FRUSTUM_INSIDE;
+    int i = 0, j = 0;
+
+    for (i = 0; i < 6; i++)
+    {
+        plane = frustum->planes[i];
+
+        /* pVertex is the corner furthest along the normal of the plane, 
+        ** nVertex the one opposite of it
+        */
+        for (j = 0; j < 3; j++)
+        {
+            pVertex[j] = plane[j] >= 0.0f ? max[j] : min[j];
+            nVertex[j] = plane[j] >= 0.0f ? min[j] : max[j];
+        }
+
+        if (plane[0]*pVertex[0] + plane[1]*pVertex[1] + 
+            plane[2]*pVertex[2] + plane[3] < 0.0f)
+        {
+            return FF_FRUSTUM_OUTSIDE;
+        }
+
+        if (plane[0]*nVertex[0] + plane[1]*nVertex[1] + 
+            plane[2]*nVertex[2] + plane[3] < 0.0f)
+        {
+            result = FF_FRUSTUM_INTERSECTS;
+        }
+    }
+
+    return result;
+}
+
+int FFFrustumTestSphere(
+    const FFFrustum* frustum, 
+    const float* center, 
+    float radius
+)
+{
+    const float* plane = NULL;
+    float distance = 0.0f;
+    int result = FF_FRUSTUM_INSIDE;
+    int i = 0;
+
+    for (i = 0; i < 6; i++)
+    {
+        plane = frustum->planes[i];
+        distance = plane[0]*center[0] + plane[1]*center[1] + 
+            plane[2]*center[2] + plane[3];
+
+        if (distance < -radius)
+        {
+            return FF_FRUSTUM_OUTSIDE;
+        }
+
+        if (distance < radius)
+        {
+            result = FF_FRUSTUM_INTERSECTS;
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,80 @@
+/*
+ * View frustum. Extracts the clip planes of a view projection matrix and 
+ * tests bounding volumes against them.
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+** Results of the tests, a volume is either completely outside, intersects 
+** the frustum or is completely inside.
+*/
+#define FF_FRUSTUM_OUTSIDE 0
+#define FF_FRUSTUM_INTERSECTS 1
+#define FF_FRUSTUM_INSIDE 2
+
+/*
+** The six clip planes (left, right, bottom, top, near, far). A plane is 
+** (a, b, c, d) with a*x + b*y + c*z + d >= 0 for points on the inner side,
+** (a, b, c) is normalized.
+*/
+typedef struct
+{
+    float planes[6][4];
+}
+FFFrustum;
+
+/*
+** Computes result = a*b for opengl (column major) matrices with 16 elements.
+** result must not alias a or b.
+*/
+void FFFrustumMultiplyMatrices(float* result, const float* a, const float* b);
+
+/*
+** Extracts the planes of the frustum from viewProjection (= projection*view,
+** an opengl matrix with 16 elements). The planes are in world space, or in 
+** the space of model if viewProjection is projection*view*model.
+*/
+void FFFrustumSetMatrix(FFFrustum* frustum, const float* viewProjection);
+
+/*
+** Tests the axis aligned box min, max (3 floats each) against the frustum.
+** Returns FF_FRUSTUM_OUTSIDE, FF_FRUSTUM_INTERSECTS or FF_FRUSTUM_INSIDE. 
+** Boxes near the corners of the frustum may be reported as intersecting 
+** although they are outside.
+*/
+int FFFrustumTestBox(const FFFrustum* frustum, const float* min, const float* max);
+
+/*
+** Like FFFrustumTestBox for the sphere with center (3 floats) and radius.
+*/
+int FFFrustumTestSphere(
+    const FFFrustum* frustum, 
+    const float* center, 
+    float radius
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: FRUSTUM_H */
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include "GLState.h"
+
+#define UNKNOWN 0xFFFFFFFF  /* marks state we do not know about */
+
+#define MAX_TEXTURE_UNITS 16
+
+/* buffer targets that are shadowed */
+static const GLenum bufferTargets[] = {
+        GL_ARRAY_BUFFER,
+        GL_ELEMENT_ARRAY_BUFFER,
+        GL_DRAW_INDIRECT_BUFFER,
+        GL_TEXTURE_BUFFER,
+        GL_UNIFORM_BUFFER,
+        GL_PIXEL_UNPACK_BUFFER
+    };
+
+#define NUM_BUFFER_TARGETS (sizeof(bufferTargets)/sizeof(GLenum))
+#define ELEMENT_ARRAY_BUFFER_SLOT 1
+
+/* texture targets that are shadowed */
+static const GLenum textureTargets[] = {
+        GL_TEXTURE_2D,
+        GL_TEXTURE_2D_ARRAY,
+        GL_TEXTURE_BUFFER,
+        GL_TEXTURE_CUBE_MAP
+    };
+
+#define NUM_TEXTURE_TARGETS (sizeof(textureTargets)/sizeof(GLenum))
+
+/* capabilities that are shadowed */
+static const GLenum caps[] = {
+        GL_DEPTH_TEST,
+        GL_BLEND,
+        GL_CULL_FACE
+    };
+
+#define NUM_CAPS (sizeof(caps)/sizeof(GLenum))
+
+/*
+** The shadowed state.
+*/
+static GLuint program;
+static GLuint vao;
+static GLuint buffers[NUM_BUFFER_TARGETS];
+static GLuint activeTexture;
+static GLuint textures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+static GLuint polygonMode;
+static GLuint capEnabled[NUM_CAPS];
+static GLuint depthMask;
+static GLuint depthFunc;
+static GLuint blendSrc;
+static GLuint blendDst;
+
+static int wasInitialized = 0;
+static FFGLStateStats stats;
+
+static int FindIndex(const GLenum* list, unsigned int size, GLenum value)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < size; i++)
+    {
+        if (list[i] == value)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+** Compares the shadowed state with the requested one and updates it. Returns
+** 1 if the change has to be passed to OpenGL.
+*/
+static int Change(GLuint* state, GLuint value)
+{
+    if (!wasInitialized)
+    {
+        FFGLStateInvalidate();
+    }
+
+    if (*state == value)
+    {
+        stats.avoided++;
+        return 0;
+    }
+
+    *state = value;
+    stats.issued++;
+
+    return 1;
+}
+
+void FFGLStateInvalidate()
+{
+    unsigned int i = 0, j = 0;
+
+    program = UNKNOWN;
+    vao = UNKNOWN;
+    activeTexture = UNKNOWN;
+    polygonMode = UNKNOWN;
+    depthMask = UNKNOWN;
+    depthFunc = UNKNOWN;
+    blendSrc = UNKNOWN;
+    blendDst = UNKNOWN;
+
+    for (i = 0; i < NUM_BUFFER_TARGETS; i++)
+    {
+        buffers[i] = UNKNOWN;
+    }
+
+    for (i = 0; i < MAX_TEXTURE_UNITS; i++)
+    {
+        for (j = 0; j < NUM_TEXTURE_TARGETS; j++)
+        {
+            textures[i][j] = UNKNOWN;
+        }
+    }
+
+    for (i = 0; i < NUM_CAPS; i++)
+    {
+        capEnabled[i] = UNKNOWN;
+    }
+
+    wasInitialized = 1;
+}
+
+void FFGLStateUseProgram(GLuint p)
+{
+    if (Change(&program, p))
+    {
+        glUseProgram(p);
+    }
+}
+
+void FFGLStateBindVertexArray(GLuint v)
+{
+    if (Change(&vao, v))
+    {
+        glBindVertexArray(v);
+
+        /* the element array buffer binding belongs to the vao */
+        buffers[ELEMENT_ARRAY_BUFFER_SLOT] = UNKNOWN;
+    }
+}
+
+void FFGLStateBindBuffer(GLenum target, GLuint buffer)
+{
+    int slot = FindIndex(bufferTargets, NUM_BUFFER_TARGETS, target);
+
+    if (slot == -1)
+    {
+        stats.issued++;
+        glBindBuffer(target, buffer);
+        return;
+    }
+
+    if (Change(&buffers[slot], buffer))
+    {
+        glBindBuffer(target, buffer);
+    }
+}
+
+void FFGLStateBindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+    int slot = FindIndex(textureTargets, NUM_TEXTURE_TARGETS, target);
+
+    if (slot == -1 || unit >= MAX_TEXTURE_UNITS)
+    {
+        stats.issued += 2;
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        activeTexture = unit;
+        return;
+    }
+
+    if (!wasInitialized)
+    {
+        FFGLStateInvalidate();
+    }
+
+    /* the unit is switched even if the texture is bound already, callers
+    ** edit the texture through the active unit after binding it
+    */
+    if (Change(&activeTexture, unit))
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+
+    if (Change(&textures[unit][slot], texture))
+    {
+        glBindTexture(target, texture);
+    }
+}
+
+void FFGLStatePolygonMode(GLenum mode)
+{
+    if (Change(&polygonMode, mode))
+    {
+        glPolygonMode(GL_FRONT_AND_BACK, mode);
+    }
+}
+
+void FFGLStateEnable(GLenum cap)
+{
+    int slot = FindIndex(caps, NUM_CAPS, cap);
+
+    if (slot == -1)
+    {
+        stats.issued++;
+        glEnable(cap);
+        return;
+    }
+
+    if (Change(&capEnabled[slot], GL_TRUE))
+    {
+        glEnable(cap);
+    }
+}
+
+void FFGLStateDisable(GLenum cap)
+{
+    int slot = FindIndex(caps, NUM_CAPS, cap);
+
+    if (slot == -1)
+    {
+        stats.issued++;
+        glDisable(cap);
+        return;
+    }
+
+    if (Change(&capEnabled[slot], GL_FALSE))
+    {
+        glDisable(cap);
+    }
+}
+
+void FFGLStateDepthMask(GLboolean flag)
+{
+    if (Change(&depthMask, flag))
+    {
+        glDepthMask(flag);
+    }
+}
+
+void FFGLStateDepthFunc(GLenum func)
+{
+    if (Change(&depthFunc, func))
+    {
+        glDepthFunc(func);
+    }
+}
+
+void FFGLStateBlendFunc(GLenum sfactor, GLenum dfactor)
+{
+    if (!wasInitialized)
+    {
+        FFGLStateInvalidate();
+    }
+
+    if (blendSrc == sfactor && blendDst == dfactor)
+    {
+        stats.avoided++;
+        return;
+    }
+
+    blendSrc = sfactor;
+    blendDst = dfactor;
+    stats.issued++;
+    glBlendFunc(sfactor, dfactor);
+}
+
+void FFGLStateDeleteProgram(GLuint p)
+{
+    /* deleting the current program is deferred by OpenGL until it is no 
+    ** longer in use, keep the binding as it is.
+    */
+    glDeleteProgram(p);
+}
+
+void FFGLStateDeleteVertexArray(GLuint v)
+{
+    if (v == vao)
+    {
+        vao = 0;
+        buffers[ELEMENT_ARRAY_BUFFER_SLOT] = UNKNOWN;
+    }
+
+    glDeleteVertexArrays(1, &v);
+}
+
+void FFGLStateDeleteBuffer(GLuint buffer)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < NUM_BUFFER_TARGETS; i++)
+    {
+        if (buffers[i] == buffer)
+        {
+            buffers[i] = 0;
+        }
+    }
+
+    glDeleteBuffers(1, &buffer);
+}
+
+void FFGLStateDeleteTexture(GLuint texture)
+{
+    unsigned int i = 0, j = 0;
+
+    for (i = 0; i < MAX_TEXTURE_UNITS; i++)
+    {
+        for (j = 0; j < NUM_TEXTURE_TARGETS; j++)
+        {
+            if (textures[i][j] == texture)
+            {
+                textures[i][j] = 0;
+            }
+        }
+    }
+
+    glDeleteTextures(1, &texture);
+}
+
+void FFGLStateGetStats(FFGLStateStats* s)
+{
+    *s = stats;
+}
+
+void FFGLStateResetStats()
+{
+    stats.issued = 0;
+    stats.avoided = 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * Shadows OpenGL state to skip redundant state changes.
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef GLSTATE_H
+#define GLSTATE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES 1
+#endif
+#include <Fxs/OpenGL/glcorearb.h>
+
+/*
+** All FF renderers route their program, vao, buffer, texture, polygon mode
+** and depth/blend state changes through the functions below. A call is only
+** passed to OpenGL if the state differs from the shadowed state.
+**
+** The shadowed state is unknown initially, so the first change of each state
+** always reaches OpenGL. Code that changes OpenGL state without going through
+** this module has to call FFGLStateInvalidate() afterwards.
+*/
+
+/*
+** Counters for instrumentation.
+*/
+typedef struct
+{
+    unsigned int issued;    /* # of state changes passed to OpenGL */
+    unsigned int avoided;   /* # of redundant state changes that were skipped */
+}
+FFGLStateStats;
+
+/*
+** Forgets all shadowed state. The next change of each state will reach 
+** OpenGL.
+*/
+void FFGLStateInvalidate();
+
+void FFGLStateUseProgram(GLuint program);
+void FFGLStateBindVertexArray(GLuint vao);
+
+/*
+** Binds a buffer to target. Note that the GL_ELEMENT_ARRAY_BUFFER binding is 
+** part of the vao state, it is forgotten whenever the vao changes.
+*/
+void FFGLStateBindBuffer(GLenum target, GLuint buffer);
+
+/*
+** Binds a texture to target of the texture unit (0, 1, ...). The unit is the
+** active texture unit afterwards, so glTex* calls that follow edit texture.
+*/
+void FFGLStateBindTexture(GLuint unit, GLenum target, GLuint texture);
+
+/*
+** Sets the polygon mode for GL_FRONT_AND_BACK.
+*/
+void FFGLStatePolygonMode(GLenum mode);
+
+/*
+** Enables/disables a capability. Shadowed are GL_DEPTH_TEST, GL_BLEND and
+** GL_CULL_FACE, other capabilities are passed through to OpenGL.
+*/
+void FFGLStateEnable(GLenum cap);
+void FFGLStateDisable(GLenum cap);
+
+void FFGLStateDepthMask(GLboolean flag);
+void FFGLStateDepthFunc(GLenum func);
+void FFGLStateBlendFunc(GLenum sfactor, GLenum dfactor);
+
+/*
+** Deletes OpenGL objects and resets their bindings in the shadowed state, as
+** OpenGL does.
+*/
+void FFGLStateDeleteProgram(GLuint program);
+void FFGLStateDeleteVertexArray(GLuint vao);
+void FFGLStateDeleteBuffer(GLuint buffer);
+void FFGLStateDeleteTexture(GLuint texture);
+
+/*
+** Gets the counters of issued and avoided state changes since the last reset.
+*/
+void FFGLStateGetStats(FFGLStateStats* stats);
+void FFGLStateResetStats();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: GLSTATE_H */
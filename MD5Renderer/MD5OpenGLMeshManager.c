@@ -7,6 +7,7 @@
 #include "MD5OpenGLMeshManager.h"
 #include <Fxs/MD5/MD5Animation.h>
 #include "../External/parson.h"
+#include "../GLState/GLState.h"
 
 #define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
 static char errMsg[1024];
@@ -83,6 +84,39 @@ static int MD5OpenGLMeshCreateWithFile(
 		(*glmesh)->numSubMeshes*sizeof(MD5OpenGLSubMesh)
 	);
 
+	/* alloc one host array for the positions of all submeshes, each submesh 
+	** gets its range in it.
+	*/
+	for (i = 0; i < md5mesh->numSubMeshes; i++)
+	{
+		(*glmesh)->numPositions += 3*md5mesh->meshes[i].numFaces;
+	}
+
+	(*glmesh)->positionsHost = (FxsVector3*)malloc(
+			(*glmesh)->numPositions*sizeof(FxsVector3)
+		);
+	(*glmesh)->firsts = (GLint*)malloc(md5mesh->numSubMeshes*sizeof(GLint));
+	(*glmesh)->counts = (GLsizei*)malloc(md5mesh->numSubMeshes*sizeof(GLsizei));
+
+	if (!(*glmesh)->positionsHost || !(*glmesh)->firsts || !(*glmesh)->counts) 
+	{
+		sprintf(
+			errMsg, 
+			"Warning: malloc failed. Could not load md5mesh: %s", 
+			filename
+		);
+		
+		ERR_MSG(errMsg);	
+		MD5OpenGLMeshDestroy(glmesh);
+		return 0;
+	}
+
+	memset(
+		(*glmesh)->positionsHost,
+		0,
+		(*glmesh)->numPositions*sizeof(FxsVector3)
+	);
+
 	(*glmesh)->min.x = FLT_MAX;
 	(*glmesh)->min.y = FLT_MAX;
 	(*glmesh)->min.z = FLT_MAX;
@@ -95,30 +129,15 @@ static int MD5OpenGLMeshCreateWithFile(
 	{
 	  	md5subMesh = &md5mesh->meshes[i];
 
-		/* alloc host memory for positions of this gl submesh */
+		/* set the range of this submesh in the packed host array */
 		(*glmesh)->subMeshes[i].numPositions = 3*md5subMesh->numFaces;
-		(*glmesh)->subMeshes[i].positionsHost = (FxsVector3*)malloc(
-				3*md5subMesh->numFaces*sizeof(FxsVector3)
-			);
-		
-		if (!(*glmesh)->subMeshes[i].positionsHost) 
-		{
-		    sprintf(
-				errMsg, 
-				"Warning: malloc failed. Could not load md5mesh: %s", 
-				filename
-			);
-			
-			ERR_MSG(errMsg);	
-			FxsMD5MeshDestroy(&md5mesh);
-			MD5OpenGLMeshDestroy(glmesh);
-		}
-
-		memset(
-			(*glmesh)->subMeshes[i].positionsHost,
-			0,
-			3*md5subMesh->numFaces*sizeof(FxsVector3)
-		);
+		(*glmesh)->subMeshes[i].first = i ? 
+			(*glmesh)->subMeshes[i - 1].first + 
+			(*glmesh)->subMeshes[i - 1].numPositions : 0;
+		(*glmesh)->subMeshes[i].positionsHost = 
+			&(*glmesh)->positionsHost[(*glmesh)->subMeshes[i].first];
+		(*glmesh)->firsts[i] = (*glmesh)->subMeshes[i].first;
+		(*glmesh)->counts[i] = (*glmesh)->subMeshes[i].numPositions;
 
 		/* init the bounding box for the sub mesh */
 		(*glmesh)->subMeshes[i].min.x = FLT_MAX;
@@ -200,32 +219,31 @@ static int MD5OpenGLMeshCreateWithFile(
 		(*glmesh)->max.x = fmaxf((*glmesh)->subMeshes[i].max.x, (*glmesh)->max.x);
 		(*glmesh)->max.y = fmaxf((*glmesh)->subMeshes[i].max.y, (*glmesh)->max.y);
 		(*glmesh)->max.z = fmaxf((*glmesh)->subMeshes[i].max.z, (*glmesh)->max.z);
+	}
 
-		/* initialize the opengl data for the sub mesh */
-		glGenBuffers(1, &(*glmesh)->subMeshes[i].positions);
-		glBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->subMeshes[i].positions);  
-		
-		glBufferData(
-			GL_ARRAY_BUFFER,
-		 	sizeof(FxsVector3)*(*glmesh)->subMeshes[i].numPositions,
-			(*glmesh)->subMeshes[i].positionsHost,
-			GL_DYNAMIC_DRAW
-		);
-		
-		glGenVertexArrays(1, &(*glmesh)->subMeshes[i].vao);
-		glBindVertexArray((*glmesh)->subMeshes[i].vao);
-		glBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->subMeshes[i].positions);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+	/* initialize the opengl data for all sub meshes at once */
+	glGenBuffers(1, &(*glmesh)->positions);
+	FFGLStateBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->positions);  
 	
-		if (GL_NO_ERROR != glGetError()) 
-		{
-			sprintf(errMsg, "Warning: opengl failed. Could not load md5mesh: %s", filename);
-			ERR_MSG(errMsg);	
-			FxsMD5MeshDestroy(&md5mesh);
-			MD5OpenGLMeshDestroy(glmesh);
-			return 0;		    
-		}
+	glBufferData(
+		GL_ARRAY_BUFFER,
+	 	sizeof(FxsVector3)*(*glmesh)->numPositions,
+		(*glmesh)->positionsHost,
+		GL_DYNAMIC_DRAW
+	);
+	
+	glGenVertexArrays(1, &(*glmesh)->vao);
+	FFGLStateBindVertexArray((*glmesh)->vao);
+	FFGLStateBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->positions);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+	if (GL_NO_ERROR != glGetError()) 
+	{
+		sprintf(errMsg, "Warning: opengl failed. Could not load md5mesh: %s", filename);
+		ERR_MSG(errMsg);	
+		MD5OpenGLMeshDestroy(glmesh);
+		return 0;		    
 	}
 	
 	return 1;
@@ -233,12 +251,14 @@ static int MD5OpenGLMeshCreateWithFile(
 
 /*
 ** updates the md5mesh of mesh according to the passed animation and the frame.
-** updates geometry on host and opengl side according to the updated pose.
+** updates geometry on host and, if upload is set, on opengl side according to 
+** the updated pose.
 */ 
 static int MD5OpenGLMeshUpdatePoseWithAnimationFrame(
 	MD5OpenGLMesh* mesh,
 	const FxsMD5Animation* animation, 
-	unsigned int frame
+	unsigned int frame,
+	int upload
 )
 {
 	int i = 0, j = 0, k = 0, l = 0;
@@ -355,30 +375,29 @@ static int MD5OpenGLMeshUpdatePoseWithAnimationFrame(
 		mesh->max.x = fmaxf(mesh->subMeshes[i].max.x, mesh->max.x);
 		mesh->max.y = fmaxf(mesh->subMeshes[i].max.y, mesh->max.y);
 		mesh->max.z = fmaxf(mesh->subMeshes[i].max.z, mesh->max.z);
+	}
 
-		/* update the opengl data for the sub mesh */
-		glBindBuffer(GL_ARRAY_BUFFER, mesh->subMeshes[i].positions);  
-	
-		glBufferSubData(
-			GL_ARRAY_BUFFER,
-			0,
-		 	sizeof(FxsVector3)*mesh->subMeshes[i].numPositions,
-			mesh->subMeshes[i].positionsHost
-		);
-		
-//		glGenVertexArrays(1, &(*glmesh)->subMeshes[i].vao);
-//		glBindVertexArray((*glmesh)->subMeshes[i].vao);
-//		glBindBuffer(GL_ARRAY_BUFFER, (*glmesh)->subMeshes[i].positions);
-//		glEnableVertexAttribArray(0);
-//		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-	
-		if (GL_NO_ERROR != glGetError()) 
-		{
-			sprintf(errMsg, "Warning: opengl failed. Could not update md5mesh");
-			ERR_MSG(errMsg);	
-			return 0;		    
-		}	
+	if (!upload)
+	{
+		return 1;
 	}
+
+	/* update the opengl data for all sub meshes with one upload */
+	FFGLStateBindBuffer(GL_ARRAY_BUFFER, mesh->positions);  
+
+	glBufferSubData(
+		GL_ARRAY_BUFFER,
+		0,
+	 	sizeof(FxsVector3)*mesh->numPositions,
+		mesh->positionsHost
+	);
+	
+	if (GL_NO_ERROR != glGetError()) 
+	{
+		sprintf(errMsg, "Warning: opengl failed. Could not update md5mesh");
+		ERR_MSG(errMsg);	
+		return 0;		    
+	}	
 	
 	return 1;
 }
@@ -388,8 +407,6 @@ static int MD5OpenGLMeshUpdatePoseWithAnimationFrame(
 */ 
 static void MD5OpenGLMeshDestroy(MD5OpenGLMesh** glmesh)
 {
-	int i = 0;
-
 	if (!(*glmesh)) 
 	{
 	    return;
@@ -401,20 +418,18 @@ static void MD5OpenGLMeshDestroy(MD5OpenGLMesh** glmesh)
 		FxsMD5MeshDestroy(&(*glmesh)->md5mesh);
 	}
 
-	/* delete the submeshes and their data */
-	if ((*glmesh)->subMeshes)
+	/* delete the packed data of the submeshes */
+	if ((*glmesh)->positions)
 	{
-		for (i = 0; i < (*glmesh)->numSubMeshes; i++) 
-		{
-			if((*glmesh)->subMeshes[i].positions)
-			{
-				free((*glmesh)->subMeshes[i].positionsHost);
-				glDeleteBuffers(1, &(*glmesh)->subMeshes[i].positions);
-				glDeleteVertexArrays(1, &(*glmesh)->subMeshes[i].vao);
-			}
-		}
+		FFGLStateDeleteBuffer((*glmesh)->positions);
+		FFGLStateDeleteVertexArray((*glmesh)->vao);
 	}
 
+	free((*glmesh)->positionsHost);
+	free((*glmesh)->firsts);
+	free((*glmesh)->counts);
+	free((*glmesh)->subMeshes);
+
 	/* delete the gl mesh */
 	free(*glmesh);
 	
@@ -617,10 +632,15 @@ void MD5OpenGLMeshManagerDestroy()
     }
 }
 
-const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+/*
+** Validates the ids and updates the pose of the mesh, see 
+** MD5OpenGLMeshUpdatePoseWithAnimationFrame.
+*/
+static int UpdateMeshPose(
     int meshId,
     int animationId,
-    int frame
+    int frame,
+    int upload
 )
 {
     int f = 0;
@@ -666,7 +686,7 @@ const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
     /* keep the frame between 0 .. animations[animationId]->numFrames */
     f = frame % animations[animationId]->numFrames;
 
-    if (!MD5OpenGLMeshUpdatePoseWithAnimationFrame(meshes[meshId], animations[animationId], f))
+    if (!MD5OpenGLMeshUpdatePoseWithAnimationFrame(meshes[meshId], animations[animationId], f, upload))
     {
         ERR_MSG("Failed to update the opengl mesh");
         return 0;
@@ -675,3 +695,20 @@ const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
     return 1;
 }
 
+const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+    int meshId,
+    int animationId,
+    int frame
+)
+{
+    return UpdateMeshPose(meshId, animationId, frame, 1);
+}
+
+const int MD5OpenGLMeshManagerUpdateMeshHostPoseWithAnimationFrame(
+    int meshId,
+    int animationId,
+    int frame
+)
+{
+    return UpdateMeshPose(meshId, animationId, frame, 0);
+}
@@ -25,17 +25,21 @@ extern "C"
 
 #include <Fxs/Math/Vector3.h>
 #include <Fxs/MD5/MD5Mesh.h>
+#ifndef GL_GLEXT_PROTOTYPES
 #define GL_GLEXT_PROTOTYPES 1
+#endif
 #include <Fxs/Opengl/glcorearb.h>
 
 /*
-** Submesh that actually stores all the opengl data
+** Submesh of a MD5OpenGLMesh. The opengl data of all submeshes is packed into
+** the buffer of their mesh, a submesh only stores its range in that buffer.
 */ 
 typedef struct
 {
-	GLuint vao;
-	GLuint positions; 			/* opengl positions buffer */
-	FxsVector3* positionsHost; 	/* positions in host memory */
+	int first; 					/* offset of the first position in the 
+								** mesh's packed buffer */
+	FxsVector3* positionsHost; 	/* positions in host memory (points into the
+								** packed host array of the mesh) */
 	int numPositions; 			/* # of positions */
 	
 	/* bounding box for the submesh */
@@ -47,7 +51,9 @@ MD5OpenGLSubMesh;
 /*
 ** Struct for storing OpenGL data for a MD5 mesh.
 **
-** A mesh consits of submeshes that store all the opengl data
+** A mesh consits of submeshes. The positions of all submeshes live in one 
+** opengl buffer (and one vao), so the whole mesh is uploaded with a single
+** call and drawn with a single glMultiDrawArrays.
 */
 typedef struct
 {
@@ -55,6 +61,15 @@ typedef struct
 	int numSubMeshes; 				/* # of submeshes */
 	MD5OpenGLSubMesh* subMeshes;
 
+	GLuint vao;
+	GLuint positions; 				/* opengl positions buffer for all 
+									** submeshes */
+	FxsVector3* positionsHost; 		/* positions of all submeshes in host 
+									** memory */
+	int numPositions; 				/* # of positions of all submeshes */
+	GLint* firsts; 					/* per submesh offsets and ... */
+	GLsizei* counts; 				/* ... counts for glMultiDrawArrays */
+
 	/* bounding box for the mesh */
     FxsVector3 min;
 	FxsVector3 max;
@@ -80,6 +95,19 @@ const int MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
     int frame
 );
 
+/*
+** Like MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame, but only updates
+** the host data of the mesh and does not issue any opengl calls. It can be 
+** called from any thread, as long as no other thread updates the same mesh.
+** mesh->positionsHost has to be uploaded to mesh->positions before the mesh
+** is drawn.
+*/
+const int MD5OpenGLMeshManagerUpdateMeshHostPoseWithAnimationFrame(
+    int meshId,
+    int animationId,
+    int frame
+);
+
 /*
 ** Destroys the mesh manager. and releases all meshes it contains.
 */ 
@@ -1,8 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <memory.h>
 #include "MD5OpenGLRenderer.h"
 #include "MD5OpenGLMeshManager.h"
 #include <Fxs/OpenGL/Program.h>
+#include "../GLState/GLState.h"
 
 #define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
 
@@ -39,6 +41,14 @@ TO_STRING(
 
 /* the opengl program we use to render */
 static GLuint program; 
+static GLint modelLocation = -1;
+static GLint viewLocation = -1;
+static GLint projectionLocation = -1;
+
+/* host copies of the matrices, needed to compute the depth of packets */
+static float modelMatrix[16];
+static float viewMatrix[16];
+static float projectionMatrix[16];
 static int wasInitialized = 0;
 
 int FFMD5OpenGLRendererCreate(const char* filename)
@@ -80,6 +90,10 @@ int FFMD5OpenGLRendererCreate(const char* filename)
 	glBindFragDataLocation(program, 0, "fragOut"); 
 	FxsOpenGLProgramLink(program);
 
+	modelLocation = glGetUniformLocation(program, "model");
+	viewLocation = glGetUniformLocation(program, "view");
+	projectionLocation = glGetUniformLocation(program, "projection");
+
 	if (GL_NO_ERROR != glGetError())
 	{
 		ERR_MSG("Detected OpenGL error.")
@@ -104,7 +118,7 @@ void FFMD5OpenGLRendererDestroy()
 		return;
 	}
 
-	glDeleteProgram(program);
+	FFGLStateDeleteProgram(program);
 
 	MD5OpenGLMeshManagerDestroy();
 }
@@ -112,7 +126,6 @@ void FFMD5OpenGLRendererDestroy()
 int FFMD5OpenGLRendererRender(int meshId, int animationId, int frame)
 {
 	const MD5OpenGLMesh* mesh = NULL;
-	int i = 0;
 
     if (!wasInitialized)
     {
@@ -132,30 +145,163 @@ int FFMD5OpenGLRendererRender(int meshId, int animationId, int frame)
 		return 0;
 	}
     
-	glUseProgram(program);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	FFGLStateUseProgram(program);
+    FFGLStatePolygonMode(GL_LINE);
 	
-	for (i = 0; i < mesh->numSubMeshes; i++)
+	/* all submeshes share one vao, draw them with a single call */
+	FFGLStateBindVertexArray(mesh->vao);
+	glMultiDrawArrays(
+		GL_TRIANGLES, 
+		mesh->firsts, 
+		mesh->counts, 
+		mesh->numSubMeshes
+	);
+
+	return 1;
+}
+
+/*
+** Fills the draw packet and the sort key for mesh drawn with model.
+*/
+static void MakePacket(
+	const MD5OpenGLMesh* mesh, 
+	const float* model,
+	FFRenderQueuePacket* packet,
+	uint64_t* key
+)
+{
+	float depth = 0.0f;
+
+	memset(packet, 0, sizeof(FFRenderQueuePacket));
+	packet->program = program;
+	packet->vao = mesh->vao;
+	packet->polygonMode = GL_LINE;
+	packet->drawType = FF_RENDER_QUEUE_MULTI_DRAW_ARRAYS;
+	packet->mode = GL_TRIANGLES;
+	packet->firsts = mesh->firsts;
+	packet->counts = mesh->counts;
+	packet->drawCount = mesh->numSubMeshes;
+	packet->modelLocation = modelLocation;
+	packet->paramsLocation = -1;
+
+	depth = FFRenderQueueComputeDepth(
+			model,
+			viewMatrix,
+			projectionMatrix,
+			0.5f*(mesh->min.x + mesh->max.x),
+			0.5f*(mesh->min.y + mesh->max.y),
+			0.5f*(mesh->min.z + mesh->max.z)
+		);
+
+	*key = FFRenderQueueMakeKey(
+			FF_RENDER_QUEUE_PASS_OPAQUE, 
+			program, 
+			0, 
+			mesh->vao, 
+			depth
+		);
+}
+
+int FFMD5OpenGLRendererSubmit(
+    FFRenderQueuePtr queue, 
+    int meshId, 
+    int animationId, 
+    int frame
+)
+{
+	const MD5OpenGLMesh* mesh = NULL;
+	FFRenderQueuePacket packet;
+	uint64_t key = 0;
+
+    if (!wasInitialized)
+    {
+        return 0;
+    }
+    
+    /* the pose is uploaded now, the queue only draws */
+    MD5OpenGLMeshManagerUpdateMeshPoseWithAnimationFrame(
+        meshId,
+        animationId,
+        frame
+    );
+    
+    mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+
+	if (!mesh)
 	{
-		glBindVertexArray(mesh->subMeshes[i].vao);
-		glDrawArrays(GL_TRIANGLES, 0, mesh->subMeshes[i].numPositions);
+		return 0;
 	}
 
-	return 1;
+	MakePacket(mesh, modelMatrix, &packet, &key);
+
+	return FFRenderQueueSubmit(queue, key, &packet, modelMatrix);
+}
+
+int FFMD5OpenGLRendererRecord(
+    FFCommandListPtr list, 
+    int meshId, 
+    int animationId, 
+    int frame,
+    const float* model
+)
+{
+	const MD5OpenGLMesh* mesh = NULL;
+	FFRenderQueuePacket packet;
+	uint64_t key = 0;
+
+    if (!wasInitialized)
+    {
+        return 0;
+    }
+    
+    /* skin on this thread, the upload is replayed on the opengl thread */
+    if (!MD5OpenGLMeshManagerUpdateMeshHostPoseWithAnimationFrame(
+            meshId,
+            animationId,
+            frame
+        ))
+    {
+        return 0;
+    }
+    
+    mesh = MD5OpenGLMeshManagerGetMeshWithId(meshId);
+
+	if (!mesh)
+	{
+		return 0;
+	}
+
+	MakePacket(mesh, model, &packet, &key);
+
+	return FFCommandListRecordUpload(
+			list, 
+			GL_ARRAY_BUFFER, 
+			mesh->positions, 
+			0, 
+			mesh->numPositions*sizeof(FxsVector3), 
+			mesh->positionsHost
+		) && 
+		FFCommandListRecordDraw(list, key, &packet, model);
 }
 
 void FFMD5OpenGLRendererSetModelMatrix(const float* model)
 {
-    FxsOpenGLProgramUniformMatrix4(program, "model", model, GL_FALSE);
+    memcpy(modelMatrix, model, sizeof(modelMatrix));
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, model);
 }
 
 void FFMD5OpenGLRendererSetViewMatrix(const float* view)
 {
-    FxsOpenGLProgramUniformMatrix4(program, "view", view, GL_FALSE);
+    memcpy(viewMatrix, view, sizeof(viewMatrix));
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, view);
 }
 
 void FFMD5OpenGLRendererSetProjectionMatrix(const float* projection)
 {
-    FxsOpenGLProgramUniformMatrix4(program, "projection", projection, GL_FALSE);
+    memcpy(projectionMatrix, projection, sizeof(projectionMatrix));
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, projection);
 }
 
@@ -23,6 +23,9 @@ extern "C"
 {
 #endif
 
+#include "../RenderQueue/RenderQueue.h"
+#include "../CommandList/CommandList.h"
+
 /*
 ** Creates the renderer. filename refers to the config file for the renderer.
 ** returns 0 if it fails.
@@ -57,6 +60,38 @@ int FFMD5OpenGLRendererCreate(const char* filename);
 */ 
 int FFMD5OpenGLRendererRender(int meshId, int animationId, int frame);
 
+/*
+** Like FFMD5OpenGLRendererRender, but instead of drawing the mesh right away
+** a packet is submitted to queue. The packet uses the model matrix that is
+** set at the time of submission. Its depth is computed from the center of 
+** the mesh's bounding box.
+**
+** The pose is uploaded during submission, so if the same mesh is submitted
+** more than once per flush, all its packets are drawn with the last pose.
+*/
+int FFMD5OpenGLRendererSubmit(
+    FFRenderQueuePtr queue, 
+    int meshId, 
+    int animationId, 
+    int frame
+);
+
+/*
+** Records the mesh with id into list, the pose upload as well as the draw.
+** model is the model matrix (16 elements) the mesh is drawn with. Skinning
+** happens on the calling thread and no opengl calls are issued, so worker 
+** threads can record disjoint sets of meshes in parallel (see 
+** CommandList.h). A mesh must only be recorded once per execution of the 
+** lists.
+*/
+int FFMD5OpenGLRendererRecord(
+    FFCommandListPtr list, 
+    int meshId, 
+    int animationId, 
+    int frame,
+    const float* model
+);
+
 /*
 ** Sets the model matrix. Initially it is the identity.
 ** @param model a float array with 16 elements, representing and opengl 
@@ -1,3 +1,709 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
 #include "FFMeshRenderer.h"
 #include <Fxs/OpenGL/Program.h>
+#include <Fxs/Dictionary/Dictionary.h>
+#include "Mesh.h"
+#include "../GLState/GLState.h"
+#include "../Frustum/Frustum.h"
+#include "../Transforms/Transforms.h"
 
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define MAX_FILES_LOADED_HINT 64
+#define DIFF_MAP_UNIT 0
+#define MODELS_UNIT 1
+
+#define TO_STRING(X) #X
+
+/*
+** The model matrix of an instance is read from the buffer texture models,
+** a matrix takes 4 texels, one per column.
+*/
+static char* vertexShader =
+    "#version 150\n"
+TO_STRING(
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform samplerBuffer models;
+    uniform int firstInstance;
+
+    in vec3 position;
+    in vec3 normal;
+    in vec2 texCoord;
+
+    out vec3 viewNormal;
+    out vec2 fragTexCoord;
+
+    void main()
+    {
+        int i = 4*(firstInstance + gl_InstanceID);
+        mat4 model = mat4(
+            texelFetch(models, i),
+            texelFetch(models, i + 1),
+            texelFetch(models, i + 2),
+            texelFetch(models, i + 3)
+        );
+        mat4 modelView = view*model;
+
+        viewNormal = mat3(modelView)*normal;
+        fragTexCoord = texCoord;
+        gl_Position = projection*modelView*vec4(position, 1.0);
+    }
+);
+
+/*
+** Lit by a light at the eye. Nodes without normals get a normal of 0 and are
+** not lit.
+*/
+static char* fragmentShader =
+    "#version 150\n"
+TO_STRING(
+    uniform vec3 diffColor;
+    uniform sampler2D diffMap;
+    uniform int hasDiffMap;
+
+    in vec3 viewNormal;
+    in vec2 fragTexCoord;
+
+    out vec4 fragOut;
+
+    void main()
+    {
+        vec3 color = diffColor;
+        float light = 1.0;
+
+        if (hasDiffMap != 0)
+        {
+            color *= texture(diffMap, fragTexCoord).rgb;
+        }
+
+        if (dot(viewNormal, viewNormal) > 0.0)
+        {
+            light = 0.3 + 0.7*abs(normalize(viewNormal).z);
+        }
+
+        fragOut = vec4(light*color, 1.0);
+    }
+);
+
+/*
+** A loaded file and the model matrices of its instances. A static mesh has
+** an entry of its own with a single instance, its model matrix is the
+** identity as the geometry is in world space already.
+*/
+typedef struct
+{
+    Mesh* mesh;
+    FxsMatrix4* models;
+    unsigned int numModels;
+    unsigned int maxModels;
+    unsigned int firstModel;    /* of the instances in the model buffer */
+    unsigned int dirtyFirst;    /* the models changed since the last upload */
+    unsigned int dirtyEnd;      /* are in [dirtyFirst, dirtyEnd) */
+    int isStatic;
+}
+MeshEntry;
+
+/*
+** Where the model matrix of an instance is, the id of an instance is its
+** index in instances and its node in transforms.
+*/
+typedef struct
+{
+    MeshEntry* entry;
+    unsigned int model;
+}
+Instance;
+
+static GLuint program = 0;
+static GLint viewLocation = -1;
+static GLint projectionLocation = -1;
+static GLint firstInstanceLocation = -1;
+static GLint diffColorLocation = -1;
+static GLint hasDiffMapLocation = -1;
+
+/* the model matrices of all instances and the buffer texture to read them */
+static GLuint modelBuffer = 0;
+static GLuint modelTexture = 0;
+static int modelsChanged = 0;
+static int layoutChanged = 0;   /* instances were added, upload all models */
+
+static FxsDictionaryPtr meshes = NULL;
+static MeshEntry** entries = NULL;
+static unsigned int numEntries = 0;
+static unsigned int maxEntries = 0;
+static MeshEntry** dirtyEntries = NULL;
+static unsigned int numDirtyEntries = 0;
+static unsigned int maxDirtyEntries = 0;
+static Instance* instances = NULL;
+static unsigned int numInstances = 0;
+static unsigned int maxInstances = 0;
+
+/* the local matrices of the instances, the models are their world matrices */
+static FFTransformsPtr transforms = NULL;
+
+/* the static meshes added since FFMeshRendererBeginStatic */
+static MeshBuilder* staticBuilder = NULL;
+
+static FxsMatrix4 viewMatrix;
+static FxsMatrix4 projectionMatrix;
+static int wasInitialized = 0;
+
+/*
+** Grows the array data to hold at least count elements of size. Returns 0 if
+** it runs out of memory, data stays valid then.
+*/
+static int Reserve(
+    void** data,
+    unsigned int* max,
+    unsigned int count,
+    size_t size
+)
+{
+    unsigned int newMax = *max ? *max : 16;
+    void* newData = NULL;
+
+    if (count <= *max)
+    {
+        return 1;
+    }
+
+    while (newMax < count)
+    {
+        newMax *= 2;
+    }
+
+    newData = realloc(*data, newMax*size);
+
+    if (!newData)
+    {
+        return 0;
+    }
+
+    *data = newData;
+    *max = newMax;
+
+    return 1;
+}
+
+static int CreateProgram()
+{
+    program = glCreateProgram();
+    FxsOpenGLProgramAttachShaderWithSource(program, GL_VERTEX_SHADER, vertexShader);
+    FxsOpenGLProgramAttachShaderWithSource(program, GL_FRAGMENT_SHADER, fragmentShader);
+    glBindAttribLocation(program, 0, "position");
+    glBindAttribLocation(program, 1, "normal");
+    glBindAttribLocation(program, 2, "texCoord");
+    glBindFragDataLocation(program, 0, "fragOut");
+    FxsOpenGLProgramLink(program);
+
+    viewLocation = glGetUniformLocation(program, "view");
+    projectionLocation = glGetUniformLocation(program, "projection");
+    firstInstanceLocation = glGetUniformLocation(program, "firstInstance");
+    diffColorLocation = glGetUniformLocation(program, "diffColor");
+    hasDiffMapLocation = glGetUniformLocation(program, "hasDiffMap");
+
+    FFGLStateUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "diffMap"), DIFF_MAP_UNIT);
+    glUniform1i(glGetUniformLocation(program, "models"), MODELS_UNIT);
+
+    return GL_NO_ERROR == glGetError();
+}
+
+int FFMeshRendererCreate()
+{
+    if (wasInitialized)
+    {
+        ERR_MSG("FFMeshRenderer was already initialized");
+        return 0;
+    }
+
+    meshes = FxsDictionaryCreateWithTableSize(MAX_FILES_LOADED_HINT);
+    transforms = FFTransformsCreate(MAX_FILES_LOADED_HINT);
+
+    if (!meshes || !transforms || !CreateProgram())
+    {
+        ERR_MSG("Failed to create the renderer");
+        FxsDictionaryDestroy(&meshes);
+        FFTransformsDestroy(&transforms);
+        return 0;
+    }
+
+    /* the buffer is allocated when the first models are uploaded */
+    glGenBuffers(1, &modelBuffer);
+    FFGLStateBindBuffer(GL_TEXTURE_BUFFER, modelBuffer);
+    glGenTextures(1, &modelTexture);
+    FFGLStateBindTexture(MODELS_UNIT, GL_TEXTURE_BUFFER, modelTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, modelBuffer);
+
+    FxsMatrix4MakeIdentity(&viewMatrix);
+    FxsMatrix4MakeIdentity(&projectionMatrix);
+    wasInitialized = 1;
+
+    return 1;
+}
+
+/*
+** Adds an instance of entry below the instance parent (-1 for none) with the
+** identity as local matrix. Returns the id of the instance, or -1 if it fails.
+*/
+static int AddInstance(MeshEntry* entry, int parent)
+{
+    if (!Reserve((void**)&entry->models, &entry->maxModels,
+            entry->numModels + 1, sizeof(FxsMatrix4)) ||
+        !Reserve((void**)&instances, &maxInstances, numInstances + 1,
+            sizeof(Instance)) ||
+        FFTransformsAdd(transforms, parent, NULL) != (int)numInstances)
+    {
+        return -1;
+    }
+
+    FxsMatrix4MakeIdentity(&entry->models[entry->numModels]);
+    instances[numInstances].entry = entry;
+    instances[numInstances].model = entry->numModels++;
+    modelsChanged = layoutChanged = 1;
+
+    return (int)numInstances++;
+}
+
+/*
+** Gets the entry of the file filename, loads it if it is not loaded yet.
+** Returns NULL if it fails.
+*/
+static MeshEntry* GetEntry(const char* filename)
+{
+    MeshEntry* entry = FxsDictionaryFind(meshes, filename);
+
+    if (entry)
+    {
+        return entry;
+    }
+
+    if (!Reserve((void**)&entries, &maxEntries, numEntries + 1, sizeof(MeshEntry*)))
+    {
+        return NULL;
+    }
+
+    entry = calloc(1, sizeof(MeshEntry));
+
+    if (!entry)
+    {
+        return NULL;
+    }
+
+    entry->mesh = MeshCreateWithFile(filename);
+
+    if (!entry->mesh || !FxsDictionaryInsert(meshes, filename, entry))
+    {
+        MeshDestroy(&entry->mesh);
+        free(entry);
+        return NULL;
+    }
+
+    entries[numEntries++] = entry;
+
+    return entry;
+}
+
+int FFMeshRendererLoad(const char* filename)
+{
+    return FFMeshRendererLoadAttached(filename, -1);
+}
+
+int FFMeshRendererLoadAttached(const char* filename, int parent)
+{
+    MeshEntry* entry = NULL;
+    int id = -1;
+
+    if (!wasInitialized || !filename)
+    {
+        return -1;
+    }
+
+    if (parent < -1 || parent >= (int)numInstances ||
+        (parent >= 0 && instances[parent].entry->isStatic))
+    {
+        ERR_MSG("Invalid parent");
+        return -1;
+    }
+
+    entry = GetEntry(filename);
+
+    if (!entry || (id = AddInstance(entry, parent)) < 0)
+    {
+        ERR_MSG("Failed to load the mesh");
+        return -1;
+    }
+
+    return id;
+}
+
+int FFMeshRendererBeginStatic()
+{
+    if (!wasInitialized)
+    {
+        return 0;
+    }
+
+    if (staticBuilder)
+    {
+        ERR_MSG("Static meshes are already being added");
+        return 0;
+    }
+
+    staticBuilder = MeshBuilderCreate();
+
+    if (!staticBuilder)
+    {
+        ERR_MSG("Out of memory");
+        return 0;
+    }
+
+    return 1;
+}
+
+int FFMeshRendererAddStatic(const char* filename, const FxsMatrix4* model)
+{
+    if (!staticBuilder || !filename || !model)
+    {
+        return 0;
+    }
+
+    if (!MeshBuilderAddFile(staticBuilder, filename, &model->m11))
+    {
+        ERR_MSG("Failed to load the static mesh");
+        return 0;
+    }
+
+    return 1;
+}
+
+int FFMeshRendererEndStatic()
+{
+    MeshEntry* entry = NULL;
+    int id = -1;
+
+    if (!staticBuilder)
+    {
+        return -1;
+    }
+
+    if (!Reserve((void**)&entries, &maxEntries, numEntries + 1, sizeof(MeshEntry*)) ||
+        !(entry = calloc(1, sizeof(MeshEntry))))
+    {
+        ERR_MSG("Out of memory");
+        MeshBuilderDestroy(&staticBuilder);
+        return -1;
+    }
+
+    /* not shared through meshes, it is built from all added placements */
+    entry->isStatic = 1;
+    entry->mesh = MeshBuilderFinish(&staticBuilder);
+
+    if (!entry->mesh || (id = AddInstance(entry, -1)) < 0)
+    {
+        ERR_MSG("Failed to create the static mesh");
+        MeshDestroy(&entry->mesh);
+        free(entry->models);
+        free(entry);
+        return -1;
+    }
+
+    entries[numEntries++] = entry;
+
+    return id;
+}
+
+int FFMeshRendererLoadStatic(const char* filename, const FxsMatrix4* model)
+{
+    if (!FFMeshRendererBeginStatic())
+    {
+        return -1;
+    }
+
+    if (!FFMeshRendererAddStatic(filename, model))
+    {
+        MeshBuilderDestroy(&staticBuilder);
+        return -1;
+    }
+
+    return FFMeshRendererEndStatic();
+}
+
+void FFMeshRendererSetView(const FxsMatrix4* view)
+{
+    viewMatrix = *view;
+}
+
+void FFMeshRendererSetPerspective(const FxsMatrix4* proj)
+{
+    projectionMatrix = *proj;
+}
+
+void FFMeshRendererSetModel(int id, const FxsMatrix4* model)
+{
+    if (id < 0 || (unsigned int)id >= numInstances)
+    {
+        ERR_MSG("Invalid id");
+        return;
+    }
+
+    if (instances[id].entry->isStatic)
+    {
+        ERR_MSG("Static meshes can not be moved");
+        return;
+    }
+
+    FFTransformsSetLocal(transforms, (unsigned int)id, &model->m11);
+    modelsChanged = 1;
+}
+
+/*
+** Copies the model matrix of the instance id from transforms into its entry
+** and adds it to the models of the entry to upload.
+*/
+static void MarkModel(unsigned int id)
+{
+    MeshEntry* entry = instances[id].entry;
+    unsigned int model = instances[id].model;
+
+    memcpy(&entry->models[model], FFTransformsGetWorld(transforms, id),
+        sizeof(FxsMatrix4));
+
+    if (entry->dirtyFirst == entry->dirtyEnd)
+    {
+        /* without room to remember the entry every model is uploaded */
+        if (!Reserve((void**)&dirtyEntries, &maxDirtyEntries,
+                numDirtyEntries + 1, sizeof(MeshEntry*)))
+        {
+            layoutChanged = 1;
+            return;
+        }
+
+        dirtyEntries[numDirtyEntries++] = entry;
+        entry->dirtyFirst = model;
+        entry->dirtyEnd = model + 1;
+    }
+    else if (model < entry->dirtyFirst)
+    {
+        entry->dirtyFirst = model;
+    }
+    else if (model >= entry->dirtyEnd)
+    {
+        entry->dirtyEnd = model + 1;
+    }
+}
+
+/*
+** Computes the model matrices of the instances from their local matrices and
+** uploads the ones that changed. Only after instances were added the model
+** buffer is reallocated and the models of all entries are uploaded, the
+** matrices of each entry after the ones of the previous entry.
+*/
+static void UploadModels()
+{
+    const unsigned int* updated = NULL;
+    unsigned int numUpdated = 0;
+    unsigned int numModels = 0;
+    MeshEntry* entry = NULL;
+    unsigned int i = 0;
+
+    FFTransformsUpdate(transforms);
+    updated = FFTransformsGetUpdated(transforms, &numUpdated);
+
+    for (i = 0; i < numUpdated; i++)
+    {
+        MarkModel(updated[i]);
+    }
+
+    FFGLStateBindBuffer(GL_TEXTURE_BUFFER, modelBuffer);
+
+    if (layoutChanged)
+    {
+        for (i = 0; i < numEntries; i++)
+        {
+            entries[i]->firstModel = numModels;
+            numModels += entries[i]->numModels;
+        }
+
+        /* a new store, so the upload does not wait for the draws of the last
+        ** frame
+        */
+        glBufferData(GL_TEXTURE_BUFFER, numModels*sizeof(FxsMatrix4), NULL,
+            GL_DYNAMIC_DRAW);
+
+        for (i = 0; i < numEntries; i++)
+        {
+            glBufferSubData(
+                GL_TEXTURE_BUFFER,
+                entries[i]->firstModel*sizeof(FxsMatrix4),
+                entries[i]->numModels*sizeof(FxsMatrix4),
+                entries[i]->models
+            );
+        }
+    }
+    else
+    {
+        for (i = 0; i < numDirtyEntries; i++)
+        {
+            entry = dirtyEntries[i];
+            glBufferSubData(
+                GL_TEXTURE_BUFFER,
+                (entry->firstModel + entry->dirtyFirst)*sizeof(FxsMatrix4),
+                (entry->dirtyEnd - entry->dirtyFirst)*sizeof(FxsMatrix4),
+                &entry->models[entry->dirtyFirst]
+            );
+        }
+    }
+
+    for (i = 0; i < numDirtyEntries; i++)
+    {
+        dirtyEntries[i]->dirtyFirst = dirtyEntries[i]->dirtyEnd = 0;
+    }
+
+    numDirtyEntries = 0;
+    modelsChanged = layoutChanged = 0;
+}
+
+/*
+** Draws node, its siblings and their children for numModels instances.
+*/
+static void RenderNode(const Mesh* mesh, const MeshNode* node, unsigned int numModels)
+{
+    const MeshMaterial* material = NULL;
+
+    for (; node; node = node->next)
+    {
+        if (node->vao)
+        {
+            material = &mesh->materials[node->matIdx];
+            glUniform3fv(diffColorLocation, 1, &material->diffColor.x);
+            glUniform1i(hasDiffMapLocation, material->tex != 0);
+
+            if (material->tex)
+            {
+                FFGLStateBindTexture(DIFF_MAP_UNIT, GL_TEXTURE_2D, material->tex);
+            }
+
+            FFGLStateBindVertexArray(node->vao);
+            glDrawElementsInstanced(GL_TRIANGLES, node->numPositions,
+                node->indexType, 0, numModels);
+        }
+
+        RenderNode(mesh, node->children, numModels);
+    }
+}
+
+/*
+** Draws the batches of the static mesh that are not outside frustum.
+*/
+static void RenderBatches(const Mesh* mesh, const FFFrustum* frustum)
+{
+    const MeshBatch* batch = NULL;
+    const MeshMaterial* material = NULL;
+    unsigned int i = 0;
+
+    for (i = 0; i < mesh->numBatches; i++)
+    {
+        batch = &mesh->batches[i];
+
+        if (FF_FRUSTUM_OUTSIDE == FFFrustumTestBox(frustum, &batch->min.x, &batch->max.x))
+        {
+            continue;
+        }
+
+        material = &mesh->materials[batch->matIdx];
+        glUniform3fv(diffColorLocation, 1, &material->diffColor.x);
+        glUniform1i(hasDiffMapLocation, material->tex != 0);
+
+        if (material->tex)
+        {
+            FFGLStateBindTexture(DIFF_MAP_UNIT, GL_TEXTURE_2D, material->tex);
+        }
+
+        FFGLStateBindVertexArray(batch->vao);
+        glDrawElementsInstanced(GL_TRIANGLES, batch->numIndices,
+            GL_UNSIGNED_SHORT, 0, 1);
+    }
+}
+
+void FFMeshRendererRender()
+{
+    FFFrustum frustum;
+    FxsMatrix4 viewProjection;
+    unsigned int i = 0;
+
+    if (!wasInitialized || !numInstances)
+    {
+        return;
+    }
+
+    if (modelsChanged)
+    {
+        UploadModels();
+    }
+
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, &viewMatrix.m11);
+    glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, &projectionMatrix.m11);
+    FFGLStateBindTexture(MODELS_UNIT, GL_TEXTURE_BUFFER, modelTexture);
+
+    /* static meshes are in world space, so the planes are too */
+    FFFrustumMultiplyMatrices(&viewProjection.m11, &projectionMatrix.m11,
+        &viewMatrix.m11);
+    FFFrustumSetMatrix(&frustum, &viewProjection.m11);
+
+    for (i = 0; i < numEntries; i++)
+    {
+        if (entries[i]->isStatic)
+        {
+            glUniform1i(firstInstanceLocation, entries[i]->firstModel);
+            RenderBatches(entries[i]->mesh, &frustum);
+        }
+        else if (entries[i]->numModels)
+        {
+            glUniform1i(firstInstanceLocation, entries[i]->firstModel);
+            RenderNode(entries[i]->mesh, entries[i]->mesh->root,
+                entries[i]->numModels);
+        }
+    }
+}
+
+void FFMeshRendererDestroy()
+{
+    unsigned int i = 0;
+
+    if (!wasInitialized)
+    {
+        ERR_MSG("FFMeshRenderer is not initialized");
+        return;
+    }
+
+    for (i = 0; i < numEntries; i++)
+    {
+        MeshDestroy(&entries[i]->mesh);
+        free(entries[i]->models);
+        free(entries[i]);
+    }
+
+    MeshBuilderDestroy(&staticBuilder);
+    free(entries);
+    free(dirtyEntries);
+    free(instances);
+    entries = NULL;
+    dirtyEntries = NULL;
+    instances = NULL;
+    numEntries = maxEntries = 0;
+    numDirtyEntries = maxDirtyEntries = 0;
+    numInstances = maxInstances = 0;
+    FxsDictionaryDestroy(&meshes);
+    FFTransformsDestroy(&transforms);
+
+    FFGLStateDeleteTexture(modelTexture);
+    FFGLStateDeleteBuffer(modelBuffer);
+    FFGLStateDeleteProgram(program);
+    modelTexture = modelBuffer = program = 0;
+    wasInitialized = 0;
+}
@@ -1,5 +1,5 @@
-#ifndef OBJRENDERER_H
-#define OBJRENDERER_H
+#ifndef FFMESHRENDERER_H
+#define FFMESHRENDERER_H
 
 #ifdef __cplusplus
 extern "C"
@@ -8,18 +8,103 @@ extern "C"
 
 #include <Fxs/Math/Matrix4.h>
 
-void FFMeshRendererCreate();
+/*
+** Renders static meshes loaded from .obj files. Every loaded mesh is placed
+** in the world by one or more instances, each with its own model matrix.
+** A file is only loaded once, all instances of it share its geometry.
+**
+** The model matrices of all instances are kept in one contiguous buffer, the
+** instances of a mesh next to each other. It is read by the vertex shader
+** through a buffer texture, so each node of a mesh is drawn with a single
+** instanced draw call for all instances of the mesh, no matter how many
+** there are.
+**
+** Scenery that never moves can be added as static meshes instead. All
+** static meshes added between FFMeshRendererBeginStatic and
+** FFMeshRendererEndStatic are merged into a few batches per material at load
+** time (see Mesh.h), across files and placements, so a level placed from
+** many small meshes is drawn with a few draw calls. A file placed many times
+** is only read once. The batches outside the view frustum are not drawn.
+*/
+
+/*
+** Creates the renderer. Returns 0 if it fails.
+*/
+int FFMeshRendererCreate();
+
+/*
+** Adds an instance of the mesh in the .obj file filename, loads the file if
+** it is the first instance of it. The model matrix of the instance is the
+** identity. Returns the id of the instance, or -1 if it fails.
+*/
 int FFMeshRendererLoad(const char* filename);
 
+/*
+** Like FFMeshRendererLoad, but attaches the instance to the instance with id
+** parent: its model matrix is relative to the one of parent and it moves
+** with it. Static meshes can not be parents. Returns the id of the instance,
+** or -1 if it fails.
+*/
+int FFMeshRendererLoadAttached(const char* filename, int parent);
+
+/*
+** Starts adding static meshes. Returns 0 if it fails or static meshes are
+** already being added.
+*/
+int FFMeshRendererBeginStatic();
+
+/*
+** Adds the .obj file filename placed by model to the static meshes being
+** added. Returns 0 if it fails, the static meshes added before are kept then.
+*/
+int FFMeshRendererAddStatic(const char* filename, const FxsMatrix4* model);
+
+/*
+** Merges the static meshes added since FFMeshRendererBeginStatic into one
+** instance, which can not be moved. Returns the id of the instance, or -1 if
+** it fails.
+*/
+int FFMeshRendererEndStatic();
+
+/*
+** Like adding the .obj file filename placed by model as the only static mesh
+** between FFMeshRendererBeginStatic and FFMeshRendererEndStatic. Its batches
+** are not merged with the ones of other static meshes. Returns the id of the
+** instance, or -1 if it fails.
+*/
+int FFMeshRendererLoadStatic(const char* filename, const FxsMatrix4* model);
+
+/*
+** Sets the view matrix. Initially it is the identity.
+*/
 void FFMeshRendererSetView(const FxsMatrix4* view);
+
+/*
+** Sets the projection matrix. Initially it is the identity.
+*/
 void FFMeshRendererSetPerspective(const FxsMatrix4* proj);
+
+/*
+** Sets the model matrix of the instance with id, relative to its parent if
+** it is attached. The model matrices of the changed instances and the ones
+** attached to them are computed, and the buffer of the model matrices is
+** uploaded, once per frame if any of them changed (see Transforms.h). Static
+** meshes can not be moved.
+*/
 void FFMeshRendererSetModel(int id, const FxsMatrix4* model);
 
-void FFMeshRenderDestroy();
+/*
+** Draws all instances of all meshes.
+*/
+void FFMeshRendererRender();
 
+/*
+** Releases the meshes and the renderer.
+*/
+void FFMeshRendererDestroy();
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif /* end of include guard: OBJRENDERER_H */
+#endif /* end of include guard: FFMESHRENDERER_H */
@@ -1,36 +1,1392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include <math.h>
 #include "Mesh.h"
+#include "../GLState/GLState.h"
 #include <Fxs/Obj/ObjFile.h>
-#include <Fxs/Obj/ObjMtlFile.h>
+#include <Fxs/Dictionary/Dictionary.h>
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define DEFAULT_DIFF_COLOR 0.8f
+
+/* floats per vertex of a batch: position, normal, tex coord */
+#define VERTEX_SIZE 8
+
+/* a batch with more faces is split, its vertices fit unsigned short indices */
+#define BATCH_MAX_TRIANGLES 16384
+
+#define EMPTY_SLOT 0xFFFFFFFF
+
+#define FILES_TABLE_SIZE 64
+
+/*
+** A face of a static mesh in world space, gathered for the batches.
+*/
+typedef struct
+{
+    const MeshNode* node;
+    int matIdx;
+    unsigned int sequence;      /* keeps the faces of a node together */
+    float centroid[3];
+    float vertices[3*VERTEX_SIZE];
+}
+BatchTriangle;
+
+/*
+** The faces of all nodes of a static mesh and the transform into world space.
+*/
+typedef struct
+{
+    const float* model;
+    float normalMatrix[9];      /* column major */
+    int isMirrored;
+    BatchTriangle* triangles;
+    unsigned int numTriangles;
+    unsigned int maxTriangles;
+    BatchTriangle* scratch;
+    unsigned int maxBatches;
+}
+Batcher;
+
+/*
+** State shared while the nodes are built. faces and sortedFaces are scratch
+** arrays that are grown to the size of the largest group, counts is grown to 
+** the # of materials of a group + 1 for the counting sort.
+*/
+typedef struct
+{
+    FxsObjFilePtr obj;
+    FxsObjFace** faces;
+    FxsObjFace** sortedFaces;
+    size_t maxFaces;
+    unsigned int* counts;
+    unsigned int maxCounts;
+    int maxMatIdx;
+    Batcher* batcher;           /* NULL unless the mesh is static */
+}
+BuildContext;
+
+/*
+** The placements of a static mesh collected so far. Each file is parsed
+** once, the nodes of every placement are added to the root of mesh and its
+** faces to batcher.
+*/
+struct MeshBuilder_
+{
+    Mesh* mesh;
+    BuildContext context;
+    Batcher batcher;
+    FxsDictionaryPtr files;     /* the parsed files by their name */
+    FxsObjFilePtr* objs;        /* the parsed files, to destroy them */
+    unsigned int numObjs;
+    unsigned int maxObjs;
+    MeshNode** link;            /* where the next placement is added */
+};
+
+/*
+** Shares equal vertices of VERTEX_SIZE floats by an index. slots is a hash 
+** table of the indices of the vertices with linear probing, at most half 
+** full.
+*/
+typedef struct
+{
+    float* vertices;
+    unsigned int numVertices;
+    unsigned int* slots;
+    unsigned int numSlots;
+}
+Welder;
+
+static MeshNode* CreateNode(int matIdx)
+{
+    MeshNode* node = calloc(1, sizeof(MeshNode));
+
+    if (node)
+    {
+        node->matIdx = matIdx;
+    }
+
+    return node;
+}
+
+static void DestroyNode(MeshNode* node)
+{
+    MeshNode* next = NULL;
+
+    for (; node; node = next)
+    {
+        next = node->next;
+        DestroyNode(node->children);
+
+        if (node->vao)
+        {
+            FFGLStateDeleteVertexArray(node->vao);
+            FFGLStateDeleteBuffer(node->vbo);
+            FFGLStateDeleteBuffer(node->ibo);
+        }
+
+        free(node);
+    }
+}
+
+/*
+** Makes room for maxVertices vertices in welder. Returns 0 if it fails.
+*/
+static int WelderInit(Welder* welder, unsigned int maxVertices)
+{
+    memset(welder, 0, sizeof(Welder));
+    welder->numSlots = 1;
+
+    while (welder->numSlots < 2*maxVertices)
+    {
+        welder->numSlots *= 2;
+    }
+
+    welder->vertices = malloc(maxVertices*VERTEX_SIZE*sizeof(float));
+    welder->slots = malloc(welder->numSlots*sizeof(unsigned int));
+
+    if (!welder->vertices || !welder->slots)
+    {
+        return 0;
+    }
+
+    memset(welder->slots, 0xFF, welder->numSlots*sizeof(unsigned int));
+
+    return 1;
+}
+
+static void WelderRelease(Welder* welder)
+{
+    free(welder->vertices);
+    free(welder->slots);
+}
+
+/*
+** Hashes the VERTEX_SIZE floats of vertex (FNV-1a over their bits).
+*/
+static unsigned int HashVertex(const float* vertex)
+{
+    unsigned int hash = 2166136261u;
+    unsigned int bits = 0;
+    int i = 0;
+
+    for (i = 0; i < VERTEX_SIZE; i++)
+    {
+        memcpy(&bits, &vertex[i], sizeof(bits));
+        hash = (hash ^ bits)*16777619u;
+    }
+
+    return hash ^ (hash >> 16);
+}
+
+/*
+** Gets the index of vertex in welder, it is added if it is not there yet.
+*/
+static unsigned int WeldVertex(Welder* welder, const float* vertex)
+{
+    unsigned int mask = welder->numSlots - 1;
+    unsigned int slot = HashVertex(vertex) & mask;
+
+    while (welder->slots[slot] != EMPTY_SLOT &&
+           memcmp(&welder->vertices[VERTEX_SIZE*welder->slots[slot]], vertex,
+                VERTEX_SIZE*sizeof(float)))
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    if (welder->slots[slot] == EMPTY_SLOT)
+    {
+        welder->slots[slot] = welder->numVertices;
+        memcpy(&welder->vertices[VERTEX_SIZE*welder->numVertices++], vertex,
+            VERTEX_SIZE*sizeof(float));
+    }
+
+    return welder->slots[slot];
+}
+
+/*
+** Uploads numVertices interleaved vertices and indicesSize bytes of indices
+** into a new vao. Returns 0 if it fails.
+*/
+static int CreateVertexArray(
+    const float* vertices,
+    unsigned int numVertices,
+    const void* indices,
+    size_t indicesSize,
+    GLuint* vao,
+    GLuint* vbo,
+    GLuint* ibo
+)
+{
+    glGenVertexArrays(1, vao);
+    FFGLStateBindVertexArray(*vao);
+    glGenBuffers(1, vbo);
+    FFGLStateBindBuffer(GL_ARRAY_BUFFER, *vbo);
+    glBufferData(GL_ARRAY_BUFFER, numVertices*VERTEX_SIZE*sizeof(float),
+        vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE*sizeof(float), 0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE*sizeof(float),
+        (const GLvoid*)(3*sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, VERTEX_SIZE*sizeof(float),
+        (const GLvoid*)(6*sizeof(float)));
+
+    /* the element buffer is part of the state of the vao */
+    glGenBuffers(1, ibo);
+    FFGLStateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indicesSize, indices, GL_STATIC_DRAW);
+
+    if (GL_NO_ERROR != glGetError())
+    {
+        ERR_MSG("Detected OpenGL error.");
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+** Writes the 3 vertices of face to vertices, VERTEX_SIZE floats each. 
+** hasNormals (hasTexCoords) is cleared if the face has no normals (tex 
+** coords). Returns 0 if a position does not exist.
+*/
+static int GatherFace(
+    FxsObjFilePtr obj,
+    const FxsObjFace* face,
+    float* vertices,
+    int* hasNormals,
+    int* hasTexCoords
+)
+{
+    const int positions[3] = {face->p0, face->p1, face->p2};
+    const int normals[3] = {face->n0, face->n1, face->n2};
+    const int texCoords[3] = {face->tc0, face->tc1, face->tc2};
+    float* vertex = NULL;
+    int i = 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        vertex = &vertices[VERTEX_SIZE*i];
+
+        if (!FxsObjFileGetPosition(obj, (FxsVector3*)vertex, positions[i]))
+        {
+            ERR_MSG("Face refers to a position that does not exist");
+            return 0;
+        }
+
+        *hasNormals = *hasNormals && normals[i] != -1 &&
+            FxsObjFileGetNormal(obj, (FxsVector3*)&vertex[3], normals[i]);
+        *hasTexCoords = *hasTexCoords && texCoords[i] != -1 &&
+            FxsObjFileGetTexCoord(obj, (FxsVector2*)&vertex[6], texCoords[i]);
+    }
+
+    return 1;
+}
+
+/*
+** Sets the normal (tex coord) of vertex to 0s if its node has none, so that
+** the vertex does not depend on what was read before the node lost them.
+*/
+static void ClearMissing(float* vertex, int hasNormals, int hasTexCoords)
+{
+    if (!hasNormals)
+    {
+        memset(&vertex[3], 0, 3*sizeof(float));
+    }
+
+    if (!hasTexCoords)
+    {
+        memset(&vertex[6], 0, 2*sizeof(float));
+    }
+}
+
+/*
+** Gathers the vertices of faces, shares the equal ones by an index and 
+** uploads them into the vao of node. Returns 0 if it fails.
+*/
+static int UploadNode(
+    MeshNode* node,
+    FxsObjFilePtr obj,
+    FxsObjFace* const* faces,
+    unsigned int numFaces
+)
+{
+    unsigned int numIndices = 3*numFaces;
+    float* vertices = malloc(numIndices*VERTEX_SIZE*sizeof(float));
+    GLuint* indices = malloc(numIndices*sizeof(GLuint));
+    GLushort* shortIndices = NULL;
+    Welder welder;
+    int hasNormals = 1;
+    int hasTexCoords = 1;
+    int success = 0;
+    unsigned int i = 0;
+
+    if (!WelderInit(&welder, numIndices) || !vertices || !indices)
+    {
+        ERR_MSG("Out of memory");
+        goto done;
+    }
+
+    for (i = 0; i < numFaces; i++)
+    {
+        if (!GatherFace(obj, faces[i], &vertices[3*VERTEX_SIZE*i],
+                &hasNormals, &hasTexCoords))
+        {
+            goto done;
+        }
+    }
+
+    /* if one face has no normal the node has no normals, same for tex coords */
+    for (i = 0; i < numIndices; i++)
+    {
+        ClearMissing(&vertices[VERTEX_SIZE*i], hasNormals, hasTexCoords);
+        indices[i] = WeldVertex(&welder, &vertices[VERTEX_SIZE*i]);
+    }
+
+    node->numPositions = numIndices;
+    node->numNormals = hasNormals ? numIndices : 0;
+    node->numTexCoords = hasTexCoords ? numIndices : 0;
+    node->numVertices = welder.numVertices;
+    node->indexType = GL_UNSIGNED_INT;
+
+    /* most nodes fit unsigned shorts, which halves their indices */
+    if (welder.numVertices <= 65536)
+    {
+        shortIndices = malloc(numIndices*sizeof(GLushort));
+
+        if (!shortIndices)
+        {
+            ERR_MSG("Out of memory");
+            goto done;
+        }
+
+        for (i = 0; i < numIndices; i++)
+        {
+            shortIndices[i] = (GLushort)indices[i];
+        }
+
+        node->indexType = GL_UNSIGNED_SHORT;
+    }
+
+    success = CreateVertexArray(
+            welder.vertices,
+            welder.numVertices,
+            shortIndices ? (const void*)shortIndices : (const void*)indices,
+            numIndices*(shortIndices ? sizeof(GLushort) : sizeof(GLuint)),
+            &node->vao,
+            &node->vbo,
+            &node->ibo
+        );
+
+done:
+
+    free(vertices);
+    free(indices);
+    free(shortIndices);
+    WelderRelease(&welder);
+
+    return success;
+}
+
+/*
+** Computes the matrix for the normals of batcher: the cofactors of the upper
+** 3x3 of the model matrix, which is its inverse transpose up to a scale that
+** the normalization removes.
+*/
+static void SetNormalMatrix(Batcher* batcher)
+{
+    const float* m = batcher->model;
+    float* n = batcher->normalMatrix;
+    float det = 0.0f;
+    int i = 0;
+
+    /* column i is the cross product of the other two columns of the model */
+    n[0] = m[5]*m[10] - m[6]*m[9];
+    n[1] = m[6]*m[8] - m[4]*m[10];
+    n[2] = m[4]*m[9] - m[5]*m[8];
+    n[3] = m[9]*m[2] - m[10]*m[1];
+    n[4] = m[10]*m[0] - m[8]*m[2];
+    n[5] = m[8]*m[1] - m[9]*m[0];
+    n[6] = m[1]*m[6] - m[2]*m[5];
+    n[7] = m[2]*m[4] - m[0]*m[6];
+    n[8] = m[0]*m[5] - m[1]*m[4];
+    det = m[0]*n[0] + m[1]*n[1] + m[2]*n[2];
+
+    /* a mirroring model turns the faces inside out */
+    batcher->isMirrored = det < 0.0f;
+
+    if (batcher->isMirrored)
+    {
+        for (i = 0; i < 9; i++)
+        {
+            n[i] = -n[i];
+        }
+    }
+}
+
+/*
+** Transforms the position and normal of vertex into world space.
+*/
+static void TransformVertex(const Batcher* batcher, float* vertex)
+{
+    const float* m = batcher->model;
+    const float* n = batcher->normalMatrix;
+    float p[3];
+    float length = 0.0f;
+    int i = 0;
+
+    memcpy(p, vertex, sizeof(p));
+
+    for (i = 0; i < 3; i++)
+    {
+        vertex[i] = m[i]*p[0] + m[4 + i]*p[1] + m[8 + i]*p[2] + m[12 + i];
+    }
+
+    memcpy(p, &vertex[3], sizeof(p));
+
+    for (i = 0; i < 3; i++)
+    {
+        vertex[3 + i] = n[3*0 + i]*p[0] + n[3*1 + i]*p[1] + n[3*2 + i]*p[2];
+    }
+
+    length = vertex[3]*vertex[3] + vertex[4]*vertex[4] + vertex[5]*vertex[5];
+
+    if (length > 0.0f)
+    {
+        length = 1.0f/sqrtf(length);
+        vertex[3] *= length;
+        vertex[4] *= length;
+        vertex[5] *= length;
+    }
+}
+
+/*
+** Like UploadNode, but adds the faces to the batcher in world space instead.
+** Returns 0 if it fails.
+*/
+static int AddTriangles(
+    Batcher* batcher,
+    MeshNode* node,
+    FxsObjFilePtr obj,
+    FxsObjFace* const* faces,
+    unsigned int numFaces
+)
+{
+    BatchTriangle* triangles = NULL;
+    BatchTriangle* triangle = NULL;
+    unsigned int maxTriangles = batcher->maxTriangles ? batcher->maxTriangles : 1024;
+    float* vertex = NULL;
+    int hasNormals = 1;
+    int hasTexCoords = 1;
+    unsigned int i = 0;
+    int j = 0;
+    int k = 0;
+
+    while (maxTriangles < batcher->numTriangles + numFaces)
+    {
+        maxTriangles *= 2;
+    }
+
+    if (maxTriangles > batcher->maxTriangles)
+    {
+        triangles = realloc(batcher->triangles, maxTriangles*sizeof(BatchTriangle));
+
+        if (!triangles)
+        {
+            ERR_MSG("Out of memory");
+            return 0;
+        }
+
+        batcher->triangles = triangles;
+        batcher->maxTriangles = maxTriangles;
+    }
+
+    triangles = &batcher->triangles[batcher->numTriangles];
+
+    for (i = 0; i < numFaces; i++)
+    {
+        triangle = &triangles[i];
+        memset(triangle, 0, sizeof(BatchTriangle));
+        triangle->node = node;
+        triangle->matIdx = node->matIdx;
+        triangle->sequence = batcher->numTriangles + i;
+
+        if (!GatherFace(obj, faces[i], triangle->vertices, &hasNormals,
+                &hasTexCoords))
+        {
+            return 0;
+        }
+    }
+
+    /* as in UploadNode, if one face has no normal the node has none */
+    for (i = 0; i < numFaces; i++)
+    {
+        triangle = &triangles[i];
+
+        for (j = 0; j < 3; j++)
+        {
+            vertex = &triangle->vertices[VERTEX_SIZE*j];
+            ClearMissing(vertex, hasNormals, hasTexCoords);
+            TransformVertex(batcher, vertex);
+
+            for (k = 0; k < 3; k++)
+            {
+                triangle->centroid[k] += vertex[k]/3.0f;
+            }
+        }
+
+        if (batcher->isMirrored)
+        {
+            float vertex[VERTEX_SIZE];
+
+            memcpy(vertex, &triangle->vertices[VERTEX_SIZE], sizeof(vertex));
+            memcpy(&triangle->vertices[VERTEX_SIZE],
+                &triangle->vertices[2*VERTEX_SIZE], sizeof(vertex));
+            memcpy(&triangle->vertices[2*VERTEX_SIZE], vertex, sizeof(vertex));
+        }
+    }
+
+    node->numPositions = 3*numFaces;
+    node->numNormals = hasNormals ? 3*numFaces : 0;
+    node->numTexCoords = hasTexCoords ? 3*numFaces : 0;
+    batcher->numTriangles += numFaces;
+
+    return 1;
+}
+
+/*
+** Gets the counting sort key of the material of face, faces without a 
+** material come first.
+*/
+static unsigned int GetMaterialKey(const FxsObjFace* face)
+{
+    return face->matIdx < 0 ? 0 : (unsigned int)face->matIdx + 1;
+}
+
+/*
+** Sorts the numFaces faces of context by their material into the sorted 
+** faces of context with a counting sort, which keeps the file order of the 
+** faces of a material. numKeys is the largest key + 1. Returns 0 if it 
+** fails.
+*/
+static int SortByMaterial(
+    BuildContext* context,
+    unsigned int numFaces,
+    unsigned int numKeys
+)
+{
+    unsigned int* counts = context->counts;
+    unsigned int first = 0;
+    unsigned int count = 0;
+    unsigned int i = 0;
+
+    if (numKeys > context->maxCounts)
+    {
+        counts = realloc(context->counts, numKeys*sizeof(unsigned int));
+
+        if (!counts)
+        {
+            ERR_MSG("Out of memory");
+            return 0;
+        }
+
+        context->counts = counts;
+        context->maxCounts = numKeys;
+    }
+
+    memset(counts, 0, numKeys*sizeof(unsigned int));
+
+    for (i = 0; i < numFaces; i++)
+    {
+        counts[GetMaterialKey(context->faces[i])]++;
+    }
+
+    /* the counts become the first position of each key */
+    for (i = 0; i < numKeys; i++)
+    {
+        count = counts[i];
+        counts[i] = first;
+        first += count;
+    }
+
+    for (i = 0; i < numFaces; i++)
+    {
+        context->sortedFaces[counts[GetMaterialKey(context->faces[i])]++] =
+            context->faces[i];
+    }
+
+    return 1;
+}
+
+/*
+** Sorts the faces of a group by their material and adds a node with the
+** faces of each material to groupNode. The faces of context have room for all
+** faces of the group. The largest material index is stored in the maxMatIdx
+** of context. Returns 0 if it fails.
+*/
+static int BuildMaterialNodes(
+    MeshNode* groupNode,
+    FxsListPtr faceList,
+    BuildContext* context
+)
+{
+    FxsObjFace** faces = context->sortedFaces;
+    FxsListIteratorPtr iterator = NULL;
+    MeshNode** link = &groupNode->children;
+    unsigned int numFaces = 0;
+    unsigned int numKeys = 1;
+    unsigned int first = 0;
+    unsigned int i = 0;
+
+    iterator = FxsListIteratorCreate(
+            faceList,
+            FXS_LIST_FRONT,
+            FXS_LIST_FRONT_TO_BACK
+        );
+
+    if (!iterator)
+    {
+        ERR_MSG("Failed getting an iterator ...");
+        return 0;
+    }
+
+    while (FxsListIteratorHasNext(iterator))
+    {
+        context->faces[numFaces] = FxsListIteratorNext(iterator);
+
+        if (GetMaterialKey(context->faces[numFaces]) >= numKeys)
+        {
+            numKeys = GetMaterialKey(context->faces[numFaces]) + 1;
+        }
+
+        numFaces++;
+    }
+
+    FxsListIteratorDestroy(&iterator);
+
+    if (!SortByMaterial(context, numFaces, numKeys))
+    {
+        return 0;
+    }
+
+    for (first = 0; first < numFaces; first = i)
+    {
+        for (i = first; i < numFaces && faces[i]->matIdx == faces[first]->matIdx; i++)
+        {
+        }
+
+        *link = CreateNode(faces[first]->matIdx < 0 ? 0 : faces[first]->matIdx);
+
+        if (!*link)
+        {
+            return 0;
+        }
+
+        if (context->batcher)
+        {
+            if (!AddTriangles(context->batcher, *link, context->obj,
+                    &faces[first], i - first))
+            {
+                return 0;
+            }
+        }
+        else if (!UploadNode(*link, context->obj, &faces[first], i - first))
+        {
+            return 0;
+        }
+
+        link = &(*link)->next;
+
+        if (faces[first]->matIdx > context->maxMatIdx)
+        {
+            context->maxMatIdx = faces[first]->matIdx;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Adds a node for each group of object to objectNode. Returns 0 if it fails.
+*/
+static int BuildGroupNodes(
+    MeshNode* objectNode,
+    FxsObjObjectPtr object,
+    BuildContext* context
+)
+{
+    FxsListPtr groups = FxsObjObjectGetGroups(object);
+    FxsListIteratorPtr iterator = NULL;
+    FxsListPtr faceList = NULL;
+    MeshNode** link = &objectNode->children;
+    FxsObjFace** newFaces = NULL;
+    int success = 0;
+
+    if (!groups)
+    {
+        return 1;
+    }
+
+    iterator = FxsListIteratorCreate(
+            groups,
+            FXS_LIST_FRONT,
+            FXS_LIST_FRONT_TO_BACK
+        );
+
+    if (!iterator)
+    {
+        ERR_MSG("Failed getting an iterator ...");
+        return 0;
+    }
+
+    while (FxsListIteratorHasNext(iterator))
+    {
+        faceList = FxsObjGroupGetFaces(FxsListIteratorNext(iterator));
+
+        /* groups without faces are left out */
+        if (!faceList || !FxsListGetSize(faceList))
+        {
+            continue;
+        }
+
+        if (FxsListGetSize(faceList) > context->maxFaces)
+        {
+            newFaces = realloc(context->faces,
+                FxsListGetSize(faceList)*sizeof(FxsObjFace*));
+
+            if (newFaces)
+            {
+                context->faces = newFaces;
+                newFaces = realloc(context->sortedFaces,
+                    FxsListGetSize(faceList)*sizeof(FxsObjFace*));
+            }
+
+            if (!newFaces)
+            {
+                ERR_MSG("Out of memory");
+                goto done;
+            }
+
+            context->sortedFaces = newFaces;
+            context->maxFaces = FxsListGetSize(faceList);
+        }
+
+        *link = CreateNode(-1);
+
+        if (!*link || !BuildMaterialNodes(*link, faceList, context))
+        {
+            goto done;
+        }
+
+        link = &(*link)->next;
+    }
+
+    success = 1;
+
+done:
+
+    FxsListIteratorDestroy(&iterator);
+
+    return success;
+}
+
+/*
+** Adds a node for each object of the obj of context to parent. Returns 0 if
+** it fails.
+*/
+static int BuildNodes(MeshNode* parent, BuildContext* context)
+{
+    FxsListPtr objects = FxsObjFileGetObjects(context->obj);
+    FxsListIteratorPtr iterator = NULL;
+    MeshNode** link = &parent->children;
+    int success = 0;
+
+    if (!objects)
+    {
+        ERR_MSG("Found no objects");
+        return 0;
+    }
+
+    iterator = FxsListIteratorCreate(
+            objects,
+            FXS_LIST_FRONT,
+            FXS_LIST_FRONT_TO_BACK
+        );
+
+    if (!iterator)
+    {
+        ERR_MSG("Failed getting an iterator ...");
+        return 0;
+    }
+
+    while (FxsListIteratorHasNext(iterator))
+    {
+        *link = CreateNode(-1);
+
+        if (!*link ||
+            !BuildGroupNodes(*link, FxsListIteratorNext(iterator), context))
+        {
+            goto done;
+        }
+
+        link = &(*link)->next;
+    }
+
+    success = 1;
+
+done:
+
+    FxsListIteratorDestroy(&iterator);
+
+    return success;
+}
+
+static int CompareTriangles(const void* a, const void* b)
+{
+    const BatchTriangle* triangleA = a;
+    const BatchTriangle* triangleB = b;
+
+    if (triangleA->matIdx != triangleB->matIdx)
+    {
+        return (triangleA->matIdx > triangleB->matIdx) -
+            (triangleA->matIdx < triangleB->matIdx);
+    }
+
+    return (triangleA->sequence > triangleB->sequence) -
+        (triangleA->sequence < triangleB->sequence);
+}
+
+/*
+** Merges numTriangles triangles with the same material into a batch of
+** mesh. Equal vertices are shared by an index. Returns 0 if it fails.
+*/
+static int CreateBatch(
+    Mesh* mesh,
+    Batcher* batcher,
+    const BatchTriangle* triangles,
+    unsigned int numTriangles
+)
+{
+    MeshBatch* batch = NULL;
+    GLushort* indices = malloc(3*numTriangles*sizeof(GLushort));
+    const float* vertices = NULL;
+    Welder welder;
+    unsigned int numVertices = 0;
+    unsigned int i = 0;
+    int j = 0;
+    int success = 0;
+
+    assert(3*BATCH_MAX_TRIANGLES <= 65536 && numTriangles <= BATCH_MAX_TRIANGLES);
+
+    if (mesh->numBatches == batcher->maxBatches)
+    {
+        batch = realloc(mesh->batches,
+            (batcher->maxBatches ? 2*batcher->maxBatches : 16)*sizeof(MeshBatch));
+
+        if (batch)
+        {
+            mesh->batches = batch;
+            batcher->maxBatches = batcher->maxBatches ? 2*batcher->maxBatches : 16;
+        }
+    }
+
+    if (!WelderInit(&welder, 3*numTriangles) || !indices ||
+        mesh->numBatches == batcher->maxBatches)
+    {
+        ERR_MSG("Out of memory");
+        goto done;
+    }
+
+    for (i = 0; i < 3*numTriangles; i++)
+    {
+        indices[i] = (GLushort)WeldVertex(&welder,
+            &triangles[i/3].vertices[VERTEX_SIZE*(i%3)]);
+    }
+
+    vertices = welder.vertices;
+    numVertices = welder.numVertices;
+
+    batch = &mesh->batches[mesh->numBatches++];
+    memset(batch, 0, sizeof(MeshBatch));
+    batch->matIdx = triangles[0].matIdx;
+    batch->numVertices = numVertices;
+    batch->numIndices = 3*numTriangles;
+    memcpy(&batch->min, vertices, sizeof(FxsVector3));
+    memcpy(&batch->max, vertices, sizeof(FxsVector3));
+
+    for (i = 1; i < numVertices; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            if (vertices[VERTEX_SIZE*i + j] < (&batch->min.x)[j])
+            {
+                (&batch->min.x)[j] = vertices[VERTEX_SIZE*i + j];
+            }
+
+            if (vertices[VERTEX_SIZE*i + j] > (&batch->max.x)[j])
+            {
+                (&batch->max.x)[j] = vertices[VERTEX_SIZE*i + j];
+            }
+        }
+    }
+
+    /* a range for each run of triangles from the same node */
+    for (i = 0; i < numTriangles; i++)
+    {
+        batch->numRanges += !i || triangles[i].node != triangles[i - 1].node;
+    }
+
+    batch->ranges = malloc(batch->numRanges*sizeof(MeshBatchRange));
+
+    if (!batch->ranges)
+    {
+        ERR_MSG("Out of memory");
+        goto done;
+    }
+
+    for (i = 0, j = -1; i < numTriangles; i++)
+    {
+        if (!i || triangles[i].node != triangles[i - 1].node)
+        {
+            j++;
+            batch->ranges[j].node = triangles[i].node;
+            batch->ranges[j].firstIndex = 3*i;
+            batch->ranges[j].numIndices = 0;
+        }
+
+        batch->ranges[j].numIndices += 3;
+    }
+
+    success = CreateVertexArray(
+            vertices,
+            numVertices,
+            indices,
+            3*numTriangles*sizeof(GLushort),
+            &batch->vao,
+            &batch->vbo,
+            &batch->ibo
+        );
+
+done:
+
+    free(indices);
+    WelderRelease(&welder);
+
+    return success;
+}
+
+/*
+** Splits numTriangles triangles with the same material into batches of
+** mesh. Triangles are split at the middle of the longest side of the bounds
+** of their centroids until they fit a batch. The order of the triangles on
+** either side is kept, so the faces of a node stay together. Returns 0 if it
+** fails.
+*/
+static int SplitBatches(
+    Mesh* mesh,
+    Batcher* batcher,
+    BatchTriangle* triangles,
+    unsigned int numTriangles
+)
+{
+    float min[3];
+    float max[3];
+    float middle = 0.0f;
+    unsigned int numLeft = 0;
+    unsigned int numRight = 0;
+    unsigned int i = 0;
+    int axis = 0;
+    int j = 0;
+
+    if (numTriangles <= BATCH_MAX_TRIANGLES)
+    {
+        return CreateBatch(mesh, batcher, triangles, numTriangles);
+    }
+
+    memcpy(min, triangles[0].centroid, sizeof(min));
+    memcpy(max, triangles[0].centroid, sizeof(max));
+
+    for (i = 1; i < numTriangles; i++)
+    {
+        for (j = 0; j < 3; j++)
+        {
+            min[j] = triangles[i].centroid[j] < min[j] ? triangles[i].centroid[j] : min[j];
+            max[j] = triangles[i].centroid[j] > max[j] ? triangles[i].centroid[j] : max[j];
+        }
+    }
+
+    for (j = 1; j < 3; j++)
+    {
+        axis = max[j] - min[j] > max[axis] - min[axis] ? j : axis;
+    }
+
+    middle = 0.5f*(min[axis] + max[axis]);
+
+    /* stable partition, the right side goes through the scratch array */
+    for (i = 0; i < numTriangles; i++)
+    {
+        if (triangles[i].centroid[axis] < middle)
+        {
+            triangles[numLeft++] = triangles[i];
+        }
+        else
+        {
+            batcher->scratch[numRight++] = triangles[i];
+        }
+    }
+
+    memcpy(&triangles[numLeft], batcher->scratch, numRight*sizeof(BatchTriangle));
+
+    /* all centroids in one spot, halve them to stop */
+    if (!numLeft || !numRight)
+    {
+        numLeft = numTriangles/2;
+    }
+
+    return SplitBatches(mesh, batcher, triangles, numLeft) &&
+        SplitBatches(mesh, batcher, &triangles[numLeft], numTriangles - numLeft);
+}
+
+/*
+** Merges the triangles of batcher into the batches of mesh, one or more per
+** material. Returns 0 if it fails.
+*/
+static int BuildBatches(Mesh* mesh, Batcher* batcher)
+{
+    BatchTriangle* triangles = batcher->triangles;
+    unsigned int numTriangles = batcher->numTriangles;
+    unsigned int first = 0;
+    unsigned int i = 0;
+
+    if (!numTriangles)
+    {
+        return 1;
+    }
+
+    batcher->scratch = malloc(numTriangles*sizeof(BatchTriangle));
+
+    if (!batcher->scratch)
+    {
+        ERR_MSG("Out of memory");
+        return 0;
+    }
+
+    qsort(triangles, numTriangles, sizeof(BatchTriangle), CompareTriangles);
+
+    for (first = 0; first < numTriangles; first = i)
+    {
+        for (i = first; i < numTriangles && triangles[i].matIdx == triangles[first].matIdx; i++)
+        {
+        }
+
+        if (!SplitBatches(mesh, batcher, &triangles[first], i - first))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+const MeshNode* MeshBatchGetNode(const MeshBatch* batch, unsigned int triangle)
+{
+    unsigned int index = 3*triangle;
+    unsigned int low = 0;
+    unsigned int high = batch->numRanges;
+    unsigned int middle = 0;
+
+    if (index >= batch->numIndices)
+    {
+        return NULL;
+    }
+
+    /* the last range that starts at or before index */
+    while (high - low > 1)
+    {
+        middle = (low + high)/2;
+
+        if (batch->ranges[middle].firstIndex <= index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return batch->ranges[low].node;
+}
+
+/*
+** Creates the materials of mesh for the material indices up to maxMatIdx
+** with a grey diffuse color. Returns 0 if it fails.
+*/
+static int CreateMaterials(Mesh* mesh, int maxMatIdx)
+{
+    unsigned int i = 0;
+
+    /* faces without material use material 0 */
+    mesh->materials = malloc((maxMatIdx + 1)*sizeof(MeshMaterial));
+
+    if (!mesh->materials)
+    {
+        ERR_MSG("Out of memory");
+        return 0;
+    }
+
+    mesh->numMaterials = maxMatIdx + 1;
+
+    for (i = 0; i < mesh->numMaterials; i++)
+    {
+        mesh->materials[i].tex = 0;
+        mesh->materials[i].diffColor.x = DEFAULT_DIFF_COLOR;
+        mesh->materials[i].diffColor.y = DEFAULT_DIFF_COLOR;
+        mesh->materials[i].diffColor.z = DEFAULT_DIFF_COLOR;
+    }
+
+    return 1;
+}
+
+/*
+** Releases the scratch arrays of context.
+*/
+static void ReleaseContext(BuildContext* context)
+{
+    free(context->faces);
+    free(context->sortedFaces);
+    free(context->counts);
+}
 
 Mesh* MeshCreateWithFile(const char* filename)
 {
-	FxsObjFilePtr file = NULL;
     Mesh* mesh = NULL;
+    BuildContext context;
+    int success = 0;
 
     if (!filename)
     {
         return NULL;
     }
-    
-    mesh = (Mesh*)malloc(sizeof(Mesh));
+
+    memset(&context, 0, sizeof(context));
+    mesh = (Mesh*)calloc(1, sizeof(Mesh));
 
     if (!mesh)
     {
         return NULL;
     }
 
+    context.obj = FxsObjFileCreateWithFile(filename);
+    mesh->root = CreateNode(-1);
+    success = context.obj && mesh->root && BuildNodes(mesh->root, &context) &&
+        CreateMaterials(mesh, context.maxMatIdx);
+
+    if (context.obj)
+    {
+        FxsObjFileDestroy(&context.obj);
+    }
+
+    ReleaseContext(&context);
+
+    if (!success)
+    {
+        MeshDestroy(&mesh);
+    }
+
+    return mesh;
+}
+
+MeshBuilder* MeshBuilderCreate()
+{
+    MeshBuilder* builder = calloc(1, sizeof(MeshBuilder));
+
+    if (!builder)
+    {
+        return NULL;
+    }
+
+    builder->mesh = calloc(1, sizeof(Mesh));
+    builder->files = FxsDictionaryCreateWithTableSize(FILES_TABLE_SIZE);
+
+    if (!builder->mesh || !builder->files ||
+        !(builder->mesh->root = CreateNode(-1)))
+    {
+        MeshBuilderDestroy(&builder);
+        return NULL;
+    }
+
+    builder->context.batcher = &builder->batcher;
+    builder->link = &builder->mesh->root->children;
+
+    return builder;
+}
+
+/*
+** Gets the parsed file filename, parses it if it was not placed before.
+** Returns NULL if it fails.
+*/
+static FxsObjFilePtr GetFile(MeshBuilder* builder, const char* filename)
+{
+    FxsObjFilePtr file = FxsDictionaryFind(builder->files, filename);
+    FxsObjFilePtr* objs = NULL;
+
+    if (file)
+    {
+        return file;
+    }
+
+    if (builder->numObjs == builder->maxObjs)
+    {
+        objs = realloc(builder->objs,
+            (builder->maxObjs ? 2*builder->maxObjs : 16)*sizeof(FxsObjFilePtr));
+
+        if (!objs)
+        {
+            ERR_MSG("Out of memory");
+            return NULL;
+        }
+
+        builder->objs = objs;
+        builder->maxObjs = builder->maxObjs ? 2*builder->maxObjs : 16;
+    }
+
     file = FxsObjFileCreateWithFile(filename);
-    
-    if (!file)
+
+    if (!file || !FxsDictionaryInsert(builder->files, filename, file))
+    {
+        if (file)
+        {
+            FxsObjFileDestroy(&file);
+        }
+
+        return NULL;
+    }
+
+    builder->objs[builder->numObjs++] = file;
+
+    return file;
+}
+
+int MeshBuilderAddFile(
+    MeshBuilder* builder,
+    const char* filename,
+    const float* model
+)
+{
+    unsigned int numTriangles = 0;
+    MeshNode* placement = NULL;
+
+    if (!builder || !filename || !model)
+    {
+        return 0;
+    }
+
+    numTriangles = builder->batcher.numTriangles;
+    builder->batcher.model = model;
+    SetNormalMatrix(&builder->batcher);
+    builder->context.obj = GetFile(builder, filename);
+    placement = CreateNode(-1);
+
+    if (!builder->context.obj || !placement ||
+        !BuildNodes(placement, &builder->context))
+    {
+        /* drops the faces of the placement, they point to its nodes */
+        builder->batcher.numTriangles = numTriangles;
+        DestroyNode(placement);
+        return 0;
+    }
+
+    *builder->link = placement;
+    builder->link = &placement->next;
+
+    return 1;
+}
+
+Mesh* MeshBuilderFinish(MeshBuilder** builder)
+{
+    Mesh* mesh = NULL;
+
+    if (!builder || !*builder)
     {
-        free(mesh);
         return NULL;
     }
-    
-    
+
+    if (BuildBatches((*builder)->mesh, &(*builder)->batcher) &&
+        CreateMaterials((*builder)->mesh, (*builder)->context.maxMatIdx))
+    {
+        mesh = (*builder)->mesh;
+        (*builder)->mesh = NULL;
+    }
+
+    MeshBuilderDestroy(builder);
+
     return mesh;
-    
-error:
+}
+
+void MeshBuilderDestroy(MeshBuilder** builder)
+{
+    unsigned int i = 0;
+
+    if (!builder || !*builder)
+    {
+        return;
+    }
+
+    for (i = 0; i < (*builder)->numObjs; i++)
+    {
+        FxsObjFileDestroy(&(*builder)->objs[i]);
+    }
+
+    free((*builder)->objs);
+    FxsDictionaryDestroy(&(*builder)->files);
+    ReleaseContext(&(*builder)->context);
+    free((*builder)->batcher.triangles);
+    free((*builder)->batcher.scratch);
+    MeshDestroy(&(*builder)->mesh);
+    free(*builder);
+    *builder = NULL;
+}
+
+void MeshDestroy(Mesh** mesh)
+{
+    unsigned int i = 0;
+
+    if (!mesh || !*mesh)
+    {
+        return;
+    }
+
+    DestroyNode((*mesh)->root);
+
+    for (i = 0; i < (*mesh)->numBatches; i++)
+    {
+        if ((*mesh)->batches[i].vao)
+        {
+            FFGLStateDeleteVertexArray((*mesh)->batches[i].vao);
+            FFGLStateDeleteBuffer((*mesh)->batches[i].vbo);
+            FFGLStateDeleteBuffer((*mesh)->batches[i].ibo);
+        }
+
+        free((*mesh)->batches[i].ranges);
+    }
+
+    free((*mesh)->batches);
+
+    for (i = 0; i < (*mesh)->numMaterials; i++)
+    {
+        if ((*mesh)->materials[i].tex)
+        {
+            FFGLStateDeleteTexture((*mesh)->materials[i].tex);
+        }
+    }
 
-    return NULL;
+    free((*mesh)->materials);
+    free(*mesh);
+    *mesh = NULL;
 }
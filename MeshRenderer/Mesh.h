@@ -9,39 +9,147 @@ extern "C"
 #include <Fxs/OpenGL/Program.h>
 #include <Fxs/Math/Vector3.h>
 
+/*
+** A static mesh loaded from an .obj file. The nodes form a tree of the
+** objects of the file, the groups of each object and the materials used by
+** each group. Only the material nodes (the leaves) hold geometry: the faces of
+** their group with their material, in file order, as indexed vertices in a 
+** vao. Inner nodes have a matIdx of -1 and no vao.
+**
+** The vertices are interleaved as position, normal and tex coord (8 floats) 
+** at the locations 0, 1 and 2, equal vertices are shared by an index. Faces 
+** of nodes without normals (tex coords) get 0s, which is what the shader 
+** reads from a disabled attribute too.
+**
+** A static mesh is built from one or more placements of .obj files and never
+** moves. The root has a node for each placement, the nodes of its file are
+** below it. The geometry of every placement is transformed into world space
+** at load time and the faces of all nodes of all placements with the same
+** material are merged into batches of indexed vertices, so the mesh is drawn
+** with a few draw calls no matter how many nodes and placements it has. The
+** faces of a material are split at the middle of their bounds until a batch
+** is small enough, so the batches are compact in space and can be culled.
+** The nodes keep their counts but have no vao, each batch records which of
+** its indices came from which node.
+*/
+
 typedef struct
 {
-	GLuint tex;
-	FxsVector3 diffColor; 
+	GLuint tex;             /* 0 if the material has no diffuse map */
+	FxsVector3 diffColor;
 }
 MeshMaterial;
 
 typedef struct MeshNode_
 {
-	int matIdx;
-	unsigned int numPositions;
-	unsigned int numNormals;
-	unsigned int numTexCoords;
+	int matIdx;             /* index into the materials of the mesh */
+	unsigned int numPositions;  /* 3 per face, also the # of indices */
+	unsigned int numNormals;    /* numPositions or 0 */
+	unsigned int numTexCoords;  /* numPositions or 0 */
+    unsigned int numVertices;   /* after sharing the equal ones */
+    GLenum indexType;           /* GL_UNSIGNED_SHORT if numVertices fit */
     GLuint vao;
-    GLuint positionsVbo;
-    GLuint normalsVbo;
-    GLuint texCoordsVbo;
+    GLuint vbo;
+    GLuint ibo;
 
-	struct MeshNode_* next;
-	struct MeshNode_* children;
+	struct MeshNode_* next;     /* the next sibling */
+	struct MeshNode_* children; /* the first child */
 }
 MeshNode;
 
-typedef struct  
+/*
+** The indices firstIndex .. firstIndex + numIndices - 1 of a batch that were
+** created from the faces of node.
+*/
+typedef struct
+{
+    const MeshNode* node;
+    unsigned int firstIndex;
+    unsigned int numIndices;
+}
+MeshBatchRange;
+
+/*
+** Merged faces of a static mesh with the same material. The vertices are
+** laid out like those of the nodes and indexed with unsigned shorts.
+*/
+typedef struct
+{
+    int matIdx;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    unsigned int numVertices;
+    unsigned int numIndices;
+    FxsVector3 min;             /* bounds of the vertices in world space */
+    FxsVector3 max;
+    MeshBatchRange* ranges;     /* in the order of their indices */
+    unsigned int numRanges;
+}
+MeshBatch;
+
+typedef struct
 {
 	MeshNode* root;
 
 	MeshMaterial* materials;
 	unsigned int numMaterials;
+
+    MeshBatch* batches;         /* NULL unless the mesh is static */
+    unsigned int numBatches;
 }
 Mesh;
 
+/*
+** Loads the .obj file filename and uploads its geometry. The materials are
+** created for the material indices of the faces with a grey diffuse color
+** and no diffuse map. Returns NULL if it fails.
+*/
 Mesh* MeshCreateWithFile(const char* filename);
+
+/*
+** Collects the placements of a static mesh.
+*/
+typedef struct MeshBuilder_ MeshBuilder;
+
+/*
+** Creates a builder without placements. Returns NULL if it fails.
+*/
+MeshBuilder* MeshBuilderCreate();
+
+/*
+** Adds a placement of the .obj file filename to builder, placed in the world
+** by model, an opengl (column major) matrix with 16 elements. A file is only
+** parsed the first time it is placed. Returns 0 if it fails, the placements
+** added before are kept then.
+*/
+int MeshBuilderAddFile(
+    MeshBuilder* builder,
+    const char* filename,
+    const float* model
+);
+
+/*
+** Merges the placements of builder into the batches of a static mesh and
+** uploads them. Releases builder and sets it to NULL. Returns NULL if it
+** fails.
+*/
+Mesh* MeshBuilderFinish(MeshBuilder** builder);
+
+/*
+** Releases builder without creating a mesh. Sets builder to NULL.
+*/
+void MeshBuilderDestroy(MeshBuilder** builder);
+
+/*
+** Gets the node the triangle with index triangle of batch was created from,
+** e.g. to map a picked triangle back to its node.
+*/
+const MeshNode* MeshBatchGetNode(const MeshBatch* batch, unsigned int triangle);
+
+/*
+** Releases mesh and its opengl objects. Sets mesh to NULL.
+*/
 void MeshDestroy(Mesh** mesh);
 
 #ifdef __cplusplus
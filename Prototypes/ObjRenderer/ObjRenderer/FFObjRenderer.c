@@ -7,81 +7,664 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <float.h>
+#include <math.h>
 #include <Fxs/Dictionary/Dictionary.h>
 #include <Fxs/OpenGL/Program.h>
 #include <assert.h>
+#include <FF/GLState/GLState.h>
+#include <FF/ThreadPool/ThreadPool.h>
+#include <FF/Frustum/Frustum.h>
 #include "ObjRendererMesh.h"    
+#include "FFObjRenderer.h"
+#include "ObjRendererIndirect.h"
+#include "ObjRendererCache.h"
+#include "ObjRendererTextures.h"
+#include "ObjRendererStream.h"
+#include "ObjRendererOctree.h"
+#include "ObjRendererImpostor.h"
+
+/* an impostor is dropped again above this multiple of the threshold */
+#define IMPOSTOR_HYSTERESIS 1.25f
+
+/* frames of the crossfade between a mesh and its impostor */
+#define IMPOSTOR_FADE_FRAMES 15
+
+/* captures are expensive, they are spread over the frames */
+#define IMPOSTOR_CAPTURES_PER_FRAME 1
 
 static GLuint program = 0;
 static FxsDictionaryPtr meshes = NULL;
 static unsigned int maxFilesLoadedHint = 20;
 
+/* the loaded meshes in load order, for iterating them by index */
+static ObjRendererMesh** loadedMeshes = NULL;
+static unsigned int numLoadedMeshes = 0;
+static unsigned int maxLoadedMeshes = 0;
+
+static int gpuCulling = 0;
+static int frustumCulling = 1;
+static int batching = 0;
+static int meshletCulling = 0;
+
+/* screen size below which meshes become impostors, 0 if disabled */
+static float impostorThreshold = 0.0f;
+
+/* maps not uploaded by the last FFObjRendererUploadTextures, impostors wait 
+** for the maps of their mesh while there are any 
+*/
+static unsigned int numPendingMaps = 0;
+
+/* the view frustum, updated with the matrices */
+static FFFrustum frustum;
+
+/* node counts of the last FFObjRendererRender or FFObjRendererSubmit */
+static FFObjRendererCullingStats cullingStats;
+
+/* draw calls and state changes of the last FFObjRendererRender */
+static FFObjRendererDrawStats drawStats;
+
+/*
+** A visible render data, collected from all meshes for batching.
+*/
+typedef struct
+{
+    GLuint texture;
+    GLfloat params[4];          /* the material uniform */
+    GLuint vao;
+    const GLfloat* decode;      /* of the vertex buffer of vao */
+    GLsizei count;
+    const GLvoid* indices;
+    GLint baseVertex;
+}
+BatchItem;
+
+/* the items of the current frame and the arrays for the multi draws, all 
+** with the capacity maxBatchItems 
+*/
+static BatchItem* batchItems = NULL;
+static unsigned int numBatchItems = 0;
+static unsigned int maxBatchItems = 0;
+static GLsizei* batchCounts = NULL;
+static const GLvoid** batchIndices = NULL;
+static GLint* batchBaseVertices = NULL;
+
+/*
+** A visible render data whose meshlets are culled before batching. Its index
+** ranges are meshletRanges[firstRange] .. meshletRanges[firstRange + 
+** numRanges - 1].
+*/
+typedef struct
+{
+    ObjRendererMesh* mesh;
+    ObjRendererData* data;
+    unsigned int firstRange;
+    unsigned int numRanges;
+}
+MeshletJob;
+
+/* the jobs of the current frame, each with room for a range per meshlet */
+static MeshletJob* meshletJobs = NULL;
+static unsigned int numMeshletJobs = 0;
+static unsigned int maxMeshletJobs = 0;
+static ObjRendererIndexRange* meshletRanges = NULL;
+static unsigned int numMeshletRanges = 0;
+static unsigned int maxMeshletRanges = 0;
+
+/* the eye position for culling the meshlets by their normal cones */
+static FxsVector3 meshletEye;
+
+/* the state set by SetDrawState, reset for each frame */
+static GLuint currentTexture = 0;
+static GLfloat currentParams[4];
+static int hasCurrentParams = 0;
+static GLuint currentVao = 0;
+
+/* parses the .obj files */
+static FFThreadPoolPtr threadPool = NULL;
+
+/* converted meshes, NULL if caching is disabled */
+static ObjRendererCache* cache = NULL;
+
+/* loads the diffuse maps of the materials */
+static ObjRendererTexturesPtr textures = NULL;
+
+/* streams the chunks of FFObjRendererLoadChunks, NULL until it is called */
+static ObjRendererStreamPtr stream = NULL;
+
+static GLint viewLocation = -1;
+static GLint projectionLocation = -1;
+static GLint materialLocation = -1;
+static GLint decodeLocation = -1;
+
+/* host copies of the matrices, needed to compute the depth of packets */
+static float viewMatrix[16];
+static float projectionMatrix[16];
+static const float identity[16] = {
+        1.0, 0.0, 0.0, 0.0,
+        0.0, 1.0, 0.0, 0.0,
+        0.0, 0.0, 1.0, 0.0,
+        0.0, 0.0, 0.0, 1.0
+    };
+
 #define TO_STRING(X) #X
 
+/*
+** The attributes are packed (see ObjRendererPacking.h), decode is the decode
+** matrix of the vertex buffer.
+*/
 static char* vertexShader =
     "#version 150\n"
 TO_STRING(
+    uniform mat4 view;
+    uniform mat4 projection;
+    uniform mat4 decode;
+
     in vec3 position;
-    in vec3 normal;
+    in vec2 normal;
     in vec2 texCoord;
 
+    out vec3 vNormal;
+    out vec2 vTexCoord;
+
+    vec3 DecodeNormal(vec2 e)
+    {
+        vec3 n = vec3(e*(2.0/65535.0) - 1.0, 0.0);
+
+        n.z = 1.0 - abs(n.x) - abs(n.y);
+
+        if (n.z < 0.0)
+        {
+            n.xy = (1.0 - abs(n.yx))*vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        }
+
+        return normalize(n);
+    }
+
     void main()
     {
         gl_PointSize = 10.0;
+        vNormal = DecodeNormal(normal);
+        vTexCoord = vec2(decode[0][3], decode[1][3])*texCoord + vec2(decode[2][3], decode[3][3]);
     
-        gl_Position = vec4(position, 1.0);
+        gl_Position = projection*view*vec4((decode*vec4(position, 1.0)).xyz, 1.0);
     }
 );
 
+/*
+** material is the diffuse color and the layer of the diffuse map, the layer 
+** is negative if there is no map. The light comes from a fixed direction in 
+** model space, so the impostor captures are lit like their meshes.
+*/
 static char* fragmentShader =
     "#version 150\n"
 TO_STRING(
+    uniform sampler2DArray diffuseMap;
+    uniform vec4 material;
+
+    in vec3 vNormal;
+    in vec2 vTexCoord;
     out vec4 fragOut;
 
+    const vec3 lightDirection = vec3(0.27, 0.89, 0.36);
+
     void main()
     {
-        fragOut = vec4(1.0, 0.0, 0.0, 1.0);
+        float diffuse = max(dot(normalize(vNormal), lightDirection), 0.0);
+        vec4 color = vec4(material.rgb*(0.3 + 0.7*diffuse), 1.0);
+
+        if (material.w >= 0.0)
+        {
+            color *= texture(diffuseMap, vec3(vTexCoord, material.w));
+        }
+
+        fragOut = color;
     }
 );
 
-static void RenderData(ObjRendererData* data)
+typedef int (*VisitDataFunc)(
+    ObjRendererMesh* mesh, 
+    ObjRendererData* data, 
+    void* userData
+);
+
+/*
+** Calls visit for the render data of all nodes of mesh that are not culled, 
+** in the order of the draw list. A node whose bounding box is outside of the
+** frustum is skipped with its subtree, the subtree of a node that is inside 
+** is not tested any further. The nodes are counted in stats, so that threads
+** can cull with their own frustum and stats. Returns 0 if visit fails.
+*/
+static int VisitVisibleData(
+    ObjRendererMesh* mesh, 
+    const FFFrustum* frustum,
+    FFObjRendererCullingStats* stats,
+    VisitDataFunc visit, 
+    void* userData
+)
 {
-    glBindVertexArray(data->vao);
-    glDrawArrays(GL_TRIANGLES, 0, data->numFaces*3);
+    ObjRendererDrawRecord* record = NULL;
+    unsigned int insideEnd = 0;     /* end of the subtree that is inside */
+    unsigned int i = 0;
+    int result = 0;
+    
+    while (i < mesh->numDrawRecords)
+    {
+        record = &mesh->drawList[i];
+        
+        if (frustumCulling && i >= insideEnd)
+        {
+            result = FFFrustumTestBox(
+                    frustum, 
+                    &record->boundingBox.min.x, 
+                    &record->boundingBox.max.x
+                );
+            
+            if (result == FF_FRUSTUM_OUTSIDE)
+            {
+                stats->numCulledNodes += record->numDescendants + 1;
+                i += record->numDescendants + 1;
+                continue;
+            }
+            
+            if (result == FF_FRUSTUM_INSIDE)
+            {
+                insideEnd = i + record->numDescendants + 1;
+            }
+        }
+        
+        stats->numVisibleNodes++;
+        
+        if (record->data != -1 && 
+            !visit(mesh, &mesh->data[record->data], userData))
+        {
+            return 0;
+        }
+        
+        i++;
+    }
+    
+    return 1;
 }
 
 /*
-** Render the node then render the children.
+** Binds the texture, sets the material uniform and binds the vao with the 
+** decode matrix of its vertex buffer, each only if it changed since the last 
+** call. Counts the changes in drawStats.
 */
-static void RenderNode(ObjRendererMeshNode* node, ObjRendererMesh* mesh)
+static void SetDrawState(
+    GLuint texture, 
+    const GLfloat* params, 
+    GLuint vao, 
+    const GLfloat* decode
+)
 {
-    FxsListIteratorPtr nodeIterator = NULL;
+    if (texture && texture != currentTexture)
+    {
+        FFGLStateBindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+        currentTexture = texture;
+        drawStats.numTextureBinds++;
+    }
     
-    if (node->data != -1)
+    if (!hasCurrentParams || memcmp(params, currentParams, sizeof(currentParams)))
     {
-        RenderData(&mesh->data[node->data]);
+        glUniform4fv(materialLocation, 1, params);
+        memcpy(currentParams, params, sizeof(currentParams));
+        hasCurrentParams = 1;
+        drawStats.numMaterialBinds++;
     }
     
-    if (!node->children)
+    if (vao != currentVao)
     {
-        return;
+        FFGLStateBindVertexArray(vao);
+        glUniformMatrix4fv(decodeLocation, 1, GL_FALSE, decode);
+        currentVao = vao;
+        drawStats.numVertexArrayBinds++;
     }
+}
+
+static int RenderData(
+    ObjRendererMesh* mesh, 
+    ObjRendererData* data, 
+    void* userData
+)
+{
+    ObjRendererVertexBuffer* buffer = &mesh->vertexBuffers[data->format];
+    GLfloat params[4];
+    GLuint texture = 0;
     
-    nodeIterator = FxsListIteratorCreate(
-            node->children,
-            FXS_LIST_FRONT,
-            FXS_LIST_FRONT_TO_BACK
-        );
+    ObjRendererMeshGetMaterialParams(mesh, data->matId, params, &texture);
+    SetDrawState(texture, params, buffer->vao, buffer->decode);
+    glDrawElementsBaseVertex(
+        GL_TRIANGLES, 
+        data->numFaces*3, 
+        GL_UNSIGNED_INT, 
+        (const GLvoid*)(data->firstIndex*sizeof(GLuint)),
+        data->baseVertex
+    );
+    drawStats.numDrawCalls++;
+    
+    return 1;
+}
+
+/*
+** Makes room for one more batch item. Returns 0 if it fails.
+*/
+static int ReserveBatchItem()
+{
+    unsigned int maxItems = maxBatchItems ? 2*maxBatchItems : 256;
+    BatchItem* items = NULL;
+    GLsizei* counts = NULL;
+    const GLvoid** indices = NULL;
+    GLint* baseVertices = NULL;
+    
+    if (numBatchItems < maxBatchItems)
+    {
+        return 1;
+    }
+    
+    items = realloc(batchItems, maxItems*sizeof(BatchItem));
+    
+    if (items)
+    {
+        batchItems = items;
+    }
+    
+    counts = realloc(batchCounts, maxItems*sizeof(GLsizei));
+    
+    if (counts)
+    {
+        batchCounts = counts;
+    }
+    
+    indices = realloc(batchIndices, maxItems*sizeof(const GLvoid*));
+    
+    if (indices)
+    {
+        batchIndices = indices;
+    }
+    
+    baseVertices = realloc(batchBaseVertices, maxItems*sizeof(GLint));
+    
+    if (baseVertices)
+    {
+        batchBaseVertices = baseVertices;
+    }
+    
+    if (!items || !counts || !indices || !baseVertices)
+    {
+        return 0;
+    }
+    
+    maxBatchItems = maxItems;
     
-    while (FxsListIteratorHasNext(nodeIterator))
+    return 1;
+}
+
+/*
+** Adds a meshlet job for the render data. Returns 0 if it fails.
+*/
+static int AddMeshletJob(ObjRendererMesh* mesh, ObjRendererData* data)
+{
+    const ObjRendererOctree* octree = mesh->octree;
+    unsigned int index = (unsigned int)(data - mesh->data);
+    MeshletJob* jobs = NULL;
+    unsigned int maxJobs = 0;
+    
+    if (numMeshletJobs == maxMeshletJobs)
     {
-        RenderNode(FxsListIteratorNext(nodeIterator), mesh);
+        maxJobs = maxMeshletJobs ? 2*maxMeshletJobs : 256;
+        jobs = realloc(meshletJobs, maxJobs*sizeof(MeshletJob));
+        
+        if (!jobs)
+        {
+            return 0;
+        }
+        
+        meshletJobs = jobs;
+        maxMeshletJobs = maxJobs;
     }
+    
+    meshletJobs[numMeshletJobs].mesh = mesh;
+    meshletJobs[numMeshletJobs].data = data;
+    meshletJobs[numMeshletJobs].firstRange = numMeshletRanges;
+    meshletJobs[numMeshletJobs].numRanges = 0;
+    numMeshletJobs++;
+    numMeshletRanges += 
+        octree->firstDataClusters[index + 1] - octree->firstDataClusters[index];
+    
+    return 1;
 }
 
-static void RenderMesh(ObjRendererMesh* mesh)
+static int CollectData(
+    ObjRendererMesh* mesh, 
+    ObjRendererData* data, 
+    void* userData
+)
 {
-    RenderNode(mesh->root, mesh);
+    BatchItem* item = NULL;
+    
+    if (meshletCulling && mesh->octree)
+    {
+        return AddMeshletJob(mesh, data);
+    }
+    
+    if (!ReserveBatchItem())
+    {
+        return 0;
+    }
+    
+    item = &batchItems[numBatchItems++];
+    ObjRendererMeshGetMaterialParams(mesh, data->matId, item->params, &item->texture);
+    item->vao = mesh->vertexBuffers[data->format].vao;
+    item->decode = mesh->vertexBuffers[data->format].decode;
+    item->count = data->numFaces*3;
+    item->indices = (const GLvoid*)(data->firstIndex*sizeof(GLuint));
+    item->baseVertex = data->baseVertex;
+    
+    return 1;
+}
+
+/*
+** Culls the meshlets of the jobs first .. first + count - 1.
+*/
+static void CullMeshlets(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    MeshletJob* job = NULL;
+    unsigned int i = 0;
+    
+    for (i = first; i < first + count; i++)
+    {
+        job = &meshletJobs[i];
+        job->numRanges = ObjRendererOctreeCullData(
+                job->mesh->octree,
+                (unsigned int)(job->data - job->mesh->data),
+                &frustum,
+                &meshletEye,
+                &meshletRanges[job->firstRange]
+            );
+    }
+}
+
+/*
+** Culls the meshlets of the collected jobs in parallel and adds a batch item
+** for each remaining index range. The jobs are done afterwards, even if it 
+** fails. Returns 0 if it fails.
+*/
+static int CollectMeshlets()
+{
+    ObjRendererIndexRange* ranges = NULL;
+    ObjRendererIndexRange* range = NULL;
+    ObjRendererVertexBuffer* buffer = NULL;
+    MeshletJob* job = NULL;
+    BatchItem* item = NULL;
+    GLfloat params[4];
+    GLuint texture = 0;
+    unsigned int numFaces = 0;
+    unsigned int i = 0, j = 0;
+    int result = 0;
+    
+    if (numMeshletRanges > maxMeshletRanges)
+    {
+        ranges = realloc(meshletRanges, numMeshletRanges*sizeof(ObjRendererIndexRange));
+        
+        if (!ranges)
+        {
+            goto done;
+        }
+        
+        meshletRanges = ranges;
+        maxMeshletRanges = numMeshletRanges;
+    }
+    
+    if (threadPool)
+    {
+        FFThreadPoolParallelFor(threadPool, numMeshletJobs, 16, CullMeshlets, NULL);
+    }
+    else
+    {
+        CullMeshlets(NULL, 0, numMeshletJobs, 0);
+    }
+    
+    for (i = 0; i < numMeshletJobs; i++)
+    {
+        job = &meshletJobs[i];
+        buffer = &job->mesh->vertexBuffers[job->data->format];
+        ObjRendererMeshGetMaterialParams(job->mesh, job->data->matId, params, &texture);
+        numFaces = 0;
+        
+        for (j = 0; j < job->numRanges; j++)
+        {
+            if (!ReserveBatchItem())
+            {
+                goto done;
+            }
+            
+            range = &meshletRanges[job->firstRange + j];
+            item = &batchItems[numBatchItems++];
+            item->texture = texture;
+            memcpy(item->params, params, sizeof(item->params));
+            item->vao = buffer->vao;
+            item->decode = buffer->decode;
+            item->count = range->numIndices;
+            item->indices = (const GLvoid*)(range->firstIndex*sizeof(GLuint));
+            item->baseVertex = job->data->baseVertex;
+            numFaces += range->numIndices/3;
+        }
+        
+        cullingStats.numVisibleFaces += numFaces;
+        cullingStats.numCulledFaces += job->data->numFaces - numFaces;
+    }
+    
+    result = 1;
+    
+done:
+    
+    numMeshletJobs = 0;
+    numMeshletRanges = 0;
+    
+    return result;
+}
+
+/*
+** Orders the items by vao, texture and material. Each mesh has its own 
+** vaos, so ordering by vao first binds every vao once, as the scene graph 
+** order does, and the textures and materials are only sorted within a vao. 
+** Items of a vao with the same state stay in buffer order.
+*/
+static int CompareBatchItems(const void* a, const void* b)
+{
+    const BatchItem* ia = (const BatchItem*)a;
+    const BatchItem* ib = (const BatchItem*)b;
+    int result = 0;
+    
+    if (ia->vao != ib->vao)
+    {
+        return ia->vao < ib->vao ? -1 : 1;
+    }
+    
+    if (ia->texture != ib->texture)
+    {
+        return ia->texture < ib->texture ? -1 : 1;
+    }
+    
+    result = memcmp(ia->params, ib->params, sizeof(ia->params));
+    
+    if (result)
+    {
+        return result;
+    }
+    
+    return ia->indices < ib->indices ? -1 : (ia->indices > ib->indices);
+}
+
+/*
+** Sorts the collected items and draws each run of items with the same state
+** with one multi draw.
+*/
+static void RenderBatches()
+{
+    BatchItem* item = NULL;
+    unsigned int first = 0;
+    unsigned int end = 0;
+    unsigned int i = 0;
+    
+    qsort(batchItems, numBatchItems, sizeof(BatchItem), CompareBatchItems);
+    
+    for (first = 0; first < numBatchItems; first = end)
+    {
+        item = &batchItems[first];
+        
+        for (end = first; end < numBatchItems; end++)
+        {
+            if (batchItems[end].texture != item->texture ||
+                batchItems[end].vao != item->vao ||
+                memcmp(batchItems[end].params, item->params, sizeof(item->params)))
+            {
+                break;
+            }
+            
+            i = end - first;
+            batchCounts[i] = batchItems[end].count;
+            batchIndices[i] = batchItems[end].indices;
+            batchBaseVertices[i] = batchItems[end].baseVertex;
+        }
+        
+        SetDrawState(item->texture, item->params, item->vao, item->decode);
+        
+        if (end - first == 1)
+        {
+            glDrawElementsBaseVertex(
+                GL_TRIANGLES, 
+                item->count, 
+                GL_UNSIGNED_INT, 
+                item->indices,
+                item->baseVertex
+            );
+        }
+        else
+        {
+            glMultiDrawElementsBaseVertex(
+                GL_TRIANGLES,
+                batchCounts,
+                GL_UNSIGNED_INT,
+                batchIndices,
+                end - first,
+                batchBaseVertices
+            );
+        }
+        
+        drawStats.numDrawCalls++;
+    }
+    
+    numBatchItems = 0;
 }
 
 static void CreateProgram()
@@ -94,74 +677,949 @@ static void CreateProgram()
     glBindAttribLocation(program, 2, "texCoord");
     glBindFragDataLocation(program, 0, "fragOut");
     FxsOpenGLProgramLink(program);
+    viewLocation = glGetUniformLocation(program, "view");
+    projectionLocation = glGetUniformLocation(program, "projection");
+    materialLocation = glGetUniformLocation(program, "material");
+    decodeLocation = glGetUniformLocation(program, "decode");
+    FFGLStateUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "diffuseMap"), 0);
 }
 
 void FFObjRendererCreate()
 {
     meshes = FxsDictionaryCreateWithTableSize(maxFilesLoadedHint);
     assert(meshes);
+    threadPool = FFThreadPoolCreate(0);
     CreateProgram();
+    textures = ObjRendererTexturesCreate();
+    assert(textures);
+    FFObjRendererSetViewMatrix(identity);
+    FFObjRendererSetProjectionMatrix(identity);
+}
+
+static void AddLoadedMesh(ObjRendererMesh* mesh)
+{
+    if (numLoadedMeshes == maxLoadedMeshes)
+    {
+        maxLoadedMeshes = maxLoadedMeshes ? 2*maxLoadedMeshes : maxFilesLoadedHint;
+        loadedMeshes = realloc(
+                loadedMeshes, 
+                maxLoadedMeshes*sizeof(ObjRendererMesh*)
+            );
+        assert(loadedMeshes);
+    }
+    
+    loadedMeshes[numLoadedMeshes++] = mesh;
+    
+    /* the mesh is drawn with the diffuse colors until the maps are loaded */
+    ObjRendererTexturesAdd(textures, mesh);
 }
 
 int FFObjRendererLoad(const char* filename)
 {
     ObjRendererMesh* mesh = NULL;
     
-    if (!filename)
+    /* a file is loaded only once */
+    if (!filename || FxsDictionaryContains(meshes, filename))
     {
         return 0;
     }
     
-    mesh = ObjRendererMeshCreateWithFile(filename);
+    mesh = ObjRendererMeshCreateWithFile(filename, threadPool, cache);
     
     if (!mesh)
     {
         return 0;
     }
+    
+    FxsDictionaryInsert(meshes, filename, mesh);
+    AddLoadedMesh(mesh);
+    
+    return 1;
+}
+
+/*
+** Streamed chunks are drawn like loaded meshes while they are resident, but
+** are not in the dictionary.
+*/
+static void OnChunkResident(ObjRendererMesh* mesh, void* userData)
+{
+    AddLoadedMesh(mesh);
+}
+
+static void OnChunkEvict(ObjRendererMesh* mesh, void* userData)
+{
+    unsigned int i = 0;
+    
+    ObjRendererTexturesRemove(textures, mesh);
+    
+    for (i = 0; i < numLoadedMeshes && loadedMeshes[i] != mesh; i++)
+    {
+    }
+    
+    assert(i < numLoadedMeshes);
+    
+    /* keep the load order of the other meshes */
+    memmove(
+        &loadedMeshes[i], 
+        &loadedMeshes[i + 1], 
+        (numLoadedMeshes - i - 1)*sizeof(ObjRendererMesh*)
+    );
+    numLoadedMeshes--;
+}
+
+int FFObjRendererLoadChunks(const char* manifest)
+{
+    if (!manifest)
+    {
+        return 0;
+    }
+    
+    if (!stream)
+    {
+        stream = ObjRendererStreamCreate(OnChunkResident, OnChunkEvict, NULL, cache);
+        
+        if (!stream)
+        {
+            return 0;
+        }
+    }
+    
+    return ObjRendererStreamAddChunks(stream, manifest);
+}
+
+void FFObjRendererSetStreamingBudget(size_t hostBytes, size_t gpuBytes)
+{
+    if (!stream)
+    {
+        stream = ObjRendererStreamCreate(OnChunkResident, OnChunkEvict, NULL, cache);
+        assert(stream);
+    }
+    
+    ObjRendererStreamSetBudget(stream, hostBytes, gpuBytes);
+}
 
-    if (FxsDictionaryContains(meshes, filename))
+/*
+** Gets the eye position of the view matrix.
+*/
+static void GetEye(FxsVector3* eye)
+{
+    const float* m = viewMatrix;
+    
+    /* the eye is -R^T t of the view matrix (column major) */
+    eye->x = -(m[0]*m[12] + m[1]*m[13] + m[2]*m[14]);
+    eye->y = -(m[4]*m[12] + m[5]*m[13] + m[6]*m[14]);
+    eye->z = -(m[8]*m[12] + m[9]*m[13] + m[10]*m[14]);
+}
+
+unsigned int FFObjRendererUpdateStreaming(double budget)
+{
+    FxsVector3 eye;
+    
+    if (!stream)
     {
-        // TODO: ObjRendererMeshDestroy(...)
         return 0;
     }
     
-    FxsDictionaryInsert(meshes, filename, mesh);
+    GetEye(&eye);
     
-    return 1;
+    return ObjRendererStreamUpdate(stream, &eye, budget);
 }
 
 void FFObjRendererDestroy()
 {
+    unsigned int i = 0;
+    
+    /* evicts the resident chunks from the loaded meshes */
+    if (stream)
+    {
+        ObjRendererStreamDestroy(&stream);
+    }
+    
+    /* stops updating the materials of the meshes */
+    ObjRendererTexturesDestroy(&textures);
+    
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        ObjRendererMeshDestroy(&loadedMeshes[i]);
+    }
+    
     FxsDictionaryDestroy(&meshes);
+    ObjRendererIndirectShutdown();
+    ObjRendererImpostorShutdown();
+    
+    if (cache)
+    {
+        ObjRendererCacheDestroy(&cache);
+    }
+    
+    FFThreadPoolDestroy(&threadPool);
+    free(loadedMeshes);
+    free(batchItems);
+    free(batchCounts);
+    free(batchIndices);
+    free(batchBaseVertices);
+    free(meshletJobs);
+    free(meshletRanges);
+    meshletJobs = NULL;
+    meshletRanges = NULL;
+    numMeshletJobs = 0;
+    maxMeshletJobs = 0;
+    numMeshletRanges = 0;
+    maxMeshletRanges = 0;
+    loadedMeshes = NULL;
+    batchItems = NULL;
+    batchCounts = NULL;
+    batchIndices = NULL;
+    batchBaseVertices = NULL;
+    numBatchItems = 0;
+    maxBatchItems = 0;
+    numLoadedMeshes = 0;
+    maxLoadedMeshes = 0;
 }
 
-void FFObjRendererRender()
+/*
+** Draws all render data of the mesh in userData for a capture of its 
+** impostor.
+*/
+static void CaptureMesh(const float* view, const float* projection, void* userData)
 {
-    FxsListPtr keys = FxsDictionaryGetKeys(meshes);
-    FxsListIteratorPtr keyIterator = NULL;
-    char* key = NULL;
-    ObjRendererMesh* mesh = NULL;
+    ObjRendererMesh* mesh = (ObjRendererMesh*)userData;
+    unsigned int i = 0;
     
-    keyIterator = FxsListIteratorCreate(
-            keys,
-            FXS_LIST_FRONT,
-            FXS_LIST_FRONT_TO_BACK
-        );
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, view);
+    glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, projection);
+    currentTexture = 0;
+    currentVao = 0;
+    hasCurrentParams = 0;
+    
+    for (i = 0; i < mesh->numData; i++)
+    {
+        RenderData(mesh, &mesh->data[i], NULL);
+    }
+}
+
+/*
+** Returns 1 if the diffuse maps of all materials of mesh are uploaded.
+*/
+static int AreMapsLoaded(const ObjRendererMesh* mesh)
+{
+    unsigned int i = 0;
+    
+    for (i = 0; i < mesh->numMaterials; i++)
+    {
+        if (mesh->materials[i].diffuseMap && mesh->materials[i].layer < 0)
+        {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+/*
+** Gets the fraction of the viewport height that the bounding sphere of box 
+** covers seen from eye. FLT_MAX if eye is inside of the sphere.
+*/
+static float GetScreenSize(const ObjRendererBoundingBox* box, const FxsVector3* eye)
+{
+    float dx = box->max.x - box->min.x;
+    float dy = box->max.y - box->min.y;
+    float dz = box->max.z - box->min.z;
+    float radius = 0.5f*sqrtf(dx*dx + dy*dy + dz*dz);
+    float distance = 0.0f;
+    
+    dx = (box->min.x + box->max.x)*0.5f - eye->x;
+    dy = (box->min.y + box->max.y)*0.5f - eye->y;
+    dz = (box->min.z + box->max.z)*0.5f - eye->z;
+    distance = sqrtf(dx*dx + dy*dy + dz*dz);
     
-    if (!keyIterator)
+    if (distance <= radius)
     {
+        return FLT_MAX;
+    }
+    
+    /* projectionMatrix[5] is the cotangent of half the vertical field of view */
+    return radius*projectionMatrix[5]/distance;
+}
+
+/*
+** Switches mesh to and from its impostor by its screen size seen from eye, 
+** with hysteresis so that it does not flicker at the threshold, and steps 
+** the crossfade. The mesh is drawn until FFObjRendererPrepareImpostors has
+** captured the impostor.
+*/
+static void UpdateImpostor(ObjRendererMesh* mesh, const FxsVector3* eye)
+{
+    const ObjRendererBoundingBox* box = NULL;
+    float size = 0.0f;
+    float target = 0.0f;
+    
+    if (!impostorThreshold || !mesh->numDrawRecords)
+    {
+        mesh->impostorActive = 0;
+        mesh->impostorBlend = 0.0f;
         return;
     }
+    
+    box = &mesh->drawList[0].boundingBox;
+    size = GetScreenSize(box, eye);
+    
+    if (!mesh->impostorActive && size < impostorThreshold)
+    {
+        mesh->impostorActive = 1;
+    }
+    else if (mesh->impostorActive && size > impostorThreshold*IMPOSTOR_HYSTERESIS)
+    {
+        mesh->impostorActive = 0;
+    }
+    
+    target = mesh->impostorActive && mesh->impostor ? 1.0f : 0.0f;
+    
+    if (mesh->impostorBlend < target)
+    {
+        mesh->impostorBlend = fminf(target, mesh->impostorBlend + 1.0f/IMPOSTOR_FADE_FRAMES);
+    }
+    else
+    {
+        mesh->impostorBlend = fmaxf(target, mesh->impostorBlend - 1.0f/IMPOSTOR_FADE_FRAMES);
+    }
+}
+
+static void UpdateImpostors()
+{
+    FxsVector3 eye;
+    unsigned int i = 0;
+    
+    GetEye(&eye);
+    
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        UpdateImpostor(loadedMeshes[i], &eye);
+    }
+}
+
+unsigned int FFObjRendererPrepareImpostors()
+{
+    ObjRendererMesh* mesh = NULL;
+    unsigned int numCaptures = 0;
+    unsigned int numWaiting = 0;
+    unsigned int i = 0;
+    
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        mesh = loadedMeshes[i];
+        
+        if (!mesh->impostorActive || mesh->impostorCaptured)
+        {
+            continue;
+        }
+        
+        if (numCaptures == IMPOSTOR_CAPTURES_PER_FRAME ||
+            (numPendingMaps && !AreMapsLoaded(mesh)))
+        {
+            numWaiting++;
+            continue;
+        }
+        
+        if (!numCaptures)
+        {
+            FFGLStatePolygonMode(GL_FILL);
+        }
+        
+        mesh->impostor = ObjRendererImpostorCreate(
+                &mesh->drawList[0].boundingBox, 
+                CaptureMesh, 
+                mesh
+            );
+        mesh->impostorCaptured = 1;
+        numCaptures++;
+    }
+    
+    /* the captures changed the matrices */
+    if (numCaptures)
+    {
+        FFGLStateUseProgram(program);
+        glUniformMatrix4fv(viewLocation, 1, GL_FALSE, viewMatrix);
+        glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, projectionMatrix);
+    }
+    
+    return numWaiting;
+}
+
+/*
+** Draws the impostors that are fading in or have replaced their mesh over 
+** the meshes, with premultiplied alpha and without writing the depth. A 
+** fading impostor is blended over its still opaque mesh, so the mesh never 
+** shows the background through it.
+*/
+static void DrawImpostors()
+{
+    ObjRendererMesh* mesh = NULL;
+    ObjRendererImpostor* impostor = NULL;
+    float viewProjection[16];
+    FxsVector3 eye;
+    int numDrawn = 0;
+    unsigned int i = 0;
+    
+    FFFrustumMultiplyMatrices(viewProjection, projectionMatrix, viewMatrix);
+    GetEye(&eye);
+    
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        mesh = loadedMeshes[i];
+        impostor = mesh->impostor;
+        
+        if (!impostor || mesh->impostorBlend <= 0.0f)
+        {
+            continue;
+        }
+        
+        if (frustumCulling && FF_FRUSTUM_OUTSIDE == FFFrustumTestSphere(
+                &frustum, 
+                &impostor->center.x, 
+                impostor->radius
+            ))
+        {
+            continue;
+        }
+        
+        if (!numDrawn)
+        {
+            FFGLStatePolygonMode(GL_FILL);
+            FFGLStateEnable(GL_BLEND);
+            FFGLStateBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+            FFGLStateDepthMask(GL_FALSE);
+        }
+        
+        ObjRendererImpostorDraw(impostor, &eye, viewProjection, mesh->impostorBlend);
+        numDrawn++;
+        drawStats.numDrawCalls++;
+    }
+    
+    if (numDrawn)
+    {
+        FFGLStateDepthMask(GL_TRUE);
+        FFGLStateDisable(GL_BLEND);
+        FFGLStateUseProgram(program);
+    }
+}
+
+/*
+** Returns 1 if mesh is replaced by its impostor.
+*/
+static int IsImpostor(const ObjRendererMesh* mesh)
+{
+    return mesh->impostorBlend >= 1.0f;
+}
+
+void FFObjRendererRender()
+{
+    unsigned int i = 0;
  
-    glUseProgram(program);
-    glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+    FFGLStateUseProgram(program);
+    FFGLStatePolygonMode(GL_LINE);
+    UpdateImpostors();
+    
+    memset(&cullingStats, 0, sizeof(cullingStats));
+    memset(&drawStats, 0, sizeof(drawStats));
+    
+    /* the state is set at least once per frame */
+    currentTexture = 0;
+    currentVao = 0;
+    hasCurrentParams = 0;
+    
+    if (!batching)
+    {
+        for (i = 0; i < numLoadedMeshes; i++)
+        {
+            if (!IsImpostor(loadedMeshes[i]))
+            {
+                VisitVisibleData(loadedMeshes[i], &frustum, &cullingStats, 
+                    RenderData, NULL);
+            }
+        }
+    }
+    else
+    {
+        GetEye(&meshletEye);
+        
+        /* all meshes first, so that the materials they share are set once */
+        for (i = 0; i < numLoadedMeshes; i++)
+        {
+            if (!IsImpostor(loadedMeshes[i]) && 
+                !VisitVisibleData(loadedMeshes[i], &frustum, &cullingStats, 
+                    CollectData, NULL))
+            {
+                break;
+            }
+        }
+        
+        /* the ranges collected so far are drawn if it fails */
+        if (numMeshletJobs)
+        {
+            CollectMeshlets();
+        }
+        
+        RenderBatches();
+    }
+    
+    DrawImpostors();
+    
+    /* only the meshes are drawn as lines */
+    FFGLStatePolygonMode(GL_FILL);
+}
+
+/*
+** Fills the draw packet and the sort key for the render data. The decode 
+** matrix of the vertex buffer is passed as the model matrix of the packet.
+*/
+static void MakePacket(
+    const ObjRendererMesh* mesh,
+    const ObjRendererData* data,
+    FFRenderQueuePacket* packet,
+    uint64_t* key
+)
+{
+    float depth = 0.0f;
+
+    memset(packet, 0, sizeof(FFRenderQueuePacket));
+    packet->program = program;
+    packet->vao = mesh->vertexBuffers[data->format].vao;
+    packet->polygonMode = GL_LINE;
+    packet->drawType = FF_RENDER_QUEUE_DRAW_ELEMENTS;
+    packet->mode = GL_TRIANGLES;
+    packet->count = data->numFaces*3;
+    packet->indexType = GL_UNSIGNED_INT;
+    packet->indices = (const GLvoid*)(data->firstIndex*sizeof(GLuint));
+    packet->baseVertex = data->baseVertex;
+    packet->modelLocation = decodeLocation;
+    packet->paramsLocation = materialLocation;
+    packet->textureTarget = GL_TEXTURE_2D_ARRAY;
+    ObjRendererMeshGetMaterialParams(
+        mesh, 
+        data->matId, 
+        packet->params, 
+        &packet->texture
+    );
+
+    depth = FFRenderQueueComputeDepth(
+            identity,
+            viewMatrix,
+            projectionMatrix,
+            0.5f*(data->boundingBox.min.x + data->boundingBox.max.x),
+            0.5f*(data->boundingBox.min.y + data->boundingBox.max.y),
+            0.5f*(data->boundingBox.min.z + data->boundingBox.max.z)
+        );
+    
+    *key = FFRenderQueueMakeKey(
+            FF_RENDER_QUEUE_PASS_OPAQUE,
+            program,
+            packet->texture,
+            packet->vao,
+            depth
+        );
+}
+
+/*
+** Where SubmitData puts the packets, to queue or else to list, and the 
+** culling state of the thread that submits them.
+*/
+typedef struct
+{
+    FFRenderQueuePtr queue;
+    FFCommandListPtr list;
+    const FFFrustum* frustum;
+    FFObjRendererCullingStats* stats;
+    FxsVector3 eye;
+    ObjRendererIndexRange* ranges;
+    unsigned int maxRanges;
+}
+SubmitContext;
+
+static int SubmitPacket(
+    const SubmitContext* context,
+    uint64_t key,
+    const FFRenderQueuePacket* packet,
+    const float* decode
+)
+{
+    if (context->queue)
+    {
+        return FFRenderQueueSubmit(context->queue, key, packet, decode);
+    }
     
-    while (FxsListIteratorHasNext(keyIterator))
+    return FFCommandListRecordDraw(context->list, key, packet, decode);
+}
+
+/*
+** Culls the meshlets of data like CollectMeshlets and submits packet for 
+** each remaining index range. Returns 0 if it fails.
+*/
+static int SubmitMeshlets(
+    SubmitContext* context,
+    ObjRendererMesh* mesh,
+    ObjRendererData* data,
+    FFRenderQueuePacket* packet,
+    uint64_t key
+)
+{
+    const ObjRendererOctree* octree = mesh->octree;
+    unsigned int index = (unsigned int)(data - mesh->data);
+    unsigned int numClusters = 
+        octree->firstDataClusters[index + 1] - octree->firstDataClusters[index];
+    ObjRendererIndexRange* ranges = NULL;
+    unsigned int numRanges = 0;
+    unsigned int numFaces = 0;
+    unsigned int i = 0;
+    
+    if (numClusters > context->maxRanges)
     {
-        key = FxsListIteratorNext(keyIterator);
-        mesh = FxsDictionaryFind(meshes, key);
-        RenderMesh(mesh);
+        ranges = realloc(context->ranges, numClusters*sizeof(ObjRendererIndexRange));
+        
+        if (!ranges)
+        {
+            return 0;
+        }
+        
+        context->ranges = ranges;
+        context->maxRanges = numClusters;
     }
     
-    FxsListIteratorDestroy(&keyIterator);
-}
\ No newline at end of file
+    numRanges = ObjRendererOctreeCullData(
+            octree, 
+            index, 
+            context->frustum, 
+            &context->eye, 
+            context->ranges
+        );
+    
+    for (i = 0; i < numRanges; i++)
+    {
+        packet->count = context->ranges[i].numIndices;
+        packet->indices = 
+            (const GLvoid*)(context->ranges[i].firstIndex*sizeof(GLuint));
+        
+        if (!SubmitPacket(context, key, packet, 
+                mesh->vertexBuffers[data->format].decode))
+        {
+            return 0;
+        }
+        
+        numFaces += context->ranges[i].numIndices/3;
+    }
+    
+    context->stats->numVisibleFaces += numFaces;
+    context->stats->numCulledFaces += data->numFaces - numFaces;
+    
+    return 1;
+}
+
+static int SubmitData(
+    ObjRendererMesh* mesh, 
+    ObjRendererData* data, 
+    void* userData
+)
+{
+    SubmitContext* context = (SubmitContext*)userData;
+    FFRenderQueuePacket packet;
+    uint64_t key = 0;
+    
+    MakePacket(mesh, data, &packet, &key);
+    
+    if (meshletCulling && mesh->octree)
+    {
+        return SubmitMeshlets(context, mesh, data, &packet, key);
+    }
+    
+    return SubmitPacket(
+            context, 
+            key, 
+            &packet, 
+            mesh->vertexBuffers[data->format].decode
+        );
+}
+
+/*
+** Submits the visible render data of the meshes first .. first + count - 1 
+** with context. Returns 0 if it fails.
+*/
+static int SubmitMeshes(
+    SubmitContext* context, 
+    unsigned int first, 
+    unsigned int count
+)
+{
+    unsigned int i = 0;
+    int result = 1;
+    
+    /* an impostor is blended and has uniforms of its own, a packet can not 
+    ** carry either
+    */
+    if (impostorThreshold > 0.0f)
+    {
+        return 0;
+    }
+    
+    GetEye(&context->eye);
+    
+    for (i = first; i < first + count && result; i++)
+    {
+        result = VisitVisibleData(
+                loadedMeshes[i], 
+                context->frustum, 
+                context->stats, 
+                SubmitData, 
+                context
+            );
+    }
+    
+    free(context->ranges);
+    
+    return result;
+}
+
+int FFObjRendererSubmit(FFRenderQueuePtr queue)
+{
+    SubmitContext context;
+    
+    memset(&cullingStats, 0, sizeof(cullingStats));
+    memset(&context, 0, sizeof(SubmitContext));
+    context.queue = queue;
+    context.frustum = &frustum;
+    context.stats = &cullingStats;
+    
+    return SubmitMeshes(&context, 0, numLoadedMeshes);
+}
+
+unsigned int FFObjRendererGetNumMeshes()
+{
+    return numLoadedMeshes;
+}
+
+int FFObjRendererRecord(
+    FFCommandListPtr list, 
+    unsigned int firstMesh, 
+    unsigned int numMeshes,
+    FFObjRendererCullingStats* stats
+)
+{
+    /* a copy, so that the threads do not share the cache lines it is on */
+    FFFrustum threadFrustum = frustum;
+    SubmitContext context;
+    
+    if (firstMesh + numMeshes > numLoadedMeshes)
+    {
+        return 0;
+    }
+    
+    memset(&context, 0, sizeof(SubmitContext));
+    context.list = list;
+    context.frustum = &threadFrustum;
+    context.stats = stats;
+    
+    return SubmitMeshes(&context, firstMesh, numMeshes);
+}
+
+void FFObjRendererRenderIndirect()
+{
+    float viewProjection[16];
+    unsigned int i = 0;
+
+    if (gpuCulling && ObjRendererIndirectIsSupported())
+    {
+        FFFrustumMultiplyMatrices(viewProjection, projectionMatrix, viewMatrix);
+
+        for (i = 0; i < numLoadedMeshes; i++)
+        {
+            ObjRendererIndirectCull(loadedMeshes[i], viewProjection);
+        }
+    }
+
+    FFGLStateUseProgram(program);
+    FFGLStatePolygonMode(GL_LINE);
+
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        ObjRendererIndirectDraw(loadedMeshes[i], materialLocation, decodeLocation);
+    }
+    
+    FFGLStatePolygonMode(GL_FILL);
+}
+
+void FFObjRendererSetGpuCulling(int enable)
+{
+    unsigned int i = 0;
+
+    if (gpuCulling && !enable)
+    {
+        for (i = 0; i < numLoadedMeshes; i++)
+        {
+            ObjRendererIndirectResetCulling(loadedMeshes[i]);
+        }
+    }
+
+    gpuCulling = enable;
+}
+
+/*
+** Extracts the frustum from the current matrices.
+*/
+static void UpdateFrustum()
+{
+    float viewProjection[16];
+    
+    FFFrustumMultiplyMatrices(viewProjection, projectionMatrix, viewMatrix);
+    FFFrustumSetMatrix(&frustum, viewProjection);
+}
+
+unsigned int FFObjRendererUploadTextures(double budget)
+{
+    numPendingMaps = ObjRendererTexturesUpload(textures, budget);
+    
+    return numPendingMaps;
+}
+
+int FFObjRendererSetCacheDirectory(const char* directory, size_t maxSize)
+{
+    if (cache)
+    {
+        ObjRendererCacheDestroy(&cache);
+    }
+    
+    if (!directory)
+    {
+        return 1;
+    }
+    
+    cache = ObjRendererCacheCreate(directory, maxSize);
+    
+    return cache != NULL;
+}
+
+int FFObjRendererPick(
+    const float* origin, 
+    const float* direction, 
+    FFObjRendererPickResult* result
+)
+{
+    ObjRendererRayHit hit;
+    FxsVector3 o;
+    FxsVector3 d;
+    float distance = FLT_MAX;
+    unsigned int i = 0;
+    int found = 0;
+    
+    o.x = origin[0];
+    o.y = origin[1];
+    o.z = origin[2];
+    d.x = direction[0];
+    d.y = direction[1];
+    d.z = direction[2];
+    
+    /* later meshes only have to beat the closest hit so far */
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        /* the faces are only kept on the cpu in the octree */
+        if (!loadedMeshes[i]->octree ||
+            !ObjRendererOctreeRaycast(loadedMeshes[i]->octree, &o, &d, distance, &hit))
+        {
+            continue;
+        }
+        
+        distance = hit.distance;
+        result->mesh = i;
+        result->data = loadedMeshes[i]->octree->clusters[hit.cluster].data;
+        result->face = hit.face;
+        result->distance = hit.distance;
+        result->position[0] = o.x + hit.distance*d.x;
+        result->position[1] = o.y + hit.distance*d.y;
+        result->position[2] = o.z + hit.distance*d.z;
+        found = 1;
+    }
+    
+    return found;
+}
+
+void FFObjRendererSetFrustumCulling(int enable)
+{
+    frustumCulling = enable;
+}
+
+void FFObjRendererSetMeshletCulling(int enable)
+{
+    meshletCulling = enable;
+}
+
+void FFObjRendererSetImpostorThreshold(float screenSize)
+{
+    impostorThreshold = screenSize > 0.0f ? screenSize : 0.0f;
+}
+
+void FFObjRendererGetCullingStats(FFObjRendererCullingStats* stats)
+{
+    *stats = cullingStats;
+}
+
+void FFObjRendererSetBatching(int enable)
+{
+    batching = enable;
+}
+
+void FFObjRendererGetDrawStats(FFObjRendererDrawStats* stats)
+{
+    *stats = drawStats;
+}
+
+void FFObjRendererSetViewMatrix(const float* view)
+{
+    memcpy(viewMatrix, view, sizeof(viewMatrix));
+    UpdateFrustum();
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(viewLocation, 1, GL_FALSE, view);
+}
+
+void FFObjRendererSetProjectionMatrix(const float* projection)
+{
+    memcpy(projectionMatrix, projection, sizeof(projectionMatrix));
+    UpdateFrustum();
+    FFGLStateUseProgram(program);
+    glUniformMatrix4fv(projectionLocation, 1, GL_FALSE, projection);
+}
+
+void FFObjRendererPrintStats()
+{
+    ObjRendererMeshStats* stats = NULL;
+    unsigned int i = 0;
+    
+    for (i = 0; i < numLoadedMeshes; i++)
+    {
+        stats = &loadedMeshes[i]->stats;
+        
+        if (!stats->numFaces)
+        {
+            continue;
+        }
+        
+        printf("mesh %u: %u faces\n", i, stats->numFaces);
+        printf("\tvertices: %u -> %u\n", stats->numSoupVertices, stats->numVertices);
+        printf(
+            "\tmemory: %.2f MB -> %.2f MB -> %.2f MB (packed)\n", 
+            stats->soupBytes/1e6, 
+            stats->indexedBytes/1e6,
+            stats->packedBytes/1e6
+        );
+        printf(
+            "\tACMR: 3.000 -> %.3f (welded) -> %.3f (optimized)\n",
+            (float)stats->numMissesWelded/stats->numFaces,
+            (float)stats->numMissesOptimized/stats->numFaces
+        );
+        printf(
+            "\tpacking errors: position %g, normal %.4f deg, tex coord %g\n",
+            stats->positionError,
+            stats->normalError,
+            stats->texCoordError
+        );
+    }
+}
@@ -9,10 +9,225 @@
 #ifndef ObjRenderer_FFObjRenderer_h
 #define ObjRenderer_FFObjRenderer_h
 
+#include <stddef.h>
+#include <FF/RenderQueue/RenderQueue.h>
+#include <FF/CommandList/CommandList.h>
 
 void FFObjRendererCreate();
+
+/*
+** Sets the directory converted meshes are cached in (see ObjRendererCache.h)
+** and its size limit in bytes. The directory is created if it does not 
+** exist. NULL disables the cache, which is the initial state. Returns 0 if
+** it fails, the cache is disabled then.
+*/
+int FFObjRendererSetCacheDirectory(const char* directory, size_t maxSize);
+
 int FFObjRendererLoad(const char* filename);
+
+/*
+** Adds the chunks of a .obj file that was split by ObjRendererChunksSplit 
+** (see ObjRendererChunks.h), manifest is the manifest it wrote. The chunks 
+** are not loaded right away but streamed in and out by their distance to the
+** eye by FFObjRendererUpdateStreaming. Resident chunks count as loaded 
+** meshes, so the mesh indices change while streaming. Returns 0 if it fails.
+*/
+int FFObjRendererLoadChunks(const char* manifest);
+
+/*
+** Sets the bytes of vertices and indices of streamed chunks that may be in 
+** host memory waiting for the upload and uploaded. Initially 256 MB and 
+** 512 MB.
+*/
+void FFObjRendererSetStreamingBudget(size_t hostBytes, size_t gpuBytes);
+
+/*
+** Streams the chunks for the eye of the current view matrix: evicts the 
+** chunks that fell out of the budget, loads the closest ones in the 
+** background and uploads the loaded ones until budget (in seconds) is used 
+** up. Should be called once per frame. Returns the # of chunks within the 
+** budget that are not resident yet.
+*/
+unsigned int FFObjRendererUpdateStreaming(double budget);
+
+/*
+** Uploads the diffuse maps that were decoded in the background since the 
+** last call, until budget (in seconds) is used up. Should be called once per
+** frame. Returns the # of maps that are not uploaded yet.
+*/
+unsigned int FFObjRendererUploadTextures(double budget);
+
+/*
+** Renders the loaded meshes. Subtrees of the scene graph whose bounding box 
+** is outside of the view frustum are skipped (see 
+** FFObjRendererSetFrustumCulling), the remaining render data can be batched
+** across the meshes (see FFObjRendererSetBatching). The meshes are drawn as
+** lines, the polygon mode is GL_FILL again afterwards.
+*/
 void FFObjRendererRender();
+
+/*
+** Captures the impostors of the meshes that FFObjRendererRender switched to 
+** their impostor (see FFObjRendererSetImpostorThreshold), at most one per 
+** call, once the diffuse maps of the mesh are uploaded. A capture renders to
+** a framebuffer of its own and changes the viewport, so this should be 
+** called once per frame outside of the render pass, before the frame is 
+** cleared. Returns the # of impostors that still wait to be captured.
+*/
+unsigned int FFObjRendererPrepareImpostors();
+
+/*
+** Renders all loaded meshes with one multi draw per mesh, vertex format and 
+** material. The draws are indirect (glMultiDrawElementsIndirect) if OpenGL 
+** 4.3 is available, glMultiDrawElementsBaseVertex otherwise.
+*/
+void FFObjRendererRenderIndirect();
+
+/*
+** Enables/disables culling the indirect draws against the view frustum with a
+** compute shader. Only has an effect with OpenGL 4.3. Initially disabled.
+*/
+void FFObjRendererSetGpuCulling(int enable);
+
+/*
+** Enables/disables culling the nodes of the meshes against the view frustum
+** on the cpu in FFObjRendererRender, FFObjRendererSubmit and 
+** FFObjRendererRecord. Initially enabled.
+*/
+void FFObjRendererSetFrustumCulling(int enable);
+
+/*
+** Enables/disables culling the meshlets of the visible render data in 
+** FFObjRendererRender with batching, FFObjRendererSubmit and 
+** FFObjRendererRecord. The meshlets are the clusters of the 
+** octrees of the meshes (see ObjRendererOctree.h), they are culled against 
+** the view frustum and by their normal cones on the threads of the pool, the
+** remaining index ranges are batched like render data (submitted as 
+** packets of their own by FFObjRendererSubmit and FFObjRendererRecord, 
+** which cull them on the calling thread). Meshlets that face 
+** away from the eye are culled, so back faces have to be culled 
+** (GL_CULL_FACE) for this not to change the image, and the projection has to
+** be a perspective one. Initially disabled.
+*/
+void FFObjRendererSetMeshletCulling(int enable);
+
+/*
+** Sets the screen size below which a mesh is drawn as its impostor in 
+** FFObjRendererRender (see ObjRendererImpostor.h), as the fraction of the 
+** viewport height covered by its bounding sphere. A mesh goes back to its 
+** faces above 1.25 times the threshold, and fades between the two over a few
+** frames, so it does not pop at the threshold. The impostor of a mesh is 
+** captured by FFObjRendererPrepareImpostors the first time it is needed.
+** 0 disables impostors. Initially 0.
+*/
+void FFObjRendererSetImpostorThreshold(float screenSize);
+
+/*
+** # of visible and culled nodes of the last FFObjRendererRender or 
+** FFObjRendererSubmit. The nodes of a culled subtree all count as culled.
+** The faces of the visible nodes are counted if meshlet culling is enabled.
+*/
+typedef struct
+{
+    unsigned int numVisibleNodes;
+    unsigned int numCulledNodes;
+    unsigned int numVisibleFaces;
+    unsigned int numCulledFaces;    /* by meshlet culling */
+}
+FFObjRendererCullingStats;
+
+void FFObjRendererGetCullingStats(FFObjRendererCullingStats* stats);
+
+/*
+** Enables/disables batching in FFObjRendererRender. With batching the 
+** visible render data of all meshes are collected first and sorted by vao, 
+** texture and material, so that the render data that share a state are 
+** drawn with one multi draw. Without it the render data are drawn in the 
+** order of the scene graphs. Initially disabled, the vaos are per mesh, so 
+** batching only pays off for meshes with many render data per material.
+*/
+void FFObjRendererSetBatching(int enable);
+
+/*
+** # of draw calls and state changes of the last FFObjRendererRender. 
+** Material binds count the updates of the material uniform.
+*/
+typedef struct
+{
+    unsigned int numDrawCalls;
+    unsigned int numTextureBinds;
+    unsigned int numMaterialBinds;
+    unsigned int numVertexArrayBinds;
+}
+FFObjRendererDrawStats;
+
+void FFObjRendererGetDrawStats(FFObjRendererDrawStats* stats);
+
+/*
+** The closest face hit by a ray.
+*/
+typedef struct
+{
+    unsigned int mesh;          /* index of the loaded mesh */
+    unsigned int data;          /* index of the render data in the mesh */
+    unsigned int face;          /* first index of the face / 3 */
+    float distance;             /* in units of the length of the direction */
+    float position[3];
+}
+FFObjRendererPickResult;
+
+/*
+** Casts the ray origin + t*direction, t >= 0, (3 floats each, in world 
+** space) against the faces of the loaded meshes using their octrees (see 
+** ObjRendererOctree.h). Meshes without an octree, because building it 
+** failed, can not be hit. Returns 0 if no face is hit.
+*/
+int FFObjRendererPick(
+    const float* origin, 
+    const float* direction, 
+    FFObjRendererPickResult* result
+);
+
+/*
+** Prints the vertex counts, memory and average cache miss ratio of the loaded 
+** meshes without and with indexing.
+*/
+void FFObjRendererPrintStats();
+
+/*
+** Submits a packet for each render data of all loaded meshes that is not 
+** culled to queue instead of drawing them right away, or for each index 
+** range of its meshlets with meshlet culling. Fails while impostors are 
+** enabled, they can not be drawn from packets. Returns 0 if it fails.
+*/
+int FFObjRendererSubmit(FFRenderQueuePtr queue);
+
+/*
+** Gets the # of loaded meshes. Meshes are indexed in load order.
+*/
+unsigned int FFObjRendererGetNumMeshes();
+
+/*
+** Records the render data of the meshes firstMesh .. firstMesh + numMeshes - 1
+** into list. Does not issue opengl calls, so worker threads can record 
+** disjoint ranges of meshes in parallel (see CommandList.h). Only the render
+** data that are not culled are recorded, like in FFObjRendererSubmit. The 
+** culled nodes and faces are added to stats, which each thread has to have 
+** its own of. They are not included in FFObjRendererGetCullingStats.
+*/
+int FFObjRendererRecord(
+    FFCommandListPtr list, 
+    unsigned int firstMesh, 
+    unsigned int numMeshes,
+    FFObjRendererCullingStats* stats
+);
+
+/*
+** Set the view and projection matrices, opengl (column major) matrices with 
+** 16 elements. Initially they are the identity.
+*/
+void FFObjRendererSetViewMatrix(const float* view);
+void FFObjRendererSetProjectionMatrix(const float* projection);
 void FFObjRendererDestroy();
 
 
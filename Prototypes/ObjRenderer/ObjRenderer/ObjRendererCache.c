@@ -0,0 +1,656 @@
+//
+//  ObjRendererCache.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#define mkdir(DIR, MODE) _mkdir(DIR)
+#else
+#include <dirent.h>
+#include <utime.h>
+#endif
+#include "ObjRendererCache.h"
+#include "ObjRendererFile.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define MAGIC "OBJRMESH"
+#define EXTENSION ".objcache"
+#define MAX_PATH_LENGTH 1024
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+/* sections of the file start at multiples of ALIGNMENT */
+#define ALIGNMENT 8
+#define ALIGN(X) (((X) + ALIGNMENT - 1) & ~(uint64_t)(ALIGNMENT - 1))
+
+/*
+** The header of a cached file, it is followed by the sections data, draw
+** list, indices, the vertices of each format and the strings. The strings 
+** are the mtllib (empty if there is none) and the material names, each zero 
+** terminated.
+*/
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;    /* catches layout differences between builds */
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t numData;
+    uint32_t numDrawRecords;
+    uint32_t numIndices;
+    uint32_t numVertices[OBJ_RENDERER_NUM_FORMATS];
+    uint32_t numMaterials;
+    uint32_t stringsSize;
+    ObjRendererMeshStats stats;
+}
+CacheHeader;
+
+/*
+** Offsets of the sections of a cached file.
+*/
+typedef struct
+{
+    uint64_t data;
+    uint64_t drawList;
+    uint64_t indices;
+    uint64_t vertices[OBJ_RENDERER_NUM_FORMATS];
+    uint64_t strings;
+    uint64_t size;          /* of the whole file */
+}
+CacheLayout;
+
+static void ComputeLayout(const CacheHeader* header, CacheLayout* layout)
+{
+    uint64_t offset = ALIGN(sizeof(CacheHeader));
+    int i = 0;
+
+    layout->data = offset;
+    offset = ALIGN(offset + (uint64_t)header->numData*sizeof(ObjRendererData));
+    layout->drawList = offset;
+    offset = ALIGN(
+            offset +
+            (uint64_t)header->numDrawRecords*sizeof(ObjRendererDrawRecord)
+        );
+    layout->indices = offset;
+    offset = ALIGN(offset + (uint64_t)header->numIndices*sizeof(GLuint));
+
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        layout->vertices[i] = offset;
+        offset = ALIGN(
+                offset +
+                (uint64_t)header->numVertices[i]*
+                ObjRendererGetFormatSize(i)*sizeof(float)
+            );
+    }
+
+    layout->strings = offset;
+    offset = ALIGN(offset + header->stringsSize);
+    layout->size = offset;
+}
+
+/*
+** Writes the path of the cached file of key to path, suffix is appended to
+** it. Returns 0 if it does not fit in MAX_PATH_LENGTH.
+*/
+static int GetPath(
+    const ObjRendererCache* cache,
+    const ObjRendererCacheKey* key,
+    const char* suffix,
+    char* path
+)
+{
+    int length = snprintf(
+            path,
+            MAX_PATH_LENGTH,
+            "%s/%016llx" EXTENSION "%s",
+            cache->directory,
+            (unsigned long long)key->hash,
+            suffix
+        );
+
+    return length >= 0 && length < MAX_PATH_LENGTH;
+}
+
+ObjRendererCache* ObjRendererCacheCreate(const char* directory, size_t maxSize)
+{
+    ObjRendererCache* cache = NULL;
+    struct stat info;
+
+    if (stat(directory, &info) == -1 && mkdir(directory, 0755) == -1)
+    {
+        ERR_MSG("Failed to create the cache directory");
+        return NULL;
+    }
+
+    cache = malloc(sizeof(ObjRendererCache));
+
+    if (!cache)
+    {
+        return NULL;
+    }
+
+    cache->directory = strdup(directory);
+    cache->maxSize = maxSize;
+
+    if (!cache->directory)
+    {
+        free(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+int ObjRendererCacheComputeKey(const char* filename, ObjRendererCacheKey* key)
+{
+    size_t size = 0;
+    const char* data = ObjRendererFileMap(filename, &size);
+    uint64_t hash = FNV_OFFSET;
+    uint64_t word = 0;
+    size_t i = 0;
+
+    if (!data)
+    {
+        return 0;
+    }
+
+    /* FNV-1a over 64 bit words, the version is hashed first so that cached
+    ** files of older versions are not even looked at
+    */
+    hash = (hash ^ OBJ_RENDERER_CACHE_VERSION)*FNV_PRIME;
+
+    for (i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+    {
+        memcpy(&word, &data[i], sizeof(uint64_t));
+        hash = (hash ^ word)*FNV_PRIME;
+    }
+
+    for (; i < size; i++)
+    {
+        hash = (hash ^ (unsigned char)data[i])*FNV_PRIME;
+    }
+
+    ObjRendererFileUnmap(data, size);
+    key->hash = hash;
+    key->size = size;
+
+    return 1;
+}
+
+/*
+** Checks that the ranges of the entry are consistent, so that a broken file
+** can not make the draws read outside of the buffers.
+*/
+static int ValidateEntry(const ObjRendererCacheEntry* entry)
+{
+    const ObjRendererData* data = NULL;
+    const ObjRendererDrawRecord* record = NULL;
+    unsigned int i = 0, j = 0;
+
+    for (i = 0; i < entry->numData; i++)
+    {
+        data = &entry->data[i];
+
+        if (data->format < 0 || data->format >= OBJ_RENDERER_NUM_FORMATS ||
+            data->matId < -1 || data->matId >= (int)entry->numMaterials ||
+            data->firstIndex > entry->numIndices ||
+            3*(uint64_t)data->numFaces > entry->numIndices - data->firstIndex ||
+            data->baseVertex > entry->numVertices[data->format] ||
+            data->numVertices >
+                entry->numVertices[data->format] - data->baseVertex)
+        {
+            return 0;
+        }
+
+        for (j = 0; j < 3*data->numFaces; j++)
+        {
+            if (entry->indices[data->firstIndex + j] >= data->numVertices)
+            {
+                return 0;
+            }
+        }
+    }
+
+    if (!entry->numDrawRecords ||
+        entry->drawList[0].numDescendants != entry->numDrawRecords - 1)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < entry->numDrawRecords; i++)
+    {
+        record = &entry->drawList[i];
+
+        if (record->numDescendants > entry->numDrawRecords - i - 1 ||
+            record->data < -1 ||
+            record->data >= (int)entry->numData)
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+** Sets the mtllib and the material names of entry to the strings of a cached
+** file. Returns 0 if they do not match numMaterials or if it runs out of
+** memory.
+*/
+static int ReadStrings(
+    const char* strings,
+    uint64_t size,
+    unsigned int numMaterials,
+    ObjRendererCacheEntry* entry
+)
+{
+    const char** names = NULL;
+    const char* end = strings + size;
+    unsigned int i = 0;
+
+    if (!size || end[-1] != '\0')
+    {
+        return 0;
+    }
+
+    names = malloc((numMaterials + 1)*sizeof(const char*));
+
+    if (!names)
+    {
+        return 0;
+    }
+
+    entry->mtlLib = *strings ? strings : NULL;
+    strings += strlen(strings) + 1;
+
+    for (i = 0; i < numMaterials && strings < end; i++)
+    {
+        names[i] = strings;
+        strings += strlen(strings) + 1;
+    }
+
+    entry->materialNames = names;
+    entry->numMaterials = numMaterials;
+
+    return i == numMaterials && strings == end;
+}
+
+int ObjRendererCacheLoad(
+    ObjRendererCache* cache,
+    const ObjRendererCacheKey* key,
+    ObjRendererCacheEntry* entry
+)
+{
+    char path[MAX_PATH_LENGTH];
+    const CacheHeader* header = NULL;
+    CacheLayout layout;
+    const char* mapping = NULL;
+    size_t size = 0;
+    int i = 0;
+
+    memset(entry, 0, sizeof(ObjRendererCacheEntry));
+    if (!GetPath(cache, key, "", path))
+    {
+        return 0;
+    }
+
+    mapping = ObjRendererFileMap(path, &size);
+
+    if (!mapping)
+    {
+        return 0;
+    }
+
+    header = (const CacheHeader*)mapping;
+
+    /* the hash names the file, but it may collide or the file may belong to
+    ** an other version
+    */
+    if (size < sizeof(CacheHeader) ||
+        memcmp(header->magic, MAGIC, sizeof(header->magic)) ||
+        header->version != OBJ_RENDERER_CACHE_VERSION ||
+        header->headerSize != sizeof(CacheHeader) ||
+        header->sourceHash != key->hash ||
+        header->sourceSize != key->size)
+    {
+        ObjRendererFileUnmap(mapping, size);
+        return 0;
+    }
+
+    ComputeLayout(header, &layout);
+
+    if (layout.size != size)
+    {
+        ERR_MSG("Cached file has the wrong size, removing it");
+        ObjRendererFileUnmap(mapping, size);
+        remove(path);
+        return 0;
+    }
+
+    entry->data = (const ObjRendererData*)&mapping[layout.data];
+    entry->drawList = (const ObjRendererDrawRecord*)&mapping[layout.drawList];
+    entry->indices = (const GLuint*)&mapping[layout.indices];
+    entry->numData = header->numData;
+    entry->numDrawRecords = header->numDrawRecords;
+    entry->numIndices = header->numIndices;
+    entry->stats = header->stats;
+    entry->mapping = mapping;
+    entry->mappingSize = size;
+
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        entry->vertices[i] = (const float*)&mapping[layout.vertices[i]];
+        entry->numVertices[i] = header->numVertices[i];
+    }
+
+    if (!ReadStrings(
+            &mapping[layout.strings], 
+            header->stringsSize, 
+            header->numMaterials, 
+            entry
+        ) ||
+        !ValidateEntry(entry))
+    {
+        ERR_MSG("Cached file is broken, removing it");
+        ObjRendererCacheRelease(entry);
+        remove(path);
+        return 0;
+    }
+
+#ifndef _WIN32
+    /* the modification time orders the files for eviction */
+    utime(path, NULL);
+#endif
+
+    return 1;
+}
+
+void ObjRendererCacheRelease(ObjRendererCacheEntry* entry)
+{
+    if (entry->mapping)
+    {
+        ObjRendererFileUnmap(entry->mapping, entry->mappingSize);
+    }
+
+    free((void*)entry->materialNames);
+
+    memset(entry, 0, sizeof(ObjRendererCacheEntry));
+}
+
+/*
+** Writes size bytes of data to f, padded to ALIGNMENT. Returns 0 if it
+** fails.
+*/
+static int WriteSection(FILE* f, const void* data, uint64_t size)
+{
+    static const char padding[ALIGNMENT];
+
+    if (size && fwrite(data, 1, size, f) != size)
+    {
+        return 0;
+    }
+
+    size = ALIGN(size) - size;
+
+    return !size || fwrite(padding, 1, size, f) == size;
+}
+
+/*
+** Writes the strings section of entry, size is its unpadded size. Returns 0
+** if it fails.
+*/
+static int WriteStrings(FILE* f, const ObjRendererCacheEntry* entry, uint64_t size)
+{
+    static const char padding[ALIGNMENT];
+    const char* mtlLib = entry->mtlLib ? entry->mtlLib : "";
+    unsigned int i = 0;
+
+    if (fwrite(mtlLib, 1, strlen(mtlLib) + 1, f) != strlen(mtlLib) + 1)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < entry->numMaterials; i++)
+    {
+        if (fwrite(
+                entry->materialNames[i], 
+                1, 
+                strlen(entry->materialNames[i]) + 1, 
+                f
+            ) != strlen(entry->materialNames[i]) + 1)
+        {
+            return 0;
+        }
+    }
+
+    size = ALIGN(size) - size;
+
+    return !size || fwrite(padding, 1, size, f) == size;
+}
+
+#ifndef _WIN32
+/*
+** A cached file found when trimming the cache.
+*/
+typedef struct
+{
+    char name[256];
+    off_t size;
+    time_t time;
+}
+CacheFile;
+
+static int CompareCacheFiles(const void* a, const void* b)
+{
+    const CacheFile* fa = (const CacheFile*)a;
+    const CacheFile* fb = (const CacheFile*)b;
+
+    return fa->time < fb->time ? -1 : (fa->time > fb->time);
+}
+#endif
+
+/*
+** Removes the least recently used files until the cache fits its size
+** limit.
+*/
+static void Trim(ObjRendererCache* cache)
+{
+#ifndef _WIN32
+    char path[MAX_PATH_LENGTH];
+    DIR* directory = opendir(cache->directory);
+    struct dirent* dirEntry = NULL;
+    struct stat info;
+    CacheFile* files = NULL;
+    CacheFile* newFiles = NULL;
+    unsigned int numFiles = 0;
+    unsigned int maxFiles = 0;
+    unsigned int i = 0;
+    uint64_t totalSize = 0;
+    size_t length = 0;
+
+    if (!directory)
+    {
+        return;
+    }
+
+    while ((dirEntry = readdir(directory)))
+    {
+        length = strlen(dirEntry->d_name);
+
+        if (length < strlen(EXTENSION) ||
+            length >= sizeof(files[0].name) ||
+            strcmp(&dirEntry->d_name[length - strlen(EXTENSION)], EXTENSION))
+        {
+            continue;
+        }
+
+        snprintf(path, MAX_PATH_LENGTH, "%s/%s", cache->directory, dirEntry->d_name);
+
+        if (stat(path, &info) == -1)
+        {
+            continue;
+        }
+
+        if (numFiles == maxFiles)
+        {
+            maxFiles = maxFiles ? 2*maxFiles : 64;
+            newFiles = realloc(files, maxFiles*sizeof(CacheFile));
+
+            if (!newFiles)
+            {
+                break;
+            }
+
+            files = newFiles;
+        }
+
+        strcpy(files[numFiles].name, dirEntry->d_name);
+        files[numFiles].size = info.st_size;
+        files[numFiles].time = info.st_mtime;
+        totalSize += info.st_size;
+        numFiles++;
+    }
+
+    closedir(directory);
+
+    if (totalSize > cache->maxSize)
+    {
+        qsort(files, numFiles, sizeof(CacheFile), CompareCacheFiles);
+
+        for (i = 0; i < numFiles && totalSize > cache->maxSize; i++)
+        {
+            snprintf(path, MAX_PATH_LENGTH, "%s/%s", cache->directory, files[i].name);
+
+            if (!remove(path))
+            {
+                totalSize -= files[i].size;
+            }
+        }
+    }
+
+    free(files);
+#endif
+}
+
+int ObjRendererCacheStore(
+    ObjRendererCache* cache,
+    const ObjRendererCacheKey* key,
+    const ObjRendererCacheEntry* entry
+)
+{
+    char path[MAX_PATH_LENGTH];
+    char tmpPath[MAX_PATH_LENGTH];
+    CacheHeader header;
+    CacheLayout layout;
+    FILE* f = NULL;
+    int success = 1;
+    int i = 0;
+
+    memset(&header, 0, sizeof(CacheHeader));
+    memcpy(header.magic, MAGIC, sizeof(header.magic));
+    header.version = OBJ_RENDERER_CACHE_VERSION;
+    header.headerSize = sizeof(CacheHeader);
+    header.sourceHash = key->hash;
+    header.sourceSize = key->size;
+    header.numData = entry->numData;
+    header.numDrawRecords = entry->numDrawRecords;
+    header.numIndices = entry->numIndices;
+    header.numMaterials = entry->numMaterials;
+    header.stringsSize = (entry->mtlLib ? strlen(entry->mtlLib) : 0) + 1;
+    header.stats = entry->stats;
+
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        header.numVertices[i] = entry->numVertices[i];
+    }
+
+    for (i = 0; i < (int)entry->numMaterials; i++)
+    {
+        header.stringsSize += strlen(entry->materialNames[i]) + 1;
+    }
+
+    ComputeLayout(&header, &layout);
+
+    if (layout.size > cache->maxSize)
+    {
+        return 0;
+    }
+
+    /* write to a temporary file first, so that other processes never see a
+    ** partial file
+    */
+    if (!GetPath(cache, key, "", path) || !GetPath(cache, key, ".tmp", tmpPath))
+    {
+        ERR_MSG("The path of the cached file is too long");
+        return 0;
+    }
+
+    f = fopen(tmpPath, "wb");
+
+    if (!f)
+    {
+        ERR_MSG("Failed to create the cached file");
+        return 0;
+    }
+
+    success =
+        WriteSection(f, &header, sizeof(CacheHeader)) &&
+        WriteSection(f, entry->data, entry->numData*sizeof(ObjRendererData)) &&
+        WriteSection(
+            f,
+            entry->drawList,
+            entry->numDrawRecords*sizeof(ObjRendererDrawRecord)
+        ) &&
+        WriteSection(f, entry->indices, entry->numIndices*sizeof(GLuint));
+
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS && success; i++)
+    {
+        success = WriteSection(
+                f,
+                entry->vertices[i],
+                (uint64_t)entry->numVertices[i]*
+                ObjRendererGetFormatSize(i)*sizeof(float)
+            );
+    }
+
+    success = success && WriteStrings(f, entry, header.stringsSize);
+
+    success = !fclose(f) && success;
+
+#ifdef _WIN32
+    remove(path);
+#endif
+
+    if (!success || rename(tmpPath, path))
+    {
+        ERR_MSG("Failed to write the cached file");
+        remove(tmpPath);
+        return 0;
+    }
+
+    Trim(cache);
+
+    return 1;
+}
+
+void ObjRendererCacheDestroy(ObjRendererCache** cache)
+{
+    assert(cache && *cache);
+    free((*cache)->directory);
+    free(*cache);
+    *cache = NULL;
+}
@@ -0,0 +1,123 @@
+#ifndef OBJRENDERERCACHE_H
+#define OBJRENDERERCACHE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#include "ObjRendererMesh.h"
+
+/*
+** A directory of converted .obj files. After a file is loaded the first time
+** the render data, the draw list and the vertices and indices of its mesh
+** are written to the directory in a binary layout that can be uploaded as it
+** is. Later loads map the cached file instead of parsing and converting the
+** .obj file again.
+**
+** The cached files are named by a hash of the contents of the source file
+** and OBJ_RENDERER_CACHE_VERSION, so changed sources are converted again.
+** Cached files are validated when they are loaded and removed if they are
+** broken. If the directory grows beyond its size limit the least recently
+** used files are removed.
+*/
+
+/*
+** Has to be increased whenever the conversion or the layout of the cached
+** files changes.
+*/
+#define OBJ_RENDERER_CACHE_VERSION 4
+
+typedef struct ObjRendererCache_
+{
+    char* directory;
+    size_t maxSize;         /* in bytes */
+}
+ObjRendererCache;
+
+/*
+** Identifies the contents of a source file.
+*/
+typedef struct
+{
+    uint64_t hash;
+    uint64_t size;
+}
+ObjRendererCacheKey;
+
+/*
+** The data of a mesh as it is stored in the cache. Loaded entries point into
+** the mapped cache file.
+*/
+typedef struct
+{
+    const ObjRendererData* data;
+    const ObjRendererDrawRecord* drawList;
+    const GLuint* indices;
+    const float* vertices[OBJ_RENDERER_NUM_FORMATS];
+    unsigned int numData;
+    unsigned int numDrawRecords;
+    unsigned int numIndices;
+    unsigned int numVertices[OBJ_RENDERER_NUM_FORMATS];
+    ObjRendererMeshStats stats;
+
+    /* the "mtllib" and the material names of the source file, the materials
+    ** themselves are read from the .mtl file when the mesh is loaded
+    */
+    const char* mtlLib;                 /* NULL if there is none */
+    const char* const* materialNames;
+    unsigned int numMaterials;
+
+    /* the mapped file of a loaded entry */
+    const char* mapping;
+    size_t mappingSize;
+}
+ObjRendererCacheEntry;
+
+/*
+** Creates a cache in directory, the directory is created if it does not
+** exist. maxSize is the size limit in bytes. Returns NULL if it fails.
+*/
+ObjRendererCache* ObjRendererCacheCreate(const char* directory, size_t maxSize);
+
+/*
+** Hashes the contents of the file filename. Returns 0 if it can not be read.
+*/
+int ObjRendererCacheComputeKey(const char* filename, ObjRendererCacheKey* key);
+
+/*
+** Maps the cached entry for key. Returns 0 if there is none or if it is
+** invalid. A loaded entry has to be released with ObjRendererCacheRelease.
+*/
+int ObjRendererCacheLoad(
+    ObjRendererCache* cache,
+    const ObjRendererCacheKey* key,
+    ObjRendererCacheEntry* entry
+);
+
+/*
+** Unmaps a loaded entry and releases its material names.
+*/
+void ObjRendererCacheRelease(ObjRendererCacheEntry* entry);
+
+/*
+** Writes entry to the cache and removes the least recently used entries if
+** the cache exceeds its size limit afterwards. Returns 0 if it fails.
+*/
+int ObjRendererCacheStore(
+    ObjRendererCache* cache,
+    const ObjRendererCacheKey* key,
+    const ObjRendererCacheEntry* entry
+);
+
+/*
+** Releases cache, the cached files are kept. Sets cache to NULL.
+*/
+void ObjRendererCacheDestroy(ObjRendererCache** cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERCACHE_H */
@@ -0,0 +1,1049 @@
+//
+//  ObjRendererChunks.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <memory.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <assert.h>
+#include "ObjRendererChunks.h"
+#include "ObjRendererFile.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define IS_SPACE(X) ((X) == ' ' || (X) == '\t' || (X) == '\r')
+
+#define MAX_LINE_LENGTH 4096
+#define MAX_PATH_LENGTH 1024
+
+/* faces buffered in memory before the cells are flushed to their files */
+#define MAX_BUFFERED_FACES (1 << 21)
+
+/*
+** A triangle of the source file. Indices are 0 based, -1 if the corner has
+** no tex coord or normal.
+*/
+typedef struct
+{
+    int32_t matIdx;
+    int32_t p[3];
+    int32_t tc[3];
+    int32_t n[3];
+}
+ChunkFace;
+
+typedef struct
+{
+    ChunkFace* faces;           /* buffered faces */
+    unsigned int numFaces;
+    unsigned int maxFaces;
+    unsigned int numStored;     /* faces in the temporary file of the cell */
+}
+Cell;
+
+typedef struct
+{
+    const char* directory;
+
+    FxsVector3* positions;
+    FxsVector3* normals;
+    FxsVector2* texCoords;
+    unsigned int numPositions;
+    unsigned int numNormals;
+    unsigned int numTexCoords;
+    unsigned int maxPositions;
+    unsigned int maxNormals;
+    unsigned int maxTexCoords;
+    ObjRendererBoundingBox boundingBox;
+
+    char** materialNames;
+    unsigned int numMaterials;
+    char* mtlLib;               /* absolute path, NULL if there is none */
+
+    Cell* cells;
+    unsigned int dims[3];
+    float cellSize;
+    unsigned int numBuffered;
+}
+Splitter;
+
+/*
+** Grows the array at pointer (elements of size bytes) so that it holds at
+** least count + 1 elements. Returns 0 if it fails.
+*/
+static int Reserve(void** pointer, unsigned int* max, unsigned int count, size_t size)
+{
+    unsigned int newMax = *max ? 2*(*max) : 1024;
+    void* data = NULL;
+
+    if (count < *max)
+    {
+        return 1;
+    }
+
+    data = realloc(*pointer, newMax*size);
+
+    if (!data)
+    {
+        return 0;
+    }
+
+    *pointer = data;
+    *max = newMax;
+
+    return 1;
+}
+
+/*
+** Copies the line starting at p into line, zero terminated and without the
+** line break. Returns the start of the next line.
+*/
+static const char* ReadLine(const char* p, const char* end, char* line)
+{
+    const char* lineEnd = memchr(p, '\n', end - p);
+    size_t length = 0;
+
+    lineEnd = lineEnd ? lineEnd : end;
+    length = lineEnd - p;
+
+    /* overlong lines are cut, they are neither vertices nor sane faces */
+    if (length >= MAX_LINE_LENGTH)
+    {
+        length = MAX_LINE_LENGTH - 1;
+    }
+
+    memcpy(line, p, length);
+    line[length] = '\0';
+
+    while (length && IS_SPACE(line[length - 1]))
+    {
+        line[--length] = '\0';
+    }
+
+    return lineEnd < end ? lineEnd + 1 : end;
+}
+
+/*
+** Returns the argument of the statement keyword in line, NULL if line is no
+** such statement.
+*/
+static const char* GetArgument(const char* line, const char* keyword)
+{
+    size_t length = strlen(keyword);
+
+    while (IS_SPACE(*line))
+    {
+        line++;
+    }
+
+    if (strncmp(line, keyword, length) || !IS_SPACE(line[length]))
+    {
+        return NULL;
+    }
+
+    line += length;
+
+    while (IS_SPACE(*line))
+    {
+        line++;
+    }
+
+    return line;
+}
+
+/*
+** Reads the vertex attributes, the bounding box and the material library.
+*/
+static int ReadVertices(
+    Splitter* splitter,
+    const char* filename,
+    const char* data,
+    size_t size
+)
+{
+    char line[MAX_LINE_LENGTH];
+    const char* p = data;
+    const char* end = data + size;
+    const char* argument = NULL;
+    FxsVector3* v = NULL;
+    FxsVector2* t = NULL;
+    char* path = NULL;
+    ObjRendererBoundingBox* box = &splitter->boundingBox;
+
+    box->min.x = box->min.y = box->min.z = FLT_MAX;
+    box->max.x = box->max.y = box->max.z = -FLT_MAX;
+
+    while (p < end)
+    {
+        p = ReadLine(p, end, line);
+
+        if ((argument = GetArgument(line, "v")))
+        {
+            if (!Reserve((void**)&splitter->positions, &splitter->maxPositions,
+                splitter->numPositions, sizeof(FxsVector3)))
+            {
+                return 0;
+            }
+
+            v = &splitter->positions[splitter->numPositions++];
+            memset(v, 0, sizeof(FxsVector3));
+            sscanf(argument, "%f %f %f", &v->x, &v->y, &v->z);
+            box->min.x = fminf(box->min.x, v->x);
+            box->min.y = fminf(box->min.y, v->y);
+            box->min.z = fminf(box->min.z, v->z);
+            box->max.x = fmaxf(box->max.x, v->x);
+            box->max.y = fmaxf(box->max.y, v->y);
+            box->max.z = fmaxf(box->max.z, v->z);
+        }
+        else if ((argument = GetArgument(line, "vn")))
+        {
+            if (!Reserve((void**)&splitter->normals, &splitter->maxNormals,
+                splitter->numNormals, sizeof(FxsVector3)))
+            {
+                return 0;
+            }
+
+            v = &splitter->normals[splitter->numNormals++];
+            memset(v, 0, sizeof(FxsVector3));
+            sscanf(argument, "%f %f %f", &v->x, &v->y, &v->z);
+        }
+        else if ((argument = GetArgument(line, "vt")))
+        {
+            if (!Reserve((void**)&splitter->texCoords, &splitter->maxTexCoords,
+                splitter->numTexCoords, sizeof(FxsVector2)))
+            {
+                return 0;
+            }
+
+            t = &splitter->texCoords[splitter->numTexCoords++];
+            memset(t, 0, sizeof(FxsVector2));
+            sscanf(argument, "%f %f", &t->x, &t->y);
+        }
+        else if (!splitter->mtlLib && (argument = GetArgument(line, "mtllib")))
+        {
+            /* the chunks are written to an other directory */
+            path = ObjRendererFileJoinPath(filename, argument);
+
+            if (!path)
+            {
+                return 0;
+            }
+
+#ifdef _WIN32
+            splitter->mtlLib = _fullpath(NULL, path, 0);
+#else
+            splitter->mtlLib = realpath(path, NULL);
+#endif
+            splitter->mtlLib = splitter->mtlLib ? splitter->mtlLib : path;
+
+            if (splitter->mtlLib != path)
+            {
+                free(path);
+            }
+        }
+    }
+
+    return splitter->numPositions > 0;
+}
+
+static int FindMaterial(Splitter* splitter, const char* name)
+{
+    char** names = NULL;
+    unsigned int i = 0;
+
+    for (i = 0; i < splitter->numMaterials; i++)
+    {
+        if (!strcmp(splitter->materialNames[i], name))
+        {
+            return (int)i;
+        }
+    }
+
+    names = realloc(
+            splitter->materialNames,
+            (splitter->numMaterials + 1)*sizeof(char*)
+        );
+
+    if (!names)
+    {
+        return -2;
+    }
+
+    splitter->materialNames = names;
+    names[splitter->numMaterials] = strdup(name);
+
+    if (!names[splitter->numMaterials])
+    {
+        return -2;
+    }
+
+    return (int)splitter->numMaterials++;
+}
+
+static void GetCellPath(const Splitter* splitter, unsigned int cell, char* path)
+{
+    snprintf(path, MAX_PATH_LENGTH, "%s/cell%u.tmp", splitter->directory, cell);
+}
+
+/*
+** Appends the buffered faces of all cells to their temporary files.
+*/
+static int FlushCells(Splitter* splitter)
+{
+    char path[MAX_PATH_LENGTH];
+    unsigned int numCells = splitter->dims[0]*splitter->dims[1]*splitter->dims[2];
+    Cell* cell = NULL;
+    FILE* f = NULL;
+    unsigned int i = 0;
+    int success = 0;
+
+    for (i = 0; i < numCells; i++)
+    {
+        cell = &splitter->cells[i];
+
+        if (!cell->numFaces)
+        {
+            continue;
+        }
+
+        GetCellPath(splitter, i, path);
+        f = fopen(path, "ab");
+        success = f &&
+            fwrite(cell->faces, sizeof(ChunkFace), cell->numFaces, f) == cell->numFaces;
+
+        if (f)
+        {
+            success = !fclose(f) && success;
+        }
+
+        if (!success)
+        {
+            ERR_MSG("Failed to write the faces of a chunk");
+            return 0;
+        }
+
+        cell->numStored += cell->numFaces;
+        cell->numFaces = 0;
+        cell->maxFaces = 0;
+        free(cell->faces);
+        cell->faces = NULL;
+    }
+
+    splitter->numBuffered = 0;
+
+    return 1;
+}
+
+/*
+** Gets the cell that contains the centroid of face.
+*/
+static unsigned int GetCell(const Splitter* splitter, const ChunkFace* face)
+{
+    const ObjRendererBoundingBox* box = &splitter->boundingBox;
+    const FxsVector3* p[3];
+    float c[3];
+    int xyz[3];
+    int i = 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        p[i] = &splitter->positions[face->p[i]];
+    }
+
+    c[0] = (p[0]->x + p[1]->x + p[2]->x)/3.0f - box->min.x;
+    c[1] = (p[0]->y + p[1]->y + p[2]->y)/3.0f - box->min.y;
+    c[2] = (p[0]->z + p[1]->z + p[2]->z)/3.0f - box->min.z;
+
+    for (i = 0; i < 3; i++)
+    {
+        xyz[i] = (int)(c[i]/splitter->cellSize);
+        xyz[i] = xyz[i] < 0 ? 0 : xyz[i];
+        xyz[i] = xyz[i] >= (int)splitter->dims[i] ? (int)splitter->dims[i] - 1 : xyz[i];
+    }
+
+    return (xyz[2]*splitter->dims[1] + xyz[1])*splitter->dims[0] + xyz[0];
+}
+
+static int AddFace(Splitter* splitter, const ChunkFace* face)
+{
+    Cell* cell = &splitter->cells[GetCell(splitter, face)];
+
+    if (!Reserve((void**)&cell->faces, &cell->maxFaces, cell->numFaces, sizeof(ChunkFace)))
+    {
+        return 0;
+    }
+
+    cell->faces[cell->numFaces++] = *face;
+
+    if (++splitter->numBuffered == MAX_BUFFERED_FACES)
+    {
+        return FlushCells(splitter);
+    }
+
+    return 1;
+}
+
+/*
+** Resolves a 1 based or negative (relative to the count of elements read so
+** far) .obj index. Returns -2 if it is not valid.
+*/
+static int32_t ResolveIndex(long index, unsigned int numRead)
+{
+    if (index > 0 && index <= (long)numRead)
+    {
+        return (int32_t)(index - 1);
+    }
+
+    if (index < 0 && -index <= (long)numRead)
+    {
+        return (int32_t)(numRead + index);
+    }
+
+    return -2;
+}
+
+/*
+** Parses the corners of a face statement and adds it as a fan of triangles.
+** numRead are the # of positions, tex coords and normals before the face.
+*/
+static int ParseFace(
+    Splitter* splitter,
+    const char* argument,
+    int matIdx,
+    const unsigned int* numRead
+)
+{
+    ChunkFace face;
+    int32_t corners[3][3];      /* p, tc, n of the first, the last and the
+                                ** current corner */
+    char* next = NULL;
+    long index = 0;
+    unsigned int numCorners = 0;
+    int i = 0;
+
+    face.matIdx = matIdx;
+
+    while (*argument)
+    {
+        int32_t* corner = corners[numCorners < 2 ? numCorners : 2];
+
+        corner[1] = corner[2] = -1;
+        index = strtol(argument, &next, 10);
+
+        if (next == argument)
+        {
+            return 0;
+        }
+
+        corner[0] = ResolveIndex(index, numRead[0]);
+        argument = next;
+
+        for (i = 1; i < 3 && *argument == '/'; i++)
+        {
+            argument++;
+
+            if (*argument == '/' || IS_SPACE(*argument) || !*argument)
+            {
+                continue;
+            }
+
+            index = strtol(argument, &next, 10);
+
+            if (next == argument)
+            {
+                return 0;
+            }
+
+            corner[i] = ResolveIndex(index, numRead[i]);
+            argument = next;
+        }
+
+        if (corner[0] == -2 || corner[1] == -2 || corner[2] == -2)
+        {
+            return 0;
+        }
+
+        while (IS_SPACE(*argument))
+        {
+            argument++;
+        }
+
+        if (++numCorners < 3)
+        {
+            continue;
+        }
+
+        for (i = 0; i < 3; i++)
+        {
+            face.p[i] = corners[i][0];
+            face.tc[i] = corners[i][1];
+            face.n[i] = corners[i][2];
+        }
+
+        if (!AddFace(splitter, &face))
+        {
+            return 0;
+        }
+
+        /* the next triangle of the fan starts at the current corner */
+        memcpy(corners[1], corners[2], sizeof(corners[1]));
+    }
+
+    return 1;
+}
+
+/*
+** Sorts the faces into the cells.
+*/
+static int ReadFaces(Splitter* splitter, const char* data, size_t size)
+{
+    char line[MAX_LINE_LENGTH];
+    const char* p = data;
+    const char* end = data + size;
+    const char* argument = NULL;
+    unsigned int numRead[3] = {0, 0, 0};    /* positions, tex coords, normals */
+    int matIdx = -1;
+
+    while (p < end)
+    {
+        p = ReadLine(p, end, line);
+
+        if (GetArgument(line, "v"))
+        {
+            numRead[0]++;
+        }
+        else if (GetArgument(line, "vt"))
+        {
+            numRead[1]++;
+        }
+        else if (GetArgument(line, "vn"))
+        {
+            numRead[2]++;
+        }
+        else if ((argument = GetArgument(line, "usemtl")))
+        {
+            matIdx = FindMaterial(splitter, argument);
+
+            if (matIdx == -2)
+            {
+                return 0;
+            }
+        }
+        else if ((argument = GetArgument(line, "f")))
+        {
+            if (!ParseFace(splitter, argument, matIdx, numRead))
+            {
+                ERR_MSG("Invalid face");
+                printf("\t%s\n", line);
+                return 0;
+            }
+        }
+    }
+
+    return FlushCells(splitter);
+}
+
+/*
+** Writes the corner of a face in .obj syntax.
+*/
+static void WriteCorner(FILE* f, int32_t p, int32_t tc, int32_t n)
+{
+    if (tc < 0 && n < 0)
+    {
+        fprintf(f, " %d", p + 1);
+    }
+    else if (n < 0)
+    {
+        fprintf(f, " %d/%d", p + 1, tc + 1);
+    }
+    else if (tc < 0)
+    {
+        fprintf(f, " %d//%d", p + 1, n + 1);
+    }
+    else
+    {
+        fprintf(f, " %d/%d/%d", p + 1, tc + 1, n + 1);
+    }
+}
+
+/*
+** Replaces the indices of the attribute of faces (offset of the index in
+** ChunkFace) with indices local to the chunk. remap is -1 for all elements
+** of the file. Returns the # of used elements, used gets their source
+** indices.
+*/
+static unsigned int RemapIndices(
+    ChunkFace* faces,
+    unsigned int numFaces,
+    size_t offset,
+    int32_t* remap,
+    int32_t* used
+)
+{
+    unsigned int numUsed = 0;
+    int32_t* indices = NULL;
+    unsigned int i = 0;
+    int j = 0;
+
+    for (i = 0; i < numFaces; i++)
+    {
+        indices = (int32_t*)((char*)&faces[i] + offset);
+
+        for (j = 0; j < 3; j++)
+        {
+            if (indices[j] < 0)
+            {
+                continue;
+            }
+
+            if (remap[indices[j]] == -1)
+            {
+                remap[indices[j]] = (int32_t)numUsed;
+                used[numUsed++] = indices[j];
+            }
+
+            indices[j] = remap[indices[j]];
+        }
+    }
+
+    /* reset remap for the next chunk */
+    for (i = 0; i < numUsed; i++)
+    {
+        remap[used[i]] = -1;
+    }
+
+    return numUsed;
+}
+
+/*
+** Writes the faces of cell as .obj file and adds it to the manifest.
+*/
+static int WriteChunk(
+    Splitter* splitter,
+    unsigned int cellIdx,
+    int32_t** remap,
+    FILE* manifest
+)
+{
+    char path[MAX_PATH_LENGTH];
+    char name[64];
+    Cell* cell = &splitter->cells[cellIdx];
+    unsigned int numFaces = cell->numStored;
+    ChunkFace* faces = malloc(numFaces*sizeof(ChunkFace));
+    int32_t* used = malloc(3*numFaces*sizeof(int32_t));
+    unsigned int numUsed[3];
+    ObjRendererBoundingBox box;
+    const FxsVector3* v = NULL;
+    FILE* f = NULL;
+    int matIdx = -1;
+    int hasNormals = 1;
+    int hasTexCoords = 1;
+    unsigned int vertexSize = 3;
+    unsigned int i = 0;
+    int j = 0;
+    int success = 0;
+
+    if (!faces || !used)
+    {
+        free(faces);
+        free(used);
+        return 0;
+    }
+
+    /* all faces are in the temporary file once ReadFaces is done */
+    GetCellPath(splitter, cellIdx, path);
+    f = fopen(path, "rb");
+
+    if (!f || fread(faces, sizeof(ChunkFace), cell->numStored, f) != cell->numStored)
+    {
+        ERR_MSG("Failed to read the faces of a chunk");
+
+        if (f)
+        {
+            fclose(f);
+        }
+
+        free(faces);
+        free(used);
+        return 0;
+    }
+
+    fclose(f);
+    remove(path);
+
+    for (i = 0; i < numFaces; i++)
+    {
+        hasTexCoords = hasTexCoords && faces[i].tc[0] >= 0;
+        hasNormals = hasNormals && faces[i].n[0] >= 0;
+    }
+
+    snprintf(name, sizeof(name), "chunk%u.obj", cellIdx);
+    snprintf(path, MAX_PATH_LENGTH, "%s/%s", splitter->directory, name);
+    f = fopen(path, "w");
+
+    if (!f)
+    {
+        ERR_MSG("Failed to create a chunk");
+        free(faces);
+        free(used);
+        return 0;
+    }
+
+    if (splitter->mtlLib)
+    {
+        fprintf(f, "mtllib %s\n", splitter->mtlLib);
+    }
+
+    box.min.x = box.min.y = box.min.z = FLT_MAX;
+    box.max.x = box.max.y = box.max.z = -FLT_MAX;
+    numUsed[0] = RemapIndices(faces, numFaces, offsetof(ChunkFace, p), remap[0], used);
+
+    for (i = 0; i < numUsed[0]; i++)
+    {
+        v = &splitter->positions[used[i]];
+        fprintf(f, "v %.9g %.9g %.9g\n", v->x, v->y, v->z);
+        box.min.x = fminf(box.min.x, v->x);
+        box.min.y = fminf(box.min.y, v->y);
+        box.min.z = fminf(box.min.z, v->z);
+        box.max.x = fmaxf(box.max.x, v->x);
+        box.max.y = fmaxf(box.max.y, v->y);
+        box.max.z = fmaxf(box.max.z, v->z);
+    }
+
+    numUsed[1] = RemapIndices(faces, numFaces, offsetof(ChunkFace, tc), remap[1], used);
+
+    for (i = 0; i < numUsed[1]; i++)
+    {
+        fprintf(
+            f,
+            "vt %.9g %.9g\n",
+            splitter->texCoords[used[i]].x,
+            splitter->texCoords[used[i]].y
+        );
+    }
+
+    numUsed[2] = RemapIndices(faces, numFaces, offsetof(ChunkFace, n), remap[2], used);
+
+    for (i = 0; i < numUsed[2]; i++)
+    {
+        v = &splitter->normals[used[i]];
+        fprintf(f, "vn %.9g %.9g %.9g\n", v->x, v->y, v->z);
+    }
+
+    fprintf(f, "g chunk%u\n", cellIdx);
+
+    for (i = 0; i < numFaces; i++)
+    {
+        if (faces[i].matIdx != matIdx && faces[i].matIdx >= 0)
+        {
+            fprintf(f, "usemtl %s\n", splitter->materialNames[faces[i].matIdx]);
+        }
+
+        matIdx = faces[i].matIdx;
+        fputc('f', f);
+
+        for (j = 0; j < 3; j++)
+        {
+            WriteCorner(f, faces[i].p[j], faces[i].tc[j], faces[i].n[j]);
+        }
+
+        fputc('\n', f);
+    }
+
+    success = !ferror(f);
+    success = !fclose(f) && success;
+
+    /* the size after indexing is not known yet, it is estimated with the
+    ** positions as vertices
+    */
+    vertexSize += hasNormals ? 3 : 0;
+    vertexSize += hasTexCoords ? 2 : 0;
+    fprintf(
+        manifest,
+        "chunk %s %.9g %.9g %.9g %.9g %.9g %.9g %u %lu\n",
+        name,
+        box.min.x, box.min.y, box.min.z,
+        box.max.x, box.max.y, box.max.z,
+        numFaces,
+        (unsigned long)(numUsed[0]*vertexSize*sizeof(float) + 3*numFaces*sizeof(GLuint))
+    );
+
+    free(faces);
+    free(used);
+
+    if (!success)
+    {
+        ERR_MSG("Failed to write a chunk");
+    }
+
+    return success;
+}
+
+/*
+** Writes a chunk for each cell with faces and the manifest.
+*/
+static int WriteChunks(Splitter* splitter)
+{
+    char path[MAX_PATH_LENGTH];
+    unsigned int numCells = splitter->dims[0]*splitter->dims[1]*splitter->dims[2];
+    int32_t* remap[3] = {NULL, NULL, NULL};
+    unsigned int counts[3];
+    FILE* manifest = NULL;
+    unsigned int i = 0;
+    int success = 1;
+
+    counts[0] = splitter->numPositions;
+    counts[1] = splitter->numTexCoords;
+    counts[2] = splitter->numNormals;
+
+    for (i = 0; i < 3; i++)
+    {
+        remap[i] = malloc((counts[i] + 1)*sizeof(int32_t));
+        success = success && remap[i];
+
+        if (remap[i])
+        {
+            memset(remap[i], 0xFF, (counts[i] + 1)*sizeof(int32_t));
+        }
+    }
+
+    snprintf(path, MAX_PATH_LENGTH, "%s/%s", splitter->directory, OBJ_RENDERER_CHUNKS_MANIFEST);
+    manifest = success ? fopen(path, "w") : NULL;
+
+    if (manifest)
+    {
+        for (i = 0; i < numCells && success; i++)
+        {
+            if (splitter->cells[i].numStored)
+            {
+                success = WriteChunk(splitter, i, remap, manifest);
+            }
+        }
+
+        success = !fclose(manifest) && success;
+    }
+    else
+    {
+        success = 0;
+    }
+
+    for (i = 0; i < 3; i++)
+    {
+        free(remap[i]);
+    }
+
+    return success;
+}
+
+/*
+** Sets up the grid of cubes over the bounding box.
+*/
+static int CreateCells(Splitter* splitter, unsigned int gridSize)
+{
+    const ObjRendererBoundingBox* box = &splitter->boundingBox;
+    float extent[3];
+    float maxExtent = 0.0f;
+    int i = 0;
+
+    extent[0] = box->max.x - box->min.x;
+    extent[1] = box->max.y - box->min.y;
+    extent[2] = box->max.z - box->min.z;
+    maxExtent = fmaxf(extent[0], fmaxf(extent[1], extent[2]));
+    gridSize = gridSize < 1 ? 1 : gridSize;
+    gridSize = gridSize > OBJ_RENDERER_CHUNKS_MAX_GRID_SIZE ?
+        OBJ_RENDERER_CHUNKS_MAX_GRID_SIZE : gridSize;
+    splitter->cellSize = maxExtent > 0.0f ? maxExtent/gridSize : 1.0f;
+
+    for (i = 0; i < 3; i++)
+    {
+        splitter->dims[i] = (unsigned int)ceilf(extent[i]/splitter->cellSize);
+        splitter->dims[i] = splitter->dims[i] < 1 ? 1 : splitter->dims[i];
+        splitter->dims[i] = splitter->dims[i] > gridSize ? gridSize : splitter->dims[i];
+    }
+
+    splitter->cells = calloc(
+            splitter->dims[0]*splitter->dims[1]*splitter->dims[2],
+            sizeof(Cell)
+        );
+
+    return splitter->cells != NULL;
+}
+
+static void SplitterRelease(Splitter* splitter)
+{
+    char path[MAX_PATH_LENGTH];
+    unsigned int numCells = splitter->dims[0]*splitter->dims[1]*splitter->dims[2];
+    unsigned int i = 0;
+
+    for (i = 0; i < splitter->numMaterials; i++)
+    {
+        free(splitter->materialNames[i]);
+    }
+
+    /* temporary files are left if splitting failed */
+    for (i = 0; splitter->cells && i < numCells; i++)
+    {
+        if (splitter->cells[i].numStored)
+        {
+            GetCellPath(splitter, i, path);
+            remove(path);
+        }
+
+        free(splitter->cells[i].faces);
+    }
+
+    free(splitter->cells);
+    free(splitter->materialNames);
+    free(splitter->mtlLib);
+    free(splitter->positions);
+    free(splitter->normals);
+    free(splitter->texCoords);
+}
+
+int ObjRendererChunksSplit(
+    const char* filename,
+    const char* directory,
+    unsigned int gridSize
+)
+{
+    Splitter splitter;
+    size_t size = 0;
+    const char* data = ObjRendererFileMap(filename, &size);
+    int success = 0;
+
+    if (!data)
+    {
+        return 0;
+    }
+
+    memset(&splitter, 0, sizeof(Splitter));
+    splitter.directory = directory;
+
+    /* the faces can refer to vertices that follow them, so the vertices are
+    ** read in a pass of their own
+    */
+    success =
+        ReadVertices(&splitter, filename, data, size) &&
+        CreateCells(&splitter, gridSize) &&
+        ReadFaces(&splitter, data, size) &&
+        WriteChunks(&splitter);
+
+    ObjRendererFileUnmap(data, size);
+
+    if (!success)
+    {
+        ERR_MSG("Failed to split the file into chunks");
+    }
+
+    SplitterRelease(&splitter);
+
+    return success;
+}
+
+ObjRendererChunkList* ObjRendererChunkListCreateWithFile(const char* manifest)
+{
+    char line[MAX_LINE_LENGTH];
+    char name[MAX_PATH_LENGTH];
+    ObjRendererChunkList* list = NULL;
+    ObjRendererChunk* chunks = NULL;
+    ObjRendererChunk* chunk = NULL;
+    unsigned int maxChunks = 0;
+    unsigned long size = 0;
+    FILE* f = fopen(manifest, "r");
+
+    if (!f)
+    {
+        return NULL;
+    }
+
+    list = calloc(1, sizeof(ObjRendererChunkList));
+
+    if (!list)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), f))
+    {
+        if (list->numChunks == maxChunks)
+        {
+            maxChunks = maxChunks ? 2*maxChunks : 64;
+            chunks = realloc(list->chunks, maxChunks*sizeof(ObjRendererChunk));
+
+            if (!chunks)
+            {
+                goto error;
+            }
+
+            list->chunks = chunks;
+        }
+
+        chunk = &list->chunks[list->numChunks];
+        memset(chunk, 0, sizeof(ObjRendererChunk));
+
+        if (sscanf(
+                line,
+                "chunk %1023s %f %f %f %f %f %f %u %lu",
+                name,
+                &chunk->boundingBox.min.x,
+                &chunk->boundingBox.min.y,
+                &chunk->boundingBox.min.z,
+                &chunk->boundingBox.max.x,
+                &chunk->boundingBox.max.y,
+                &chunk->boundingBox.max.z,
+                &chunk->numFaces,
+                &size
+            ) != 9)
+        {
+            continue;
+        }
+
+        chunk->size = size;
+        chunk->filename = ObjRendererFileJoinPath(manifest, name);
+
+        if (!chunk->filename)
+        {
+            goto error;
+        }
+
+        list->numChunks++;
+    }
+
+    fclose(f);
+
+    return list;
+
+error:
+
+    ERR_MSG("Out of memory");
+    fclose(f);
+    ObjRendererChunkListDestroy(&list);
+
+    return NULL;
+}
+
+void ObjRendererChunkListDestroy(ObjRendererChunkList** list)
+{
+    unsigned int i = 0;
+
+    assert(list && *list);
+
+    for (i = 0; i < (*list)->numChunks; i++)
+    {
+        free((*list)->chunks[i].filename);
+    }
+
+    free((*list)->chunks);
+    free(*list);
+    *list = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef OBJRENDERERCHUNKS_H
+#define OBJRENDERERCHUNKS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ObjRendererMesh.h"
+
+/*
+** Splits .obj files that are too large to be loaded as one mesh into chunks.
+** The faces are sorted into the cells of a grid of cubes over the bounding
+** box of the file by their centroid, each cell is written to a small .obj
+** file of its own. A manifest lists the chunks with their bounding boxes, so
+** they can be streamed in and out by the distance to the camera without
+** reading them first (see ObjRendererStream.h).
+**
+** Only the vertex attributes are kept in memory while splitting, the faces
+** are passed through temporary files in the output directory. Groups and
+** objects are not kept, each chunk is one group. The chunks refer to the
+** material library of the source file by its absolute path.
+*/
+
+#define OBJ_RENDERER_CHUNKS_MANIFEST "chunks.txt"
+#define OBJ_RENDERER_CHUNKS_MAX_GRID_SIZE 64
+
+typedef struct
+{
+    char* filename;                     /* .obj file of the chunk */
+    ObjRendererBoundingBox boundingBox;
+    unsigned int numFaces;
+    size_t size;                        /* estimated vertex and index bytes
+                                        ** of its mesh */
+}
+ObjRendererChunk;
+
+typedef struct
+{
+    ObjRendererChunk* chunks;
+    unsigned int numChunks;
+}
+ObjRendererChunkList;
+
+/*
+** Splits the .obj file filename into chunks. The longest side of its
+** bounding box is divided into gridSize cells (at most
+** OBJ_RENDERER_CHUNKS_MAX_GRID_SIZE). The chunks and the manifest
+** OBJ_RENDERER_CHUNKS_MANIFEST are written to directory, which has to exist.
+** Returns 0 if it fails.
+*/
+int ObjRendererChunksSplit(
+    const char* filename,
+    const char* directory,
+    unsigned int gridSize
+);
+
+/*
+** Reads the manifest written by ObjRendererChunksSplit. The filenames of the
+** chunks are resolved relative to the manifest. Returns NULL if it fails.
+*/
+ObjRendererChunkList* ObjRendererChunkListCreateWithFile(const char* manifest);
+
+/*
+** Releases list. Sets list to NULL.
+*/
+void ObjRendererChunkListDestroy(ObjRendererChunkList** list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERCHUNKS_H */
@@ -0,0 +1,1377 @@
+//
+//  ObjRendererFile.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ObjRendererFile.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/* chunks are at least MIN_CHUNK_SIZE bytes, and there are at most
+** CHUNKS_PER_THREAD chunks per thread to balance the load
+*/
+#define MIN_CHUNK_SIZE (1 << 20)
+#define CHUNKS_PER_THREAD 4
+
+#define IS_DIGIT(X) ((unsigned int)((X) - '0') < 10)
+#define IS_SPACE(X) ((X) == ' ' || (X) == '\t' || (X) == '\r')
+#define IS_SEPARATOR(X) ((X) == '/' || (X) == '\\')
+
+/******************************************************************************/
+/*
+** Statements that affect faces in other chunks. They are resolved in order
+** once all chunks are parsed.
+*/
+enum
+{
+    EVENT_OBJECT,
+    EVENT_GROUP,
+    EVENT_MATERIAL,
+    EVENT_MTLLIB,
+    EVENT_SMOOTHING
+};
+
+typedef struct
+{
+    int type;
+    unsigned int face;          /* # of faces in the chunk before the event */
+    const char* name;           /* points into the file */
+    unsigned int nameLength;
+    int matIdx;                 /* resolved material of EVENT_MATERIAL */
+    int smoothingGroup;         /* of EVENT_SMOOTHING */
+}
+Event;
+
+/*
+** A polygon corner as read from the file. 0 marks a missing index.
+*/
+typedef struct
+{
+    int p;
+    int tc;
+    int n;
+}
+Corner;
+
+/*
+** A line aligned part of the file and what was parsed from it. Face indices
+** are absolute, except for the ones listed in fixups: relative indices are
+** stored relative to the first vertex of the chunk.
+*/
+typedef struct
+{
+    const char* begin;
+    const char* end;
+
+    FxsVector3* positions;
+    FxsVector3* normals;
+    FxsVector2* texCoords;
+    ObjRendererFace* faces;
+    unsigned int* fixups;       /* 9*face + slot, see FaceIndex */
+    Event* events;
+    Corner* corners;            /* corners of the current polygon */
+
+    unsigned int numPositions, maxPositions;
+    unsigned int numNormals, maxNormals;
+    unsigned int numTexCoords, maxTexCoords;
+    unsigned int numFaces, maxFaces;
+    unsigned int numFixups, maxFixups;
+    unsigned int numEvents, maxEvents;
+    unsigned int maxCorners;
+
+    /* offsets of the chunk in the merged arrays */
+    unsigned int firstPosition;
+    unsigned int firstNormal;
+    unsigned int firstTexCoord;
+    unsigned int firstFace;
+    int matIdx;                 /* material at the start of the chunk */
+    int smoothingGroup;         /* smoothing group at the start of the chunk */
+
+    int failed;
+}
+Chunk;
+
+typedef struct
+{
+    ObjRendererFile* file;
+    Chunk* chunks;
+}
+MergeData;
+
+/******************************************************************************/
+/*
+** Makes room for at least needed elements of size bytes in array. Returns 0 if
+** it fails.
+*/
+static int Reserve(
+    void** array,
+    unsigned int* max,
+    unsigned int needed,
+    size_t size
+)
+{
+    unsigned int newMax = *max ? *max : 256;
+    void* newArray = NULL;
+
+    if (needed <= *max)
+    {
+        return 1;
+    }
+
+    while (newMax < needed)
+    {
+        newMax *= 2;
+    }
+
+    newArray = realloc(*array, newMax*size);
+
+    if (!newArray)
+    {
+        return 0;
+    }
+
+    *array = newArray;
+    *max = newMax;
+
+    return 1;
+}
+
+static int* FaceIndex(ObjRendererFace* face, unsigned int slot)
+{
+    switch (slot)
+    {
+        case 0: return &face->p0;
+        case 1: return &face->p1;
+        case 2: return &face->p2;
+        case 3: return &face->n0;
+        case 4: return &face->n1;
+        case 5: return &face->n2;
+        case 6: return &face->tc0;
+        case 7: return &face->tc1;
+        default: return &face->tc2;
+    }
+}
+
+/******************************************************************************/
+static const char* SkipLine(const char* p, const char* end)
+{
+    p = memchr(p, '\n', end - p);
+
+    return p ? p + 1 : end;
+}
+
+static const char* SkipSpace(const char* p, const char* end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+    {
+        p++;
+    }
+
+    return p;
+}
+
+/*
+** Falls back to strtod for what ParseFloat does not handle (inf, nan, hex).
+*/
+static int ParseFloatSlow(const char** cursor, const char* end, float* value)
+{
+    char buffer[64];
+    char* last = NULL;
+    size_t length = 0;
+    const char* p = *cursor;
+
+    while (p + length < end && length < sizeof(buffer) - 1 &&
+        !IS_SPACE(p[length]) && p[length] != '\n')
+    {
+        buffer[length] = p[length];
+        length++;
+    }
+
+    buffer[length] = '\0';
+    *value = (float)strtod(buffer, &last);
+
+    if (last == buffer)
+    {
+        return 0;
+    }
+
+    *cursor = p + (last - buffer);
+
+    return 1;
+}
+
+/*
+** Parses a decimal float at *cursor and advances the cursor. The digits are
+** accumulated in an integer and scaled by an exact power of ten once.
+** Returns 0 if there is no number.
+*/
+static int ParseFloat(const char** cursor, const char* end, float* value)
+{
+    static const double powers[] = {
+            1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+    const char* p = *cursor;
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int numDigits = 0;
+    int negative = 0;
+    int exponentValue = 0;
+    int exponentNegative = 0;
+    double result = 0.0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    for (; p < end && IS_DIGIT(*p); p++, numDigits++)
+    {
+        if (mantissa < 100000000000000000ULL)
+        {
+            mantissa = 10*mantissa + (*p - '0');
+        }
+        else
+        {
+            exponent++;
+        }
+    }
+
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && IS_DIGIT(*p); p++, numDigits++)
+        {
+            if (mantissa < 100000000000000000ULL)
+            {
+                mantissa = 10*mantissa + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+
+    if (!numDigits)
+    {
+        return ParseFloatSlow(cursor, end, value);
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        p++;
+
+        if (p < end && (*p == '-' || *p == '+'))
+        {
+            exponentNegative = *p == '-';
+            p++;
+        }
+
+        for (; p < end && IS_DIGIT(*p); p++)
+        {
+            if (exponentValue < 10000)
+            {
+                exponentValue = 10*exponentValue + (*p - '0');
+            }
+        }
+
+        exponent += exponentNegative ? -exponentValue : exponentValue;
+    }
+
+    result = (double)mantissa;
+
+    if (exponent < 0)
+    {
+        result = exponent >= -22 ? result/powers[-exponent] :
+            result*pow(10.0, exponent);
+    }
+    else if (exponent > 0)
+    {
+        result = exponent <= 22 ? result*powers[exponent] :
+            result*pow(10.0, exponent);
+    }
+
+    *value = (float)(negative ? -result : result);
+    *cursor = p;
+
+    return 1;
+}
+
+/*
+** Parses a (signed) decimal integer. Returns 0 if there is none.
+*/
+static int ParseInt(const char** cursor, const char* end, int* value)
+{
+    const char* p = *cursor;
+    int negative = 0;
+    int result = 0;
+
+    if (p < end && (*p == '-' || *p == '+'))
+    {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (p == end || !IS_DIGIT(*p))
+    {
+        return 0;
+    }
+
+    for (; p < end && IS_DIGIT(*p); p++)
+    {
+        result = 10*result + (*p - '0');
+    }
+
+    *value = negative ? -result : result;
+    *cursor = p;
+
+    return 1;
+}
+
+static int ParseFloats(
+    const char** cursor,
+    const char* end,
+    float* values,
+    int count
+)
+{
+    int i = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        *cursor = SkipSpace(*cursor, end);
+
+        if (!ParseFloat(cursor, end, &values[i]))
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/******************************************************************************/
+static int AddEvent(
+    Chunk* chunk,
+    int type,
+    const char* p,
+    const char* end
+)
+{
+    const char* nameEnd = memchr(p, '\n', end - p);
+    Event* event = NULL;
+
+    if (!nameEnd)
+    {
+        nameEnd = end;
+    }
+
+    p = SkipSpace(p, nameEnd);
+
+    while (nameEnd > p && IS_SPACE(nameEnd[-1]))
+    {
+        nameEnd--;
+    }
+
+    if (!Reserve((void**)&chunk->events, &chunk->maxEvents,
+            chunk->numEvents + 1, sizeof(Event)))
+    {
+        return 0;
+    }
+
+    event = &chunk->events[chunk->numEvents++];
+    event->type = type;
+    event->face = chunk->numFaces;
+    event->name = p;
+    event->nameLength = (unsigned int)(nameEnd - p);
+    event->matIdx = -1;
+    event->smoothingGroup = 0;
+
+    /* "s off" and "s 0" turn smoothing off */
+    if (type == EVENT_SMOOTHING)
+    {
+        ParseInt(&p, nameEnd, &event->smoothingGroup);
+    }
+
+    return 1;
+}
+
+/*
+** Converts an index as read from the file to a 0 based one. Negative indices
+** are relative to the vertices read so far, they are made relative to the
+** first vertex of the chunk and the slot is remembered for fixing them up.
+*/
+static int ResolveIndex(
+    Chunk* chunk,
+    int index,
+    unsigned int count,
+    unsigned int slot
+)
+{
+    if (index > 0)
+    {
+        return index - 1;
+    }
+
+    if (!Reserve((void**)&chunk->fixups, &chunk->maxFixups,
+            chunk->numFixups + 1, sizeof(unsigned int)))
+    {
+        chunk->failed = 1;
+        return 0;
+    }
+
+    chunk->fixups[chunk->numFixups++] = 9*chunk->numFaces + slot;
+
+    return (int)count + index;
+}
+
+/*
+** Parses the corners of an "f" statement and adds them as a triangle fan.
+*/
+static int ParseFace(Chunk* chunk, const char* p, const char* end)
+{
+    unsigned int numCorners = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    Corner* corner = NULL;
+    Corner* c[3];
+    ObjRendererFace* face = NULL;
+
+    while (1)
+    {
+        p = SkipSpace(p, end);
+
+        if (!Reserve((void**)&chunk->corners, &chunk->maxCorners,
+                numCorners + 1, sizeof(Corner)))
+        {
+            return 0;
+        }
+
+        corner = &chunk->corners[numCorners];
+        memset(corner, 0, sizeof(Corner));
+
+        if (!ParseInt(&p, end, &corner->p))
+        {
+            break;
+        }
+
+        if (p < end && *p == '/')
+        {
+            p++;
+            ParseInt(&p, end, &corner->tc);
+
+            if (p < end && *p == '/')
+            {
+                p++;
+                ParseInt(&p, end, &corner->n);
+            }
+        }
+
+        if (!corner->p)
+        {
+            return 0;
+        }
+
+        numCorners++;
+    }
+
+    if (!Reserve((void**)&chunk->faces, &chunk->maxFaces,
+            chunk->numFaces + (numCorners > 2 ? numCorners - 2 : 0),
+            sizeof(ObjRendererFace)))
+    {
+        return 0;
+    }
+
+    for (i = 2; i < numCorners; i++)
+    {
+        c[0] = &chunk->corners[0];
+        c[1] = &chunk->corners[i - 1];
+        c[2] = &chunk->corners[i];
+        face = &chunk->faces[chunk->numFaces];
+
+        for (j = 0; j < 3; j++)
+        {
+            *FaceIndex(face, j) = ResolveIndex(
+                    chunk, c[j]->p, chunk->numPositions, j
+                );
+        }
+
+        face->n0 = face->n1 = face->n2 = -1;
+        face->tc0 = face->tc1 = face->tc2 = -1;
+        face->matIdx = -1;
+        face->smoothingGroup = -1;
+
+        if (c[0]->n && c[1]->n && c[2]->n)
+        {
+            for (j = 0; j < 3; j++)
+            {
+                *FaceIndex(face, 3 + j) = ResolveIndex(
+                        chunk, c[j]->n, chunk->numNormals, 3 + j
+                    );
+            }
+        }
+
+        if (c[0]->tc && c[1]->tc && c[2]->tc)
+        {
+            for (j = 0; j < 3; j++)
+            {
+                *FaceIndex(face, 6 + j) = ResolveIndex(
+                        chunk, c[j]->tc, chunk->numTexCoords, 6 + j
+                    );
+            }
+        }
+
+        chunk->numFaces++;
+    }
+
+    return !chunk->failed;
+}
+
+/*
+** Parses the lines of chunk. Unknown statements are skipped.
+*/
+static void ParseChunk(Chunk* chunk)
+{
+    const char* p = chunk->begin;
+    const char* end = chunk->end;
+    float* v = NULL;
+
+    while (p < end && !chunk->failed)
+    {
+        p = SkipSpace(p, end);
+
+        if (end - p < 2)
+        {
+            break;
+        }
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            if (!Reserve((void**)&chunk->positions, &chunk->maxPositions,
+                    chunk->numPositions + 1, sizeof(FxsVector3)))
+            {
+                chunk->failed = 1;
+                break;
+            }
+
+            p += 2;
+            v = &chunk->positions[chunk->numPositions].x;
+            chunk->failed = !ParseFloats(&p, end, v, 3);
+            chunk->numPositions++;
+        }
+        else if (p[0] == 'v' && p[1] == 'n')
+        {
+            if (!Reserve((void**)&chunk->normals, &chunk->maxNormals,
+                    chunk->numNormals + 1, sizeof(FxsVector3)))
+            {
+                chunk->failed = 1;
+                break;
+            }
+
+            p += 2;
+            v = &chunk->normals[chunk->numNormals].x;
+            chunk->failed = !ParseFloats(&p, end, v, 3);
+            chunk->numNormals++;
+        }
+        else if (p[0] == 'v' && p[1] == 't')
+        {
+            if (!Reserve((void**)&chunk->texCoords, &chunk->maxTexCoords,
+                    chunk->numTexCoords + 1, sizeof(FxsVector2)))
+            {
+                chunk->failed = 1;
+                break;
+            }
+
+            p += 2;
+            v = &chunk->texCoords[chunk->numTexCoords].x;
+            chunk->failed = !ParseFloats(&p, end, v, 2);
+            chunk->numTexCoords++;
+        }
+        else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            chunk->failed = !ParseFace(chunk, p + 2, end);
+        }
+        else if (p[0] == 'o' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            chunk->failed = !AddEvent(chunk, EVENT_OBJECT, p + 2, end);
+        }
+        else if (p[0] == 'g' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            chunk->failed = !AddEvent(chunk, EVENT_GROUP, p + 2, end);
+        }
+        else if (end - p > 7 && !memcmp(p, "usemtl", 6) && IS_SPACE(p[6]))
+        {
+            chunk->failed = !AddEvent(chunk, EVENT_MATERIAL, p + 7, end);
+        }
+        else if (end - p > 7 && !memcmp(p, "mtllib", 6) && IS_SPACE(p[6]))
+        {
+            chunk->failed = !AddEvent(chunk, EVENT_MTLLIB, p + 7, end);
+        }
+        else if (p[0] == 's' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            chunk->failed = !AddEvent(chunk, EVENT_SMOOTHING, p + 2, end);
+        }
+
+        p = SkipLine(p, end);
+    }
+
+    if (chunk->failed)
+    {
+        ERR_MSG("Failed to parse .obj file");
+    }
+}
+
+static void ParseChunks(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    Chunk* chunks = userData;
+    unsigned int i = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        ParseChunk(&chunks[i]);
+    }
+}
+
+static void ChunkDestroy(Chunk* chunk)
+{
+    free(chunk->positions);
+    free(chunk->normals);
+    free(chunk->texCoords);
+    free(chunk->faces);
+    free(chunk->fixups);
+    free(chunk->events);
+    free(chunk->corners);
+}
+
+/******************************************************************************/
+/*
+** Maps material names to their index in the file's materialNames.
+*/
+typedef struct
+{
+    int* slots;             /* index of the material, -1 if the slot is free */
+    unsigned int numSlots;  /* power of two */
+}
+MaterialTable;
+
+static unsigned int HashName(const char* name, unsigned int length)
+{
+    unsigned int hash = 2166136261u;
+    unsigned int i = 0;
+
+    for (i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char)name[i])*16777619u;
+    }
+
+    return hash;
+}
+
+/*
+** Gets the index of the material name, adds it to the materials of file if it
+** is new. Returns -1 if it fails.
+*/
+static int FindMaterial(
+    MaterialTable* table,
+    ObjRendererFile* file,
+    unsigned int* maxMaterials,
+    const char* name,
+    unsigned int length
+)
+{
+    unsigned int i = 0;
+    unsigned int slot = 0;
+    int* slots = NULL;
+    const char* other = NULL;
+
+    /* keep the table at most half full */
+    if (2*(file->numMaterials + 1) > table->numSlots)
+    {
+        slots = malloc(2*table->numSlots*sizeof(int));
+
+        if (!slots)
+        {
+            return -1;
+        }
+
+        free(table->slots);
+        table->slots = slots;
+        table->numSlots *= 2;
+        memset(slots, 0xFF, table->numSlots*sizeof(int));
+
+        for (i = 0; i < file->numMaterials; i++)
+        {
+            other = file->materialNames[i];
+            slot = HashName(other, (unsigned int)strlen(other));
+
+            while (table->slots[slot & (table->numSlots - 1)] != -1)
+            {
+                slot++;
+            }
+
+            table->slots[slot & (table->numSlots - 1)] = i;
+        }
+    }
+
+    for (slot = HashName(name, length); ; slot++)
+    {
+        i = slot & (table->numSlots - 1);
+
+        if (table->slots[i] == -1)
+        {
+            break;
+        }
+
+        other = file->materialNames[table->slots[i]];
+
+        if (!strncmp(other, name, length) && other[length] == '\0')
+        {
+            return table->slots[i];
+        }
+    }
+
+    if (!Reserve((void**)&file->materialNames, maxMaterials,
+            file->numMaterials + 1, sizeof(char*)))
+    {
+        return -1;
+    }
+
+    file->materialNames[file->numMaterials] = malloc(length + 1);
+
+    if (!file->materialNames[file->numMaterials])
+    {
+        return -1;
+    }
+
+    memcpy(file->materialNames[file->numMaterials], name, length);
+    file->materialNames[file->numMaterials][length] = '\0';
+    table->slots[i] = file->numMaterials;
+
+    return file->numMaterials++;
+}
+
+/*
+** Keeps track of the object and group that are open while the events are
+** resolved. Empty groups and objects are dropped when they are closed.
+*/
+typedef struct
+{
+    unsigned int maxGroups;
+    unsigned int maxObjects;
+    unsigned int groupStart;        /* first face of the open group */
+    unsigned int objectStart;       /* first group of the open object */
+}
+Hierarchy;
+
+static int CloseGroup(
+    Hierarchy* hierarchy,
+    ObjRendererFile* file,
+    unsigned int face
+)
+{
+    ObjRendererFileGroup* group = NULL;
+
+    if (face > hierarchy->groupStart)
+    {
+        if (!Reserve((void**)&file->groups, &hierarchy->maxGroups,
+                file->numGroups + 1, sizeof(ObjRendererFileGroup)))
+        {
+            return 0;
+        }
+
+        group = &file->groups[file->numGroups++];
+        group->firstFace = hierarchy->groupStart;
+        group->numFaces = face - hierarchy->groupStart;
+    }
+
+    hierarchy->groupStart = face;
+
+    return 1;
+}
+
+static int CloseObject(Hierarchy* hierarchy, ObjRendererFile* file)
+{
+    ObjRendererFileObject* object = NULL;
+
+    if (file->numGroups > hierarchy->objectStart)
+    {
+        if (!Reserve((void**)&file->objects, &hierarchy->maxObjects,
+                file->numObjects + 1, sizeof(ObjRendererFileObject)))
+        {
+            return 0;
+        }
+
+        object = &file->objects[file->numObjects++];
+        object->firstGroup = hierarchy->objectStart;
+        object->numGroups = file->numGroups - hierarchy->objectStart;
+    }
+
+    hierarchy->objectStart = file->numGroups;
+
+    return 1;
+}
+
+/*
+** Walks the events of all chunks in file order. Builds the objects, groups
+** and materials of file and resolves the material at the start of each chunk
+** and of each "usemtl", and the smoothing group at the start of each chunk.
+** Returns 0 if it fails.
+*/
+static int ResolveEvents(
+    ObjRendererFile* file,
+    Chunk* chunks,
+    unsigned int numChunks
+)
+{
+    MaterialTable table;
+    Hierarchy hierarchy;
+    unsigned int maxMaterials = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int face = 0;
+    int matIdx = -1;
+    int smoothingGroup = -1;
+    int success = 1;
+    Event* event = NULL;
+
+    memset(&hierarchy, 0, sizeof(Hierarchy));
+    table.numSlots = 16;
+    table.slots = malloc(table.numSlots*sizeof(int));
+
+    if (!table.slots)
+    {
+        return 0;
+    }
+
+    memset(table.slots, 0xFF, table.numSlots*sizeof(int));
+
+    for (i = 0; i < numChunks && success; i++)
+    {
+        chunks[i].matIdx = matIdx;
+        chunks[i].smoothingGroup = smoothingGroup;
+
+        for (j = 0; j < chunks[i].numEvents && success; j++)
+        {
+            event = &chunks[i].events[j];
+            face = chunks[i].firstFace + event->face;
+
+            switch (event->type)
+            {
+                case EVENT_OBJECT:
+                    success = CloseGroup(&hierarchy, file, face) &&
+                        CloseObject(&hierarchy, file);
+                    break;
+
+                case EVENT_GROUP:
+                    success = CloseGroup(&hierarchy, file, face);
+                    break;
+
+                case EVENT_MATERIAL:
+                    matIdx = FindMaterial(&table, file, &maxMaterials,
+                        event->name, event->nameLength);
+                    event->matIdx = matIdx;
+                    success = matIdx != -1;
+                    break;
+
+                case EVENT_MTLLIB:
+                    if (!file->mtlLib)
+                    {
+                        file->mtlLib = malloc(event->nameLength + 1);
+                        success = file->mtlLib != NULL;
+
+                        if (success)
+                        {
+                            memcpy(file->mtlLib, event->name, event->nameLength);
+                            file->mtlLib[event->nameLength] = '\0';
+                        }
+                    }
+                    break;
+
+                case EVENT_SMOOTHING:
+                    smoothingGroup = event->smoothingGroup;
+                    break;
+            }
+        }
+    }
+
+    success = success && CloseGroup(&hierarchy, file, file->numFaces) &&
+        CloseObject(&hierarchy, file);
+
+    free(table.slots);
+
+    return success;
+}
+
+static int IndexValid(int index, unsigned int count)
+{
+    return index >= 0 && (unsigned int)index < count;
+}
+
+/*
+** Copies the arrays of the chunks into the arrays of the file, fixes up
+** relative indices and sets the materials and smoothing groups of the faces.
+** Flags the chunk as failed if a face refers to a vertex that does not exist.
+*/
+static void MergeChunks(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    MergeData* merge = userData;
+    ObjRendererFile* file = merge->file;
+    Chunk* chunk = NULL;
+    ObjRendererFace* faces = NULL;
+    ObjRendererFace* face = NULL;
+    unsigned int offsets[3];
+    unsigned int slot = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    unsigned int event = 0;
+    int matIdx = 0;
+    int smoothingGroup = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        chunk = &merge->chunks[i];
+        faces = &file->faces[chunk->firstFace];
+
+        /* the arrays of empty chunks (and files) may be NULL */
+        if (chunk->numPositions)
+        {
+            memcpy(&file->positions[chunk->firstPosition], chunk->positions,
+                chunk->numPositions*sizeof(FxsVector3));
+        }
+
+        if (chunk->numNormals)
+        {
+            memcpy(&file->normals[chunk->firstNormal], chunk->normals,
+                chunk->numNormals*sizeof(FxsVector3));
+        }
+
+        if (chunk->numTexCoords)
+        {
+            memcpy(&file->texCoords[chunk->firstTexCoord], chunk->texCoords,
+                chunk->numTexCoords*sizeof(FxsVector2));
+        }
+
+        if (chunk->numFaces)
+        {
+            memcpy(faces, chunk->faces, chunk->numFaces*sizeof(ObjRendererFace));
+        }
+
+        offsets[0] = chunk->firstPosition;
+        offsets[1] = chunk->firstNormal;
+        offsets[2] = chunk->firstTexCoord;
+
+        for (j = 0; j < chunk->numFixups; j++)
+        {
+            slot = chunk->fixups[j] % 9;
+            *FaceIndex(&faces[chunk->fixups[j]/9], slot) += offsets[slot/3];
+        }
+
+        matIdx = chunk->matIdx;
+        smoothingGroup = chunk->smoothingGroup;
+        event = 0;
+
+        for (j = 0; j < chunk->numFaces; j++)
+        {
+            while (event < chunk->numEvents && chunk->events[event].face <= j)
+            {
+                if (chunk->events[event].type == EVENT_MATERIAL)
+                {
+                    matIdx = chunk->events[event].matIdx;
+                }
+                else if (chunk->events[event].type == EVENT_SMOOTHING)
+                {
+                    smoothingGroup = chunk->events[event].smoothingGroup;
+                }
+
+                event++;
+            }
+
+            face = &faces[j];
+            face->matIdx = matIdx;
+            face->smoothingGroup = smoothingGroup;
+
+            if (!IndexValid(face->p0, file->numPositions) ||
+                !IndexValid(face->p1, file->numPositions) ||
+                !IndexValid(face->p2, file->numPositions) ||
+                (face->n0 != -1 && (
+                    !IndexValid(face->n0, file->numNormals) ||
+                    !IndexValid(face->n1, file->numNormals) ||
+                    !IndexValid(face->n2, file->numNormals))) ||
+                (face->tc0 != -1 && (
+                    !IndexValid(face->tc0, file->numTexCoords) ||
+                    !IndexValid(face->tc1, file->numTexCoords) ||
+                    !IndexValid(face->tc2, file->numTexCoords))))
+            {
+                chunk->failed = 1;
+            }
+        }
+    }
+}
+
+/******************************************************************************/
+const char* ObjRendererFileMap(const char* filename, size_t* size)
+{
+#ifdef _WIN32
+    FILE* f = fopen(filename, "rb");
+    char* data = NULL;
+    long length = 0;
+
+    if (!f)
+    {
+        return NULL;
+    }
+
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (length == 0)
+    {
+        fclose(f);
+        *size = 0;
+        return "";
+    }
+
+    if (length > 0)
+    {
+        data = malloc(length);
+    }
+
+    if (data && fread(data, 1, length, f) != (size_t)length)
+    {
+        free(data);
+        data = NULL;
+    }
+
+    fclose(f);
+    *size = data ? (size_t)length : 0;
+
+    return data;
+#else
+    struct stat info;
+    void* data = NULL;
+    int fd = open(filename, O_RDONLY);
+
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    if (fstat(fd, &info) == -1)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    /* mmap fails for 0 bytes, an empty file is an empty string */
+    if (info.st_size == 0)
+    {
+        close(fd);
+        *size = 0;
+        return "";
+    }
+
+    data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    /* the chunks are read in parallel, not front to back */
+    madvise(data, info.st_size, MADV_WILLNEED);
+    *size = info.st_size;
+
+    return data;
+#endif
+}
+
+void ObjRendererFileUnmap(const char* data, size_t size)
+{
+    if (!data || size == 0)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    free((void*)data);
+#else
+    munmap((void*)data, size);
+#endif
+}
+
+char* ObjRendererFileJoinPath(const char* base, const char* name)
+{
+    size_t length = strlen(base);
+    char* path = NULL;
+
+    while (length && !IS_SEPARATOR(base[length - 1]))
+    {
+        length--;
+    }
+
+    /* absolute names are kept as they are */
+    if (IS_SEPARATOR(name[0]) || (name[0] && name[1] == ':'))
+    {
+        length = 0;
+    }
+
+    path = malloc(length + strlen(name) + 1);
+
+    if (path)
+    {
+        memcpy(path, base, length);
+        strcpy(&path[length], name);
+    }
+
+    return path;
+}
+
+/*
+** Splits data into line aligned chunks. Returns the # of chunks, 0 if it
+** fails.
+*/
+static unsigned int CreateChunks(
+    Chunk** chunks,
+    const char* data,
+    size_t size,
+    FFThreadPoolPtr pool
+)
+{
+    unsigned int numThreads = pool ? FFThreadPoolGetNumThreads(pool) : 1;
+    size_t numChunks = size/MIN_CHUNK_SIZE + 1;
+    const char* begin = data;
+    const char* end = data + size;
+    const char* split = NULL;
+    size_t i = 0;
+
+    if (numChunks > CHUNKS_PER_THREAD*numThreads)
+    {
+        numChunks = CHUNKS_PER_THREAD*numThreads;
+    }
+
+    if (numThreads == 1)
+    {
+        numChunks = 1;
+    }
+
+    *chunks = malloc(numChunks*sizeof(Chunk));
+
+    if (!*chunks)
+    {
+        return 0;
+    }
+
+    memset(*chunks, 0, numChunks*sizeof(Chunk));
+
+    for (i = 0; i < numChunks; i++)
+    {
+        split = i + 1 == numChunks ? end : data + (i + 1)*(size/numChunks);
+
+        if (split < begin)
+        {
+            split = begin;
+        }
+
+        split = split < end ? SkipLine(split, end) : end;
+        (*chunks)[i].begin = begin;
+        (*chunks)[i].end = split;
+        begin = split;
+    }
+
+    return (unsigned int)numChunks;
+}
+
+/*
+** Allocates the arrays of file, sized by the sum of the chunks. Also computes
+** the offsets of the chunks in the arrays. Returns 0 if it fails.
+*/
+static int AllocateArrays(
+    ObjRendererFile* file,
+    Chunk* chunks,
+    unsigned int numChunks
+)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < numChunks; i++)
+    {
+        chunks[i].firstPosition = file->numPositions;
+        chunks[i].firstNormal = file->numNormals;
+        chunks[i].firstTexCoord = file->numTexCoords;
+        chunks[i].firstFace = file->numFaces;
+        file->numPositions += chunks[i].numPositions;
+        file->numNormals += chunks[i].numNormals;
+        file->numTexCoords += chunks[i].numTexCoords;
+        file->numFaces += chunks[i].numFaces;
+    }
+
+    /* + 1 so an empty array is not a failed allocation */
+    file->positions = malloc((file->numPositions + 1)*sizeof(FxsVector3));
+    file->normals = malloc((file->numNormals + 1)*sizeof(FxsVector3));
+    file->texCoords = malloc((file->numTexCoords + 1)*sizeof(FxsVector2));
+    file->faces = malloc((file->numFaces + 1)*sizeof(ObjRendererFace));
+
+    return file->positions && file->normals && file->texCoords && file->faces;
+}
+
+ObjRendererFile* ObjRendererFileCreateWithFile(
+    const char* filename,
+    FFThreadPoolPtr pool
+)
+{
+    ObjRendererFile* file = NULL;
+    Chunk* chunks = NULL;
+    unsigned int numChunks = 0;
+    unsigned int i = 0;
+    const char* data = NULL;
+    size_t size = 0;
+    MergeData merge;
+    int failed = 0;
+
+    if (!filename)
+    {
+        return NULL;
+    }
+
+    data = ObjRendererFileMap(filename, &size);
+
+    if (!data)
+    {
+        ERR_MSG("Failed to read .obj file");
+        return NULL;
+    }
+
+    file = malloc(sizeof(ObjRendererFile));
+    numChunks = CreateChunks(&chunks, data, size, pool);
+
+    if (!file || !numChunks)
+    {
+        ERR_MSG("Out of memory");
+        free(file);
+        free(chunks);
+        ObjRendererFileUnmap(data, size);
+        return NULL;
+    }
+
+    memset(file, 0, sizeof(ObjRendererFile));
+
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, numChunks, 1, ParseChunks, chunks);
+    }
+    else
+    {
+        ParseChunks(chunks, 0, numChunks, 0);
+    }
+
+    for (i = 0; i < numChunks; i++)
+    {
+        failed |= chunks[i].failed;
+    }
+
+    if (failed || !AllocateArrays(file, chunks, numChunks) ||
+        !ResolveEvents(file, chunks, numChunks))
+    {
+        goto error;
+    }
+
+    merge.file = file;
+    merge.chunks = chunks;
+
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, numChunks, 1, MergeChunks, &merge);
+    }
+    else
+    {
+        MergeChunks(&merge, 0, numChunks, 0);
+    }
+
+    for (i = 0; i < numChunks; i++)
+    {
+        failed |= chunks[i].failed;
+    }
+
+    if (failed)
+    {
+        ERR_MSG("A face refers to a vertex that does not exist");
+        goto error;
+    }
+
+    for (i = 0; i < numChunks; i++)
+    {
+        ChunkDestroy(&chunks[i]);
+    }
+
+    free(chunks);
+    ObjRendererFileUnmap(data, size);
+
+    return file;
+
+error:
+
+    for (i = 0; i < numChunks; i++)
+    {
+        ChunkDestroy(&chunks[i]);
+    }
+
+    free(chunks);
+    ObjRendererFileUnmap(data, size);
+    ObjRendererFileDestroy(&file);
+
+    return NULL;
+}
+
+void ObjRendererFileDestroy(ObjRendererFile** file)
+{
+    unsigned int i = 0;
+
+    if (!file || !*file)
+    {
+        return;
+    }
+
+    for (i = 0; i < (*file)->numMaterials; i++)
+    {
+        free((*file)->materialNames[i]);
+    }
+
+    free((*file)->materialNames);
+    free((*file)->mtlLib);
+    free((*file)->positions);
+    free((*file)->normals);
+    free((*file)->texCoords);
+    free((*file)->faces);
+    free((*file)->groups);
+    free((*file)->objects);
+    free(*file);
+    *file = NULL;
+}
@@ -0,0 +1,113 @@
+#ifndef OBJRENDERERFILE_H
+#define OBJRENDERERFILE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <Fxs/Math/Vector3.h>
+#include <FF/ThreadPool/ThreadPool.h>
+
+/*
+** A native .obj loader that replaces FxsObjFile for building meshes. The file
+** is memory mapped and split into line aligned chunks which are parsed in 
+** parallel. The chunks are merged into flat arrays afterwards.
+*/
+
+/*
+** A triangle. Indices are 0 based and refer to the arrays of the file, -1
+** marks a missing normal or tex coord. Either all three corners have a normal
+** (tex coord) or none. Polygons are triangulated as fans.
+*/
+typedef struct
+{
+    int p0, p1, p2;
+    int n0, n1, n2;
+    int tc0, tc1, tc2;
+    int matIdx;         /* index into materialNames, -1 if no material */
+    int smoothingGroup; /* of "s", 0 for "s off", -1 before the first "s" */
+}
+ObjRendererFace;
+
+/*
+** A range of faces started by a "g" statement (or the start of an object).
+*/
+typedef struct
+{
+    unsigned int firstFace;
+    unsigned int numFaces;
+}
+ObjRendererFileGroup;
+
+/*
+** A range of groups started by an "o" statement (or the start of the file).
+*/
+typedef struct
+{
+    unsigned int firstGroup;
+    unsigned int numGroups;
+}
+ObjRendererFileObject;
+
+typedef struct
+{
+    FxsVector3* positions;
+    FxsVector3* normals;
+    FxsVector2* texCoords;
+    ObjRendererFace* faces;
+    ObjRendererFileGroup* groups;
+    ObjRendererFileObject* objects;
+    char** materialNames;   /* in order of their first "usemtl" */
+    char* mtlLib;           /* first "mtllib", NULL if there is none */
+
+    unsigned int numPositions;
+    unsigned int numNormals;
+    unsigned int numTexCoords;
+    unsigned int numFaces;
+    unsigned int numGroups;
+    unsigned int numObjects;
+    unsigned int numMaterials;
+}
+ObjRendererFile;
+
+/*
+** Loads the .obj file filename. The chunks of the file are parsed on the
+** threads of pool, if pool is NULL the file is parsed on the calling thread.
+** Groups without faces are left out. Returns NULL if the file can not be read,
+** runs out of memory, or a face refers to a vertex that does not exist.
+*/
+ObjRendererFile* ObjRendererFileCreateWithFile(
+    const char* filename,
+    FFThreadPoolPtr pool
+);
+
+/*
+** Releases file. Sets file to NULL.
+*/
+void ObjRendererFileDestroy(ObjRendererFile** file);
+
+/*
+** Maps the file filename into memory read only (reads it on windows). Returns
+** NULL if it fails, an empty file is mapped to an empty string. The size of 
+** the file is stored in size.
+*/
+const char* ObjRendererFileMap(const char* filename, size_t* size);
+
+/*
+** Releases memory returned by ObjRendererFileMap.
+*/
+void ObjRendererFileUnmap(const char* data, size_t size);
+
+/*
+** Resolves name relative to the directory of the file base, absolute names 
+** are copied. The result has to be freed. Returns NULL if it runs out of 
+** memory.
+*/
+char* ObjRendererFileJoinPath(const char* base, const char* name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERFILE_H */
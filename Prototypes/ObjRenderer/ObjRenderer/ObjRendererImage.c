@@ -0,0 +1,523 @@
+//
+//  ObjRendererImage.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAS_SSE2 1
+#endif
+#include "ObjRendererImage.h"
+#include "ObjRendererFile.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define TGA_HEADER_SIZE 18
+
+/*
+** The format of an image file and where its pixels start.
+*/
+typedef struct
+{
+    enum { FORMAT_TGA, FORMAT_PPM } format;
+    unsigned int width;
+    unsigned int height;
+    size_t dataOffset;
+
+    /* tga only */
+    unsigned int bytesPerPixel;
+    int isRle;
+    int isTopDown;
+}
+ImageHeader;
+
+/*
+** Reads an unsigned decimal of a ppm header, skips white space and comments
+** before it. Returns 0 if there is none.
+*/
+static int ReadPpmNumber(
+    const unsigned char* data,
+    size_t size,
+    size_t* pos,
+    unsigned int* value
+)
+{
+    int hasDigits = 0;
+
+    while (*pos < size)
+    {
+        if (data[*pos] == '#')
+        {
+            while (*pos < size && data[*pos] != '\n')
+            {
+                (*pos)++;
+            }
+        }
+        else if (data[*pos] == ' ' || data[*pos] == '\t' ||
+            data[*pos] == '\r' || data[*pos] == '\n')
+        {
+            (*pos)++;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    *value = 0;
+
+    while (*pos < size && data[*pos] >= '0' && data[*pos] <= '9' &&
+        *value < OBJ_RENDERER_IMAGE_MAX_SIZE)
+    {
+        *value = 10*(*value) + (data[*pos] - '0');
+        (*pos)++;
+        hasDigits = 1;
+    }
+
+    return hasDigits;
+}
+
+/*
+** Parses the header of the image in data. size may be smaller than the file
+** as long as it contains the header. Returns 0 if the format is not
+** supported.
+*/
+static int ParseHeader(
+    const unsigned char* data,
+    size_t size,
+    ImageHeader* header
+)
+{
+    unsigned int maxValue = 0;
+    size_t pos = 2;
+    int type = 0;
+    int bits = 0;
+
+    memset(header, 0, sizeof(ImageHeader));
+
+    if (size >= 2 && data[0] == 'P' && data[1] == '6')
+    {
+        header->format = FORMAT_PPM;
+
+        if (!ReadPpmNumber(data, size, &pos, &header->width) ||
+            !ReadPpmNumber(data, size, &pos, &header->height) ||
+            !ReadPpmNumber(data, size, &pos, &maxValue) ||
+            pos >= size || maxValue == 0 || maxValue > 255)
+        {
+            return 0;
+        }
+
+        header->dataOffset = pos + 1;   /* a single white space */
+    }
+    else
+    {
+        if (size < TGA_HEADER_SIZE)
+        {
+            return 0;
+        }
+
+        /* no color maps, true color (2, 10) or gray scale (3, 11) */
+        type = data[2];
+        bits = data[16];
+        header->format = FORMAT_TGA;
+        header->width = data[12] | (data[13] << 8);
+        header->height = data[14] | (data[15] << 8);
+        header->bytesPerPixel = bits/8;
+        header->isRle = type >= 8;
+        header->isTopDown = (data[17] >> 5) & 1;
+        header->dataOffset = TGA_HEADER_SIZE + data[0];
+
+        if (data[1] != 0 ||
+            (type != 2 && type != 3 && type != 10 && type != 11) ||
+            ((type & 7) == 2 && bits != 24 && bits != 32) ||
+            ((type & 7) == 3 && bits != 8))
+        {
+            return 0;
+        }
+    }
+
+    return header->width > 0 && header->height > 0 &&
+        header->width <= OBJ_RENDERER_IMAGE_MAX_SIZE &&
+        header->height <= OBJ_RENDERER_IMAGE_MAX_SIZE;
+}
+
+/*
+** Converts a tga pixel (BGR(A) or gray) to RGBA.
+*/
+static void ConvertTgaPixel(
+    const unsigned char* src,
+    unsigned int bytesPerPixel,
+    unsigned char* dst
+)
+{
+    if (bytesPerPixel == 1)
+    {
+        dst[0] = dst[1] = dst[2] = src[0];
+        dst[3] = 255;
+        return;
+    }
+
+    dst[0] = src[2];
+    dst[1] = src[1];
+    dst[2] = src[0];
+    dst[3] = bytesPerPixel == 4 ? src[3] : 255;
+}
+
+/*
+** Decodes the pixels of a tga file into rgba in file order. Returns 0 if the
+** file is truncated.
+*/
+static int DecodeTga(
+    const unsigned char* data,
+    size_t size,
+    const ImageHeader* header,
+    unsigned char* rgba
+)
+{
+    size_t numPixels = (size_t)header->width*header->height;
+    size_t pos = header->dataOffset;
+    size_t i = 0;
+    unsigned int count = 0;
+    unsigned int bpp = header->bytesPerPixel;
+    unsigned int j = 0;
+
+    if (!header->isRle)
+    {
+        if (pos + numPixels*bpp > size)
+        {
+            return 0;
+        }
+
+        for (i = 0; i < numPixels; i++)
+        {
+            ConvertTgaPixel(&data[pos + i*bpp], bpp, &rgba[4*i]);
+        }
+
+        return 1;
+    }
+
+    /* packets of 1 .. 128 pixels, either one repeated pixel or raw pixels */
+    while (i < numPixels)
+    {
+        if (pos >= size)
+        {
+            return 0;
+        }
+
+        count = (data[pos] & 0x7F) + 1;
+
+        if (i + count > numPixels ||
+            pos + 1 + ((data[pos] & 0x80) ? 1 : count)*bpp > size)
+        {
+            return 0;
+        }
+
+        if (data[pos] & 0x80)
+        {
+            for (j = 0; j < count; j++)
+            {
+                ConvertTgaPixel(&data[pos + 1], bpp, &rgba[4*(i + j)]);
+            }
+
+            pos += 1 + bpp;
+        }
+        else
+        {
+            for (j = 0; j < count; j++)
+            {
+                ConvertTgaPixel(&data[pos + 1 + j*bpp], bpp, &rgba[4*(i + j)]);
+            }
+
+            pos += 1 + count*bpp;
+        }
+
+        i += count;
+    }
+
+    return 1;
+}
+
+static int DecodePpm(
+    const unsigned char* data,
+    size_t size,
+    const ImageHeader* header,
+    unsigned char* rgba
+)
+{
+    size_t numPixels = (size_t)header->width*header->height;
+    const unsigned char* src = &data[header->dataOffset];
+    size_t i = 0;
+
+    if (header->dataOffset + 3*numPixels > size)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < numPixels; i++)
+    {
+        rgba[4*i + 0] = src[3*i + 0];
+        rgba[4*i + 1] = src[3*i + 1];
+        rgba[4*i + 2] = src[3*i + 2];
+        rgba[4*i + 3] = 255;
+    }
+
+    return 1;
+}
+
+/*
+** Reverses the order of the rows of an rgba image.
+*/
+static void FlipRows(unsigned char* rgba, unsigned int width, unsigned int height)
+{
+    size_t rowSize = 4*(size_t)width;
+    unsigned char* top = rgba;
+    unsigned char* bottom = rgba + (height - 1)*rowSize;
+    unsigned char tmp = 0;
+    size_t i = 0;
+
+    for (; top < bottom; top += rowSize, bottom -= rowSize)
+    {
+        for (i = 0; i < rowSize; i++)
+        {
+            tmp = top[i];
+            top[i] = bottom[i];
+            bottom[i] = tmp;
+        }
+    }
+}
+
+/*
+** Computes the next mip level of src (width x height) with a 2x2 box filter.
+** Odd sizes clamp at the last row/column.
+*/
+static void Downsample(
+    const unsigned char* src,
+    unsigned int width,
+    unsigned int height,
+    unsigned char* dst
+)
+{
+    unsigned int dstWidth = width > 1 ? width/2 : 1;
+    unsigned int dstHeight = height > 1 ? height/2 : 1;
+    const unsigned char* row0 = NULL;
+    const unsigned char* row1 = NULL;
+    unsigned int x = 0, y = 0, c = 0;
+    unsigned int x0 = 0, x1 = 0;
+
+    for (y = 0; y < dstHeight; y++)
+    {
+        row0 = &src[4*(size_t)width*(2*y < height ? 2*y : height - 1)];
+        row1 = &src[4*(size_t)width*(2*y + 1 < height ? 2*y + 1 : height - 1)];
+        x = 0;
+
+#ifdef HAS_SSE2
+        /* 4 destination pixels from 2 x 8 source pixels. The averages round
+        ** up, which biases the result by at most one step per level.
+        */
+        if (!(width & 1))
+        {
+            for (; x + 4 <= dstWidth; x += 4)
+            {
+                __m128i a0 = _mm_loadu_si128((const __m128i*)&row0[8*x]);
+                __m128i a1 = _mm_loadu_si128((const __m128i*)&row0[8*x + 16]);
+                __m128i b0 = _mm_loadu_si128((const __m128i*)&row1[8*x]);
+                __m128i b1 = _mm_loadu_si128((const __m128i*)&row1[8*x + 16]);
+                __m128 v0 = _mm_castsi128_ps(_mm_avg_epu8(a0, b0));
+                __m128 v1 = _mm_castsi128_ps(_mm_avg_epu8(a1, b1));
+                __m128i even = _mm_castps_si128(
+                        _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0))
+                    );
+                __m128i odd = _mm_castps_si128(
+                        _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1))
+                    );
+
+                _mm_storeu_si128(
+                    (__m128i*)&dst[4*((size_t)y*dstWidth + x)],
+                    _mm_avg_epu8(even, odd)
+                );
+            }
+        }
+#endif
+
+        for (; x < dstWidth; x++)
+        {
+            x0 = 2*x < width ? 2*x : width - 1;
+            x1 = 2*x + 1 < width ? 2*x + 1 : width - 1;
+
+            for (c = 0; c < 4; c++)
+            {
+                dst[4*((size_t)y*dstWidth + x) + c] = (unsigned char)(
+                        (row0[4*x0 + c] + row0[4*x1 + c] +
+                        row1[4*x0 + c] + row1[4*x1 + c] + 2) >> 2
+                    );
+            }
+        }
+    }
+}
+
+unsigned int ObjRendererImageGetNumLevels(unsigned int width, unsigned int height)
+{
+    unsigned int numLevels = 1;
+
+    while (width > 1 || height > 1)
+    {
+        width = width > 1 ? width/2 : 1;
+        height = height > 1 ? height/2 : 1;
+        numLevels++;
+    }
+
+    return numLevels;
+}
+
+unsigned char* ObjRendererImageGetLevel(
+    const ObjRendererImage* image,
+    unsigned int level,
+    unsigned int* width,
+    unsigned int* height
+)
+{
+    unsigned char* pixels = image->pixels;
+    unsigned int w = image->width;
+    unsigned int h = image->height;
+    unsigned int i = 0;
+
+    for (i = 0; i < level; i++)
+    {
+        pixels += 4*(size_t)w*h;
+        w = w > 1 ? w/2 : 1;
+        h = h > 1 ? h/2 : 1;
+    }
+
+    if (width)
+    {
+        *width = w;
+    }
+
+    if (height)
+    {
+        *height = h;
+    }
+
+    return pixels;
+}
+
+int ObjRendererImageReadSize(
+    const char* filename,
+    unsigned int* width,
+    unsigned int* height
+)
+{
+    unsigned char data[256];
+    ImageHeader header;
+    size_t size = 0;
+    FILE* f = fopen(filename, "rb");
+
+    if (!f)
+    {
+        return 0;
+    }
+
+    size = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    if (!ParseHeader(data, size, &header))
+    {
+        return 0;
+    }
+
+    *width = header.width;
+    *height = header.height;
+
+    return 1;
+}
+
+int ObjRendererImageLoad(const char* filename, ObjRendererImage* image)
+{
+    size_t size = 0;
+    const unsigned char* data = NULL;
+    ImageHeader header;
+    size_t totalSize = 0;
+    unsigned int w = 0, h = 0;
+    unsigned int level = 0;
+    int success = 0;
+
+    memset(image, 0, sizeof(ObjRendererImage));
+    data = (const unsigned char*)ObjRendererFileMap(filename, &size);
+
+    if (!data)
+    {
+        return 0;
+    }
+
+    if (!ParseHeader(data, size, &header))
+    {
+        ERR_MSG("Unsupported image format");
+        ObjRendererFileUnmap((const char*)data, size);
+        return 0;
+    }
+
+    image->width = header.width;
+    image->height = header.height;
+    image->numLevels = ObjRendererImageGetNumLevels(header.width, header.height);
+
+    /* the levels sum up to less than 4/3 of level 0 (plus rounding) */
+    for (level = 0, w = header.width, h = header.height;
+        level < image->numLevels; level++)
+    {
+        totalSize += 4*(size_t)w*h;
+        w = w > 1 ? w/2 : 1;
+        h = h > 1 ? h/2 : 1;
+    }
+
+    image->pixels = malloc(totalSize);
+
+    if (image->pixels)
+    {
+        if (header.format == FORMAT_PPM)
+        {
+            success = DecodePpm(data, size, &header, image->pixels);
+        }
+        else
+        {
+            success = DecodeTga(data, size, &header, image->pixels);
+        }
+    }
+
+    ObjRendererFileUnmap((const char*)data, size);
+
+    if (!success)
+    {
+        ERR_MSG("Failed to decode the image");
+        ObjRendererImageRelease(image);
+        return 0;
+    }
+
+    /* ppm and top down tga files start with the top row */
+    if (header.format == FORMAT_PPM || header.isTopDown)
+    {
+        FlipRows(image->pixels, header.width, header.height);
+    }
+
+    for (level = 1; level < image->numLevels; level++)
+    {
+        data = ObjRendererImageGetLevel(image, level - 1, &w, &h);
+        Downsample(data, w, h, ObjRendererImageGetLevel(image, level, NULL, NULL));
+    }
+
+    return 1;
+}
+
+void ObjRendererImageRelease(ObjRendererImage* image)
+{
+    free(image->pixels);
+    memset(image, 0, sizeof(ObjRendererImage));
+}
@@ -0,0 +1,65 @@
+#ifndef OBJRENDERERIMAGE_H
+#define OBJRENDERERIMAGE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+** Decodes the images of diffuse maps into RGBA8 with a full mip chain.
+** Supported are TGA (true color and gray scale, uncompressed and RLE) and
+** binary PPM (P6). The rows are stored bottom up, as opengl expects them.
+*/
+
+#define OBJ_RENDERER_IMAGE_MAX_SIZE 16384
+
+typedef struct
+{
+    unsigned char* pixels;      /* all levels, level 0 first, 4 bytes per
+                                ** pixel */
+    unsigned int width;         /* of level 0 */
+    unsigned int height;
+    unsigned int numLevels;
+}
+ObjRendererImage;
+
+/*
+** Reads only the size of the image filename. Returns 0 if the file can not
+** be read or its format is not supported.
+*/
+int ObjRendererImageReadSize(
+    const char* filename,
+    unsigned int* width,
+    unsigned int* height
+);
+
+/*
+** Decodes the image filename and generates its mip levels. Returns 0 if it
+** fails.
+*/
+int ObjRendererImageLoad(const char* filename, ObjRendererImage* image);
+
+/*
+** Gets the # of mip levels of an image with size width x height, down to
+** 1 x 1.
+*/
+unsigned int ObjRendererImageGetNumLevels(unsigned int width, unsigned int height);
+
+/*
+** Gets the first pixel of the mip level of image and optionally its size.
+*/
+unsigned char* ObjRendererImageGetLevel(
+    const ObjRendererImage* image,
+    unsigned int level,
+    unsigned int* width,
+    unsigned int* height
+);
+
+void ObjRendererImageRelease(ObjRendererImage* image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERIMAGE_H */
@@ -0,0 +1,474 @@
+//
+//  ObjRendererImpostor.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <math.h>
+#include <Fxs/OpenGL/Program.h>
+#include <FF/GLState/GLState.h>
+#include "ObjRendererImpostor.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define ATLAS_SIZE (OBJ_RENDERER_IMPOSTOR_GRID*OBJ_RENDERER_IMPOSTOR_CELL_SIZE)
+
+/* mip levels below 8x8 pixels per cell would blend neighbouring cells */
+#define MAX_LEVEL 4
+
+#define TO_STRING(X) #X
+
+/* draws the quads, created with the first impostor */
+static GLuint program = 0;
+static GLuint vao = 0;
+static GLint viewProjectionLocation = -1;
+static GLint centerLocation = -1;
+static GLint rightLocation = -1;
+static GLint upLocation = -1;
+static GLint cellLocation = -1;
+static GLint alphaLocation = -1;
+
+/*
+** The corners of the quad are made from gl_VertexID, so no vertex buffer is
+** needed. right and up are scaled by the radius, cell is the offset and size
+** of the cell in the atlas.
+*/
+static char* vertexShader =
+    "#version 150\n"
+TO_STRING(
+    uniform mat4 viewProjection;
+    uniform vec3 center;
+    uniform vec3 right;
+    uniform vec3 up;
+    uniform vec4 cell;
+
+    out vec2 vTexCoord;
+
+    void main()
+    {
+        vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1)*2.0 - 1.0;
+
+        vTexCoord = cell.xy + (corner*0.5 + 0.5)*cell.zw;
+        gl_Position = viewProjection*vec4(center + corner.x*right + corner.y*up, 1.0);
+    }
+);
+
+/*
+** The atlas is cleared to transparent black and the mesh is drawn opaque, so
+** its colors are premultiplied by alpha, also in the mip levels.
+*/
+static char* fragmentShader =
+    "#version 150\n"
+TO_STRING(
+    uniform sampler2D atlas;
+    uniform float alpha;
+
+    in vec2 vTexCoord;
+    out vec4 fragOut;
+
+    void main()
+    {
+        vec4 color = texture(atlas, vTexCoord)*alpha;
+
+        if (color.a < 0.01)
+        {
+            discard;
+        }
+
+        fragOut = color;
+    }
+);
+
+static float Sign(float x)
+{
+    return x >= 0.0f ? 1.0f : -1.0f;
+}
+
+/*
+** Gets the direction of the center of cell x, y.
+*/
+static void GetCellDirection(int x, int y, FxsVector3* d)
+{
+    float u = (x + 0.5f)*(2.0f/OBJ_RENDERER_IMPOSTOR_GRID) - 1.0f;
+    float v = (y + 0.5f)*(2.0f/OBJ_RENDERER_IMPOSTOR_GRID) - 1.0f;
+    float z = 1.0f - fabsf(u) - fabsf(v);
+    float t = u;
+    float length = 0.0f;
+
+    if (z < 0.0f)
+    {
+        u = (1.0f - fabsf(v))*Sign(t);
+        v = (1.0f - fabsf(t))*Sign(v);
+    }
+
+    length = sqrtf(u*u + v*v + z*z);
+    d->x = u/length;
+    d->y = v/length;
+    d->z = z/length;
+}
+
+/*
+** Gets the cell whose direction is closest to the direction d. The cells are
+** not evenly shaped on the sphere, so the cell d falls into and its 
+** neighbours are compared.
+*/
+static void GetCell(const FxsVector3* d, int* x, int* y)
+{
+    float l1 = fabsf(d->x) + fabsf(d->y) + fabsf(d->z);
+    float u = l1 > 0.0f ? d->x/l1 : 0.0f;
+    float v = l1 > 0.0f ? d->y/l1 : 0.0f;
+    float t = u;
+    float dot = 0.0f;
+    float bestDot = -2.0f;
+    FxsVector3 cell;
+    int cx = 0;
+    int cy = 0;
+    int i = 0;
+    int j = 0;
+
+    if (d->z < 0.0f)
+    {
+        u = (1.0f - fabsf(v))*Sign(t);
+        v = (1.0f - fabsf(t))*Sign(v);
+    }
+
+    cx = (int)floorf((u + 1.0f)*0.5f*OBJ_RENDERER_IMPOSTOR_GRID);
+    cy = (int)floorf((v + 1.0f)*0.5f*OBJ_RENDERER_IMPOSTOR_GRID);
+
+    for (j = cy - 1; j <= cy + 1; j++)
+    {
+        for (i = cx - 1; i <= cx + 1; i++)
+        {
+            if (i < 0 || j < 0 || 
+                i >= OBJ_RENDERER_IMPOSTOR_GRID || 
+                j >= OBJ_RENDERER_IMPOSTOR_GRID)
+            {
+                continue;
+            }
+
+            GetCellDirection(i, j, &cell);
+            dot = cell.x*d->x + cell.y*d->y + cell.z*d->z;
+
+            if (dot > bestDot)
+            {
+                bestDot = dot;
+                *x = i;
+                *y = j;
+            }
+        }
+    }
+}
+
+/*
+** Gets the right and up vectors of a view along -d. The capture and the quad
+** of a cell use the same ones, so the image is not rotated on the quad.
+*/
+static void GetBasis(const FxsVector3* d, FxsVector3* right, FxsVector3* up)
+{
+    FxsVector3 up0 = {0.0f, 1.0f, 0.0f};
+    float length = 0.0f;
+
+    if (fabsf(d->y) > 0.99f)
+    {
+        up0.y = 0.0f;
+        up0.z = 1.0f;
+    }
+
+    /* right = up0 x d, up = d x right */
+    right->x = up0.y*d->z - up0.z*d->y;
+    right->y = up0.z*d->x - up0.x*d->z;
+    right->z = up0.x*d->y - up0.y*d->x;
+    length = sqrtf(right->x*right->x + right->y*right->y + right->z*right->z);
+    right->x /= length;
+    right->y /= length;
+    right->z /= length;
+    up->x = d->y*right->z - d->z*right->y;
+    up->y = d->z*right->x - d->x*right->z;
+    up->z = d->x*right->y - d->y*right->x;
+}
+
+/*
+** Sets up the orthographic view of the bounding sphere of impostor along -d.
+** The eye is 2 radii from the center, the sphere is between the near and the
+** far plane.
+*/
+static void GetCaptureMatrices(
+    const ObjRendererImpostor* impostor,
+    const FxsVector3* d,
+    float* view,
+    float* projection
+)
+{
+    const FxsVector3* c = &impostor->center;
+    float r = impostor->radius;
+    FxsVector3 right;
+    FxsVector3 up;
+    FxsVector3 eye;
+
+    GetBasis(d, &right, &up);
+    eye.x = c->x + 2.0f*r*d->x;
+    eye.y = c->y + 2.0f*r*d->y;
+    eye.z = c->z + 2.0f*r*d->z;
+
+    /* the rows of the rotation are right, up and d (column major) */
+    memset(view, 0, 16*sizeof(float));
+    view[0] = right.x;
+    view[4] = right.y;
+    view[8] = right.z;
+    view[1] = up.x;
+    view[5] = up.y;
+    view[9] = up.z;
+    view[2] = d->x;
+    view[6] = d->y;
+    view[10] = d->z;
+    view[12] = -(right.x*eye.x + right.y*eye.y + right.z*eye.z);
+    view[13] = -(up.x*eye.x + up.y*eye.y + up.z*eye.z);
+    view[14] = -(d->x*eye.x + d->y*eye.y + d->z*eye.z);
+    view[15] = 1.0f;
+
+    /* -r .. r in x and y, near r, far 3r */
+    memset(projection, 0, 16*sizeof(float));
+    projection[0] = 1.0f/r;
+    projection[5] = 1.0f/r;
+    projection[10] = -1.0f/r;
+    projection[14] = -2.0f;
+    projection[15] = 1.0f;
+}
+
+static int CreateProgram()
+{
+    if (program)
+    {
+        return 1;
+    }
+
+    program = glCreateProgram();
+    FxsOpenGLProgramAttachShaderWithSource(program, GL_VERTEX_SHADER, vertexShader);
+    FxsOpenGLProgramAttachShaderWithSource(program, GL_FRAGMENT_SHADER, fragmentShader);
+    glBindFragDataLocation(program, 0, "fragOut");
+    FxsOpenGLProgramLink(program);
+    viewProjectionLocation = glGetUniformLocation(program, "viewProjection");
+    centerLocation = glGetUniformLocation(program, "center");
+    rightLocation = glGetUniformLocation(program, "right");
+    upLocation = glGetUniformLocation(program, "up");
+    cellLocation = glGetUniformLocation(program, "cell");
+    alphaLocation = glGetUniformLocation(program, "alpha");
+    FFGLStateUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "atlas"), 0);
+
+    /* a core profile draws nothing without a vao */
+    glGenVertexArrays(1, &vao);
+
+    if (GL_NO_ERROR != glGetError())
+    {
+        ERR_MSG("Failed to create the impostor program");
+        ObjRendererImpostorShutdown();
+        return 0;
+    }
+
+    return 1;
+}
+
+ObjRendererImpostor* ObjRendererImpostorCreate(
+    const ObjRendererBoundingBox* box,
+    ObjRendererImpostorDrawFunc draw,
+    void* userData
+)
+{
+    ObjRendererImpostor* impostor = NULL;
+    GLuint framebuffer = 0;
+    GLuint depthbuffer = 0;
+    GLint oldFramebuffer = 0;
+    GLint oldViewport[4];
+    GLfloat oldClearColor[4];
+    GLboolean depthTest = GL_FALSE;
+    FxsVector3 d;
+    float view[16];
+    float projection[16];
+    float dx = box->max.x - box->min.x;
+    float dy = box->max.y - box->min.y;
+    float dz = box->max.z - box->min.z;
+    int x = 0;
+    int y = 0;
+
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f || !CreateProgram())
+    {
+        return NULL;
+    }
+
+    impostor = calloc(1, sizeof(ObjRendererImpostor));
+
+    if (!impostor)
+    {
+        ERR_MSG("Failed to allocate memory for the impostor");
+        return NULL;
+    }
+
+    impostor->center.x = (box->min.x + box->max.x)*0.5f;
+    impostor->center.y = (box->min.y + box->max.y)*0.5f;
+    impostor->center.z = (box->min.z + box->max.z)*0.5f;
+    impostor->radius = 0.5f*sqrtf(dx*dx + dy*dy + dz*dz);
+
+    /* a single point still gets a visible capture */
+    if (impostor->radius <= 0.0f)
+    {
+        impostor->radius = 1.0f;
+    }
+
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &oldFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, oldViewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, oldClearColor);
+    depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+    glGenTextures(1, &impostor->texture);
+    FFGLStateBindTexture(0, GL_TEXTURE_2D, impostor->texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ATLAS_SIZE, ATLAS_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MAX_LEVEL);
+
+    /* not bound while it is drawn to */
+    FFGLStateBindTexture(0, GL_TEXTURE_2D, 0);
+
+    glGenRenderbuffers(1, &depthbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, ATLAS_SIZE, ATLAS_SIZE);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, impostor->texture, 0);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthbuffer);
+
+    if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_DRAW_FRAMEBUFFER))
+    {
+        ERR_MSG("The impostor framebuffer is incomplete");
+        goto error;
+    }
+
+    FFGLStateEnable(GL_DEPTH_TEST);
+    FFGLStateDepthMask(GL_TRUE);
+    glViewport(0, 0, ATLAS_SIZE, ATLAS_SIZE);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    for (y = 0; y < OBJ_RENDERER_IMPOSTOR_GRID; y++)
+    {
+        for (x = 0; x < OBJ_RENDERER_IMPOSTOR_GRID; x++)
+        {
+            GetCellDirection(x, y, &d);
+            GetCaptureMatrices(impostor, &d, view, projection);
+            glViewport(
+                x*OBJ_RENDERER_IMPOSTOR_CELL_SIZE,
+                y*OBJ_RENDERER_IMPOSTOR_CELL_SIZE,
+                OBJ_RENDERER_IMPOSTOR_CELL_SIZE,
+                OBJ_RENDERER_IMPOSTOR_CELL_SIZE
+            );
+            draw(view, projection, userData);
+        }
+    }
+
+    FFGLStateBindTexture(0, GL_TEXTURE_2D, impostor->texture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    if (GL_NO_ERROR != glGetError())
+    {
+        ERR_MSG("Failed to capture the impostor");
+        goto error;
+    }
+
+    goto done;
+
+error:
+    FFGLStateDeleteTexture(impostor->texture);
+    free(impostor);
+    impostor = NULL;
+
+done:
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, oldFramebuffer);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteRenderbuffers(1, &depthbuffer);
+    glViewport(oldViewport[0], oldViewport[1], oldViewport[2], oldViewport[3]);
+    glClearColor(oldClearColor[0], oldClearColor[1], oldClearColor[2], oldClearColor[3]);
+
+    if (!depthTest)
+    {
+        FFGLStateDisable(GL_DEPTH_TEST);
+    }
+
+    return impostor;
+}
+
+void ObjRendererImpostorDraw(
+    const ObjRendererImpostor* impostor,
+    const FxsVector3* eye,
+    const float* viewProjection,
+    float alpha
+)
+{
+    const float cellSize = 1.0f/OBJ_RENDERER_IMPOSTOR_GRID;
+    FxsVector3 d;
+    FxsVector3 right;
+    FxsVector3 up;
+    int x = 0;
+    int y = 0;
+
+    if (!program)
+    {
+        return;
+    }
+
+    d.x = eye->x - impostor->center.x;
+    d.y = eye->y - impostor->center.y;
+    d.z = eye->z - impostor->center.z;
+    GetCell(&d, &x, &y);
+
+    /* the quad faces the direction of the capture, not the eye */
+    GetCellDirection(x, y, &d);
+    GetBasis(&d, &right, &up);
+    right.x *= impostor->radius;
+    right.y *= impostor->radius;
+    right.z *= impostor->radius;
+    up.x *= impostor->radius;
+    up.y *= impostor->radius;
+    up.z *= impostor->radius;
+
+    FFGLStateUseProgram(program);
+    FFGLStateBindVertexArray(vao);
+    FFGLStateBindTexture(0, GL_TEXTURE_2D, impostor->texture);
+    glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, viewProjection);
+    glUniform3fv(centerLocation, 1, &impostor->center.x);
+    glUniform3fv(rightLocation, 1, &right.x);
+    glUniform3fv(upLocation, 1, &up.x);
+    glUniform4f(cellLocation, x*cellSize, y*cellSize, cellSize, cellSize);
+    glUniform1f(alphaLocation, alpha);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+}
+
+void ObjRendererImpostorDestroy(ObjRendererImpostor** impostor)
+{
+    FFGLStateDeleteTexture((*impostor)->texture);
+    free(*impostor);
+    *impostor = NULL;
+}
+
+void ObjRendererImpostorShutdown()
+{
+    if (vao)
+    {
+        FFGLStateDeleteVertexArray(vao);
+        vao = 0;
+    }
+
+    if (program)
+    {
+        FFGLStateDeleteProgram(program);
+        program = 0;
+    }
+}
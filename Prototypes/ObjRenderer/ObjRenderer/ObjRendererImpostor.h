@@ -0,0 +1,83 @@
+#ifndef OBJRENDERERIMPOSTOR_H
+#define OBJRENDERERIMPOSTOR_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ObjRendererMesh.h"
+
+/*
+** An impostor replaces a distant mesh with a single textured quad. The mesh
+** is captured from OBJ_RENDERER_IMPOSTOR_GRID^2 directions into the cells of
+** an atlas texture with a framebuffer object. The directions are the cell
+** centers of an octahedral map of the sphere (the same mapping as the packed
+** normals, see ObjRendererPacking.h), so they cover the sphere evenly and the
+** cell of a direction is found without a search.
+**
+** Each capture is an orthographic view of the bounding sphere of the mesh.
+** The quad is drawn around the center of the sphere, facing the direction of
+** the cell that is closest to the direction to the eye, so the image on it
+** matches the mesh up to the angle between the two directions.
+*/
+
+#define OBJ_RENDERER_IMPOSTOR_GRID 8
+#define OBJ_RENDERER_IMPOSTOR_CELL_SIZE 128     /* in pixels */
+
+typedef struct ObjRendererImpostor_
+{
+    GLuint texture;             /* the atlas */
+    FxsVector3 center;          /* of the bounding sphere */
+    float radius;
+}
+ObjRendererImpostor;
+
+/*
+** Draws the mesh for a capture. view and projection are opengl matrices, the
+** framebuffer and viewport are set up.
+*/
+typedef void (*ObjRendererImpostorDrawFunc)(
+    const float* view,
+    const float* projection,
+    void* userData
+);
+
+/*
+** Captures the mesh inside box by calling draw for each cell of the atlas.
+** The viewport, framebuffer and clear color are restored afterwards. Returns
+** NULL if it fails.
+*/
+ObjRendererImpostor* ObjRendererImpostorCreate(
+    const ObjRendererBoundingBox* box,
+    ObjRendererImpostorDrawFunc draw,
+    void* userData
+);
+
+/*
+** Draws the quad of impostor for the eye position with the opengl matrix
+** viewProjection. Its alpha is multiplied with alpha, blending has to be set
+** up by the caller. Uses its own program and vao, they stay bound.
+*/
+void ObjRendererImpostorDraw(
+    const ObjRendererImpostor* impostor,
+    const FxsVector3* eye,
+    const float* viewProjection,
+    float alpha
+);
+
+/*
+** Releases impostor. Sets impostor to NULL.
+*/
+void ObjRendererImpostorDestroy(ObjRendererImpostor** impostor);
+
+/*
+** Releases the program and vao of the quads.
+*/
+void ObjRendererImpostorShutdown();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERIMPOSTOR_H */
@@ -0,0 +1,557 @@
+//
+//  ObjRendererIndexer.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <math.h>
+#include <assert.h>
+#include "ObjRendererIndexer.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/* constants of the vertex scoring, see Forsyth's article */
+#define CACHE_DECAY_POWER 1.5f
+#define LAST_TRI_SCORE 0.75f
+#define VALENCE_BOOST_SCALE 2.0f
+#define VALENCE_BOOST_POWER 0.5f
+#define MAX_VALENCE_SCORE 32
+
+/******************************************************************************/
+static unsigned int HashKey(const ObjRendererVertexKey* key)
+{
+    return (unsigned int)key->p*73856093u ^
+        (unsigned int)key->n*19349663u ^
+        (unsigned int)key->tc*83492791u;
+}
+
+static int KeysEqual(const ObjRendererVertexKey* a, const ObjRendererVertexKey* b)
+{
+    return a->p == b->p && a->n == b->n && a->tc == b->tc;
+}
+
+/*
+** Gets the slot of key, which is either free or holds the vertex with key.
+*/
+static unsigned int FindSlot(
+    const ObjRendererIndexer* indexer,
+    const ObjRendererVertexKey* key
+)
+{
+    unsigned int mask = indexer->numSlots - 1;
+    unsigned int slot = HashKey(key) & mask;
+
+    while (indexer->stamps[slot] == indexer->stamp &&
+        !KeysEqual(&indexer->vertices[indexer->slots[slot]], key))
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    return slot;
+}
+
+/*
+** Doubles the hash table and reinserts the vertices. Returns 0 if it fails.
+*/
+static int GrowSlots(ObjRendererIndexer* indexer)
+{
+    unsigned int numSlots = indexer->numSlots ? 2*indexer->numSlots : 1024;
+    unsigned int* slots = malloc(numSlots*sizeof(unsigned int));
+    unsigned int* stamps = calloc(numSlots, sizeof(unsigned int));
+    unsigned int slot = 0;
+    unsigned int i = 0;
+
+    if (!slots || !stamps)
+    {
+        free(slots);
+        free(stamps);
+        return 0;
+    }
+
+    free(indexer->slots);
+    free(indexer->stamps);
+    indexer->slots = slots;
+    indexer->stamps = stamps;
+    indexer->numSlots = numSlots;
+    indexer->stamp = 1;
+
+    for (i = 0; i < indexer->numVertices; i++)
+    {
+        slot = FindSlot(indexer, &indexer->vertices[i]);
+        indexer->slots[slot] = i;
+        indexer->stamps[slot] = indexer->stamp;
+    }
+
+    return 1;
+}
+
+static int Reserve(
+    void** array,
+    unsigned int* max,
+    unsigned int needed,
+    size_t size
+)
+{
+    unsigned int newMax = *max ? *max : 1024;
+    void* newArray = NULL;
+
+    if (needed <= *max)
+    {
+        return 1;
+    }
+
+    while (newMax < needed)
+    {
+        newMax *= 2;
+    }
+
+    newArray = realloc(*array, newMax*size);
+
+    if (!newArray)
+    {
+        return 0;
+    }
+
+    *array = newArray;
+    *max = newMax;
+
+    return 1;
+}
+
+/******************************************************************************/
+ObjRendererIndexer* ObjRendererIndexerCreate()
+{
+    ObjRendererIndexer* indexer = malloc(sizeof(ObjRendererIndexer));
+
+    if (!indexer)
+    {
+        return NULL;
+    }
+
+    memset(indexer, 0, sizeof(ObjRendererIndexer));
+
+    if (!GrowSlots(indexer))
+    {
+        free(indexer);
+        return NULL;
+    }
+
+    return indexer;
+}
+
+void ObjRendererIndexerReset(ObjRendererIndexer* indexer)
+{
+    indexer->stamp++;
+
+    if (!indexer->stamp)
+    {
+        memset(indexer->stamps, 0, indexer->numSlots*sizeof(unsigned int));
+        indexer->stamp = 1;
+    }
+
+    indexer->numVertices = 0;
+    indexer->numIndices = 0;
+}
+
+static int AddCorner(ObjRendererIndexer* indexer, int p, int n, int tc)
+{
+    ObjRendererVertexKey key;
+    unsigned int slot = 0;
+
+    key.p = p;
+    key.n = n;
+    key.tc = tc;
+    slot = FindSlot(indexer, &key);
+
+    if (indexer->stamps[slot] != indexer->stamp)
+    {
+        if (!Reserve((void**)&indexer->vertices, &indexer->maxVertices,
+                indexer->numVertices + 1, sizeof(ObjRendererVertexKey)))
+        {
+            return 0;
+        }
+
+        indexer->slots[slot] = indexer->numVertices;
+        indexer->stamps[slot] = indexer->stamp;
+        indexer->vertices[indexer->numVertices++] = key;
+
+        /* keep the table at most half full */
+        if (2*indexer->numVertices > indexer->numSlots)
+        {
+            if (!GrowSlots(indexer))
+            {
+                return 0;
+            }
+
+            slot = FindSlot(indexer, &key);
+        }
+    }
+
+    indexer->indices[indexer->numIndices++] = indexer->slots[slot];
+
+    return 1;
+}
+
+int ObjRendererIndexerAddFace(
+    ObjRendererIndexer* indexer,
+    const ObjRendererFace* face,
+    int useNormals,
+    int useTexCoords
+)
+{
+    int hasNormals = useNormals && face->n0 != -1;
+    int hasTexCoords = useTexCoords && face->tc0 != -1;
+
+    if (!Reserve((void**)&indexer->indices, &indexer->maxIndices,
+            indexer->numIndices + 3, sizeof(unsigned int)))
+    {
+        return 0;
+    }
+
+    return AddCorner(indexer, face->p0,
+            hasNormals ? face->n0 : -1, hasTexCoords ? face->tc0 : -1) &&
+        AddCorner(indexer, face->p1,
+            hasNormals ? face->n1 : -1, hasTexCoords ? face->tc1 : -1) &&
+        AddCorner(indexer, face->p2,
+            hasNormals ? face->n2 : -1, hasTexCoords ? face->tc2 : -1);
+}
+
+/******************************************************************************/
+/*
+** Score of a vertex for the triangle selection, high if the vertex is likely
+** in the cache or has few triangles left.
+*/
+static float ComputeVertexScore(
+    unsigned int numActiveTris,
+    int cachePosition,
+    const float* cacheScores,
+    const float* valenceScores
+)
+{
+    float score = 0.0f;
+
+    if (!numActiveTris)
+    {
+        return -1.0f;
+    }
+
+    if (cachePosition >= 0)
+    {
+        score = cacheScores[cachePosition];
+    }
+
+    if (numActiveTris <= MAX_VALENCE_SCORE)
+    {
+        return score + valenceScores[numActiveTris];
+    }
+
+    return score + VALENCE_BOOST_SCALE*powf(
+            (float)numActiveTris,
+            -VALENCE_BOOST_POWER
+        );
+}
+
+int ObjRendererIndexerOptimize(ObjRendererIndexer* indexer)
+{
+    unsigned int numVertices = indexer->numVertices;
+    unsigned int numIndices = indexer->numIndices;
+    unsigned int numTris = numIndices/3;
+    size_t scratchSize = 8*(size_t)numVertices + 8*(size_t)numTris + 1;
+    unsigned int* numActiveTris = NULL;
+    unsigned int* offsets = NULL;
+    unsigned int* adjacency = NULL;
+    int* cachePositions = NULL;
+    float* vertexScores = NULL;
+    float* triScores = NULL;
+    unsigned int* triAdded = NULL;
+    unsigned int* output = NULL;
+    unsigned int* remap = NULL;
+    ObjRendererVertexKey* keys = NULL;
+    float cacheScores[OBJ_RENDERER_CACHE_SIZE];
+    float valenceScores[MAX_VALENCE_SCORE + 1];
+    unsigned int cache[OBJ_RENDERER_CACHE_SIZE + 3];
+    unsigned int newCache[OBJ_RENDERER_CACHE_SIZE + 3];
+    unsigned int cacheSize = 0;
+    unsigned int newCacheSize = 0;
+    unsigned int nextTri = 0;
+    unsigned int numAdded = 0;
+    unsigned int i = 0, j = 0, k = 0;
+    unsigned int v = 0, t = 0;
+    int bestTri = -1;
+    float bestScore = 0.0f;
+
+    if (numTris < 2)
+    {
+        return 1;
+    }
+
+    if (scratchSize > indexer->scratchSize)
+    {
+        free(indexer->scratch);
+        indexer->scratch = malloc(scratchSize*sizeof(unsigned int));
+        indexer->scratchSize = indexer->scratch ? scratchSize : 0;
+
+        if (!indexer->scratch)
+        {
+            return 0;
+        }
+    }
+
+    numActiveTris = indexer->scratch;
+    offsets = numActiveTris + numVertices;
+    adjacency = offsets + numVertices + 1;
+    cachePositions = (int*)(adjacency + 3*numTris);
+    vertexScores = (float*)(cachePositions + numVertices);
+    triScores = (float*)(vertexScores + numVertices);
+    triAdded = (unsigned int*)(triScores + numTris);
+    output = triAdded + numTris;
+    remap = output + 3*numTris;
+    keys = (ObjRendererVertexKey*)(remap + numVertices);
+
+    for (i = 0; i < OBJ_RENDERER_CACHE_SIZE; i++)
+    {
+        cacheScores[i] = i < 3 ? LAST_TRI_SCORE : powf(
+                1.0f - (i - 3)*(1.0f/(OBJ_RENDERER_CACHE_SIZE - 3)),
+                CACHE_DECAY_POWER
+            );
+    }
+
+    valenceScores[0] = 0.0f;
+
+    for (i = 1; i <= MAX_VALENCE_SCORE; i++)
+    {
+        valenceScores[i] = VALENCE_BOOST_SCALE*powf(
+                (float)i,
+                -VALENCE_BOOST_POWER
+            );
+    }
+
+    /* build the triangle lists of the vertices */
+    memset(numActiveTris, 0, numVertices*sizeof(unsigned int));
+
+    for (i = 0; i < numIndices; i++)
+    {
+        numActiveTris[indexer->indices[i]]++;
+    }
+
+    offsets[0] = 0;
+
+    for (i = 0; i < numVertices; i++)
+    {
+        offsets[i + 1] = offsets[i] + numActiveTris[i];
+        cachePositions[i] = 0;      /* fill counter for now */
+    }
+
+    for (i = 0; i < numIndices; i++)
+    {
+        v = indexer->indices[i];
+        adjacency[offsets[v] + cachePositions[v]++] = i/3;
+    }
+
+    for (i = 0; i < numVertices; i++)
+    {
+        cachePositions[i] = -1;
+        vertexScores[i] = ComputeVertexScore(
+                numActiveTris[i],
+                -1,
+                cacheScores,
+                valenceScores
+            );
+    }
+
+    for (i = 0; i < numTris; i++)
+    {
+        triAdded[i] = 0;
+        triScores[i] = vertexScores[indexer->indices[3*i + 0]] +
+            vertexScores[indexer->indices[3*i + 1]] +
+            vertexScores[indexer->indices[3*i + 2]];
+
+        if (bestTri == -1 || triScores[i] > bestScore)
+        {
+            bestTri = i;
+            bestScore = triScores[i];
+        }
+    }
+
+    while (numAdded < numTris)
+    {
+        /* nothing in the cache has triangles left, continue with the next
+        ** triangle in the original order
+        */
+        if (bestTri == -1)
+        {
+            while (triAdded[nextTri])
+            {
+                nextTri++;
+            }
+
+            bestTri = nextTri;
+        }
+
+        t = (unsigned int)bestTri;
+        triAdded[t] = 1;
+        output[3*numAdded + 0] = indexer->indices[3*t + 0];
+        output[3*numAdded + 1] = indexer->indices[3*t + 1];
+        output[3*numAdded + 2] = indexer->indices[3*t + 2];
+        numAdded++;
+
+        /* the vertices of the triangle move to the front of the cache */
+        newCacheSize = 0;
+
+        for (i = 0; i < 3; i++)
+        {
+            v = indexer->indices[3*t + i];
+            newCache[newCacheSize++] = v;
+
+            /* remove the triangle from the active triangles of v */
+            for (j = offsets[v]; j < offsets[v] + numActiveTris[v]; j++)
+            {
+                if (adjacency[j] == t)
+                {
+                    adjacency[j] = adjacency[offsets[v] + numActiveTris[v] - 1];
+                    numActiveTris[v]--;
+                    break;
+                }
+            }
+        }
+
+        for (i = 0; i < cacheSize; i++)
+        {
+            v = cache[i];
+
+            if (v != newCache[0] && v != newCache[1] && v != newCache[2])
+            {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        /* update the scores of the cached vertices, the ones beyond the
+        ** cache size drop out
+        */
+        for (i = 0; i < newCacheSize; i++)
+        {
+            v = newCache[i];
+            cachePositions[v] = i < OBJ_RENDERER_CACHE_SIZE ? (int)i : -1;
+            vertexScores[v] = ComputeVertexScore(
+                    numActiveTris[v],
+                    cachePositions[v],
+                    cacheScores,
+                    valenceScores
+                );
+        }
+
+        /* rescore the triangles of those vertices and pick the best one */
+        bestTri = -1;
+
+        for (i = 0; i < newCacheSize; i++)
+        {
+            v = newCache[i];
+
+            for (j = offsets[v]; j < offsets[v] + numActiveTris[v]; j++)
+            {
+                k = adjacency[j];
+                triScores[k] = vertexScores[indexer->indices[3*k + 0]] +
+                    vertexScores[indexer->indices[3*k + 1]] +
+                    vertexScores[indexer->indices[3*k + 2]];
+
+                if (bestTri == -1 || triScores[k] > bestScore)
+                {
+                    bestTri = k;
+                    bestScore = triScores[k];
+                }
+            }
+        }
+
+        cacheSize = newCacheSize < OBJ_RENDERER_CACHE_SIZE ?
+            newCacheSize : OBJ_RENDERER_CACHE_SIZE;
+        memcpy(cache, newCache, cacheSize*sizeof(unsigned int));
+    }
+
+    /* remember the hash table slots of the vertices before they move */
+    for (i = 0; i < numVertices; i++)
+    {
+        numActiveTris[i] = FindSlot(indexer, &indexer->vertices[i]);
+    }
+
+    /* renumber the vertices in the order of their first use */
+    memset(remap, 0xFF, numVertices*sizeof(unsigned int));
+    v = 0;
+
+    for (i = 0; i < numIndices; i++)
+    {
+        if (remap[output[i]] == 0xFFFFFFFF)
+        {
+            remap[output[i]] = v++;
+        }
+
+        indexer->indices[i] = remap[output[i]];
+    }
+
+    memcpy(keys, indexer->vertices, numVertices*sizeof(ObjRendererVertexKey));
+
+    for (i = 0; i < numVertices; i++)
+    {
+        indexer->vertices[remap[i]] = keys[i];
+        indexer->slots[numActiveTris[i]] = remap[i];
+    }
+
+    return 1;
+}
+
+unsigned int ObjRendererCountCacheMisses(
+    const unsigned int* indices,
+    unsigned int numIndices,
+    unsigned int numVertices
+)
+{
+    unsigned int* insertedAt = malloc(numVertices*sizeof(unsigned int));
+    unsigned int numMisses = 0;
+    unsigned int i = 0;
+    unsigned int v = 0;
+
+    if (!insertedAt)
+    {
+        return numIndices;
+    }
+
+    /* a vertex is in the fifo if less than OBJ_RENDERER_CACHE_SIZE misses
+    ** happened since it was inserted
+    */
+    memset(insertedAt, 0xFF, numVertices*sizeof(unsigned int));
+
+    for (i = 0; i < numIndices; i++)
+    {
+        v = indices[i];
+
+        if (insertedAt[v] == 0xFFFFFFFF ||
+            numMisses - insertedAt[v] >= OBJ_RENDERER_CACHE_SIZE)
+        {
+            insertedAt[v] = numMisses++;
+        }
+    }
+
+    free(insertedAt);
+
+    return numMisses;
+}
+
+void ObjRendererIndexerDestroy(ObjRendererIndexer** indexer)
+{
+    if (!indexer || !*indexer)
+    {
+        return;
+    }
+
+    free((*indexer)->vertices);
+    free((*indexer)->indices);
+    free((*indexer)->slots);
+    free((*indexer)->stamps);
+    free((*indexer)->scratch);
+    free(*indexer);
+    *indexer = NULL;
+}
@@ -0,0 +1,103 @@
+#ifndef OBJRENDERERINDEXER_H
+#define OBJRENDERERINDEXER_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ObjRendererFile.h"
+
+/*
+** Turns the faces of a render data into indexed triangles. Corners with the
+** same (position, normal, tex coord) are welded into one vertex, then the
+** triangles are reordered for the post transform vertex cache (Tom Forsyth's
+** "Linear-Speed Vertex Cache Optimisation") and the vertices are renumbered
+** in the order they are first used, for locality of the vertex fetches.
+**
+** The indexer keeps its memory between blocks, so one indexer should be used
+** for all render data of a mesh.
+*/
+
+/*
+** A welded vertex: indices into the arrays of the ObjRendererFile, -1 if the
+** vertex has no normal or tex coord.
+*/
+typedef struct
+{
+    int p;
+    int n;
+    int tc;
+}
+ObjRendererVertexKey;
+
+typedef struct
+{
+    /* the result for the current block */
+    ObjRendererVertexKey* vertices;
+    unsigned int* indices;      /* 3 per triangle, refer to vertices */
+    unsigned int numVertices;
+    unsigned int numIndices;
+
+    unsigned int maxVertices;
+    unsigned int maxIndices;
+
+    /* hash table for welding. A slot holds a vertex of the current block if
+    ** its stamp is the current stamp, resetting just bumps the stamp.
+    */
+    unsigned int* slots;
+    unsigned int* stamps;
+    unsigned int numSlots;
+    unsigned int stamp;
+
+    /* scratch memory of ObjRendererIndexerOptimize */
+    unsigned int* scratch;
+    size_t scratchSize;
+}
+ObjRendererIndexer;
+
+ObjRendererIndexer* ObjRendererIndexerCreate();
+
+/*
+** Starts a new block, the vertices and indices of the last one are dropped.
+*/
+void ObjRendererIndexerReset(ObjRendererIndexer* indexer);
+
+/*
+** Adds a triangle to the current block. The normal (tex coord) indices of the
+** face are ignored if useNormals (useTexCoords) is 0. Returns 0 if it fails.
+*/
+int ObjRendererIndexerAddFace(
+    ObjRendererIndexer* indexer,
+    const ObjRendererFace* face,
+    int useNormals,
+    int useTexCoords
+);
+
+/*
+** Reorders the triangles and renumbers the vertices of the current block.
+** Returns 0 if it fails, the block is left in its original order then.
+*/
+int ObjRendererIndexerOptimize(ObjRendererIndexer* indexer);
+
+/*
+** Simulates a FIFO post transform cache of OBJ_RENDERER_CACHE_SIZE entries
+** and returns the # of vertices that miss it. Divided by the # of triangles
+** this is the average cache miss ratio (ACMR), 3 is the worst and 0.5 about
+** the best a regular mesh can get.
+*/
+#define OBJ_RENDERER_CACHE_SIZE 32
+
+unsigned int ObjRendererCountCacheMisses(
+    const unsigned int* indices,
+    unsigned int numIndices,
+    unsigned int numVertices
+);
+
+void ObjRendererIndexerDestroy(ObjRendererIndexer** indexer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERINDEXER_H */
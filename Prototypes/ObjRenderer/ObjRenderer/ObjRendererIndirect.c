@@ -0,0 +1,444 @@
+//
+//  ObjRendererIndirect.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <assert.h>
+#include <Fxs/OpenGL/Program.h>
+#include <FF/GLState/GLState.h>
+#include "ObjRendererIndirect.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/* macOS stops at OpenGL 4.1 and does not export the 4.3 entry points */
+#if !defined(__APPLE__)
+#define HAS_GL43 1
+#endif
+
+#define CULL_GROUP_SIZE 64
+
+#define TO_STRING(X) #X
+
+/*
+** Tests the bounding box of each command against the clip volume. A box is
+** culled if all its corners are outside of one of the clip planes.
+*/
+static char* cullShader =
+    "#version 430\n"
+TO_STRING(
+    layout(local_size_x = 64) in;
+
+    struct Command
+    {
+        uint count;
+        uint instanceCount;
+        uint firstIndex;
+        int baseVertex;
+        uint baseInstance;
+    };
+
+    layout(std430, binding = 0) buffer Commands
+    {
+        Command commands[];
+    };
+
+    layout(std430, binding = 1) readonly buffer Bounds
+    {
+        vec4 bounds[];
+    };
+
+    uniform mat4 viewProjection;
+    uniform uint numCommands;
+
+    void main()
+    {
+        uint i = gl_GlobalInvocationID.x;
+        vec3 bmin;
+        vec3 bmax;
+        vec4 c[8];
+        bool visible = true;
+        int j;
+
+        if (i >= numCommands)
+        {
+            return;
+        }
+
+        bmin = bounds[2u*i].xyz;
+        bmax = bounds[2u*i + 1u].xyz;
+
+        for (j = 0; j < 8; j++)
+        {
+            c[j] = viewProjection*vec4(
+                    (j & 1) != 0 ? bmax.x : bmin.x,
+                    (j & 2) != 0 ? bmax.y : bmin.y,
+                    (j & 4) != 0 ? bmax.z : bmin.z,
+                    1.0
+                );
+        }
+
+        for (j = 0; j < 3; j++)
+        {
+            bool allBelow = true;
+            bool allAbove = true;
+            int k;
+
+            for (k = 0; k < 8; k++)
+            {
+                allBelow = allBelow && c[k][j] < -c[k].w;
+                allAbove = allAbove && c[k][j] > c[k].w;
+            }
+
+            visible = visible && !allBelow && !allAbove;
+        }
+
+        commands[i].instanceCount = visible ? 1u : 0u;
+    }
+);
+
+static GLuint cullProgram = 0;
+static GLint viewProjectionLocation = -1;
+static GLint numCommandsLocation = -1;
+static int isSupported = -1;    /* -1 until it was checked */
+
+/*
+** Sort item for ordering the render data by vertex format and material.
+*/
+typedef struct
+{
+    int format;
+    int matId;
+    unsigned int data;
+}
+DataItem;
+
+static int CompareDataItems(const void* a, const void* b)
+{
+    const DataItem* da = (const DataItem*)a;
+    const DataItem* db = (const DataItem*)b;
+
+    if (da->format != db->format)
+    {
+        return da->format < db->format ? -1 : 1;
+    }
+
+    if (da->matId != db->matId)
+    {
+        return da->matId < db->matId ? -1 : 1;
+    }
+
+    return da->data < db->data ? -1 : (da->data > db->data);
+}
+
+int ObjRendererIndirectIsSupported()
+{
+    GLint major = 0;
+    GLint minor = 0;
+
+    if (isSupported == -1)
+    {
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+#ifdef HAS_GL43
+        isSupported = major > 4 || (major == 4 && minor >= 3);
+#else
+        isSupported = 0;
+#endif
+    }
+
+    return isSupported;
+}
+
+static int CreateCullProgram()
+{
+    if (cullProgram)
+    {
+        return 1;
+    }
+
+    cullProgram = glCreateProgram();
+    FxsOpenGLProgramAttachShaderWithSource(cullProgram, GL_COMPUTE_SHADER, cullShader);
+    FxsOpenGLProgramLink(cullProgram);
+    viewProjectionLocation = glGetUniformLocation(cullProgram, "viewProjection");
+    numCommandsLocation = glGetUniformLocation(cullProgram, "numCommands");
+
+    if (GL_NO_ERROR != glGetError())
+    {
+        ERR_MSG("Failed to create the culling program");
+        FFGLStateDeleteProgram(cullProgram);
+        cullProgram = 0;
+        return 0;
+    }
+
+    return 1;
+}
+
+int ObjRendererIndirectCreate(ObjRendererMesh* mesh)
+{
+    ObjRendererIndirect* indirect = &mesh->indirect;
+    ObjRendererData* data = NULL;
+    DataItem* items = NULL;
+    float* bounds = NULL;
+    unsigned int i = 0;
+
+    memset(indirect, 0, sizeof(ObjRendererIndirect));
+
+    if (!mesh->numData)
+    {
+        return 1;
+    }
+
+    items = malloc(mesh->numData*sizeof(DataItem));
+    bounds = malloc(8*mesh->numData*sizeof(float));
+    indirect->commands = malloc(mesh->numData*sizeof(ObjRendererDrawCommand));
+    indirect->counts = malloc(mesh->numData*sizeof(GLsizei));
+    indirect->indexOffsets = malloc(mesh->numData*sizeof(GLvoid*));
+    indirect->baseVertices = malloc(mesh->numData*sizeof(GLint));
+    indirect->batches = malloc(mesh->numData*sizeof(ObjRendererDrawBatch));
+
+    if (!items || !bounds || !indirect->commands || !indirect->counts || 
+        !indirect->indexOffsets || !indirect->baseVertices || 
+        !indirect->batches)
+    {
+        ERR_MSG("Failed to allocate the draw commands");
+        free(items);
+        free(bounds);
+        ObjRendererIndirectDestroy(mesh);
+        return 0;
+    }
+
+    /* order the render data by vertex format and material, so that each 
+    ** (format, material) pair is one batch of consecutive commands
+    */
+    for (i = 0; i < mesh->numData; i++)
+    {
+        items[i].format = mesh->data[i].format;
+        items[i].matId = mesh->data[i].matId;
+        items[i].data = i;
+    }
+
+    qsort(items, mesh->numData, sizeof(DataItem), CompareDataItems);
+
+    for (i = 0; i < mesh->numData; i++)
+    {
+        data = &mesh->data[items[i].data];
+
+        indirect->commands[i].count = 3*data->numFaces;
+        indirect->commands[i].instanceCount = 1;
+        indirect->commands[i].firstIndex = data->firstIndex;
+        indirect->commands[i].baseVertex = data->baseVertex;
+        indirect->commands[i].baseInstance = 0;
+        indirect->counts[i] = 3*data->numFaces;
+        indirect->indexOffsets[i] = (GLvoid*)(data->firstIndex*sizeof(GLuint));
+        indirect->baseVertices[i] = data->baseVertex;
+
+        bounds[8*i + 0] = data->boundingBox.min.x;
+        bounds[8*i + 1] = data->boundingBox.min.y;
+        bounds[8*i + 2] = data->boundingBox.min.z;
+        bounds[8*i + 3] = 1.0f;
+        bounds[8*i + 4] = data->boundingBox.max.x;
+        bounds[8*i + 5] = data->boundingBox.max.y;
+        bounds[8*i + 6] = data->boundingBox.max.z;
+        bounds[8*i + 7] = 1.0f;
+
+        if (!indirect->numBatches || 
+            indirect->batches[indirect->numBatches - 1].format != data->format ||
+            indirect->batches[indirect->numBatches - 1].matId != data->matId)
+        {
+            indirect->batches[indirect->numBatches].format = data->format;
+            indirect->batches[indirect->numBatches].matId = data->matId;
+            indirect->batches[indirect->numBatches].firstCommand = i;
+            indirect->batches[indirect->numBatches].numCommands = 0;
+            indirect->numBatches++;
+        }
+
+        indirect->batches[indirect->numBatches - 1].numCommands++;
+    }
+
+    indirect->numCommands = mesh->numData;
+
+    if (ObjRendererIndirectIsSupported())
+    {
+        glGenBuffers(1, &indirect->commandBuffer);
+        FFGLStateBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect->commandBuffer);
+        glBufferData(
+            GL_DRAW_INDIRECT_BUFFER, 
+            indirect->numCommands*sizeof(ObjRendererDrawCommand),
+            indirect->commands,
+            GL_DYNAMIC_DRAW
+        );
+
+        glGenBuffers(1, &indirect->boundsBuffer);
+        FFGLStateBindBuffer(GL_ARRAY_BUFFER, indirect->boundsBuffer);
+        glBufferData(
+            GL_ARRAY_BUFFER, 
+            8*indirect->numCommands*sizeof(float),
+            bounds,
+            GL_STATIC_DRAW
+        );
+    }
+
+    free(items);
+    free(bounds);
+
+    if (GL_NO_ERROR != glGetError())
+    {
+        ERR_MSG("Failed to upload the draw commands");
+        ObjRendererIndirectDestroy(mesh);
+        return 0;
+    }
+
+    return 1;
+}
+
+void ObjRendererIndirectCull(ObjRendererMesh* mesh, const float* viewProjection)
+{
+#ifdef HAS_GL43
+    ObjRendererIndirect* indirect = &mesh->indirect;
+
+    if (!ObjRendererIndirectIsSupported() || !indirect->numCommands || 
+        !CreateCullProgram())
+    {
+        return;
+    }
+
+    FFGLStateUseProgram(cullProgram);
+    glUniformMatrix4fv(viewProjectionLocation, 1, GL_FALSE, viewProjection);
+    glUniform1ui(numCommandsLocation, indirect->numCommands);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, indirect->commandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, indirect->boundsBuffer);
+    glDispatchCompute(
+        (indirect->numCommands + CULL_GROUP_SIZE - 1)/CULL_GROUP_SIZE, 
+        1, 
+        1
+    );
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+#endif
+}
+
+void ObjRendererIndirectResetCulling(ObjRendererMesh* mesh)
+{
+    ObjRendererIndirect* indirect = &mesh->indirect;
+
+    if (!indirect->commandBuffer)
+    {
+        return;
+    }
+
+    FFGLStateBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect->commandBuffer);
+    glBufferSubData(
+        GL_DRAW_INDIRECT_BUFFER, 
+        0,
+        indirect->numCommands*sizeof(ObjRendererDrawCommand),
+        indirect->commands
+    );
+}
+
+/*
+** Sets the material of batch.
+*/
+static void SetMaterial(
+    const ObjRendererMesh* mesh, 
+    const ObjRendererDrawBatch* batch,
+    GLint materialLocation
+)
+{
+    GLfloat params[4];
+    GLuint texture = 0;
+
+    ObjRendererMeshGetMaterialParams(mesh, batch->matId, params, &texture);
+    glUniform4fv(materialLocation, 1, params);
+
+    if (texture)
+    {
+        FFGLStateBindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+    }
+}
+
+void ObjRendererIndirectDraw(
+    ObjRendererMesh* mesh, 
+    GLint materialLocation, 
+    GLint decodeLocation
+)
+{
+    ObjRendererIndirect* indirect = &mesh->indirect;
+    ObjRendererDrawBatch* batch = NULL;
+    unsigned int i = 0;
+
+#ifdef HAS_GL43
+    if (indirect->commandBuffer)
+    {
+        FFGLStateBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect->commandBuffer);
+
+        for (i = 0; i < indirect->numBatches; i++)
+        {
+            batch = &indirect->batches[i];
+            SetMaterial(mesh, batch, materialLocation);
+            FFGLStateBindVertexArray(mesh->vertexBuffers[batch->format].vao);
+            glUniformMatrix4fv(decodeLocation, 1, GL_FALSE, mesh->vertexBuffers[batch->format].decode);
+            glMultiDrawElementsIndirect(
+                GL_TRIANGLES,
+                GL_UNSIGNED_INT,
+                (const void*)(batch->firstCommand*sizeof(ObjRendererDrawCommand)),
+                batch->numCommands,
+                0
+            );
+        }
+
+        return;
+    }
+#endif
+
+    for (i = 0; i < indirect->numBatches; i++)
+    {
+        batch = &indirect->batches[i];
+        SetMaterial(mesh, batch, materialLocation);
+        FFGLStateBindVertexArray(mesh->vertexBuffers[batch->format].vao);
+        glUniformMatrix4fv(decodeLocation, 1, GL_FALSE, mesh->vertexBuffers[batch->format].decode);
+        glMultiDrawElementsBaseVertex(
+            GL_TRIANGLES,
+            &indirect->counts[batch->firstCommand],
+            GL_UNSIGNED_INT,
+            (const GLvoid* const*)&indirect->indexOffsets[batch->firstCommand],
+            batch->numCommands,
+            &indirect->baseVertices[batch->firstCommand]
+        );
+    }
+}
+
+void ObjRendererIndirectDestroy(ObjRendererMesh* mesh)
+{
+    ObjRendererIndirect* indirect = &mesh->indirect;
+
+    if (indirect->commandBuffer)
+    {
+        FFGLStateDeleteBuffer(indirect->commandBuffer);
+    }
+
+    if (indirect->boundsBuffer)
+    {
+        FFGLStateDeleteBuffer(indirect->boundsBuffer);
+    }
+
+    free(indirect->commands);
+    free(indirect->counts);
+    free(indirect->indexOffsets);
+    free(indirect->baseVertices);
+    free(indirect->batches);
+    memset(indirect, 0, sizeof(ObjRendererIndirect));
+}
+
+void ObjRendererIndirectShutdown()
+{
+    if (cullProgram)
+    {
+        FFGLStateDeleteProgram(cullProgram);
+        cullProgram = 0;
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef OBJRENDERERINDIRECT_H
+#define OBJRENDERERINDIRECT_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ObjRendererMesh.h"
+
+/*
+** Indirect drawing of all render data of a mesh. The draw commands live in a
+** GL_DRAW_INDIRECT_BUFFER and are issued with one glMultiDrawElementsIndirect
+** per material. With OpenGL 4.3 the commands can be culled against the view
+** frustum on the gpu by a compute shader. Without OpenGL 4.3 (e.g. macOS, 
+** older Mesa drivers) the same batches are drawn with 
+** glMultiDrawElementsBaseVertex.
+*/
+
+/*
+** Builds the draw commands and batches for all render data of mesh and 
+** uploads them. Returns 0 if it fails.
+*/
+int ObjRendererIndirectCreate(ObjRendererMesh* mesh);
+
+/*
+** Returns 1 if indirect multi draws and compute shaders (OpenGL 4.3) are 
+** available.
+*/
+int ObjRendererIndirectIsSupported();
+
+/*
+** Runs the culling pass: sets the instance count of each command of mesh to 1
+** if its bounding box intersects the view frustum and to 0 otherwise. 
+** viewProjection is an opengl matrix with 16 elements. Does nothing if 
+** indirect drawing is not supported.
+*/
+void ObjRendererIndirectCull(ObjRendererMesh* mesh, const float* viewProjection);
+
+/*
+** Makes all commands of mesh visible again after they were culled.
+*/
+void ObjRendererIndirectResetCulling(ObjRendererMesh* mesh);
+
+/*
+** Draws all render data of mesh, one multi draw per batch. The program has 
+** to be in use. The material of each batch is set to the vec4 uniform at 
+** materialLocation and its diffuse map is bound to unit 0 (see 
+** ObjRendererMeshGetMaterialParams). The decode matrix of the vertex buffer
+** of each batch is set to the mat4 uniform at decodeLocation.
+*/
+void ObjRendererIndirectDraw(
+    ObjRendererMesh* mesh, 
+    GLint materialLocation, 
+    GLint decodeLocation
+);
+
+/*
+** Releases the commands of mesh.
+*/
+void ObjRendererIndirectDestroy(ObjRendererMesh* mesh);
+
+/*
+** Releases the culling program. 
+*/
+void ObjRendererIndirectShutdown();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERINDIRECT_H */
@@ -7,516 +7,1017 @@
 //
 
 #include <stdio.h>
-#include <Fxs/Obj/ObjFile.h>
-#include <Fxs/Obj/ObjMtlFile.h>
 #include <stdlib.h>
+#include <math.h>
+#include <float.h>
 #include <memory.h>
+#include <string.h>
 #include <assert.h>
+#include <FF/GLState/GLState.h>
 #include "ObjRendererMesh.h"
+#include "ObjRendererIndirect.h"
+#include "ObjRendererFile.h"
+#include "ObjRendererIndexer.h"
+#include "ObjRendererCache.h"
+#include "ObjRendererMtlFile.h"
+#include "ObjRendererOctree.h"
+#include "ObjRendererPacking.h"
+#include "ObjRendererImpostor.h"
+#include "ObjRendererNormals.h"
 
-#define MAX_MATERIALS 256
 #define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
 
 /******************************************************************************/
 /*
-** Stores faces according to their material index in lists.
+** Sorts the faces of a group by their material with a counting sort. Bucket 
+** 0 holds the faces without material, bucket i the faces with matIdx i - 1.
+** The memory is kept between groups, so filling the buckets does not 
+** allocate.
 */
 typedef struct
 {
-    FxsListPtr buckets[MAX_MATERIALS];
+    unsigned int numBuckets;    /* # materials + 1 */
+    unsigned int* counts;       /* # faces per bucket, 0 for unused buckets */
+    unsigned int* starts;       /* first face of each bucket in faces */
+    unsigned int* used;         /* the non empty buckets in ascending order */
+    unsigned int numUsed;
+    unsigned int* faces;        /* indices of the faces, ordered by bucket */
 }
-MtlGroupHashTable;
+MtlGroupBuckets;
 
-MtlGroupHashTable* MtlGroupHashTableCreate()
+static int CompareBuckets(const void* a, const void* b)
 {
-    MtlGroupHashTable* table = malloc(sizeof(MtlGroupHashTable));
+    unsigned int ba = *(const unsigned int*)a;
+    unsigned int bb = *(const unsigned int*)b;
     
-    memset(table, 0, sizeof(MtlGroupHashTable));
-    
-    return table;
+    return ba < bb ? -1 : (ba > bb);
 }
 
-int MtlGroupHashTableInsert(MtlGroupHashTable* table, int idx, FxsObjFace* face)
+static MtlGroupBuckets* MtlGroupBucketsCreate(unsigned int numMaterials)
 {
-    assert(table);
-    assert(idx < MAX_MATERIALS);
+    MtlGroupBuckets* buckets = malloc(sizeof(MtlGroupBuckets));
     
-    if (!table->buckets[idx])
+    if (!buckets)
     {
-        table->buckets[idx] = FxsListCreate();
-
-        if (!table->buckets[idx])
-        {
-            ERR_MSG("failed to create table bucket");
-            return 0;
-        }
+        return NULL;
     }
     
-    FxsListPushBack(table->buckets[idx], face);
-    return 1;
+    memset(buckets, 0, sizeof(MtlGroupBuckets));
+    buckets->numBuckets = numMaterials + 1;
+    buckets->counts = calloc(buckets->numBuckets, sizeof(unsigned int));
+    buckets->starts = malloc(buckets->numBuckets*sizeof(unsigned int));
+    buckets->used = malloc(buckets->numBuckets*sizeof(unsigned int));
+    
+    if (!buckets->counts || !buckets->starts || !buckets->used)
+    {
+        free(buckets->counts);
+        free(buckets->starts);
+        free(buckets->used);
+        free(buckets);
+        return NULL;
+    }
+    
+    return buckets;
 }
 
-void MtlGroupHashTableClear(MtlGroupHashTable* table)
+/*
+** Sorts the faces of group into the buckets, the faces of a bucket keep their 
+** order. The sorted faces are written to faces, which has to hold the faces 
+** of the group and stays valid after the next group is sorted.
+*/
+static void MtlGroupBucketsFill(
+    MtlGroupBuckets* buckets,
+    const ObjRendererFile* obj,
+    const ObjRendererFileGroup* group,
+    unsigned int* faces
+)
 {
-    int i = 0;
+    const ObjRendererFace* groupFaces = &obj->faces[group->firstFace];
+    unsigned int bucket = 0;
+    unsigned int offset = 0;
+    unsigned int i = 0;
+    
+    /* only the buckets used by the last group need to be cleared */
+    for (i = 0; i < buckets->numUsed; i++)
+    {
+        buckets->counts[buckets->used[i]] = 0;
+    }
+    
+    buckets->numUsed = 0;
+    buckets->faces = faces;
     
-    for (i = 0; i < MAX_MATERIALS; i++)
+    /* count the faces per bucket */
+    for (i = 0; i < group->numFaces; i++)
     {
-        if (table->buckets[i])
+        bucket = (unsigned int)(groupFaces[i].matIdx + 1);
+        
+        if (!buckets->counts[bucket]++)
         {
-            FxsListDestroy(&table->buckets[i]);
-            table->buckets[i] = NULL;
+            buckets->used[buckets->numUsed++] = bucket;
         }
     }
+    
+    qsort(buckets->used, buckets->numUsed, sizeof(unsigned int), CompareBuckets);
+    
+    for (i = 0; i < buckets->numUsed; i++)
+    {
+        buckets->starts[buckets->used[i]] = offset;
+        offset += buckets->counts[buckets->used[i]];
+    }
+    
+    /* scatter the faces, starts are advanced to the end of the buckets */
+    for (i = 0; i < group->numFaces; i++)
+    {
+        bucket = (unsigned int)(groupFaces[i].matIdx + 1);
+        buckets->faces[buckets->starts[bucket]++] = group->firstFace + i;
+    }
+    
+    for (i = 0; i < buckets->numUsed; i++)
+    {
+        buckets->starts[buckets->used[i]] -= buckets->counts[buckets->used[i]];
+    }
 }
 
-void MtlGroupHashTableDestroy(MtlGroupHashTable* table)
+static void MtlGroupBucketsDestroy(MtlGroupBuckets** buckets)
 {
-    assert(table);
-    MtlGroupHashTableClear(table);
-    free(table);
+    assert(buckets && *buckets);
+    free((*buckets)->counts);
+    free((*buckets)->starts);
+    free((*buckets)->used);
+    free(*buckets);
+    *buckets = NULL;
 }
 /******************************************************************************/
 
 /*
-** Computes the number of render data. which equals to the sum of the number of 
-** different materials used per group (including no material).
-** Returns 0 in case of an error.
+** The faces of a render data, the faces of one material in one group. The 
+** render data are built from their jobs on the threads of a pool once the
+** scene graph is built (see BuildRenderData).
+*/
+typedef struct
+{
+    const unsigned int* faces;      /* indices of the faces in the file */
+    ObjRendererVertexKey* vertices; /* the welded vertices until gathered */
+    unsigned int numMissesWelded;
+    unsigned int numMissesOptimized;
+    int failed;
+}
+DataJob;
+
+/*
+** Makes room for numData more render data and their jobs in mesh. The arrays
+** grow geometrically, maxData is their capacity. Returns 0 if it fails.
 */
-static unsigned int ComputeNumData(ObjRendererMesh* mesh, FxsObjFilePtr obj)
+static int ReserveData(
+    ObjRendererMesh* mesh, 
+    DataJob** jobs,
+    unsigned int* maxData, 
+    unsigned int numData
+)
 {
-	FxsListPtr objects = NULL;
-	FxsListPtr groups = NULL;
-    FxsListPtr faces = NULL;
-    FxsListIteratorPtr objectIterator = NULL;
-    FxsListIteratorPtr groupIterator = NULL;
-    FxsListIteratorPtr faceIterator = NULL;
-    FxsObjObjectPtr object = NULL;
-    FxsObjGroupPtr group = NULL;
-    FxsObjFace* face = NULL;
-    unsigned int matIdCount[MAX_MATERIALS];
-    unsigned int numMaterialGroups = 0;
+    unsigned int newMaxData = *maxData ? *maxData : 64;
+    ObjRendererData* data = NULL;
+    DataJob* newJobs = NULL;
     
-    memset(matIdCount, 0, sizeof(matIdCount));
+    if (mesh->numData + numData <= *maxData)
+    {
+        return 1;
+    }
     
-	objects = FxsObjFileGetObjects(obj);
-
-    if (!objects)
+    while (newMaxData < mesh->numData + numData)
+    {
+        newMaxData *= 2;
+    }
+    
+    data = realloc(mesh->data, newMaxData*sizeof(ObjRendererData));
+    
+    if (!data)
     {
-        ERR_MSG("Found no objects");
         return 0;
     }
-
-    objectIterator = FxsListIteratorCreate(
-            objects,
-            FXS_LIST_FRONT,
-            FXS_LIST_FRONT_TO_BACK
-        );
-
-    if (!objectIterator)
+    
+    mesh->data = data;
+    newJobs = realloc(*jobs, newMaxData*sizeof(DataJob));
+    
+    if (!newJobs)
     {
-        ERR_MSG("Failed getting an iterator ...");
         return 0;
     }
+    
+    *jobs = newJobs;
+    *maxData = newMaxData;
+    
+    return 1;
+}
 
-    while (FxsListIteratorHasNext(objectIterator))  /* for all objects */
+/******************************************************************************/
+unsigned int ObjRendererGetFormatSize(int format)
+{
+    unsigned int size = 3;
+    
+    if (format & OBJ_RENDERER_FORMAT_NORMALS)
     {
-        object = FxsListIteratorNext(objectIterator);
-        groups = FxsObjObjectGetGroups(object);
-        assert(groups);
-        
-        groupIterator = FxsListIteratorCreate(
-                groups,
-                FXS_LIST_FRONT,
-                FXS_LIST_FRONT_TO_BACK
-            );
+        size += 3;
+    }
+    
+    if (format & OBJ_RENDERER_FORMAT_TEX_COORDS)
+    {
+        size += 2;
+    }
+    
+    return size;
+}
+
+/*
+** Host memory for the vertices and indices of all render data of a mesh. The
+** vertices are interleaved, one array per vertex format. They are uploaded
+** into buffers shared by all render data once the mesh is built.
+*/
+typedef struct
+{
+    float* vertices[OBJ_RENDERER_NUM_FORMATS];
+    unsigned int numVertices[OBJ_RENDERER_NUM_FORMATS];
+    unsigned int maxVertices[OBJ_RENDERER_NUM_FORMATS];
+    GLuint* indices;
+    unsigned int numIndices;
+    unsigned int maxIndices;
+}
+VertexStage;
+
+static void VertexStageDestroy(VertexStage* stage)
+{
+    int i = 0;
+    
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        free(stage->vertices[i]);
+    }
+    
+    free(stage->indices);
+    memset(stage, 0, sizeof(VertexStage));
+}
 
-        if (!groupIterator)
+/*
+** Creates a vao and an interleaved vertex buffer for each vertex format used
+** by the render data of the mesh and uploads the packed vertices of the
+** stage. All vaos share one index buffer.
+*/
+static void VertexStageUpload(
+    VertexStage* stage, 
+    const ObjRendererPackedVertices* packed,
+    ObjRendererMesh* mesh
+)
+{
+    ObjRendererVertexBuffer* buffer = NULL;
+    size_t offset = 0;
+    int format = 0;
+    
+    mesh->numVertices = 0;
+    mesh->numIndices = stage->numIndices;
+    
+    if (!stage->numIndices)
+    {
+        return;
+    }
+    
+    glGenBuffers(1, &mesh->indexVbo);
+    
+    for (format = 0; format < OBJ_RENDERER_NUM_FORMATS; format++)
+    {
+        if (!stage->numVertices[format])
         {
-            ERR_MSG("Failed getting an iterator ...");
-            FxsListIteratorDestroy(&objectIterator);
-            return 0;
+            continue;
         }
         
-        while (FxsListIteratorHasNext(groupIterator))  /* for all groups */
+        buffer = &mesh->vertexBuffers[format];
+        buffer->numVertices = stage->numVertices[format];
+        buffer->stride = ObjRendererGetPackedFormatSize(format);
+        memcpy(buffer->decode, packed[format].decode, sizeof(buffer->decode));
+        mesh->numVertices += buffer->numVertices;
+        
+        glGenVertexArrays(1, &buffer->vao);
+        FFGLStateBindVertexArray(buffer->vao);
+        
+        /* the integers are converted to floats as they are, not normalized */
+        glGenBuffers(1, &buffer->vbo);
+        FFGLStateBindBuffer(GL_ARRAY_BUFFER, buffer->vbo);
+        glBufferData(GL_ARRAY_BUFFER, buffer->stride*buffer->numVertices, packed[format].vertices, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_FALSE, buffer->stride, 0);
+        offset = 3*sizeof(GLushort);
+        
+        if (format & OBJ_RENDERER_FORMAT_NORMALS)
         {
-            group = FxsListIteratorNext(groupIterator);
-            faces = FxsObjGroupGetFaces(group);
-            
-            if (!faces)
-            {
-                continue;
-            }
-            
-            faceIterator = FxsListIteratorCreate(
-                    faces,
-                    FXS_LIST_FRONT,
-                    FXS_LIST_FRONT_TO_BACK
-                );
-            
-            if (!faceIterator)
-            {
-                continue;
-            }
-            
-            while (FxsListIteratorHasNext(faceIterator))   /* for all faces */
-            {
-                face = FxsListIteratorNext(faceIterator);
-                assert(face);
-                
-                if (face->matIdx >= MAX_MATERIALS - 1)
-                {
-                    ERR_MSG(".obj file contains too many materials");
-                    FxsListIteratorDestroy(&groupIterator);
-                    FxsListIteratorDestroy(&objectIterator);
-                    FxsListIteratorDestroy(&faceIterator);
-                    return 0;
-                }
-                
-                /* face->matIdx + 1 because no materials are 
-                ** indicated by having a matIdx of -1 and we
-                ** want to include no materials
-                */
-                if (!matIdCount[face->matIdx + 1])
-                {
-                    numMaterialGroups++;
-                    matIdCount[face->matIdx + 1]++;
-                }
-                
-            }
-            
-            memset(matIdCount, 0, sizeof(matIdCount));
-            FxsListIteratorDestroy(&faceIterator);
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_FALSE, buffer->stride, (const GLvoid*)offset);
+            offset += 2*sizeof(GLushort);
         }
         
-        FxsListIteratorDestroy(&groupIterator);
+        if (format & OBJ_RENDERER_FORMAT_TEX_COORDS)
+        {
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_FALSE, buffer->stride, (const GLvoid*)offset);
+        }
         
+        /* the element array buffer binding is part of the vao */
+        FFGLStateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexVbo);
     }
+    
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*stage->numIndices, stage->indices, GL_STATIC_DRAW);
+    
+    assert(GL_NO_ERROR == glGetError());
+}
+
+/*
+** The host data of a mesh between ObjRendererMeshLoad and 
+** ObjRendererMeshUpload. The vertices of a mesh loaded from the cache point
+** into the mapped entry. The packed vertices are the ones uploaded.
+*/
+struct ObjRendererMeshStage_
+{
+    VertexStage vertices;
+    ObjRendererPackedVertices packed[OBJ_RENDERER_NUM_FORMATS];
+    ObjRendererCacheEntry entry;    /* mapping is NULL if not from the cache */
+};
 
-    FxsListIteratorDestroy(&objectIterator);
+typedef struct ObjRendererMeshStage_ MeshStage;
+/******************************************************************************/
 
-    return numMaterialGroups;
+/*
+** Shared by the threads building the render data of a mesh.
+*/
+typedef struct
+{
+    ObjRendererMesh* mesh;
+    VertexStage* stage;
+    const ObjRendererFile* obj;
+    DataJob* jobs;
+    ObjRendererIndexer** indexers;  /* one per thread */
 }
+BuildContext;
 
-static void CreateRenderData(
-    ObjRendererMesh* mesh,
-    FxsListPtr faceList,
-    FxsObjFilePtr obj,
-    int matId,
-    unsigned numDataLoaded
+/*
+** Welds the corners of the faces of the render data first .. first + count
+** - 1 into indexed vertices and optimizes their order, in the format of the
+** attributes all faces of a render data have. The indices are written to the
+** stage at the first index of the render data, the welded vertices are kept
+** in the job until the base vertex of the render data is known.
+*/
+static void WeldData(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
 )
 {
-    size_t numFaces = FxsListGetSize(faceList);
-    FxsObjFace* face = NULL;
-    FxsVector3* positions = NULL;
-    FxsVector3* normals = NULL;
-    FxsVector2* texCoords = NULL;
-    FxsListIteratorPtr faceIterator = NULL;
+    BuildContext* context = (BuildContext*)userData;
+    ObjRendererIndexer* indexer = context->indexers[thread];
+    const ObjRendererFace* face = NULL;
+    ObjRendererData* data = NULL;
+    DataJob* job = NULL;
     int hasNormalData = 1;
     int hasTexCoordData = 1;
-    unsigned int loaded = 0;
-
-    if (!numFaces)
+    unsigned int i = 0;
+    unsigned int j = 0;
+    
+    for (j = first; j < first + count; j++)
     {
-        return;
-    }
+        data = &context->mesh->data[j];
+        job = &context->jobs[j];
+        hasNormalData = 1;
+        hasTexCoordData = 1;
     
-    faceIterator = FxsListIteratorCreate(
-            faceList,
-            FXS_LIST_FRONT,
-            FXS_LIST_FRONT_TO_BACK
+        /* if there is at least one face that has no normal this render data
+        ** is considered to have no normals, same for tex coords
+        */
+        for (i = 0; i < data->numFaces; i++)
+        {
+            face = &context->obj->faces[job->faces[i]];
+            hasNormalData = hasNormalData && face->n0 != -1;
+            hasTexCoordData = hasTexCoordData && face->tc0 != -1;
+        }
+    
+        data->format = 0;
+    
+        if (hasNormalData)
+        {
+            data->format |= OBJ_RENDERER_FORMAT_NORMALS;
+        }
+    
+        if (hasTexCoordData)
+        {
+            data->format |= OBJ_RENDERER_FORMAT_TEX_COORDS;
+        }
+    
+        /* weld the corners */
+        ObjRendererIndexerReset(indexer);
+    
+        for (i = 0; i < data->numFaces && !job->failed; i++)
+        {
+            face = &context->obj->faces[job->faces[i]];
+            job->failed = !ObjRendererIndexerAddFace(
+                    indexer,
+                    face,
+                    hasNormalData,
+                    hasTexCoordData
+                );
+        }
+    
+        if (job->failed)
+        {
+            continue;
+        }
+    
+        job->numMissesWelded = ObjRendererCountCacheMisses(
+                indexer->indices,
+                indexer->numIndices,
+                indexer->numVertices
+            );
+        ObjRendererIndexerOptimize(indexer);
+        job->numMissesOptimized = ObjRendererCountCacheMisses(
+                indexer->indices,
+                indexer->numIndices,
+                indexer->numVertices
+            );
+    
+        job->vertices = malloc(indexer->numVertices*sizeof(ObjRendererVertexKey));
+    
+        if (!job->vertices)
+        {
+            job->failed = 1;
+            continue;
+        }
+    
+        memcpy(
+            job->vertices,
+            indexer->vertices,
+            indexer->numVertices*sizeof(ObjRendererVertexKey)
+        );
+        memcpy(
+            &context->stage->indices[data->firstIndex],
+            indexer->indices,
+            indexer->numIndices*sizeof(GLuint)
         );
-    assert(faceIterator);
+        data->numVertices = indexer->numVertices;
+    }
+}
+
+/*
+** Gathers the attributes of the welded vertices of the render data first ..
+** first + count - 1 into the stage from their base vertex on and computes
+** their bounding boxes.
+*/
+static void GatherData(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    BuildContext* context = (BuildContext*)userData;
+    const ObjRendererFile* obj = context->obj;
+    const ObjRendererVertexKey* key = NULL;
+    ObjRendererData* data = NULL;
+    ObjRendererBoundingBox* box = NULL;
+    DataJob* job = NULL;
+    float* vertices = NULL;
+    float* vertex = NULL;
+    unsigned int vertexSize = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    
+    for (j = first; j < first + count; j++)
+    {
+        data = &context->mesh->data[j];
+        job = &context->jobs[j];
+        vertexSize = ObjRendererGetFormatSize(data->format);
+        vertices = &context->stage->vertices[data->format][data->baseVertex*vertexSize];
+        box = &data->boundingBox;
+        box->min.x = box->min.y = box->min.z = FLT_MAX;
+        box->max.x = box->max.y = box->max.z = -FLT_MAX;
+    
+        for (i = 0; i < data->numVertices; i++)
+        {
+            key = &job->vertices[i];
+            vertex = &vertices[i*vertexSize];
+            memcpy(vertex, &obj->positions[key->p], sizeof(FxsVector3));
+            box->min.x = fminf(box->min.x, vertex[0]);
+            box->min.y = fminf(box->min.y, vertex[1]);
+            box->min.z = fminf(box->min.z, vertex[2]);
+            box->max.x = fmaxf(box->max.x, vertex[0]);
+            box->max.y = fmaxf(box->max.y, vertex[1]);
+            box->max.z = fmaxf(box->max.z, vertex[2]);
+            vertex += 3;
     
-    positions = (FxsVector3*)malloc(numFaces*3*sizeof(FxsVector3));
-    normals = (FxsVector3*)malloc(numFaces*3*sizeof(FxsVector3));
-    texCoords = (FxsVector2*)malloc(numFaces*3*sizeof(FxsVector2));
+            if (data->format & OBJ_RENDERER_FORMAT_NORMALS)
+            {
+                memcpy(vertex, &obj->normals[key->n], sizeof(FxsVector3));
+                vertex += 3;
+            }
     
-    assert(positions && normals && texCoords);
+            if (data->format & OBJ_RENDERER_FORMAT_TEX_COORDS)
+            {
+                memcpy(vertex, &obj->texCoords[key->tc], sizeof(FxsVector2));
+            }
+        }
     
-    mesh->data[numDataLoaded].matId = matId;
-    mesh->data[numDataLoaded].numFaces = (unsigned int)numFaces;
+        free(job->vertices);
+        job->vertices = NULL;
+    }
+}
 
-    while (FxsListIteratorHasNext(faceIterator))
+/*
+** Builds the render data of mesh from their jobs into the empty stage. The
+** render data are welded and gathered on the threads of pool, pool may be
+** NULL. Only the offsets of the render data in the stage are computed in
+** between, in the order of the render data, so the stage is the same for any
+** # of threads. Returns 0 if it fails.
+*/
+static int BuildRenderData(
+    ObjRendererMesh* mesh,
+    VertexStage* stage,
+    const ObjRendererFile* obj,
+    DataJob* jobs,
+    FFThreadPoolPtr pool
+)
+{
+    BuildContext context;
+    ObjRendererMeshStats* stats = &mesh->stats;
+    ObjRendererData* data = NULL;
+    unsigned int numThreads = pool ? FFThreadPoolGetNumThreads(pool) : 1;
+    unsigned int vertexSize = 0;
+    unsigned int i = 0;
+    int format = 0;
+    int result = 0;
+    
+    memset(&context, 0, sizeof(BuildContext));
+    context.mesh = mesh;
+    context.stage = stage;
+    context.obj = obj;
+    context.jobs = jobs;
+    context.indexers = calloc(numThreads, sizeof(ObjRendererIndexer*));
+    
+    if (!context.indexers)
     {
-        face = FxsListIteratorNext(faceIterator);
-        assert(FxsObjFileGetPosition(obj, &positions[3*loaded + 0], face->p0));
-        assert(FxsObjFileGetPosition(obj, &positions[3*loaded + 1], face->p1));
-        assert(FxsObjFileGetPosition(obj, &positions[3*loaded + 2], face->p2));
-        
-        /* if there is at least one face that has no normal this render data
-        ** is considered to have no normals
-        */
-        if (face->n0 == -1)
+        ERR_MSG("Failed to allocate memory for the indexers");
+        goto done;
+    }
+    
+    for (i = 0; i < numThreads; i++)
+    {
+        context.indexers[i] = ObjRendererIndexerCreate();
+    
+        if (!context.indexers[i])
         {
-            hasNormalData = 0;
+            ERR_MSG("Failed to create the indexers");
+            goto done;
         }
-        else
+    }
+    
+    /* the # of indices is known from the faces */
+    for (i = 0; i < mesh->numData; i++)
+    {
+        mesh->data[i].firstIndex = stage->numIndices;
+        stage->numIndices += 3*mesh->data[i].numFaces;
+    }
+    
+    stage->indices = malloc(stage->numIndices*sizeof(GLuint));
+    stage->maxIndices = stage->numIndices;
+    
+    if (!stage->indices && stage->numIndices)
+    {
+        ERR_MSG("Failed to allocate memory for the indices");
+        goto done;
+    }
+    
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, mesh->numData, 1, WeldData, &context);
+    }
+    else
+    {
+        WeldData(&context, 0, mesh->numData, 0);
+    }
+    
+    /* the # of vertices of each render data is known now */
+    for (i = 0; i < mesh->numData; i++)
+    {
+        data = &mesh->data[i];
+    
+        if (jobs[i].failed)
         {
-            assert(FxsObjFileGetNormal(obj, &normals[3*loaded + 0], face->n0));
-            assert(FxsObjFileGetNormal(obj, &normals[3*loaded + 1], face->n1));
-            assert(FxsObjFileGetNormal(obj, &normals[3*loaded + 2], face->n2));
+            ERR_MSG("Failed to allocate memory for the vertices");
+            goto done;
         }
-
-        if (face->tc0 == -1)
+    
+        data->baseVertex = stage->numVertices[data->format];
+        stage->numVertices[data->format] += data->numVertices;
+    
+        vertexSize = ObjRendererGetFormatSize(data->format);
+        stats->numMissesWelded += jobs[i].numMissesWelded;
+        stats->numMissesOptimized += jobs[i].numMissesOptimized;
+        stats->numFaces += data->numFaces;
+        stats->numSoupVertices += 3*data->numFaces;
+        stats->numVertices += data->numVertices;
+        stats->soupBytes += 3*data->numFaces*vertexSize*sizeof(float);
+        stats->indexedBytes += data->numVertices*vertexSize*sizeof(float) +
+            3*data->numFaces*sizeof(GLuint);
+    }
+    
+    for (format = 0; format < OBJ_RENDERER_NUM_FORMATS; format++)
+    {
+        if (!stage->numVertices[format])
         {
-            hasTexCoordData = 0;
+            continue;
         }
-        else
+    
+        stage->vertices[format] = malloc(
+                stage->numVertices[format]*ObjRendererGetFormatSize(format)*sizeof(float)
+            );
+        stage->maxVertices[format] = stage->numVertices[format];
+    
+        if (!stage->vertices[format])
         {
-            assert(FxsObjFileGetTexCoord(obj, &texCoords[3*loaded + 0], face->tc0));
-            assert(FxsObjFileGetTexCoord(obj, &texCoords[3*loaded + 1], face->tc1));
-            assert(FxsObjFileGetTexCoord(obj, &texCoords[3*loaded + 2], face->tc2));
+            ERR_MSG("Failed to allocate memory for the vertices");
+            goto done;
         }
-
-        loaded++;
     }
-
-
-    glGenVertexArrays(1, &mesh->data[numDataLoaded].vao);
-    glBindVertexArray(mesh->data[numDataLoaded].vao);
     
-    glGenBuffers(1, &mesh->data[numDataLoaded].positionsVbo);
-    glBindBuffer(GL_ARRAY_BUFFER, mesh->data[numDataLoaded].positionsVbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(FxsVector3)*3*numFaces, positions, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, mesh->numData, 1, GatherData, &context);
+    }
+    else
+    {
+        GatherData(&context, 0, mesh->numData, 0);
+    }
+    
+    result = 1;
+    
+done:
     
-    if (hasNormalData)
+    /* left over if it failed */
+    for (i = 0; i < mesh->numData; i++)
     {
-        glGenBuffers(1, &mesh->data[numDataLoaded].normalsVbo);
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->data[numDataLoaded].normalsVbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(FxsVector3)*3*numFaces, normals, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        free(jobs[i].vertices);
+        jobs[i].vertices = NULL;
     }
     
-    if (hasTexCoordData)
+    for (i = 0; context.indexers && i < numThreads; i++)
     {
-        glGenBuffers(1, &mesh->data[numDataLoaded].texCoordsVbo);
-        glBindBuffer(GL_ARRAY_BUFFER, mesh->data[numDataLoaded].texCoordsVbo);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(FxsVector2)*3*numFaces, texCoords, GL_STATIC_DRAW);
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        if (context.indexers[i])
+        {
+            ObjRendererIndexerDestroy(&context.indexers[i]);
+        }
     }
     
-    assert(GL_NO_ERROR == glGetError());
+    free(context.indexers);
     
-    FxsListIteratorDestroy(&faceIterator);
-    free(positions);
-    free(normals);
-    free(texCoords);
+    return result;
 }
 
 /*
-** Creates the material group nodes and the render data associated 
+** Creates the material group nodes of the group and a render data and job
 ** for each material group node.
 **
 ** Returns 0 if it fails.
 */
 static int BuildMaterialGroupNodesForGroup(
     ObjRendererMeshNode* groupNode,
-    MtlGroupHashTable* table,
+    MtlGroupBuckets* buckets,
     ObjRendererMesh* mesh,
-    FxsObjFilePtr obj,
-    unsigned int* numDataLoaded
+    DataJob** jobs,
+    unsigned int* maxData
 )
 {
     ObjRendererMeshNode* currentMtlGroupNode = NULL;
-    int i = 0;
-
-    for (i = 0; i < MAX_MATERIALS; i++)
+    ObjRendererData* data = NULL;
+    DataJob* job = NULL;
+    unsigned int bucket = 0;
+    unsigned int i = 0;
+    
+    if (!ReserveData(mesh, jobs, maxData, buckets->numUsed))
+    {
+        ERR_MSG("Failed to allocate memory for the render data");
+        return 0;
+    }
+    
+    /* for all materials that have faces in the group ... */
+    for (i = 0; i < buckets->numUsed; i++)
     {
-        /* if faces for the material i exist ... */
-        if (table->buckets[i])
+        bucket = buckets->used[i];
+    
+        /* set up the render data, it is built with the others */
+        data = &mesh->data[mesh->numData];
+        job = &(*jobs)[mesh->numData];
+        memset(data, 0, sizeof(ObjRendererData));
+        memset(job, 0, sizeof(DataJob));
+        data->matId = (int)bucket - 1;
+        data->numFaces = buckets->counts[bucket];
+        job->faces = &buckets->faces[buckets->starts[bucket]];
+    
+        /* create current group node */
+        currentMtlGroupNode = (ObjRendererMeshNode*)malloc(
+                sizeof(ObjRendererMeshNode)
+            );
+    
+        assert(currentMtlGroupNode);
+        memset(currentMtlGroupNode, 0, sizeof(ObjRendererMeshNode));
+        currentMtlGroupNode->data = mesh->numData;
+    
+        /* add mtl group node to the group node */
+        if (!groupNode->children)
         {
-            /* create render data */
-            CreateRenderData(mesh, table->buckets[i], obj, i-1, *numDataLoaded);
-            
-            /* create current group node */
-            currentMtlGroupNode = (ObjRendererMeshNode*)malloc(
-                    sizeof(ObjRendererMeshNode)
-                );
-            
-            assert(currentMtlGroupNode);
-            memset(currentMtlGroupNode, 0, sizeof(ObjRendererMeshNode));
-            currentMtlGroupNode->data = *numDataLoaded;
-            
-            /* add mtl group node to the group node */
-            if (!groupNode->children)
-            {
-                groupNode->children = FxsListCreate();
-            }
-            
-            assert(groupNode->children);
-            FxsListPushBack(groupNode->children, currentMtlGroupNode);
-            
-            (*numDataLoaded)++;
+            groupNode->children = FxsListCreate();
         }
+    
+        assert(groupNode->children);
+        FxsListPushBack(groupNode->children, currentMtlGroupNode);
+    
+        mesh->numData++;
     }
-
+    
     return 1;
 }
 
 /*
-** Creates the render data and builds the scene graph
+** Builds the scene graph in one pass over the file, then creates the render
+** data for its material group nodes on the threads of pool, pool may be
+** NULL. The vertices and indices of all render data are gathered in stage.
 */
-static int BuildSceneGraph(ObjRendererMesh* mesh, FxsObjFilePtr obj)
-{
-	FxsListPtr objects = NULL;
-	FxsListPtr groups = NULL;
-    FxsListPtr faces = NULL;
-    FxsListIteratorPtr objectIterator = NULL;
-    FxsListIteratorPtr groupIterator = NULL;
-    FxsListIteratorPtr faceIterator = NULL;
-    FxsObjObjectPtr object = NULL;
-    FxsObjGroupPtr group = NULL;
-    FxsObjFace* face = NULL;
-    unsigned int numDataLoaded = 0;
-    MtlGroupHashTable* mtlgroupHashTable = MtlGroupHashTableCreate();
+static int BuildSceneGraph(
+    ObjRendererMesh* mesh,
+    VertexStage* stage,
+    ObjRendererFile* obj,
+    FFThreadPoolPtr pool
+)
+{
+    ObjRendererFileObject* object = NULL;
+    ObjRendererFileGroup* group = NULL;
+    unsigned int maxData = 0;
+    ObjRendererData* data = NULL;
+    MtlGroupBuckets* buckets = NULL;
+    unsigned int* sortedFaces = NULL;
+    DataJob* jobs = NULL;
     ObjRendererMeshNode* currentObjectNode = NULL;
     ObjRendererMeshNode* currentGroupNode = NULL;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    int result = 0;
     
-    if (!mtlgroupHashTable)
-    {
-        ERR_MSG("Failed to create the hash table");
-        return 0;
-    }
-    
-	objects = FxsObjFileGetObjects(obj);
-
-    if (!objects)
+    if (!obj->numObjects)
     {
         ERR_MSG("Found no objects");
         return 0;
     }
-
-    objectIterator = FxsListIteratorCreate(
-            objects,
-            FXS_LIST_FRONT,
-            FXS_LIST_FRONT_TO_BACK
-        );
-
-    if (!objectIterator)
+    
+    buckets = MtlGroupBucketsCreate(obj->numMaterials);
+    
+    /* the faces of each group sorted by material, in place of the group */
+    sortedFaces = malloc(obj->numFaces*sizeof(unsigned int));
+    
+    if (!buckets || (!sortedFaces && obj->numFaces))
     {
-        ERR_MSG("Failed getting an iterator ...");
-        return 0;
+        ERR_MSG("Failed to create the material buckets");
+        goto done;
     }
-
+    
     /* iterate through all objects */
-    while (FxsListIteratorHasNext(objectIterator))
+    for (i = 0; i < obj->numObjects; i++)
     {
-        object = FxsListIteratorNext(objectIterator);
-        
+        object = &obj->objects[i];
+    
         /* create a node for the object */
         currentObjectNode = (ObjRendererMeshNode*)malloc(
                 sizeof(ObjRendererMeshNode)
             );
-
+    
         assert(currentObjectNode != NULL);
         memset(currentObjectNode, 0, sizeof(ObjRendererMeshNode));
         currentObjectNode->data = -1; /* no data in an object node */
-        
+    
         /* add an object node to the root for each object */
         if (!mesh->root->children)
         {
             mesh->root->children = FxsListCreate();
         }
-        
+    
         assert(mesh->root->children);
         FxsListPushBack(mesh->root->children, currentObjectNode);
-
-        /* get the iterator for the groups*/
-        groups = FxsObjObjectGetGroups(object);
-        assert(groups);
-        groupIterator = FxsListIteratorCreate(
-                groups,
-                FXS_LIST_FRONT,
-                FXS_LIST_FRONT_TO_BACK
-            );
-        assert(groupIterator);
-
+    
         /* iterate through all groups */
-        while (FxsListIteratorHasNext(groupIterator))
+        for (j = 0; j < object->numGroups; j++)
         {
-            group = FxsListIteratorNext(groupIterator);
-            
+            group = &obj->groups[object->firstGroup + j];
+    
             /* create a group node for the group */
             currentGroupNode = malloc(sizeof(ObjRendererMeshNode));
             assert(currentGroupNode);
             memset(currentGroupNode, 0, sizeof(ObjRendererMeshNode));
             currentGroupNode->data = -1;
-            
+    
             /* add group node to the current object node */
             if (!currentObjectNode->children)
             {
                 currentObjectNode->children = FxsListCreate();
             }
-            
+    
             assert(currentObjectNode->children);
             FxsListPushBack(currentObjectNode->children, currentGroupNode);
-            
-            /* get iterator for faces */
-            faces = FxsObjGroupGetFaces(group);
-            assert(faces);
-            faceIterator = FxsListIteratorCreate(
-                    faces,
-                    FXS_LIST_FRONT,
-                    FXS_LIST_FRONT_TO_BACK
-                );
-                
-            if (!faceIterator)
+    
+            /* sort the faces of the group by material */
+            MtlGroupBucketsFill(buckets, obj, group, &sortedFaces[group->firstFace]);
+    
+            /* build the material group nodes for the group and
+            ** set up the render data for it
+            */
+            if (!BuildMaterialGroupNodesForGroup(
+                    currentGroupNode,
+                    buckets,
+                    mesh,
+                    &jobs,
+                    &maxData
+                ))
             {
-                continue;
+                goto done;
             }
+        }
+    }
+    
+    if (!BuildRenderData(mesh, stage, obj, jobs, pool))
+    {
+        goto done;
+    }
+    
+    /* release the unused capacity */
+    if (mesh->numData && mesh->numData < maxData)
+    {
+        data = realloc(mesh->data, mesh->numData*sizeof(ObjRendererData));
+    
+        if (data)
+        {
+            mesh->data = data;
+        }
+    }
+    
+    result = 1;
+    
+done:
+    
+    if (buckets)
+    {
+        MtlGroupBucketsDestroy(&buckets);
+    }
+    
+    free(sortedFaces);
+    free(jobs);
+    
+    return result;
+}
+
+/******************************************************************************/
+/*
+** Creates the materials of mesh for the material names of the .obj file 
+** filename. Their colors and diffuse maps are read from mtlLib, materials 
+** that are not found in it are white. Returns 0 if it runs out of memory.
+*/
+static int CreateMaterials(
+    ObjRendererMesh* mesh,
+    const char* filename,
+    const char* mtlLib,
+    const char* const* materialNames,
+    unsigned int numMaterials
+)
+{
+    ObjRendererMaterial* material = NULL;
+    const ObjRendererMtlMaterial* mtlMaterial = NULL;
+    ObjRendererMtlFile* mtlFile = NULL;
+    char* mtlPath = NULL;
+    unsigned int i = 0;
+    
+    if (!numMaterials)
+    {
+        return 1;
+    }
+    
+    mesh->materials = calloc(numMaterials, sizeof(ObjRendererMaterial));
+    
+    if (!mesh->materials)
+    {
+        return 0;
+    }
+    
+    mesh->numMaterials = numMaterials;
+    
+    if (mtlLib)
+    {
+        mtlPath = ObjRendererFileJoinPath(filename, mtlLib);
+        
+        if (!mtlPath)
+        {
+            return 0;
+        }
+        
+        mtlFile = ObjRendererMtlFileCreateWithFile(mtlPath);
+        
+        if (!mtlFile)
+        {
+            ERR_MSG("Failed to load the material library");
+            printf("\t%s\n", mtlPath);
+        }
+    }
+    
+    for (i = 0; i < numMaterials; i++)
+    {
+        material = &mesh->materials[i];
+        material->layer = -1;
+        material->diffuseColor.x = 1.0f;
+        material->diffuseColor.y = 1.0f;
+        material->diffuseColor.z = 1.0f;
+        mtlMaterial = mtlFile ? 
+            ObjRendererMtlFileFind(mtlFile, materialNames[i]) : NULL;
+        
+        if (!mtlMaterial)
+        {
+            continue;
+        }
+        
+        material->diffuseColor = mtlMaterial->diffuseColor;
+        
+        /* maps are relative to the .mtl file */
+        if (mtlMaterial->diffuseMap)
+        {
+            material->diffuseMap = ObjRendererFileJoinPath(mtlPath, mtlMaterial->diffuseMap);
             
-            /* iterate through all faces */
-            while (FxsListIteratorHasNext(faceIterator))
+            if (!material->diffuseMap)
             {
-                face = FxsListIteratorNext(faceIterator);
-                assert(face);
-                
-                if (face->matIdx >= MAX_MATERIALS - 1)
-                {
-                    ERR_MSG(".obj file contains too many materials");
-                    FxsListIteratorDestroy(&groupIterator);
-                    FxsListIteratorDestroy(&objectIterator);
-                    FxsListIteratorDestroy(&faceIterator);
-                    return 0;
-                }
-                
-                MtlGroupHashTableInsert(mtlgroupHashTable, face->matIdx + 1, face);
+                ObjRendererMtlFileDestroy(&mtlFile);
+                free(mtlPath);
+                return 0;
             }
-
-            /* build the material group nodes for the group and
-            ** create the render data for it 
-            */
-            BuildMaterialGroupNodesForGroup(
-                currentGroupNode,
-                mtlgroupHashTable,
-                mesh,
-                obj,
-                &numDataLoaded
-            );
-            
-            MtlGroupHashTableClear(mtlgroupHashTable);
-            
-            FxsListIteratorDestroy(&faceIterator);
         }
-        
-        FxsListIteratorDestroy(&groupIterator);
     }
-
-    FxsListIteratorDestroy(&objectIterator);
-    MtlGroupHashTableDestroy(mtlgroupHashTable);
+    
+    if (mtlFile)
+    {
+        ObjRendererMtlFileDestroy(&mtlFile);
+    }
+    
+    free(mtlPath);
     
     return 1;
 }
+/******************************************************************************/
 
-ObjRendererMesh* ObjRendererMeshCreateWithFile(const char* filename)
+/*
+** Writes the converted mesh and its staged vertices to the cache.
+*/
+static void StoreInCache(
+    ObjRendererCache* cache,
+    const ObjRendererCacheKey* key,
+    const ObjRendererMesh* mesh,
+    const VertexStage* stage,
+    const ObjRendererFile* obj
+)
+{
+    ObjRendererCacheEntry entry;
+    int i = 0;
+    
+    memset(&entry, 0, sizeof(ObjRendererCacheEntry));
+    entry.data = mesh->data;
+    entry.drawList = mesh->drawList;
+    entry.indices = stage->indices;
+    entry.numData = mesh->numData;
+    entry.numDrawRecords = mesh->numDrawRecords;
+    entry.numIndices = stage->numIndices;
+    entry.stats = mesh->stats;
+    entry.mtlLib = obj->mtlLib;
+    entry.materialNames = (const char* const*)obj->materialNames;
+    entry.numMaterials = obj->numMaterials;
+    
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        entry.vertices[i] = stage->vertices[i];
+        entry.numVertices[i] = stage->numVertices[i];
+    }
+    
+    ObjRendererCacheStore(cache, key, &entry);
+}
+
+/*
+** Parses the .obj file filename and converts it. Faces without normals get
+** smooth normals. The result is stored in cache if cache is not NULL. The
+** vertices stay in the stage of the mesh.
+*/
+static ObjRendererMesh* LoadObjFile(
+    const char* filename, 
+    FFThreadPoolPtr pool,
+    ObjRendererCache* cache,
+    const ObjRendererCacheKey* key
+)
 {
 	ObjRendererMesh* mesh = NULL;
-	FxsObjFilePtr obj = FxsObjFileCreateWithFile(filename);
+	ObjRendererFile* obj = ObjRendererFileCreateWithFile(filename, pool);
 
 	if (!obj) 
 	{
@@ -531,34 +1032,549 @@ ObjRendererMesh* ObjRendererMeshCreateWithFile(const char* filename)
 	}
 
 	memset(mesh, 0, sizeof(ObjRendererMesh));
-
+	mesh->stage = calloc(1, sizeof(MeshStage));
 	mesh->root = (ObjRendererMeshNode*)malloc(sizeof(ObjRendererMeshNode));
 
-	if (!mesh->root) 
+	if (!mesh->stage || !mesh->root) 
 	{
 	    goto error;
 	}
 
 	memset(mesh->root, 0, sizeof(ObjRendererMeshNode));
+	mesh->root->data = -1;
 
-	mesh->numData = ComputeNumData(mesh, obj);
-    mesh->data = (ObjRendererData*)malloc(
-            mesh->numData*sizeof(ObjRendererData)
-        );
-    
-    if (!mesh->data)
+    if (!ObjRendererGenerateNormals(obj, OBJ_RENDERER_CREASE_ANGLE, pool) ||
+        !BuildSceneGraph(mesh, &mesh->stage->vertices, obj, pool) ||
+        !ObjRendererMeshCompileDrawList(mesh) ||
+        !CreateMaterials(
+            mesh, 
+            filename, 
+            obj->mtlLib, 
+            (const char* const*)obj->materialNames, 
+            obj->numMaterials
+        ))
     {
         goto error;
     }
     
-    if (!BuildSceneGraph(mesh, obj))
+    if (cache)
     {
-        goto error;
+        StoreInCache(cache, key, mesh, &mesh->stage->vertices, obj);
     }
     
+    ObjRendererFileDestroy(&obj);
+    
 	return mesh;
 
 error:
 
+    if (mesh)
+    {
+        ObjRendererMeshDestroy(&mesh);
+    }
+    
+    ObjRendererFileDestroy(&obj);
+
 	return NULL;
 }
+
+/*
+** Creates the scene graph for the nodes in records (in pre order).
+*/
+static ObjRendererMeshNode* CreateNodes(const ObjRendererDrawRecord* records)
+{
+    ObjRendererMeshNode* node = malloc(sizeof(ObjRendererMeshNode));
+    unsigned int i = 1;
+    
+    assert(node);
+    memset(node, 0, sizeof(ObjRendererMeshNode));
+    node->data = records[0].data;
+    node->boundingBox = records[0].boundingBox;
+    
+    while (i <= records[0].numDescendants)
+    {
+        if (!node->children)
+        {
+            node->children = FxsListCreate();
+        }
+        
+        assert(node->children);
+        FxsListPushBack(node->children, CreateNodes(&records[i]));
+        i += records[i].numDescendants + 1;
+    }
+    
+    return node;
+}
+
+/*
+** Creates the mesh of the .obj file filename for a loaded cache entry. The 
+** mesh takes over the entry, its vertices and indices are uploaded straight
+** from the mapped file. The entry is released if it fails.
+*/
+static ObjRendererMesh* LoadCacheEntry(
+    const char* filename,
+    ObjRendererCacheEntry* entry
+)
+{
+	ObjRendererMesh* mesh = NULL;
+	VertexStage* stage = NULL;
+	int i = 0;
+	
+	mesh = (ObjRendererMesh*)malloc(sizeof(ObjRendererMesh));
+
+	if (!mesh) 
+	{
+	    ObjRendererCacheRelease(entry);
+		return NULL; 
+	}
+
+	memset(mesh, 0, sizeof(ObjRendererMesh));
+	mesh->stage = calloc(1, sizeof(MeshStage));
+	
+	if (!mesh->stage)
+	{
+	    ObjRendererCacheRelease(entry);
+	    goto error;
+	}
+	
+	mesh->stage->entry = *entry;
+	mesh->numData = entry->numData;
+	mesh->stats = entry->stats;
+	mesh->data = malloc(entry->numData*sizeof(ObjRendererData));
+	
+	if (!mesh->data && entry->numData)
+	{
+	    goto error;
+	}
+	
+	memcpy(mesh->data, entry->data, entry->numData*sizeof(ObjRendererData));
+	mesh->root = CreateNodes(entry->drawList);
+	
+	if (!ObjRendererMeshCompileDrawList(mesh) ||
+	    !CreateMaterials(
+	        mesh, 
+	        filename, 
+	        entry->mtlLib, 
+	        entry->materialNames, 
+	        entry->numMaterials
+	    ))
+	{
+	    goto error;
+	}
+	
+	/* the vertex stage points into the mapping, the entry owns the memory */
+	stage = &mesh->stage->vertices;
+	stage->indices = (GLuint*)entry->indices;
+	stage->numIndices = entry->numIndices;
+	
+	for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+	{
+	    stage->vertices[i] = (float*)entry->vertices[i];
+	    stage->numVertices[i] = entry->numVertices[i];
+	}
+	
+    return mesh;
+    
+error:
+
+    ObjRendererMeshDestroy(&mesh);
+    
+    return NULL;
+}
+
+/*
+** Packs the staged vertices of mesh for uploading and updates the packing 
+** stats. Returns 0 if it fails.
+*/
+static int PackVertices(ObjRendererMesh* mesh, FFThreadPoolPtr pool)
+{
+    MeshStage* stage = mesh->stage;
+    ObjRendererMeshStats* stats = &mesh->stats;
+    ObjRendererPackedVertices* packed = NULL;
+    int format = 0;
+    
+    /* stats loaded from the cache are computed again */
+    stats->packedBytes = stage->vertices.numIndices*sizeof(GLuint);
+    stats->positionError = 0.0f;
+    stats->normalError = 0.0f;
+    stats->texCoordError = 0.0f;
+    
+    for (format = 0; format < OBJ_RENDERER_NUM_FORMATS; format++)
+    {
+        packed = &stage->packed[format];
+        
+        if (!stage->vertices.numVertices[format])
+        {
+            continue;
+        }
+        
+        if (!ObjRendererPackVertices(
+                stage->vertices.vertices[format], 
+                stage->vertices.numVertices[format], 
+                format, 
+                pool, 
+                packed
+            ))
+        {
+            return 0;
+        }
+        
+        stats->packedBytes += packed->numVertices*ObjRendererGetPackedFormatSize(format);
+        stats->positionError = fmaxf(stats->positionError, packed->positionError);
+        stats->normalError = fmaxf(stats->normalError, packed->normalError);
+        stats->texCoordError = fmaxf(stats->texCoordError, packed->texCoordError);
+    }
+    
+    return 1;
+}
+
+/*
+** Releases the host data of a loaded mesh.
+*/
+static void MeshStageDestroy(MeshStage** stage)
+{
+    int i = 0;
+    
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        ObjRendererPackedVerticesDestroy(&(*stage)->packed[i]);
+    }
+    
+    if ((*stage)->entry.mapping)
+    {
+        ObjRendererCacheRelease(&(*stage)->entry);
+    }
+    else
+    {
+        VertexStageDestroy(&(*stage)->vertices);
+    }
+    
+    free(*stage);
+    *stage = NULL;
+}
+
+ObjRendererMesh* ObjRendererMeshLoad(
+    const char* filename, 
+    FFThreadPoolPtr pool,
+    ObjRendererCache* cache
+)
+{
+    ObjRendererMesh* mesh = NULL;
+    ObjRendererCacheKey key;
+    ObjRendererCacheEntry entry;
+    
+    if (cache && !ObjRendererCacheComputeKey(filename, &key))
+    {
+        return NULL;
+    }
+    
+    if (cache && ObjRendererCacheLoad(cache, &key, &entry))
+    {
+        mesh = LoadCacheEntry(filename, &entry);
+    }
+    
+    if (!mesh)
+    {
+        mesh = LoadObjFile(filename, pool, cache, &key);
+    }
+    
+    if (mesh && 
+        (!ObjRendererMeshBuildOctree(mesh, pool) || !PackVertices(mesh, pool)))
+    {
+        ObjRendererMeshDestroy(&mesh);
+    }
+    
+    return mesh;
+}
+
+int ObjRendererMeshBuildOctree(ObjRendererMesh* mesh, FFThreadPoolPtr pool)
+{
+    VertexStage* stage = NULL;
+    ObjRendererOctree* octree = NULL;
+    
+    assert(mesh && mesh->stage);
+    
+    stage = &mesh->stage->vertices;
+    octree = ObjRendererOctreeCreate(
+            mesh, 
+            (const float* const*)stage->vertices, 
+            stage->numVertices, 
+            stage->indices, 
+            stage->numIndices, 
+            pool
+        );
+    
+    if (!octree)
+    {
+        return 0;
+    }
+    
+    if (mesh->octree)
+    {
+        ObjRendererOctreeDestroy(&mesh->octree);
+    }
+    
+    mesh->octree = octree;
+    
+    return 1;
+}
+
+int ObjRendererMeshUpload(ObjRendererMesh* mesh)
+{
+    assert(mesh && mesh->stage);
+    
+    VertexStageUpload(&mesh->stage->vertices, mesh->stage->packed, mesh);
+    MeshStageDestroy(&mesh->stage);
+    
+    return ObjRendererIndirectCreate(mesh);
+}
+
+size_t ObjRendererMeshGetSize(const ObjRendererMesh* mesh)
+{
+    return mesh->stage ? mesh->stats.indexedBytes : mesh->stats.packedBytes;
+}
+
+ObjRendererMesh* ObjRendererMeshCreateWithFile(
+    const char* filename, 
+    FFThreadPoolPtr pool,
+    ObjRendererCache* cache
+)
+{
+    ObjRendererMesh* mesh = ObjRendererMeshLoad(filename, pool, cache);
+    
+    if (mesh && !ObjRendererMeshUpload(mesh))
+    {
+        ObjRendererMeshDestroy(&mesh);
+    }
+    
+    return mesh;
+}
+
+/*
+** Returns the # of nodes in the subtree of node, node included.
+*/
+static unsigned int CountNodes(ObjRendererMeshNode* node)
+{
+    FxsListIteratorPtr nodeIterator = NULL;
+    unsigned int numNodes = 1;
+    
+    if (!node->children)
+    {
+        return numNodes;
+    }
+    
+    nodeIterator = FxsListIteratorCreate(
+            node->children,
+            FXS_LIST_FRONT,
+            FXS_LIST_FRONT_TO_BACK
+        );
+    assert(nodeIterator);
+    
+    while (FxsListIteratorHasNext(nodeIterator))
+    {
+        numNodes += CountNodes(FxsListIteratorNext(nodeIterator));
+    }
+    
+    FxsListIteratorDestroy(&nodeIterator);
+    
+    return numNodes;
+}
+
+/*
+** Grows box so that it contains other.
+*/
+static void MergeBoundingBoxes(
+    ObjRendererBoundingBox* box, 
+    const ObjRendererBoundingBox* other
+)
+{
+    box->min.x = fminf(box->min.x, other->min.x);
+    box->min.y = fminf(box->min.y, other->min.y);
+    box->min.z = fminf(box->min.z, other->min.z);
+    box->max.x = fmaxf(box->max.x, other->max.x);
+    box->max.y = fmaxf(box->max.y, other->max.y);
+    box->max.z = fmaxf(box->max.z, other->max.z);
+}
+
+/*
+** Writes the subtree of node in pre order to records and sets the bounding
+** boxes of its nodes. Returns the # of records written.
+*/
+static unsigned int FlattenNode(
+    ObjRendererMesh* mesh,
+    ObjRendererMeshNode* node, 
+    ObjRendererDrawRecord* records
+)
+{
+    FxsListIteratorPtr nodeIterator = NULL;
+    ObjRendererMeshNode* child = NULL;
+    ObjRendererBoundingBox* box = &node->boundingBox;
+    unsigned int numRecords = 1;
+    
+    box->min.x = box->min.y = box->min.z = FLT_MAX;
+    box->max.x = box->max.y = box->max.z = -FLT_MAX;
+    
+    if (node->data != -1)
+    {
+        MergeBoundingBoxes(box, &mesh->data[node->data].boundingBox);
+    }
+    
+    records[0].data = node->data;
+    
+    if (node->children)
+    {
+        nodeIterator = FxsListIteratorCreate(
+                node->children,
+                FXS_LIST_FRONT,
+                FXS_LIST_FRONT_TO_BACK
+            );
+        assert(nodeIterator);
+        
+        while (FxsListIteratorHasNext(nodeIterator))
+        {
+            child = FxsListIteratorNext(nodeIterator);
+            numRecords += FlattenNode(mesh, child, &records[numRecords]);
+            MergeBoundingBoxes(box, &child->boundingBox);
+        }
+        
+        FxsListIteratorDestroy(&nodeIterator);
+    }
+    
+    records[0].boundingBox = *box;
+    records[0].numDescendants = numRecords - 1;
+    
+    return numRecords;
+}
+
+int ObjRendererMeshCompileDrawList(ObjRendererMesh* mesh)
+{
+    ObjRendererDrawRecord* drawList = NULL;
+    unsigned int numDrawRecords = 0;
+    
+    assert(mesh && mesh->root);
+    
+    numDrawRecords = CountNodes(mesh->root);
+    drawList = malloc(numDrawRecords*sizeof(ObjRendererDrawRecord));
+    
+    if (!drawList)
+    {
+        ERR_MSG("Failed to allocate memory for the draw list");
+        return 0;
+    }
+    
+    FlattenNode(mesh, mesh->root, drawList);
+    
+    free(mesh->drawList);
+    mesh->drawList = drawList;
+    mesh->numDrawRecords = numDrawRecords;
+    
+    return 1;
+}
+
+void ObjRendererMeshGetMaterialParams(
+    const ObjRendererMesh* mesh, 
+    int matId, 
+    GLfloat* params,
+    GLuint* texture
+)
+{
+    const ObjRendererMaterial* material = NULL;
+    
+    /* faces without material are white */
+    if (matId < 0 || matId >= (int)mesh->numMaterials)
+    {
+        params[0] = params[1] = params[2] = 1.0f;
+        params[3] = -1.0f;
+        *texture = 0;
+        return;
+    }
+    
+    material = &mesh->materials[matId];
+    params[0] = material->diffuseColor.x;
+    params[1] = material->diffuseColor.y;
+    params[2] = material->diffuseColor.z;
+    params[3] = (GLfloat)material->layer;
+    *texture = material->layer != -1 ? material->texture : 0;
+}
+
+static void DestroyNode(ObjRendererMeshNode* node)
+{
+    FxsListIteratorPtr nodeIterator = NULL;
+    
+    if (node->children)
+    {
+        nodeIterator = FxsListIteratorCreate(
+                node->children,
+                FXS_LIST_FRONT,
+                FXS_LIST_FRONT_TO_BACK
+            );
+        assert(nodeIterator);
+        
+        while (FxsListIteratorHasNext(nodeIterator))
+        {
+            DestroyNode(FxsListIteratorNext(nodeIterator));
+        }
+        
+        FxsListIteratorDestroy(&nodeIterator);
+        FxsListDestroy(&node->children);
+    }
+    
+    free(node);
+}
+
+void ObjRendererMeshDestroy(ObjRendererMesh** mesh)
+{
+    ObjRendererVertexBuffer* buffer = NULL;
+    int i = 0;
+    
+    assert(mesh && *mesh);
+    
+    if ((*mesh)->stage)
+    {
+        MeshStageDestroy(&(*mesh)->stage);
+    }
+    
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        buffer = &(*mesh)->vertexBuffers[i];
+        
+        if (buffer->vao)
+        {
+            FFGLStateDeleteVertexArray(buffer->vao);
+            FFGLStateDeleteBuffer(buffer->vbo);
+        }
+    }
+    
+    if ((*mesh)->indexVbo)
+    {
+        FFGLStateDeleteBuffer((*mesh)->indexVbo);
+    }
+    
+    ObjRendererIndirectDestroy(*mesh);
+    
+    if ((*mesh)->octree)
+    {
+        ObjRendererOctreeDestroy(&(*mesh)->octree);
+    }
+    
+    if ((*mesh)->impostor)
+    {
+        ObjRendererImpostorDestroy(&(*mesh)->impostor);
+    }
+    
+    if ((*mesh)->root)
+    {
+        DestroyNode((*mesh)->root);
+    }
+    
+    for (i = 0; i < (int)(*mesh)->numMaterials; i++)
+    {
+        free((*mesh)->materials[i].diffuseMap);
+    }
+    
+    free((*mesh)->drawList);
+    free((*mesh)->data);
+    free((*mesh)->materials);
+    free(*mesh);
+    *mesh = NULL;
+}
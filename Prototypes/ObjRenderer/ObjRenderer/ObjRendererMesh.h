@@ -7,13 +7,17 @@ extern "C"
 #endif
 
 #include <Fxs/Math/Vector3.h>
+#ifndef GL_GLEXT_PROTOTYPES
 #define GL_GLEXT_PROTOTYPES 1
+#endif
 #include <Fxs/OpenGL/glcorearb.h>
 #include <Fxs/List/List.h>
+#include <FF/ThreadPool/ThreadPool.h>
 
 
 /*
-** A bounding box for a
+** An axis aligned bounding box. Boxes of nodes without faces are empty, 
+** their min is larger than their max.
 */
 typedef struct
 {
@@ -22,48 +26,270 @@ typedef struct
 }
 ObjRendererBoundingBox;
 
+/*
+** A material of the .mtl file of a mesh. The diffuse map is loaded in the 
+** background (see ObjRendererTextures.h), until then texture is 0 and layer 
+** is -1.
+*/
 typedef struct
 {
-	GLuint texture;
+	GLuint texture;             /* GL_TEXTURE_2D_ARRAY */
+	int layer;                  /* of the diffuse map in texture */
 	FxsVector3 diffuseColor;
+	char* diffuseMap;           /* path of the diffuse map, NULL if none */
 }
 ObjRendererMaterial;
 
-typedef struct 
+/*
+** Vertex formats. The attributes of a vertex are interleaved: the position, 
+** then the normal and the tex coord if the format has them.
+*/
+#define OBJ_RENDERER_FORMAT_NORMALS 1
+#define OBJ_RENDERER_FORMAT_TEX_COORDS 2
+#define OBJ_RENDERER_NUM_FORMATS 4
+
+/*
+** Gets the # of floats of a vertex in format.
+*/
+unsigned int ObjRendererGetFormatSize(int format);
+
+/*
+** The vertices of all render data of a mesh with the same format. The 
+** vertices are packed (see ObjRendererPacking.h), the vertex shader decodes
+** them with decode.
+*/
+typedef struct
 {
 	GLuint vao;
-	GLuint positionsVbo;
-	GLuint normalsVbo;
-	GLuint texCoordsVbo;
+	GLuint vbo;
+	unsigned int numVertices;
+	unsigned int stride;        /* bytes per vertex */
+	GLfloat decode[16];         /* see ObjRendererPackedVertices */
+}
+ObjRendererVertexBuffer;
 
-	unsigned int numFaces;
+/*
+** A block of faces of one material in a group. Its vertices are a range in 
+** the vertex buffer of its format, its indices are a range in the index 
+** buffer of the mesh and relative to baseVertex.
+*/
+typedef struct 
+{
+	unsigned int firstIndex;    /* first index in the index buffer */
+	unsigned int numFaces;      /* 3 indices per face */
+	unsigned int baseVertex;    /* first vertex in the vertex buffer */
+	unsigned int numVertices;
+	int format;                 /* vertex format, selects the vertex buffer */
 	int matId;
+	ObjRendererBoundingBox boundingBox;
 }
 ObjRendererData;
 
+/*
+** Draw command layout of glMultiDrawElementsIndirect.
+*/
+typedef struct
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+}
+ObjRendererDrawCommand;
+
+/*
+** Draw commands of consecutive render data that share a vertex format and a 
+** material.
+*/
+typedef struct
+{
+	int format;
+	int matId;
+	unsigned int firstCommand;
+	unsigned int numCommands;
+}
+ObjRendererDrawBatch;
+
+/*
+** The draw commands for all render data of a mesh, sorted by vertex format 
+** and material. 
+*/
+typedef struct
+{
+	GLuint commandBuffer;       /* GL_DRAW_INDIRECT_BUFFER */
+	GLuint boundsBuffer;        /* bounding box per command for gpu culling */
+	ObjRendererDrawCommand* commands;
+	GLsizei* counts;            /* host copies of the commands for the */
+	GLvoid** indexOffsets;      /* glMultiDrawElementsBaseVertex fallback */
+	GLint* baseVertices;
+	unsigned int numCommands;
+	ObjRendererDrawBatch* batches;
+	unsigned int numBatches;
+}
+ObjRendererIndirect;
+
 typedef struct ObjRenderMeshNode_
 {
     int data;  /* index to the data for this node, -1 if the node does not contain data*/
-    ObjRendererBoundingBox boundingBox;
+    ObjRendererBoundingBox boundingBox;     /* of the node and its subtree */
 	FxsListPtr children;
 } 
 ObjRendererMeshNode;
 
+/*
+** A node of the scene graph in the flattened draw list. The records are in 
+** pre order, so the subtree of a node are the numDescendants records that 
+** follow it and a culled subtree can be skipped in one step.
+*/
+typedef struct
+{
+    ObjRendererBoundingBox boundingBox; /* same as the node's */
+    int data;                           /* same as ObjRendererMeshNode.data */
+    unsigned int numDescendants;
+}
+ObjRendererDrawRecord;
+
+/*
+** What indexing the render data and packing their vertices saved. A vertex 
+** misses the post transform cache if it is not among the last 
+** OBJ_RENDERER_CACHE_SIZE vertices transformed (see ObjRendererIndexer.h), 
+** without indexing each corner of a face misses it. The errors are the 
+** largest of all vertex buffers.
+*/
+typedef struct
+{
+	unsigned int numFaces;
+	unsigned int numSoupVertices;       /* 3 per face without indexing */
+	unsigned int numVertices;           /* after welding */
+	size_t soupBytes;                   /* vertex memory without indexing */
+	size_t indexedBytes;                /* vertex and index memory */
+	size_t packedBytes;                 /* ... with packed vertices */
+	float positionError;                /* of a packed coordinate */
+	float normalError;                  /* of a packed normal, in degrees */
+	float texCoordError;                /* of a packed coordinate */
+	unsigned int numMissesWelded;       /* cache misses in file order */
+	unsigned int numMissesOptimized;    /* ... after reordering */
+}
+ObjRendererMeshStats;
+
 /*
 ** Represents a mesh associated to a (.obj)file that contains data for rendering.
 */
 typedef struct
 {
 	ObjRendererData* data;
-	ObjRendererMaterial* materials;
+	ObjRendererMaterial* materials;     /* indexed by ObjRendererData.matId */
 	unsigned int numData;
 	unsigned int numMaterials;
 
+	/* vertex and index buffers shared by all render data */
+	ObjRendererVertexBuffer vertexBuffers[OBJ_RENDERER_NUM_FORMATS];
+	GLuint indexVbo;
+	unsigned int numVertices;
+	unsigned int numIndices;
+
+	ObjRendererMeshStats stats;
+
+	ObjRendererIndirect indirect;
+
 	ObjRendererMeshNode* root;
+
+	/* the scene graph compiled by ObjRendererMeshCompileDrawList */
+	ObjRendererDrawRecord* drawList;
+	unsigned int numDrawRecords;
+
+	/* host copies of the vertices and indices, NULL once uploaded */
+	struct ObjRendererMeshStage_* stage;
+
+	/* spatial index of the faces (see ObjRendererOctree.h) */
+	struct ObjRendererOctree_* octree;
+
+	/* drawn instead of the mesh when it is small on the screen (see 
+	** ObjRendererImpostor.h), NULL until it is captured 
+	*/
+	struct ObjRendererImpostor_* impostor;
+	int impostorCaptured;       /* 1 once the capture was tried */
+	int impostorActive;         /* 1 while the mesh is below the threshold */
+	float impostorBlend;        /* 0 .. 1 from the mesh to the impostor */
 }
 ObjRendererMesh;
 
-ObjRendererMesh* ObjRendererMeshCreateWithFile(const char* filename);
+struct ObjRendererCache_;
+
+/*
+** Loads the .obj file filename and creates the mesh for it. The file is parsed
+** on the threads of pool (see ObjRendererFile.h), pool may be NULL. The render
+** data of the faces of each material in each group are welded and their 
+** vertices gathered on the threads of pool, too, only the upload is on the 
+** calling thread. Faces without normals get smooth normals (see 
+** ObjRendererNormals.h). If cache is not NULL the mesh is loaded from the 
+** cache if it holds a conversion of the file, otherwise the conversion is 
+** added to the cache (see ObjRendererCache.h).
+*/
+ObjRendererMesh* ObjRendererMeshCreateWithFile(
+    const char* filename, 
+    FFThreadPoolPtr pool,
+    struct ObjRendererCache_* cache
+);
+
+/*
+** Loads a mesh like ObjRendererMeshCreateWithFile, but keeps its vertices 
+** and indices in host memory instead of uploading them. Builds the octree of
+** the mesh and packs its vertices on the threads of pool. Issues no opengl 
+** calls, so meshes can be loaded on other threads than the gl thread. 
+** ObjRendererMeshUpload has to be called before the mesh is drawn.
+*/
+ObjRendererMesh* ObjRendererMeshLoad(
+    const char* filename, 
+    FFThreadPoolPtr pool,
+    struct ObjRendererCache_* cache
+);
+
+/*
+** Builds the octree of a loaded mesh again (see ObjRendererOctree.h) on the
+** threads of pool, pool may be NULL. The mesh must not be uploaded yet. 
+** Returns 0 if it fails, the old octree is kept then.
+*/
+int ObjRendererMeshBuildOctree(ObjRendererMesh* mesh, FFThreadPoolPtr pool);
+
+/*
+** Creates the buffers of a loaded mesh and releases its host copies of the
+** vertices and indices. Returns 0 if it fails.
+*/
+int ObjRendererMeshUpload(ObjRendererMesh* mesh);
+
+/*
+** Gets the # of bytes of the vertices and indices of mesh, unpacked in host
+** memory before and packed in buffers after ObjRendererMeshUpload.
+*/
+size_t ObjRendererMeshGetSize(const ObjRendererMesh* mesh);
+
+/*
+** Flattens the scene graph of mesh into its draw list and computes the 
+** bounding boxes of the nodes bottom up. Is called when the mesh is created 
+** and has to be called again whenever the hierarchy of the nodes changes. 
+** Returns 0 if it fails, the old draw list is kept then.
+*/
+int ObjRendererMeshCompileDrawList(ObjRendererMesh* mesh);
+
+/*
+** Gets the material uniform for the render data with matId: the diffuse 
+** color and the layer of the diffuse map, -1 if it has none or it is not 
+** loaded yet. texture is the texture array of the diffuse map, 0 if there is
+** none.
+*/
+void ObjRendererMeshGetMaterialParams(
+    const ObjRendererMesh* mesh, 
+    int matId, 
+    GLfloat* params,
+    GLuint* texture
+);
+
+/*
+** Releases mesh and its gl objects. Sets mesh to NULL.
+*/
+void ObjRendererMeshDestroy(ObjRendererMesh** mesh);
 
 #ifdef __cplusplus
 }
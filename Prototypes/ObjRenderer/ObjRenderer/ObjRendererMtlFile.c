@@ -0,0 +1,217 @@
+//
+//  ObjRendererMtlFile.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+#include "ObjRendererMtlFile.h"
+#include "ObjRendererFile.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define IS_SPACE(X) ((X) == ' ' || (X) == '\t' || (X) == '\r')
+
+/*
+** Copies the rest of the line starting at s without trailing white space.
+** Returns NULL if it fails.
+*/
+static char* CopyArgument(const char* s, const char* end)
+{
+    const char* last = s;
+    char* copy = NULL;
+
+    while (s < end && IS_SPACE(*s))
+    {
+        s++;
+    }
+
+    for (last = end; last > s && IS_SPACE(last[-1]); last--)
+    {
+    }
+
+    copy = malloc(last - s + 1);
+
+    if (copy)
+    {
+        memcpy(copy, s, last - s);
+        copy[last - s] = '\0';
+    }
+
+    return copy;
+}
+
+/*
+** Returns 1 if the line start .. end starts with the keyword followed by
+** white space.
+*/
+static int IsStatement(
+    const char* start,
+    const char* end,
+    const char* keyword
+)
+{
+    size_t length = strlen(keyword);
+
+    return (size_t)(end - start) > length &&
+        !strncmp(start, keyword, length) &&
+        IS_SPACE(start[length]);
+}
+
+ObjRendererMtlFile* ObjRendererMtlFileCreateWithFile(const char* filename)
+{
+    ObjRendererMtlFile* file = NULL;
+    ObjRendererMtlMaterial* material = NULL;
+    ObjRendererMtlMaterial* materials = NULL;
+    unsigned int maxMaterials = 0;
+    size_t size = 0;
+    const char* data = ObjRendererFileMap(filename, &size);
+    const char* end = data + size;
+    const char* line = data;
+    const char* lineEnd = NULL;
+    char* text = NULL;
+
+    if (!data)
+    {
+        return NULL;
+    }
+
+    file = malloc(sizeof(ObjRendererMtlFile));
+
+    if (!file)
+    {
+        ObjRendererFileUnmap(data, size);
+        return NULL;
+    }
+
+    memset(file, 0, sizeof(ObjRendererMtlFile));
+
+    for (; line < end; line = lineEnd + 1)
+    {
+        while (line < end && IS_SPACE(*line))
+        {
+            line++;
+        }
+
+        lineEnd = memchr(line, '\n', end - line);
+        lineEnd = lineEnd ? lineEnd : end;
+
+        if (IsStatement(line, lineEnd, "newmtl"))
+        {
+            if (file->numMaterials == maxMaterials)
+            {
+                maxMaterials = maxMaterials ? 2*maxMaterials : 16;
+                materials = realloc(
+                        file->materials,
+                        maxMaterials*sizeof(ObjRendererMtlMaterial)
+                    );
+
+                if (!materials)
+                {
+                    goto error;
+                }
+
+                file->materials = materials;
+            }
+
+            material = &file->materials[file->numMaterials++];
+            memset(material, 0, sizeof(ObjRendererMtlMaterial));
+            material->diffuseColor.x = 1.0f;
+            material->diffuseColor.y = 1.0f;
+            material->diffuseColor.z = 1.0f;
+            material->name = CopyArgument(line + strlen("newmtl"), lineEnd);
+
+            if (!material->name)
+            {
+                goto error;
+            }
+        }
+        else if (material && IsStatement(line, lineEnd, "Kd"))
+        {
+            text = CopyArgument(line + strlen("Kd"), lineEnd);
+
+            if (!text)
+            {
+                goto error;
+            }
+
+            sscanf(
+                text,
+                "%f %f %f",
+                &material->diffuseColor.x,
+                &material->diffuseColor.y,
+                &material->diffuseColor.z
+            );
+            free(text);
+        }
+        else if (material && IsStatement(line, lineEnd, "map_Kd"))
+        {
+            /* options like -bm or -s are not supported, the whole argument
+            ** is taken as the filename
+            */
+            free(material->diffuseMap);
+            material->diffuseMap = CopyArgument(line + strlen("map_Kd"), lineEnd);
+
+            if (!material->diffuseMap)
+            {
+                goto error;
+            }
+        }
+    }
+
+    ObjRendererFileUnmap(data, size);
+
+    return file;
+
+error:
+
+    ERR_MSG("Out of memory");
+    ObjRendererFileUnmap(data, size);
+    ObjRendererMtlFileDestroy(&file);
+
+    return NULL;
+}
+
+const ObjRendererMtlMaterial* ObjRendererMtlFileFind(
+    const ObjRendererMtlFile* file,
+    const char* name
+)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < file->numMaterials; i++)
+    {
+        if (!strcmp(file->materials[i].name, name))
+        {
+            return &file->materials[i];
+        }
+    }
+
+    return NULL;
+}
+
+void ObjRendererMtlFileDestroy(ObjRendererMtlFile** file)
+{
+    unsigned int i = 0;
+
+    if (!file || !*file)
+    {
+        return;
+    }
+
+    for (i = 0; i < (*file)->numMaterials; i++)
+    {
+        free((*file)->materials[i].name);
+        free((*file)->materials[i].diffuseMap);
+    }
+
+    free((*file)->materials);
+    free(*file);
+    *file = NULL;
+}
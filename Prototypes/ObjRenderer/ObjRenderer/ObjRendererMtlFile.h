@@ -0,0 +1,54 @@
+#ifndef OBJRENDERERMTLFILE_H
+#define OBJRENDERERMTLFILE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <Fxs/Math/Vector3.h>
+
+/*
+** Loads the materials of an .mtl file. Only the statements the renderer uses
+** are read: "newmtl", "Kd" and "map_Kd", everything else is skipped.
+*/
+
+typedef struct
+{
+    char* name;
+    FxsVector3 diffuseColor;    /* "Kd", white if it is missing */
+    char* diffuseMap;           /* "map_Kd" as in the file, NULL if missing */
+}
+ObjRendererMtlMaterial;
+
+typedef struct
+{
+    ObjRendererMtlMaterial* materials;
+    unsigned int numMaterials;
+}
+ObjRendererMtlFile;
+
+/*
+** Loads the .mtl file filename. Returns NULL if it can not be read or runs
+** out of memory.
+*/
+ObjRendererMtlFile* ObjRendererMtlFileCreateWithFile(const char* filename);
+
+/*
+** Gets the material called name, NULL if the file has none.
+*/
+const ObjRendererMtlMaterial* ObjRendererMtlFileFind(
+    const ObjRendererMtlFile* file,
+    const char* name
+);
+
+/*
+** Releases file. Sets file to NULL.
+*/
+void ObjRendererMtlFileDestroy(ObjRendererMtlFile** file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERMTLFILE_H */
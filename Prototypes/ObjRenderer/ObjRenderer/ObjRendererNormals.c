@@ -0,0 +1,429 @@
+//
+//  ObjRendererNormals.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAS_SSE2 1
+#endif
+#include "ObjRendererNormals.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define FACE_GRAIN 4096         /* a multiple of 4, see FaceNormalRange */
+#define POSITION_GRAIN 1024
+
+/*
+** Shared by the threads generating the normals. The faces without normals are
+** called targets, corner k of target t is 3*t + k.
+*/
+typedef struct
+{
+    ObjRendererFile* file;
+    const unsigned int* targets;    /* faces without normals */
+    float* faceNormals;             /* x, y, z and length per target */
+    const unsigned int* starts;     /* first entry of each position in corners */
+    const unsigned int* corners;    /* corners of the targets by position */
+    float cosCrease;
+    unsigned int firstNormal;       /* normal of corner 0 */
+}
+NormalsContext;
+
+/*
+** Computes the cross product of the edges of a face, which is twice its area
+** long, and its length.
+*/
+static void ComputeFaceNormal(
+    const FxsVector3* positions,
+    const ObjRendererFace* face,
+    float* normal
+)
+{
+    const FxsVector3* p0 = &positions[face->p0];
+    const FxsVector3* p1 = &positions[face->p1];
+    const FxsVector3* p2 = &positions[face->p2];
+    float e1x = p1->x - p0->x;
+    float e1y = p1->y - p0->y;
+    float e1z = p1->z - p0->z;
+    float e2x = p2->x - p0->x;
+    float e2y = p2->y - p0->y;
+    float e2z = p2->z - p0->z;
+
+    normal[0] = e1y*e2z - e1z*e2y;
+    normal[1] = e1z*e2x - e1x*e2z;
+    normal[2] = e1x*e2y - e1y*e2x;
+    normal[3] = sqrtf(
+        normal[0]*normal[0] + normal[1]*normal[1] + normal[2]*normal[2]
+    );
+}
+
+#ifdef HAS_SSE2
+/*
+** Loads the corners of 4 faces and transposes them, so x, y and z hold one
+** coordinate of the 4 faces each. Reads one float past a position, which is
+** fine as the position array has a spare element.
+*/
+static void LoadCorners(
+    const FxsVector3* positions,
+    const ObjRendererFace* faces,
+    const unsigned int* targets,
+    unsigned int corner,
+    __m128* x,
+    __m128* y,
+    __m128* z
+)
+{
+    __m128 v[4];
+    unsigned int i = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        const int* p = &faces[targets[i]].p0;
+
+        v[i] = _mm_loadu_ps(&positions[p[corner]].x);
+    }
+
+    _MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+    *x = v[0];
+    *y = v[1];
+    *z = v[2];
+}
+#endif
+
+/*
+** Computes the normals of the targets first .. first + count - 1. Blocks of 4
+** targets are computed with SSE2, which gives the same results as
+** ComputeFaceNormal. The blocks start at multiples of 4 since first is a
+** multiple of FACE_GRAIN, so the results do not depend on the threads.
+*/
+static void FaceNormalRange(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    NormalsContext* context = userData;
+    const ObjRendererFile* file = context->file;
+    unsigned int end = first + count;
+    unsigned int i = first;
+
+#ifdef HAS_SSE2
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x0, y0, z0, x1, y1, z1, x2, y2, z2;
+        __m128 nx, ny, nz, length;
+
+        LoadCorners(file->positions, file->faces, &context->targets[i], 0,
+            &x0, &y0, &z0);
+        LoadCorners(file->positions, file->faces, &context->targets[i], 1,
+            &x1, &y1, &z1);
+        LoadCorners(file->positions, file->faces, &context->targets[i], 2,
+            &x2, &y2, &z2);
+
+        /* the edges from corner 0 */
+        x1 = _mm_sub_ps(x1, x0);
+        y1 = _mm_sub_ps(y1, y0);
+        z1 = _mm_sub_ps(z1, z0);
+        x2 = _mm_sub_ps(x2, x0);
+        y2 = _mm_sub_ps(y2, y0);
+        z2 = _mm_sub_ps(z2, z0);
+
+        nx = _mm_sub_ps(_mm_mul_ps(y1, z2), _mm_mul_ps(z1, y2));
+        ny = _mm_sub_ps(_mm_mul_ps(z1, x2), _mm_mul_ps(x1, z2));
+        nz = _mm_sub_ps(_mm_mul_ps(x1, y2), _mm_mul_ps(y1, x2));
+        length = _mm_sqrt_ps(_mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+            _mm_mul_ps(nz, nz)
+        ));
+
+        _MM_TRANSPOSE4_PS(nx, ny, nz, length);
+        _mm_storeu_ps(&context->faceNormals[4*i], nx);
+        _mm_storeu_ps(&context->faceNormals[4*i + 4], ny);
+        _mm_storeu_ps(&context->faceNormals[4*i + 8], nz);
+        _mm_storeu_ps(&context->faceNormals[4*i + 12], length);
+    }
+#endif
+
+    for (; i < end; i++)
+    {
+        ComputeFaceNormal(file->positions, &file->faces[context->targets[i]],
+            &context->faceNormals[4*i]);
+    }
+}
+
+static int* GetNormalIndex(ObjRendererFace* face, unsigned int corner)
+{
+    return &face->n0 + corner;
+}
+
+/*
+** Sums the normals of the targets around a position that are smoothed with
+** target t. The corners of the position are first .. end - 1 in corners. The
+** normals are summed in the order of the corners, including the one of t, so
+** corners that are smoothed with the same targets get the same sum.
+*/
+static void SumNormals(
+    const NormalsContext* context,
+    unsigned int first,
+    unsigned int end,
+    unsigned int t,
+    float* sum
+)
+{
+    const float* normal = &context->faceNormals[4*t];
+    int smoothingGroup = context->file->faces[context->targets[t]].smoothingGroup;
+    unsigned int i = 0;
+
+    if (smoothingGroup == 0)
+    {
+        memcpy(sum, normal, 3*sizeof(float));
+        return;
+    }
+
+    sum[0] = sum[1] = sum[2] = 0.0f;
+
+    for (i = first; i < end; i++)
+    {
+        unsigned int u = context->corners[i]/3;
+        const float* other = &context->faceNormals[4*u];
+
+        if (context->file->faces[context->targets[u]].smoothingGroup != smoothingGroup)
+        {
+            continue;
+        }
+
+        /* without smoothing groups only faces within the crease angle */
+        if (u != t && smoothingGroup < 0 &&
+            normal[0]*other[0] + normal[1]*other[1] + normal[2]*other[2] <
+            context->cosCrease*normal[3]*other[3])
+        {
+            continue;
+        }
+
+        sum[0] += other[0];
+        sum[1] += other[1];
+        sum[2] += other[2];
+    }
+}
+
+/*
+** Generates the normals of the corners at the positions first .. first +
+** count - 1. Each corner has its own normal, a corner whose normal equals the
+** normal of an earlier corner of the position uses that one instead. All
+** corners of a position are handled by the same thread.
+*/
+static void PositionRange(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    NormalsContext* context = userData;
+    ObjRendererFile* file = context->file;
+    unsigned int p = 0;
+
+    for (p = first; p < first + count; p++)
+    {
+        unsigned int start = context->starts[p];
+        unsigned int end = context->starts[p + 1];
+        unsigned int i = 0;
+
+        for (i = start; i < end; i++)
+        {
+            unsigned int c = context->corners[i];
+            unsigned int index = context->firstNormal + c;
+            const float* own = &context->faceNormals[4*(c/3)];
+            float sum[3];
+            float length = 0.0f;
+            unsigned int j = 0;
+
+            SumNormals(context, start, end, c/3, sum);
+            length = sqrtf(sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2]);
+
+            /* opposite faces cancel out, degenerate faces have no normal */
+            if (length <= 0.0f)
+            {
+                memcpy(sum, own, sizeof(sum));
+                length = own[3];
+            }
+
+            if (length > 0.0f)
+            {
+                file->normals[index].x = sum[0]/length;
+                file->normals[index].y = sum[1]/length;
+                file->normals[index].z = sum[2]/length;
+            }
+            else
+            {
+                file->normals[index].x = 0.0f;
+                file->normals[index].y = 0.0f;
+                file->normals[index].z = 1.0f;
+            }
+
+            for (j = start; j < i; j++)
+            {
+                unsigned int d = context->corners[j];
+                int other = *GetNormalIndex(
+                    &file->faces[context->targets[d/3]], d%3
+                );
+
+                if (other == (int)(context->firstNormal + d) &&
+                    !memcmp(&file->normals[other], &file->normals[index],
+                        sizeof(FxsVector3)))
+                {
+                    index = other;
+                    break;
+                }
+            }
+
+            *GetNormalIndex(&file->faces[context->targets[c/3]], c%3) = (int)index;
+        }
+    }
+}
+
+/*
+** Sorts the corners of the targets by their position with a counting sort.
+** starts gets numPositions + 2 elements, the corners of position p are
+** starts[p] .. starts[p + 1] - 1 afterwards.
+*/
+static void SortCorners(
+    const ObjRendererFile* file,
+    const unsigned int* targets,
+    unsigned int numTargets,
+    unsigned int* starts,
+    unsigned int* corners
+)
+{
+    unsigned int i = 0;
+    unsigned int k = 0;
+
+    memset(starts, 0, (file->numPositions + 2)*sizeof(unsigned int));
+
+    for (i = 0; i < numTargets; i++)
+    {
+        const int* p = &file->faces[targets[i]].p0;
+
+        for (k = 0; k < 3; k++)
+        {
+            starts[p[k] + 2]++;
+        }
+    }
+
+    for (i = 2; i < file->numPositions + 2; i++)
+    {
+        starts[i] += starts[i - 1];
+    }
+
+    for (i = 0; i < numTargets; i++)
+    {
+        const int* p = &file->faces[targets[i]].p0;
+
+        for (k = 0; k < 3; k++)
+        {
+            corners[starts[p[k] + 1]++] = 3*i + k;
+        }
+    }
+}
+
+int ObjRendererGenerateNormals(
+    ObjRendererFile* file,
+    float creaseAngle,
+    FFThreadPoolPtr pool
+)
+{
+    NormalsContext context;
+    unsigned int* targets = NULL;
+    unsigned int numTargets = 0;
+    unsigned int* starts = NULL;
+    unsigned int* corners = NULL;
+    FxsVector3* normals = NULL;
+    int success = 0;
+    unsigned int i = 0;
+
+    for (i = 0; i < file->numFaces; i++)
+    {
+        numTargets += file->faces[i].n0 < 0;
+    }
+
+    if (!numTargets)
+    {
+        return 1;
+    }
+
+    targets = malloc(numTargets*sizeof(unsigned int));
+    starts = malloc((file->numPositions + 2)*sizeof(unsigned int));
+    corners = malloc(3*numTargets*sizeof(unsigned int));
+    memset(&context, 0, sizeof(NormalsContext));
+    context.faceNormals = malloc(4*numTargets*sizeof(float));
+
+    if (!targets || !starts || !corners || !context.faceNormals)
+    {
+        ERR_MSG("Out of memory");
+        goto done;
+    }
+
+    /* + 1 like the arrays of the file */
+    normals = realloc(file->normals,
+        (file->numNormals + 3*numTargets + 1)*sizeof(FxsVector3));
+
+    if (!normals)
+    {
+        ERR_MSG("Out of memory");
+        goto done;
+    }
+
+    file->normals = normals;
+    numTargets = 0;
+
+    for (i = 0; i < file->numFaces; i++)
+    {
+        if (file->faces[i].n0 < 0)
+        {
+            targets[numTargets++] = i;
+        }
+    }
+
+    context.file = file;
+    context.targets = targets;
+    context.starts = starts;
+    context.corners = corners;
+    context.cosCrease = cosf(creaseAngle);
+    context.firstNormal = file->numNormals;
+    SortCorners(file, targets, numTargets, starts, corners);
+
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, numTargets, FACE_GRAIN, FaceNormalRange,
+            &context);
+        FFThreadPoolParallelFor(pool, file->numPositions, POSITION_GRAIN,
+            PositionRange, &context);
+    }
+    else
+    {
+        FaceNormalRange(&context, 0, numTargets, 0);
+        PositionRange(&context, 0, file->numPositions, 0);
+    }
+
+    file->numNormals += 3*numTargets;
+    success = 1;
+
+done:
+
+    free(targets);
+    free(starts);
+    free(corners);
+    free(context.faceNormals);
+
+    return success;
+}
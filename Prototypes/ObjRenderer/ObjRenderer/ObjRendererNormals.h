@@ -0,0 +1,45 @@
+#ifndef OBJRENDERERNORMALS_H
+#define OBJRENDERERNORMALS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <FF/ThreadPool/ThreadPool.h>
+#include "ObjRendererFile.h"
+
+/*
+** Generates smooth normals for the faces of an .obj file that have none. The
+** normal of a corner is the sum of the (not normalized) normals of the faces
+** around its position, so each face is weighted by its area.
+**
+** Only faces of the same smoothing group ("s") are summed. Faces after "s off"
+** stay flat. Faces before the first "s" are summed only with faces whose
+** normals differ by less than the crease angle, so hard edges of files
+** without smoothing groups stay hard.
+**
+** The face normals are computed 4 at a time with SSE2 and the corners of each
+** position are summed in parallel. Corners of a position with the same normal
+** share it, so their vertices are still welded.
+*/
+
+#define OBJ_RENDERER_CREASE_ANGLE 1.0471976f    /* 60 degrees, in radians */
+
+/*
+** Generates the normals of the faces of file without normals. creaseAngle is
+** in radians. The work is split across the threads of pool, if pool is NULL
+** it runs on the calling thread. Returns 0 if it runs out of memory, file
+** keeps its normals then.
+*/
+int ObjRendererGenerateNormals(
+    ObjRendererFile* file,
+    float creaseAngle,
+    FFThreadPoolPtr pool
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERNORMALS_H */
@@ -0,0 +1,1018 @@
+//
+//  ObjRendererOctree.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <memory.h>
+#include <float.h>
+#include <math.h>
+#include <assert.h>
+#include "ObjRendererOctree.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define DEPTH_BITS 4
+#define PI 3.14159265358979f
+
+/*
+** Sort key of a cluster: the morton code of its cell, shifted to the
+** deepest level, and its depth in the lowest DEPTH_BITS bits. Sorted keys
+** put the clusters of a node before those of its descendants.
+*/
+typedef struct
+{
+    uint64_t key;
+    unsigned int cluster;
+}
+ClusterKey;
+
+typedef struct
+{
+    ObjRendererOctree* octree;
+    const ObjRendererMesh* mesh;
+    const float* const* vertices;
+    const GLuint* indices;
+    ClusterKey* keys;
+    unsigned int* firstClusters;    /* per render data, counts before the
+                                    ** prefix sum */
+    float minConeDot;               /* cos of OBJ_RENDERER_OCTREE_CONE_ANGLE */
+    FxsVector3 rootMin;
+    float rootSize;
+}
+BuildContext;
+
+/*
+** Spreads the lowest 10 bits of x to every third bit.
+*/
+static uint64_t SpreadBits(uint64_t x)
+{
+    x &= 0x3FF;
+    x = (x | (x << 16)) & 0x30000FF;
+    x = (x | (x << 8)) & 0x300F00F;
+    x = (x | (x << 4)) & 0x30C30C3;
+    x = (x | (x << 2)) & 0x9249249;
+
+    return x;
+}
+
+/*
+** Computes the sort key of cluster from its bounding box.
+*/
+static uint64_t ComputeKey(const BuildContext* context, const ObjRendererCluster* cluster)
+{
+    const ObjRendererBoundingBox* box = &cluster->boundingBox;
+    float extent = fmaxf(
+            box->max.x - box->min.x,
+            fmaxf(box->max.y - box->min.y, box->max.z - box->min.z)
+        );
+    float cellSize = context->rootSize;
+    float center[3];
+    float rootMin[3];
+    uint64_t cell[3];
+    unsigned int depth = 0;
+    unsigned int numCells = 0;
+    int i = 0;
+
+    /* the deepest level whose cells still hold the cluster */
+    while (depth < OBJ_RENDERER_OCTREE_MAX_DEPTH && 0.5f*cellSize >= extent)
+    {
+        cellSize *= 0.5f;
+        depth++;
+    }
+
+    center[0] = 0.5f*(box->min.x + box->max.x);
+    center[1] = 0.5f*(box->min.y + box->max.y);
+    center[2] = 0.5f*(box->min.z + box->max.z);
+    rootMin[0] = context->rootMin.x;
+    rootMin[1] = context->rootMin.y;
+    rootMin[2] = context->rootMin.z;
+    numCells = 1u << depth;
+
+    for (i = 0; i < 3; i++)
+    {
+        float c = floorf((center[i] - rootMin[i])/cellSize);
+
+        c = c < 0.0f ? 0.0f : c;
+        cell[i] = c >= (float)numCells ? numCells - 1 : (uint64_t)c;
+    }
+
+    return (
+        (SpreadBits(cell[0]) | (SpreadBits(cell[1]) << 1) | (SpreadBits(cell[2]) << 2))
+            << (3*(OBJ_RENDERER_OCTREE_MAX_DEPTH - depth) + DEPTH_BITS)
+    ) | depth;
+}
+
+/*
+** Copies the positions first .. first + count - 1 out of the interleaved
+** vertices.
+*/
+static void CopyPositions(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    BuildContext* context = (BuildContext*)userData;
+    ObjRendererOctree* octree = context->octree;
+    const float* v = NULL;
+    unsigned int format = 0;
+    unsigned int i = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        /* the format of position i */
+        for (format = OBJ_RENDERER_NUM_FORMATS - 1; octree->positionBase[format] > i; format--)
+        {
+        }
+
+        v = &context->vertices[format][
+                (i - octree->positionBase[format])*ObjRendererGetFormatSize(format)
+            ];
+        octree->positions[i].x = v[0];
+        octree->positions[i].y = v[1];
+        octree->positions[i].z = v[2];
+    }
+}
+
+static int CompareKeys(const void* a, const void* b)
+{
+    uint64_t ka = ((const ClusterKey*)a)->key;
+    uint64_t kb = ((const ClusterKey*)b)->key;
+
+    return ka < kb ? -1 : (ka > kb);
+}
+
+/*
+** Grows box so that it contains other.
+*/
+static void MergeBoundingBoxes(
+    ObjRendererBoundingBox* box,
+    const ObjRendererBoundingBox* other
+)
+{
+    box->min.x = fminf(box->min.x, other->min.x);
+    box->min.y = fminf(box->min.y, other->min.y);
+    box->min.z = fminf(box->min.z, other->min.z);
+    box->max.x = fmaxf(box->max.x, other->max.x);
+    box->max.y = fmaxf(box->max.y, other->max.y);
+    box->max.z = fmaxf(box->max.z, other->max.z);
+}
+
+/*
+** Converts the indices of the render data first .. first + count - 1 into
+** indices of the positions.
+*/
+static void ConvertFaces(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    BuildContext* context = (BuildContext*)userData;
+    ObjRendererOctree* octree = context->octree;
+    const ObjRendererData* data = NULL;
+    GLuint offset = 0;
+    unsigned int i = 0, j = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        data = &context->mesh->data[i];
+        offset = data->baseVertex + octree->positionBase[data->format];
+
+        for (j = data->firstIndex; j < data->firstIndex + 3*data->numFaces; j++)
+        {
+            octree->faces[j] = context->indices[j] + offset;
+        }
+    }
+}
+
+static void GetFaceBox(
+    const ObjRendererOctree* octree,
+    unsigned int face,
+    ObjRendererBoundingBox* box
+)
+{
+    const FxsVector3* p0 = &octree->positions[octree->faces[3*face]];
+    const FxsVector3* p1 = &octree->positions[octree->faces[3*face + 1]];
+    const FxsVector3* p2 = &octree->positions[octree->faces[3*face + 2]];
+
+    box->min.x = fminf(p0->x, fminf(p1->x, p2->x));
+    box->min.y = fminf(p0->y, fminf(p1->y, p2->y));
+    box->min.z = fminf(p0->z, fminf(p1->z, p2->z));
+    box->max.x = fmaxf(p0->x, fmaxf(p1->x, p2->x));
+    box->max.y = fmaxf(p0->y, fmaxf(p1->y, p2->y));
+    box->max.z = fmaxf(p0->z, fmaxf(p1->z, p2->z));
+}
+
+/*
+** Gets the unit normal of the counter clockwise face, 0 if it has no area.
+*/
+static void GetFaceNormal(
+    const ObjRendererOctree* octree,
+    unsigned int face,
+    FxsVector3* normal
+)
+{
+    const FxsVector3* p0 = &octree->positions[octree->faces[3*face]];
+    const FxsVector3* p1 = &octree->positions[octree->faces[3*face + 1]];
+    const FxsVector3* p2 = &octree->positions[octree->faces[3*face + 2]];
+    FxsVector3 e0 = {p1->x - p0->x, p1->y - p0->y, p1->z - p0->z};
+    FxsVector3 e1 = {p2->x - p0->x, p2->y - p0->y, p2->z - p0->z};
+    float length = 0.0f;
+
+    normal->x = e0.y*e1.z - e0.z*e1.y;
+    normal->y = e0.z*e1.x - e0.x*e1.z;
+    normal->z = e0.x*e1.y - e0.y*e1.x;
+    length = sqrtf(normal->x*normal->x + normal->y*normal->y + normal->z*normal->z);
+
+    if (length > 0.0f)
+    {
+        normal->x /= length;
+        normal->y /= length;
+        normal->z /= length;
+    }
+}
+
+/*
+** Tests if the face with faceBox is no farther from the cluster with box
+** than its own extent.
+*/
+static int IsNear(const ObjRendererBoundingBox* faceBox, const ObjRendererBoundingBox* box)
+{
+    float extent = fmaxf(
+            faceBox->max.x - faceBox->min.x,
+            fmaxf(faceBox->max.y - faceBox->min.y, faceBox->max.z - faceBox->min.z)
+        );
+
+    return
+        faceBox->min.x - extent <= box->max.x && box->min.x <= faceBox->max.x + extent &&
+        faceBox->min.y - extent <= box->max.y && box->min.y <= faceBox->max.y + extent &&
+        faceBox->min.z - extent <= box->max.z && box->min.z <= faceBox->max.z + extent;
+}
+
+/*
+** Divides the faces of the render data with index data into clusters and
+** writes them to clusters if it is not NULL. Consecutive faces are mostly 
+** neighbors, a cluster ends early where the order jumps to a face that is
+** not close to it. For tight normal cones it also ends where a face turns 
+** away from its first face, but only once it has a quarter of its faces and
+** if no face turned away before. Noisy surfaces, whose cones can not be 
+** culled anyway, would end up in tiny clusters otherwise. Returns the # of 
+** clusters.
+*/
+static unsigned int SplitData(
+    const BuildContext* context,
+    unsigned int data,
+    ObjRendererCluster* clusters
+)
+{
+    const ObjRendererData* d = &context->mesh->data[data];
+    ObjRendererCluster cluster;
+    ObjRendererBoundingBox faceBox;
+    FxsVector3 firstNormal = {0.0f, 0.0f, 0.0f};
+    FxsVector3 normal;
+    unsigned int numClusters = 0;
+    unsigned int face = 0;
+    int turns = 0;
+    int coherent = 1;
+
+    cluster.numFaces = 0;
+
+    for (face = d->firstIndex/3; face < d->firstIndex/3 + d->numFaces; face++)
+    {
+        GetFaceBox(context->octree, face, &faceBox);
+        GetFaceNormal(context->octree, face, &normal);
+        /* faces without area turn nowhere */
+        turns = 
+            (normal.x || normal.y || normal.z) && 
+            (firstNormal.x || firstNormal.y || firstNormal.z) &&
+            firstNormal.x*normal.x + firstNormal.y*normal.y + firstNormal.z*normal.z < 
+            context->minConeDot;
+
+        if (turns && cluster.numFaces < OBJ_RENDERER_OCTREE_CLUSTER_SIZE/4)
+        {
+            coherent = 0;
+        }
+
+        if (cluster.numFaces && 
+            (cluster.numFaces == OBJ_RENDERER_OCTREE_CLUSTER_SIZE ||
+            !IsNear(&faceBox, &cluster.boundingBox) ||
+            (turns && coherent)))
+        {
+            if (clusters)
+            {
+                clusters[numClusters] = cluster;
+            }
+
+            numClusters++;
+            cluster.numFaces = 0;
+        }
+
+        if (!cluster.numFaces)
+        {
+            cluster.data = data;
+            cluster.firstIndex = 3*face;
+            cluster.boundingBox = faceBox;
+            firstNormal = normal;
+            coherent = 1;
+        }
+        else if (!(firstNormal.x || firstNormal.y || firstNormal.z))
+        {
+            firstNormal = normal;
+        }
+
+        MergeBoundingBoxes(&cluster.boundingBox, &faceBox);
+        cluster.numFaces++;
+    }
+
+    if (cluster.numFaces && clusters)
+    {
+        clusters[numClusters] = cluster;
+    }
+
+    return numClusters + (cluster.numFaces > 0);
+}
+
+/*
+** Counts the clusters of the render data first .. first + count - 1.
+*/
+static void CountClusters(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    BuildContext* context = (BuildContext*)userData;
+    unsigned int i = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        context->firstClusters[i] = SplitData(context, i, NULL);
+    }
+}
+
+/*
+** Sets the bounding sphere and the normal cone of cluster. The sphere is 
+** centered in the bounding box. The axis of the cone is the average normal of
+** the faces, the cone is cut off where the faces point away from every eye 
+** position outside of the sphere (see ObjRendererOctreeCullData).
+*/
+static void SetClusterBounds(const ObjRendererOctree* octree, ObjRendererCluster* cluster)
+{
+    const ObjRendererBoundingBox* box = &cluster->boundingBox;
+    const FxsVector3* p = NULL;
+    FxsVector3* axis = &cluster->coneAxis;
+    FxsVector3 normal;
+    float radius = 0.0f;
+    float length = 0.0f;
+    float minDot = 1.0f;
+    unsigned int face = 0;
+    unsigned int i = 0;
+
+    cluster->center.x = 0.5f*(box->min.x + box->max.x);
+    cluster->center.y = 0.5f*(box->min.y + box->max.y);
+    cluster->center.z = 0.5f*(box->min.z + box->max.z);
+    axis->x = axis->y = axis->z = 0.0f;
+
+    for (i = cluster->firstIndex; i < cluster->firstIndex + 3*cluster->numFaces; i++)
+    {
+        p = &octree->positions[octree->faces[i]];
+        radius = fmaxf(radius, 
+            (p->x - cluster->center.x)*(p->x - cluster->center.x) +
+            (p->y - cluster->center.y)*(p->y - cluster->center.y) +
+            (p->z - cluster->center.z)*(p->z - cluster->center.z));
+    }
+
+    cluster->radius = sqrtf(radius);
+
+    for (face = cluster->firstIndex/3; face < cluster->firstIndex/3 + cluster->numFaces; face++)
+    {
+        GetFaceNormal(octree, face, &normal);
+        axis->x += normal.x;
+        axis->y += normal.y;
+        axis->z += normal.z;
+    }
+
+    length = sqrtf(axis->x*axis->x + axis->y*axis->y + axis->z*axis->z);
+
+    if (length > 0.0f)
+    {
+        axis->x /= length;
+        axis->y /= length;
+        axis->z /= length;
+    }
+
+    for (face = cluster->firstIndex/3; face < cluster->firstIndex/3 + cluster->numFaces; face++)
+    {
+        GetFaceNormal(octree, face, &normal);
+
+        if (normal.x || normal.y || normal.z)
+        {
+            minDot = fminf(minDot, axis->x*normal.x + axis->y*normal.y + axis->z*normal.z);
+        }
+    }
+
+    /* a cone of 90 degrees or more can not be culled */
+    cluster->coneCutoff = 
+        length > 0.0f && minDot > 0.0f ? sqrtf(1.0f - minDot*minDot) : 2.0f;
+}
+
+/*
+** Writes the clusters of the render data first .. first + count - 1 and
+** computes their keys.
+*/
+static void CreateClusters(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    BuildContext* context = (BuildContext*)userData;
+    ObjRendererOctree* octree = context->octree;
+    unsigned int numClusters = 0;
+    unsigned int i = 0, j = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        j = context->firstClusters[i];
+        numClusters = SplitData(context, i, &octree->clusters[j]);
+
+        for (; numClusters--; j++)
+        {
+            SetClusterBounds(octree, &octree->clusters[j]);
+            context->keys[j].key = ComputeKey(context, &octree->clusters[j]);
+            context->keys[j].cluster = j;
+        }
+    }
+}
+
+/*
+** Writes the node at depth with the sorted clusters first .. end - 1, which
+** all lie in its subtree, and its descendants in pre order from
+** octree->numNodes on. Nodes without clusters of their own and a single
+** child are left out.
+*/
+static void BuildNode(
+    ObjRendererOctree* octree,
+    const ClusterKey* keys,
+    unsigned int first,
+    unsigned int end,
+    unsigned int depth
+)
+{
+    ObjRendererOctreeNode* node = NULL;
+    unsigned int nodeIndex = 0;
+    unsigned int ownEnd = first;
+    unsigned int childFirst = 0;
+    unsigned int childEnd = 0;
+    unsigned int shift = 0;
+    unsigned int i = 0;
+
+    while (ownEnd < end && (keys[ownEnd].key & ((1 << DEPTH_BITS) - 1)) == depth)
+    {
+        ownEnd++;
+    }
+
+    /* the children are the ranges with the same cell one level deeper, on 
+    ** the deepest level all clusters are the node's own
+    */
+    shift = depth < OBJ_RENDERER_OCTREE_MAX_DEPTH ?
+        3*(OBJ_RENDERER_OCTREE_MAX_DEPTH - depth - 1) + DEPTH_BITS : 0;
+
+    if (ownEnd == first && keys[first].key >> shift == keys[end - 1].key >> shift)
+    {
+        BuildNode(octree, keys, first, end, depth + 1);
+        return;
+    }
+
+    nodeIndex = octree->numNodes++;
+    node = &octree->nodes[nodeIndex];
+    node->firstCluster = first;
+    node->numClusters = ownEnd - first;
+    node->numSubtreeClusters = end - first;
+    node->boundingBox.min.x = node->boundingBox.min.y = node->boundingBox.min.z = FLT_MAX;
+    node->boundingBox.max.x = node->boundingBox.max.y = node->boundingBox.max.z = -FLT_MAX;
+
+    for (i = first; i < ownEnd; i++)
+    {
+        MergeBoundingBoxes(&node->boundingBox, &octree->clusters[i].boundingBox);
+    }
+
+    for (childFirst = ownEnd; childFirst < end; childFirst = childEnd)
+    {
+        childEnd = childFirst + 1;
+
+        while (childEnd < end && keys[childEnd].key >> shift == keys[childFirst].key >> shift)
+        {
+            childEnd++;
+        }
+
+        i = octree->numNodes;
+        BuildNode(octree, keys, childFirst, childEnd, depth + 1);
+        MergeBoundingBoxes(&octree->nodes[nodeIndex].boundingBox, &octree->nodes[i].boundingBox);
+    }
+
+    octree->nodes[nodeIndex].numDescendants = octree->numNodes - nodeIndex - 1;
+}
+
+/*
+** Sets the cube of the root cell around the bounding boxes of the render
+** data.
+*/
+static void SetRootCell(BuildContext* context, const ObjRendererMesh* mesh)
+{
+    ObjRendererBoundingBox box;
+    float size = 0.0f;
+    unsigned int i = 0;
+
+    box.min.x = box.min.y = box.min.z = FLT_MAX;
+    box.max.x = box.max.y = box.max.z = -FLT_MAX;
+
+    for (i = 0; i < mesh->numData; i++)
+    {
+        if (mesh->data[i].numFaces)
+        {
+            MergeBoundingBoxes(&box, &mesh->data[i].boundingBox);
+        }
+    }
+
+    size = fmaxf(box.max.x - box.min.x, fmaxf(box.max.y - box.min.y, box.max.z - box.min.z));
+    size = size > 0.0f ? size : 1.0f;
+    context->rootSize = size;
+    context->rootMin.x = 0.5f*(box.min.x + box.max.x - size);
+    context->rootMin.y = 0.5f*(box.min.y + box.max.y - size);
+    context->rootMin.z = 0.5f*(box.min.z + box.max.z - size);
+}
+
+ObjRendererOctree* ObjRendererOctreeCreate(
+    const ObjRendererMesh* mesh,
+    const float* const* vertices,
+    const unsigned int* numVertices,
+    const GLuint* indices,
+    unsigned int numIndices,
+    FFThreadPoolPtr pool
+)
+{
+    BuildContext context;
+    ObjRendererOctree* octree = NULL;
+    ObjRendererCluster* clusters = NULL;
+    ObjRendererOctreeNode* nodes = NULL;
+    unsigned int numPositions = 0;
+    unsigned int numClusters = 0;
+    unsigned int i = 0;
+
+    assert(mesh && vertices && numVertices);
+
+    octree = calloc(1, sizeof(ObjRendererOctree));
+
+    if (!octree)
+    {
+        return NULL;
+    }
+
+    for (i = 0; i < OBJ_RENDERER_NUM_FORMATS; i++)
+    {
+        octree->positionBase[i] = numPositions;
+        numPositions += numVertices[i];
+    }
+
+    memset(&context, 0, sizeof(BuildContext));
+    context.octree = octree;
+    context.mesh = mesh;
+    context.vertices = vertices;
+    context.indices = indices;
+    octree->firstDataClusters = malloc((mesh->numData + 1)*sizeof(unsigned int));
+    context.firstClusters = octree->firstDataClusters;
+    context.minConeDot = cosf(OBJ_RENDERER_OCTREE_CONE_ANGLE*PI/180.0f);
+    octree->positions = malloc((numPositions + 1)*sizeof(FxsVector3));
+    octree->faces = malloc((numIndices + 1)*sizeof(GLuint));
+
+    if (!context.firstClusters || !octree->positions || !octree->faces)
+    {
+        goto error;
+    }
+
+    SetRootCell(&context, mesh);
+
+    /* the render data are split on one thread each */
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, numPositions, 4096, CopyPositions, &context);
+        FFThreadPoolParallelFor(pool, mesh->numData, 1, ConvertFaces, &context);
+        FFThreadPoolParallelFor(pool, mesh->numData, 1, CountClusters, &context);
+    }
+    else
+    {
+        CopyPositions(&context, 0, numPositions, 0);
+        ConvertFaces(&context, 0, mesh->numData, 0);
+        CountClusters(&context, 0, mesh->numData, 0);
+    }
+
+    for (i = 0; i < mesh->numData; i++)
+    {
+        numClusters = context.firstClusters[i];
+        context.firstClusters[i] = octree->numClusters;
+        octree->numClusters += numClusters;
+    }
+
+    context.firstClusters[mesh->numData] = octree->numClusters;
+
+    octree->clusters = malloc((octree->numClusters + 1)*sizeof(ObjRendererCluster));
+    context.keys = malloc((octree->numClusters + 1)*sizeof(ClusterKey));
+    clusters = malloc((octree->numClusters + 1)*sizeof(ObjRendererCluster));
+    octree->dataClusters = malloc((octree->numClusters + 1)*sizeof(unsigned int));
+
+    /* a node has clusters of its own or at least two children, so there are
+    ** less than two nodes per cluster
+    */
+    octree->nodes = malloc((2*octree->numClusters + 1)*sizeof(ObjRendererOctreeNode));
+
+    if (!octree->clusters || !context.keys || !clusters || !octree->nodes ||
+        !octree->dataClusters)
+    {
+        free(context.keys);
+        free(clusters);
+        goto error;
+    }
+
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, mesh->numData, 1, CreateClusters, &context);
+    }
+    else
+    {
+        CreateClusters(&context, 0, mesh->numData, 0);
+    }
+
+    qsort(context.keys, octree->numClusters, sizeof(ClusterKey), CompareKeys);
+
+    /* the clusters were created per render data in index order */
+    for (i = 0; i < octree->numClusters; i++)
+    {
+        clusters[i] = octree->clusters[context.keys[i].cluster];
+        octree->dataClusters[context.keys[i].cluster] = i;
+    }
+
+    free(octree->clusters);
+    octree->clusters = clusters;
+
+    if (octree->numClusters)
+    {
+        BuildNode(octree, context.keys, 0, octree->numClusters, 0);
+    }
+
+    free(context.keys);
+    nodes = realloc(octree->nodes, (octree->numNodes + 1)*sizeof(ObjRendererOctreeNode));
+    octree->nodes = nodes ? nodes : octree->nodes;
+
+    return octree;
+
+error:
+
+    ERR_MSG("Failed to allocate memory for the octree");
+    ObjRendererOctreeDestroy(&octree);
+
+    return NULL;
+}
+
+unsigned int ObjRendererOctreeQueryFrustum(
+    const ObjRendererOctree* octree,
+    const FFFrustum* frustum,
+    unsigned int* clusters
+)
+{
+    const ObjRendererOctreeNode* node = NULL;
+    const ObjRendererBoundingBox* box = NULL;
+    unsigned int numClusters = 0;
+    unsigned int i = 0, j = 0;
+    int result = 0;
+
+    while (i < octree->numNodes)
+    {
+        node = &octree->nodes[i];
+        result = FFFrustumTestBox(frustum, &node->boundingBox.min.x, &node->boundingBox.max.x);
+
+        if (result == FF_FRUSTUM_OUTSIDE)
+        {
+            i += node->numDescendants + 1;
+            continue;
+        }
+
+        /* the clusters of a subtree that is inside are not tested */
+        if (result == FF_FRUSTUM_INSIDE)
+        {
+            for (j = 0; j < node->numSubtreeClusters; j++)
+            {
+                clusters[numClusters++] = node->firstCluster + j;
+            }
+
+            i += node->numDescendants + 1;
+            continue;
+        }
+
+        for (j = node->firstCluster; j < node->firstCluster + node->numClusters; j++)
+        {
+            box = &octree->clusters[j].boundingBox;
+
+            if (FFFrustumTestBox(frustum, &box->min.x, &box->max.x) != FF_FRUSTUM_OUTSIDE)
+            {
+                clusters[numClusters++] = j;
+            }
+        }
+
+        i++;
+    }
+
+    return numClusters;
+}
+
+static int Overlaps(const ObjRendererBoundingBox* a, const ObjRendererBoundingBox* b)
+{
+    return
+        a->min.x <= b->max.x && b->min.x <= a->max.x &&
+        a->min.y <= b->max.y && b->min.y <= a->max.y &&
+        a->min.z <= b->max.z && b->min.z <= a->max.z;
+}
+
+static int Contains(const ObjRendererBoundingBox* a, const ObjRendererBoundingBox* b)
+{
+    return
+        a->min.x <= b->min.x && b->max.x <= a->max.x &&
+        a->min.y <= b->min.y && b->max.y <= a->max.y &&
+        a->min.z <= b->min.z && b->max.z <= a->max.z;
+}
+
+unsigned int ObjRendererOctreeQueryBox(
+    const ObjRendererOctree* octree,
+    const ObjRendererBoundingBox* box,
+    unsigned int* clusters
+)
+{
+    const ObjRendererOctreeNode* node = NULL;
+    unsigned int numClusters = 0;
+    unsigned int i = 0, j = 0;
+
+    while (i < octree->numNodes)
+    {
+        node = &octree->nodes[i];
+
+        if (!Overlaps(box, &node->boundingBox))
+        {
+            i += node->numDescendants + 1;
+            continue;
+        }
+
+        if (Contains(box, &node->boundingBox))
+        {
+            for (j = 0; j < node->numSubtreeClusters; j++)
+            {
+                clusters[numClusters++] = node->firstCluster + j;
+            }
+
+            i += node->numDescendants + 1;
+            continue;
+        }
+
+        for (j = node->firstCluster; j < node->firstCluster + node->numClusters; j++)
+        {
+            if (Overlaps(box, &octree->clusters[j].boundingBox))
+            {
+                clusters[numClusters++] = j;
+            }
+        }
+
+        i++;
+    }
+
+    return numClusters;
+}
+
+/*
+** Tests the ray origin + t*direction against box with the slab method,
+** invDirection is 1/direction per axis. Returns 0 if it misses the box for
+** 0 <= t <= maxDistance.
+*/
+static int HitsBox(
+    const ObjRendererBoundingBox* box,
+    const FxsVector3* origin,
+    const FxsVector3* invDirection,
+    float maxDistance
+)
+{
+    float t0 = (box->min.x - origin->x)*invDirection->x;
+    float t1 = (box->max.x - origin->x)*invDirection->x;
+    float tMin = fminf(t0, t1);
+    float tMax = fmaxf(t0, t1);
+
+    t0 = (box->min.y - origin->y)*invDirection->y;
+    t1 = (box->max.y - origin->y)*invDirection->y;
+    tMin = fmaxf(tMin, fminf(t0, t1));
+    tMax = fminf(tMax, fmaxf(t0, t1));
+    t0 = (box->min.z - origin->z)*invDirection->z;
+    t1 = (box->max.z - origin->z)*invDirection->z;
+    tMin = fmaxf(tMin, fminf(t0, t1));
+    tMax = fminf(tMax, fmaxf(t0, t1));
+
+    return tMax >= fmaxf(tMin, 0.0f) && tMin <= maxDistance;
+}
+
+/*
+** Intersects the ray with the face (Moeller-Trumbore). Returns 0 if it
+** misses the face for 0 <= t <= hit->distance, otherwise updates hit.
+*/
+static int HitsFace(
+    const ObjRendererOctree* octree,
+    unsigned int face,
+    const FxsVector3* origin,
+    const FxsVector3* direction,
+    ObjRendererRayHit* hit
+)
+{
+    const FxsVector3* p0 = &octree->positions[octree->faces[3*face]];
+    const FxsVector3* p1 = &octree->positions[octree->faces[3*face + 1]];
+    const FxsVector3* p2 = &octree->positions[octree->faces[3*face + 2]];
+    float e1[3], e2[3], s[3], p[3], q[3];
+    float det = 0.0f, invDet = 0.0f;
+    float u = 0.0f, v = 0.0f, t = 0.0f;
+
+    e1[0] = p1->x - p0->x; e1[1] = p1->y - p0->y; e1[2] = p1->z - p0->z;
+    e2[0] = p2->x - p0->x; e2[1] = p2->y - p0->y; e2[2] = p2->z - p0->z;
+    p[0] = direction->y*e2[2] - direction->z*e2[1];
+    p[1] = direction->z*e2[0] - direction->x*e2[2];
+    p[2] = direction->x*e2[1] - direction->y*e2[0];
+    det = e1[0]*p[0] + e1[1]*p[1] + e1[2]*p[2];
+
+    /* parallel to the face, or a degenerate face */
+    if (fabsf(det) < 1e-12f)
+    {
+        return 0;
+    }
+
+    invDet = 1.0f/det;
+    s[0] = origin->x - p0->x; s[1] = origin->y - p0->y; s[2] = origin->z - p0->z;
+    u = (s[0]*p[0] + s[1]*p[1] + s[2]*p[2])*invDet;
+
+    if (u < 0.0f || u > 1.0f)
+    {
+        return 0;
+    }
+
+    q[0] = s[1]*e1[2] - s[2]*e1[1];
+    q[1] = s[2]*e1[0] - s[0]*e1[2];
+    q[2] = s[0]*e1[1] - s[1]*e1[0];
+    v = (direction->x*q[0] + direction->y*q[1] + direction->z*q[2])*invDet;
+
+    if (v < 0.0f || u + v > 1.0f)
+    {
+        return 0;
+    }
+
+    t = (e2[0]*q[0] + e2[1]*q[1] + e2[2]*q[2])*invDet;
+
+    if (t < 0.0f || t > hit->distance)
+    {
+        return 0;
+    }
+
+    hit->distance = t;
+    hit->face = face;
+    hit->u = u;
+    hit->v = v;
+
+    return 1;
+}
+
+int ObjRendererOctreeRaycast(
+    const ObjRendererOctree* octree,
+    const FxsVector3* origin,
+    const FxsVector3* direction,
+    float maxDistance,
+    ObjRendererRayHit* hit
+)
+{
+    const ObjRendererOctreeNode* node = NULL;
+    const ObjRendererCluster* cluster = NULL;
+    FxsVector3 invDirection;
+    unsigned int face = 0;
+    unsigned int i = 0, j = 0;
+    int found = 0;
+
+    invDirection.x = 1.0f/direction->x;
+    invDirection.y = 1.0f/direction->y;
+    invDirection.z = 1.0f/direction->z;
+    hit->distance = maxDistance;
+
+    /* the boxes are tested against the closest hit so far */
+    while (i < octree->numNodes)
+    {
+        node = &octree->nodes[i];
+
+        if (!HitsBox(&node->boundingBox, origin, &invDirection, hit->distance))
+        {
+            i += node->numDescendants + 1;
+            continue;
+        }
+
+        for (j = node->firstCluster; j < node->firstCluster + node->numClusters; j++)
+        {
+            cluster = &octree->clusters[j];
+
+            if (!HitsBox(&cluster->boundingBox, origin, &invDirection, hit->distance))
+            {
+                continue;
+            }
+
+            for (face = cluster->firstIndex/3; face < cluster->firstIndex/3 + cluster->numFaces; face++)
+            {
+                if (HitsFace(octree, face, origin, direction, hit))
+                {
+                    hit->cluster = j;
+                    found = 1;
+                }
+            }
+        }
+
+        i++;
+    }
+
+    return found;
+}
+
+void ObjRendererOctreeDestroy(ObjRendererOctree** octree)
+{
+    assert(octree && *octree);
+
+    free((*octree)->nodes);
+    free((*octree)->clusters);
+    free((*octree)->positions);
+    free((*octree)->faces);
+    free((*octree)->firstDataClusters);
+    free((*octree)->dataClusters);
+    free(*octree);
+    *octree = NULL;
+}
+
+unsigned int ObjRendererOctreeCullData(
+    const ObjRendererOctree* octree,
+    unsigned int data,
+    const FFFrustum* frustum,
+    const FxsVector3* eye,
+    ObjRendererIndexRange* ranges
+)
+{
+    const ObjRendererCluster* cluster = NULL;
+    ObjRendererIndexRange* range = NULL;
+    FxsVector3 d;
+    unsigned int numRanges = 0;
+    unsigned int i = 0;
+
+    for (i = octree->firstDataClusters[data]; i < octree->firstDataClusters[data + 1]; i++)
+    {
+        cluster = &octree->clusters[octree->dataClusters[i]];
+
+        if (FFFrustumTestSphere(frustum, &cluster->center.x, cluster->radius) == 
+            FF_FRUSTUM_OUTSIDE)
+        {
+            continue;
+        }
+
+        /* all faces point away from the eye if the direction to the sphere
+        ** is within the cone of the directions they face away from
+        */
+        if (eye)
+        {
+            d.x = cluster->center.x - eye->x;
+            d.y = cluster->center.y - eye->y;
+            d.z = cluster->center.z - eye->z;
+
+            if (d.x*cluster->coneAxis.x + d.y*cluster->coneAxis.y + d.z*cluster->coneAxis.z >=
+                cluster->coneCutoff*sqrtf(d.x*d.x + d.y*d.y + d.z*d.z) + cluster->radius)
+            {
+                continue;
+            }
+        }
+
+        /* the clusters of a render data are consecutive in its index range */
+        if (range && range->firstIndex + range->numIndices == cluster->firstIndex)
+        {
+            range->numIndices += 3*cluster->numFaces;
+            continue;
+        }
+
+        range = &ranges[numRanges++];
+        range->firstIndex = cluster->firstIndex;
+        range->numIndices = 3*cluster->numFaces;
+    }
+
+    return numRanges;
+}
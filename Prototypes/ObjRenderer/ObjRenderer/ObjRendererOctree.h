@@ -0,0 +1,195 @@
+#ifndef OBJRENDEREROCTREE_H
+#define OBJRENDEREROCTREE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <FF/Frustum/Frustum.h>
+#include <FF/ThreadPool/ThreadPool.h>
+#include "ObjRendererMesh.h"
+
+/*
+** A spatial index over the faces of a mesh. The scene graph of a mesh
+** follows the objects, groups and materials of its file, which can be spread
+** all over the scene, so it is of little use for spatial queries.
+**
+** The faces of each render data are divided into clusters of up to
+** OBJ_RENDERER_OCTREE_CLUSTER_SIZE consecutive faces. The indexer orders the
+** faces for the vertex cache, so consecutive faces are mostly close to each
+** other, a cluster ends early where the order jumps. A cluster is an index 
+** range of its render data and can be drawn as it is.
+**
+** The clusters are stored in a loose octree: the cells of a node are
+** enlarged by half their size on each side, so a cluster is stored in the
+** deepest node whose cells are at least as large as the cluster and fits
+** into the cell of its center there. Finding the node needs no tree descent,
+** so the clusters are placed in parallel and the tree is built from the
+** clusters sorted by node. The nodes are stored in pre order like the draw
+** list of the mesh (see ObjRendererMesh.h) and carry the tight bounding box
+** of their subtree.
+**
+** The octree keeps a copy of the positions and faces of the mesh for ray
+** casts, the vertex buffers are not read back.
+**
+** The clusters double as meshlets: a cluster also ends where a face turns
+** more than OBJ_RENDERER_OCTREE_CONE_ANGLE away from its first face, and 
+** carries a bounding sphere and a cone of the normals of its faces. The 
+** clusters of a render data that are in the frustum and do not face away 
+** from the eye are found with ObjRendererOctreeCullData.
+*/
+
+#define OBJ_RENDERER_OCTREE_CLUSTER_SIZE 64
+#define OBJ_RENDERER_OCTREE_MAX_DEPTH 10
+#define OBJ_RENDERER_OCTREE_CONE_ANGLE 45.0f    /* in degrees */
+
+/*
+** Faces firstIndex/3 .. firstIndex/3 + numFaces - 1 of the render data with
+** the index data. The faces face away from an eye e if dot(center - e, 
+** coneAxis) >= coneCutoff*length(center - e) + radius, coneCutoff is larger
+** than 1 if the normals spread too much for that.
+*/
+typedef struct
+{
+    ObjRendererBoundingBox boundingBox;
+    unsigned int data;
+    unsigned int firstIndex;    /* in the index buffer of the mesh */
+    unsigned int numFaces;
+    FxsVector3 center;          /* of the bounding sphere */
+    float radius;
+    FxsVector3 coneAxis;
+    float coneCutoff;           /* sin of the largest angle to the axis */
+}
+ObjRendererCluster;
+
+/*
+** A node in pre order. Its own clusters are followed by the clusters of its
+** descendants, so the clusters of its subtree are numSubtreeClusters
+** clusters from firstCluster on.
+*/
+typedef struct
+{
+    ObjRendererBoundingBox boundingBox;     /* of the clusters of the subtree */
+    unsigned int firstCluster;
+    unsigned int numClusters;
+    unsigned int numSubtreeClusters;
+    unsigned int numDescendants;
+}
+ObjRendererOctreeNode;
+
+typedef struct ObjRendererOctree_
+{
+    ObjRendererOctreeNode* nodes;
+    ObjRendererCluster* clusters;
+    unsigned int numNodes;
+    unsigned int numClusters;
+
+    /* the clusters of render data i are dataClusters[firstDataClusters[i]] 
+    ** .. dataClusters[firstDataClusters[i + 1] - 1], in index order 
+    */
+    unsigned int* firstDataClusters;
+    unsigned int* dataClusters;
+
+    /* copies for ray casts, faces index positions */
+    FxsVector3* positions;
+    GLuint* faces;
+    unsigned int positionBase[OBJ_RENDERER_NUM_FORMATS];
+}
+ObjRendererOctree;
+
+/*
+** The closest face hit by a ray.
+*/
+typedef struct
+{
+    float distance;             /* in units of the length of the direction */
+    unsigned int cluster;
+    unsigned int face;          /* index of its first index / 3 */
+    float u, v;                 /* barycentric coordinates of the hit */
+}
+ObjRendererRayHit;
+
+/*
+** Builds the octree for the render data of mesh. vertices and numVertices 
+** are the interleaved vertices per vertex format, indices and numIndices 
+** the index buffer of the mesh, as they are uploaded. The clusters are built on the threads 
+** of pool, pool may be NULL. Returns NULL if it fails.
+*/
+ObjRendererOctree* ObjRendererOctreeCreate(
+    const ObjRendererMesh* mesh,
+    const float* const* vertices,
+    const unsigned int* numVertices,
+    const GLuint* indices,
+    unsigned int numIndices,
+    FFThreadPoolPtr pool
+);
+
+/*
+** Writes the indices of the clusters that are not outside of frustum to
+** clusters, which has to hold numClusters indices. Returns their #.
+*/
+unsigned int ObjRendererOctreeQueryFrustum(
+    const ObjRendererOctree* octree,
+    const FFFrustum* frustum,
+    unsigned int* clusters
+);
+
+/*
+** Writes the indices of the clusters whose bounding box overlaps box to
+** clusters, which has to hold numClusters indices. Returns their #.
+*/
+unsigned int ObjRendererOctreeQueryBox(
+    const ObjRendererOctree* octree,
+    const ObjRendererBoundingBox* box,
+    unsigned int* clusters
+);
+
+/*
+** Finds the closest face hit by the ray origin + t*direction with
+** 0 <= t <= maxDistance. Both sides of the faces are hit. Returns 0 if no
+** face is hit.
+*/
+int ObjRendererOctreeRaycast(
+    const ObjRendererOctree* octree,
+    const FxsVector3* origin,
+    const FxsVector3* direction,
+    float maxDistance,
+    ObjRendererRayHit* hit
+);
+
+/*
+** A range of the index buffer of a mesh.
+*/
+typedef struct
+{
+    unsigned int firstIndex;
+    unsigned int numIndices;
+}
+ObjRendererIndexRange;
+
+/*
+** Writes the index ranges of the clusters of the render data with index data
+** that are not outside of frustum to ranges, adjacent clusters are merged
+** into one range. If eye is not NULL the clusters that face away from eye 
+** are culled, too. ranges has to hold as many ranges as the render data has
+** clusters. Returns their #. Can be called from several threads at once.
+*/
+unsigned int ObjRendererOctreeCullData(
+    const ObjRendererOctree* octree,
+    unsigned int data,
+    const FFFrustum* frustum,
+    const FxsVector3* eye,
+    ObjRendererIndexRange* ranges
+);
+
+/*
+** Releases octree. Sets octree to NULL.
+*/
+void ObjRendererOctreeDestroy(ObjRendererOctree** octree);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDEREROCTREE_H */
@@ -0,0 +1,347 @@
+//
+//  ObjRendererPacking.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <float.h>
+#include <math.h>
+#include <assert.h>
+#include "ObjRendererPacking.h"
+#include "ObjRendererMesh.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define PI 3.14159265358979f
+
+/*
+** Shared by the threads packing a vertex buffer. Each thread keeps its own
+** largest errors, they are combined when all are done.
+*/
+typedef struct
+{
+    const float* vertices;
+    int format;
+    unsigned int size;          /* floats per vertex */
+    unsigned int packedSize;    /* integers per packed vertex */
+    ObjRendererPackedVertices* packed;
+    float* errors;              /* position, normal, tex coord per thread */
+}
+PackContext;
+
+unsigned int ObjRendererGetPackedFormatSize(int format)
+{
+    unsigned int size = 3;
+
+    if (format & OBJ_RENDERER_FORMAT_NORMALS)
+    {
+        size += 2;
+    }
+
+    if (format & OBJ_RENDERER_FORMAT_TEX_COORDS)
+    {
+        size += 2;
+    }
+
+    return size*sizeof(unsigned short);
+}
+
+static float Sign(float x)
+{
+    return x >= 0.0f ? 1.0f : -1.0f;
+}
+
+/*
+** Maps x within min .. min + extent to 0 .. OBJ_RENDERER_PACKED_MAX.
+*/
+static unsigned short Quantize(float x, float min, float extent)
+{
+    float q = 0.0f;
+
+    if (extent <= 0.0f)
+    {
+        return 0;
+    }
+
+    q = floorf((x - min)/extent*OBJ_RENDERER_PACKED_MAX + 0.5f);
+    q = fmaxf(0.0f, fminf(q, OBJ_RENDERER_PACKED_MAX));
+
+    return (unsigned short)q;
+}
+
+/*
+** Decodes the octahedral encoded normal e to the unit vector n, as the vertex
+** shader does.
+*/
+static void DecodeNormal(const unsigned short* e, float* n)
+{
+    float x = e[0]*(2.0f/OBJ_RENDERER_PACKED_MAX) - 1.0f;
+    float y = e[1]*(2.0f/OBJ_RENDERER_PACKED_MAX) - 1.0f;
+    float z = 1.0f - fabsf(x) - fabsf(y);
+    float t = x;
+    float length = 0.0f;
+
+    if (z < 0.0f)
+    {
+        x = (1.0f - fabsf(y))*Sign(t);
+        y = (1.0f - fabsf(t))*Sign(y);
+    }
+
+    length = sqrtf(x*x + y*y + z*z);
+    n[0] = x/length;
+    n[1] = y/length;
+    n[2] = z/length;
+}
+
+/*
+** Gets the angle between the unit vectors a and b in radians. acos of the
+** dot product is too inaccurate for the small angles of the errors.
+*/
+static float GetAngle(const float* a, const float* b)
+{
+    float x = a[1]*b[2] - a[2]*b[1];
+    float y = a[2]*b[0] - a[0]*b[2];
+    float z = a[0]*b[1] - a[1]*b[0];
+
+    return atan2f(sqrtf(x*x + y*y + z*z), a[0]*b[0] + a[1]*b[1] + a[2]*b[2]);
+}
+
+/*
+** Encodes the unit vector n. Of the 4 integer points around the exact
+** encoding the one that decodes closest to n is chosen.
+*/
+static void EncodeNormal(const float* n, unsigned short* e)
+{
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float x = n[0]/l1;
+    float y = n[1]/l1;
+    float t = x;
+    float decoded[3];
+    float angle = 0.0f;
+    float bestAngle = FLT_MAX;
+    unsigned short candidate[2];
+    int i = 0;
+
+    /* the lower hemisphere is folded over the diagonals */
+    if (n[2] < 0.0f)
+    {
+        x = (1.0f - fabsf(y))*Sign(t);
+        y = (1.0f - fabsf(t))*Sign(y);
+    }
+
+    x = (x + 1.0f)*0.5f*OBJ_RENDERER_PACKED_MAX;
+    y = (y + 1.0f)*0.5f*OBJ_RENDERER_PACKED_MAX;
+
+    for (i = 0; i < 4; i++)
+    {
+        candidate[0] = (unsigned short)fminf(
+                (i & 1) ? ceilf(x) : floorf(x),
+                OBJ_RENDERER_PACKED_MAX
+            );
+        candidate[1] = (unsigned short)fminf(
+                (i & 2) ? ceilf(y) : floorf(y),
+                OBJ_RENDERER_PACKED_MAX
+            );
+        DecodeNormal(candidate, decoded);
+        angle = GetAngle(decoded, n);
+
+        if (angle < bestAngle)
+        {
+            bestAngle = angle;
+            e[0] = candidate[0];
+            e[1] = candidate[1];
+        }
+    }
+}
+
+/*
+** Packs the vertices first .. first + count - 1.
+*/
+static void PackRange(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    PackContext* context = (PackContext*)userData;
+    const float* decode = context->packed->decode;
+    const float* vertex = NULL;
+    unsigned short* packed = NULL;
+    float* errors = &context->errors[3*thread];
+    float normal[3];
+    float decoded[3];
+    float length = 0.0f;
+    unsigned int i = 0;
+    int j = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        vertex = &context->vertices[i*context->size];
+        packed = &context->packed->vertices[i*context->packedSize];
+
+        for (j = 0; j < 3; j++)
+        {
+            packed[j] = Quantize(vertex[j], decode[12 + j], decode[5*j]*OBJ_RENDERER_PACKED_MAX);
+            errors[0] = fmaxf(errors[0], fabsf(decode[12 + j] + packed[j]*decode[5*j] - vertex[j]));
+        }
+
+        vertex += 3;
+        packed += 3;
+
+        if (context->format & OBJ_RENDERER_FORMAT_NORMALS)
+        {
+            length = sqrtf(vertex[0]*vertex[0] + vertex[1]*vertex[1] + vertex[2]*vertex[2]);
+
+            /* a zero normal has no direction to keep, it is packed as +z */
+            if (length > 0.0f)
+            {
+                normal[0] = vertex[0]/length;
+                normal[1] = vertex[1]/length;
+                normal[2] = vertex[2]/length;
+                EncodeNormal(normal, packed);
+                DecodeNormal(packed, decoded);
+                errors[1] = fmaxf(errors[1], GetAngle(decoded, normal)*180.0f/PI);
+            }
+            else
+            {
+                packed[0] = packed[1] = OBJ_RENDERER_PACKED_MAX/2;
+            }
+
+            vertex += 3;
+            packed += 2;
+        }
+
+        if (context->format & OBJ_RENDERER_FORMAT_TEX_COORDS)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                packed[j] = Quantize(vertex[j], decode[11 + 4*j], decode[3 + 4*j]*OBJ_RENDERER_PACKED_MAX);
+                errors[2] = fmaxf(errors[2], fabsf(decode[11 + 4*j] + packed[j]*decode[3 + 4*j] - vertex[j]));
+            }
+        }
+    }
+}
+
+/*
+** Sets up decode for the bounds of the positions and tex coords.
+*/
+static void SetDecode(
+    const float* vertices,
+    unsigned int numVertices,
+    int format,
+    float* decode
+)
+{
+    unsigned int size = ObjRendererGetFormatSize(format);
+    const float* vertex = NULL;
+    float min[5] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[5] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    unsigned int texCoord = size - 2;
+    unsigned int i = 0;
+    int j = 0;
+
+    for (i = 0; i < numVertices; i++)
+    {
+        vertex = &vertices[i*size];
+
+        for (j = 0; j < 3; j++)
+        {
+            min[j] = fminf(min[j], vertex[j]);
+            max[j] = fmaxf(max[j], vertex[j]);
+        }
+
+        if (format & OBJ_RENDERER_FORMAT_TEX_COORDS)
+        {
+            for (j = 0; j < 2; j++)
+            {
+                min[3 + j] = fminf(min[3 + j], vertex[texCoord + j]);
+                max[3 + j] = fmaxf(max[3 + j], vertex[texCoord + j]);
+            }
+        }
+    }
+
+    if (!(format & OBJ_RENDERER_FORMAT_TEX_COORDS))
+    {
+        min[3] = max[3] = min[4] = max[4] = 0.0f;
+    }
+
+    memset(decode, 0, 16*sizeof(float));
+
+    for (j = 0; j < 3; j++)
+    {
+        decode[5*j] = (max[j] - min[j])/OBJ_RENDERER_PACKED_MAX;
+        decode[12 + j] = min[j];
+    }
+
+    for (j = 0; j < 2; j++)
+    {
+        decode[3 + 4*j] = (max[3 + j] - min[3 + j])/OBJ_RENDERER_PACKED_MAX;
+        decode[11 + 4*j] = min[3 + j];
+    }
+}
+
+int ObjRendererPackVertices(
+    const float* vertices,
+    unsigned int numVertices,
+    int format,
+    FFThreadPoolPtr pool,
+    ObjRendererPackedVertices* packed
+)
+{
+    PackContext context;
+    unsigned int numThreads = pool ? FFThreadPoolGetNumThreads(pool) : 1;
+    unsigned int i = 0;
+
+    memset(packed, 0, sizeof(ObjRendererPackedVertices));
+    memset(&context, 0, sizeof(PackContext));
+    context.vertices = vertices;
+    context.format = format;
+    context.size = ObjRendererGetFormatSize(format);
+    context.packedSize = ObjRendererGetPackedFormatSize(format)/sizeof(unsigned short);
+    context.packed = packed;
+    context.errors = calloc(3*numThreads, sizeof(float));
+    packed->vertices = malloc((numVertices + 1)*ObjRendererGetPackedFormatSize(format));
+    packed->numVertices = numVertices;
+
+    if (!context.errors || !packed->vertices)
+    {
+        ERR_MSG("Failed to allocate memory for the packed vertices");
+        free(context.errors);
+        ObjRendererPackedVerticesDestroy(packed);
+        return 0;
+    }
+
+    SetDecode(vertices, numVertices, format, packed->decode);
+
+    if (pool)
+    {
+        FFThreadPoolParallelFor(pool, numVertices, 4096, PackRange, &context);
+    }
+    else
+    {
+        PackRange(&context, 0, numVertices, 0);
+    }
+
+    for (i = 0; i < numThreads; i++)
+    {
+        packed->positionError = fmaxf(packed->positionError, context.errors[3*i]);
+        packed->normalError = fmaxf(packed->normalError, context.errors[3*i + 1]);
+        packed->texCoordError = fmaxf(packed->texCoordError, context.errors[3*i + 2]);
+    }
+
+    free(context.errors);
+
+    return 1;
+}
+
+void ObjRendererPackedVerticesDestroy(ObjRendererPackedVertices* packed)
+{
+    free(packed->vertices);
+    memset(packed, 0, sizeof(ObjRendererPackedVertices));
+}
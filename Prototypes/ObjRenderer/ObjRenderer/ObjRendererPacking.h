@@ -0,0 +1,75 @@
+#ifndef OBJRENDERERPACKING_H
+#define OBJRENDERERPACKING_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <FF/ThreadPool/ThreadPool.h>
+
+/*
+** Compresses the interleaved float vertices of a vertex buffer for the gpu.
+** Every attribute is stored as 16 bit unsigned integers: the position is
+** quantized within the bounding box of the vertex buffer, the normal is
+** octahedral encoded into 2 integers and the tex coord is quantized within
+** the range of the tex coords of the vertex buffer. A vertex with all
+** attributes shrinks from 32 to 14 bytes.
+**
+** The positions are quantized within the box of the whole vertex buffer
+** rather than the box of each render data, so the render data of a vertex
+** buffer share one decode matrix and can still be drawn with one multi draw.
+**
+** The integers are passed to the vertex shader as (not normalized) floats,
+** which is exact, and decoded there the way they are decoded here to measure
+** the errors, so the measured errors are the errors on the gpu.
+*/
+
+#define OBJ_RENDERER_PACKED_MAX 65535
+
+/*
+** The packed vertices of a vertex buffer. A position is decode*(x, y, z, 1)
+** of its integers x, y, z. Row 3 of decode is not needed for that and holds
+** the tex coord range: a tex coord is (decode[3], decode[7])*(s, t) +
+** (decode[11], decode[15]). A normal is decoded from e = 2*(u, v)/
+** OBJ_RENDERER_PACKED_MAX - 1 (see Cigolle et al., "A Survey of Efficient
+** Representations for Independent Unit Vectors").
+*/
+typedef struct
+{
+    unsigned short* vertices;
+    unsigned int numVertices;
+    float decode[16];           /* column major */
+    float positionError;        /* largest error of a coordinate */
+    float normalError;          /* largest angle in degrees */
+    float texCoordError;        /* largest error of a coordinate */
+}
+ObjRendererPackedVertices;
+
+/*
+** Gets the # of bytes of a packed vertex in format.
+*/
+unsigned int ObjRendererGetPackedFormatSize(int format);
+
+/*
+** Packs numVertices vertices in format (see ObjRendererGetFormatSize) on the
+** threads of pool, pool may be NULL. Returns 0 if it fails.
+*/
+int ObjRendererPackVertices(
+    const float* vertices,
+    unsigned int numVertices,
+    int format,
+    FFThreadPoolPtr pool,
+    ObjRendererPackedVertices* packed
+);
+
+/*
+** Releases the vertices of packed.
+*/
+void ObjRendererPackedVerticesDestroy(ObjRendererPackedVertices* packed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERPACKING_H */
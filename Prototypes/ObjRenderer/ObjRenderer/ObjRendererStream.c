@@ -0,0 +1,490 @@
+//
+//  ObjRendererStream.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <FF/ThreadPool/ThreadPool.h>
+#include "ObjRendererStream.h"
+#include "ObjRendererChunks.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+typedef enum
+{
+    CHUNK_UNLOADED,
+    CHUNK_QUEUED,       /* waiting for the loader */
+    CHUNK_LOADING,      /* owned by the loader */
+    CHUNK_LOADED,       /* in host memory, ready for the upload */
+    CHUNK_RESIDENT,     /* uploaded */
+    CHUNK_FAILED
+}
+ChunkState;
+
+typedef struct
+{
+    ObjRendererChunk chunk;
+    float distance;             /* to the eye of the last update */
+
+    /* written by the loader, guarded by the mutex */
+    ChunkState state;
+    ObjRendererMesh* mesh;
+}
+StreamChunk;
+
+struct ObjRendererStream
+{
+    StreamChunk* chunks;
+    unsigned int numChunks;
+    unsigned int maxChunks;
+    unsigned int* order;        /* chunks sorted by distance */
+
+    size_t hostBudget;
+    size_t gpuBudget;
+
+    ObjRendererStreamCallback onResident;
+    ObjRendererStreamCallback onEvict;
+    void* userData;
+
+    ObjRendererCache* cache;
+    FFThreadPoolPtr pool;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t queueCond;
+    unsigned int* queue;        /* chunks to load, closest first */
+    unsigned int firstQueued;
+    unsigned int numQueued;
+    int quit;
+};
+
+static double GetTime()
+{
+    struct timeval time;
+
+    gettimeofday(&time, NULL);
+
+    return time.tv_sec + time.tv_usec*1e-6;
+}
+
+static void* LoaderMain(void* userData)
+{
+    ObjRendererStreamPtr stream = (ObjRendererStreamPtr)userData;
+    StreamChunk* chunk = NULL;
+    ObjRendererMesh* mesh = NULL;
+    const char* filename = NULL;
+    unsigned int index = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&stream->mutex);
+
+        while (stream->firstQueued == stream->numQueued && !stream->quit)
+        {
+            pthread_cond_wait(&stream->queueCond, &stream->mutex);
+        }
+
+        if (stream->quit)
+        {
+            pthread_mutex_unlock(&stream->mutex);
+            break;
+        }
+
+        /* the chunks may be reallocated while loading, only the index and
+        ** the filename stay valid
+        */
+        index = stream->queue[stream->firstQueued++];
+        chunk = &stream->chunks[index];
+        chunk->state = CHUNK_LOADING;
+        filename = chunk->chunk.filename;
+        pthread_mutex_unlock(&stream->mutex);
+
+        mesh = ObjRendererMeshLoad(filename, stream->pool, stream->cache);
+
+        pthread_mutex_lock(&stream->mutex);
+        chunk = &stream->chunks[index];
+        chunk->mesh = mesh;
+        chunk->state = mesh ? CHUNK_LOADED : CHUNK_FAILED;
+        pthread_mutex_unlock(&stream->mutex);
+    }
+
+    return NULL;
+}
+
+ObjRendererStreamPtr ObjRendererStreamCreate(
+    ObjRendererStreamCallback onResident,
+    ObjRendererStreamCallback onEvict,
+    void* userData,
+    const ObjRendererCache* cache
+)
+{
+    ObjRendererStreamPtr stream = malloc(sizeof(struct ObjRendererStream));
+
+    if (!stream)
+    {
+        return NULL;
+    }
+
+    memset(stream, 0, sizeof(struct ObjRendererStream));
+    stream->onResident = onResident;
+    stream->onEvict = onEvict;
+    stream->userData = userData;
+    stream->hostBudget = OBJ_RENDERER_STREAM_HOST_BUDGET;
+    stream->gpuBudget = OBJ_RENDERER_STREAM_GPU_BUDGET;
+
+    /* a cache of its own, the loader uses it concurrently with the owner */
+    if (cache)
+    {
+        stream->cache = ObjRendererCacheCreate(cache->directory, cache->maxSize);
+    }
+
+    stream->pool = FFThreadPoolCreate(0);
+
+    if (!stream->pool || (cache && !stream->cache))
+    {
+        goto error;
+    }
+
+    pthread_mutex_init(&stream->mutex, NULL);
+    pthread_cond_init(&stream->queueCond, NULL);
+
+    if (pthread_create(&stream->thread, NULL, LoaderMain, stream))
+    {
+        ERR_MSG("Failed to create the chunk loader thread");
+        pthread_mutex_destroy(&stream->mutex);
+        pthread_cond_destroy(&stream->queueCond);
+        goto error;
+    }
+
+    return stream;
+
+error:
+
+    if (stream->pool)
+    {
+        FFThreadPoolDestroy(&stream->pool);
+    }
+
+    if (stream->cache)
+    {
+        ObjRendererCacheDestroy(&stream->cache);
+    }
+
+    free(stream);
+
+    return NULL;
+}
+
+int ObjRendererStreamAddChunks(ObjRendererStreamPtr stream, const char* manifest)
+{
+    ObjRendererChunkList* list = NULL;
+    StreamChunk* chunks = NULL;
+    unsigned int* order = NULL;
+    unsigned int* queue = NULL;
+    unsigned int maxChunks = 0;
+    unsigned int i = 0;
+
+    assert(stream && manifest);
+
+    list = ObjRendererChunkListCreateWithFile(manifest);
+
+    if (!list)
+    {
+        ERR_MSG("Failed to read the chunk manifest");
+        printf("\t%s\n", manifest);
+        return 0;
+    }
+
+    maxChunks = stream->numChunks + list->numChunks;
+
+    /* the loader only reads the chunks and the queue with the mutex locked */
+    pthread_mutex_lock(&stream->mutex);
+
+    if (maxChunks > stream->maxChunks)
+    {
+        chunks = realloc(stream->chunks, maxChunks*sizeof(StreamChunk));
+        stream->chunks = chunks ? chunks : stream->chunks;
+        order = realloc(stream->order, maxChunks*sizeof(unsigned int));
+        stream->order = order ? order : stream->order;
+        queue = realloc(stream->queue, maxChunks*sizeof(unsigned int));
+        stream->queue = queue ? queue : stream->queue;
+
+        if (!chunks || !order || !queue)
+        {
+            pthread_mutex_unlock(&stream->mutex);
+            ERR_MSG("Failed to allocate memory for the chunks");
+            ObjRendererChunkListDestroy(&list);
+            return 0;
+        }
+
+        stream->maxChunks = maxChunks;
+    }
+
+    /* the filenames are taken over */
+    for (i = 0; i < list->numChunks; i++)
+    {
+        memset(&stream->chunks[stream->numChunks], 0, sizeof(StreamChunk));
+        stream->chunks[stream->numChunks].chunk = list->chunks[i];
+        stream->order[stream->numChunks] = stream->numChunks;
+        stream->numChunks++;
+        list->chunks[i].filename = NULL;
+    }
+
+    pthread_mutex_unlock(&stream->mutex);
+    ObjRendererChunkListDestroy(&list);
+
+    return 1;
+}
+
+void ObjRendererStreamSetBudget(
+    ObjRendererStreamPtr stream,
+    size_t hostBytes,
+    size_t gpuBytes
+)
+{
+    stream->hostBudget = hostBytes;
+    stream->gpuBudget = gpuBytes;
+}
+
+/*
+** Distance from p to box, 0 if p is inside.
+*/
+static float GetDistance(const ObjRendererBoundingBox* box, const FxsVector3* p)
+{
+    float dx = fmaxf(fmaxf(box->min.x - p->x, p->x - box->max.x), 0.0f);
+    float dy = fmaxf(fmaxf(box->min.y - p->y, p->y - box->max.y), 0.0f);
+    float dz = fmaxf(fmaxf(box->min.z - p->z, p->z - box->max.z), 0.0f);
+
+    return sqrtf(dx*dx + dy*dy + dz*dz);
+}
+
+static const StreamChunk* sortChunks = NULL;
+
+static int CompareDistances(const void* a, const void* b)
+{
+    float da = sortChunks[*(const unsigned int*)a].distance;
+    float db = sortChunks[*(const unsigned int*)b].distance;
+
+    return da < db ? -1 : (da > db);
+}
+
+/*
+** Gets the bytes of the mesh of chunk, estimated until it is loaded.
+*/
+static size_t GetChunkSize(const StreamChunk* chunk)
+{
+    return chunk->mesh ? ObjRendererMeshGetSize(chunk->mesh) : chunk->chunk.size;
+}
+
+/*
+** Destroys the mesh of chunk and calls onEvict for it if it was resident.
+*/
+static void EvictChunk(ObjRendererStreamPtr stream, StreamChunk* chunk)
+{
+    if (chunk->state == CHUNK_RESIDENT && stream->onEvict)
+    {
+        stream->onEvict(chunk->mesh, stream->userData);
+    }
+
+    ObjRendererMeshDestroy(&chunk->mesh);
+    chunk->state = CHUNK_UNLOADED;
+}
+
+unsigned int ObjRendererStreamUpdate(
+    ObjRendererStreamPtr stream,
+    const FxsVector3* eye,
+    double budget
+)
+{
+    double start = GetTime();
+    StreamChunk* chunk = NULL;
+    size_t gpuBytes = 0;
+    size_t hostBytes = 0;
+    unsigned int numWanted = 0;
+    unsigned int numPending = 0;
+    unsigned int i = 0;
+    int uploaded = 0;
+
+    assert(stream && eye);
+
+    for (i = 0; i < stream->numChunks; i++)
+    {
+        stream->chunks[i].distance = GetDistance(&stream->chunks[i].chunk.boundingBox, eye);
+    }
+
+    sortChunks = stream->chunks;
+    qsort(stream->order, stream->numChunks, sizeof(unsigned int), CompareDistances);
+    sortChunks = NULL;
+
+    pthread_mutex_lock(&stream->mutex);
+
+    /* the closest chunks that fit into the gpu budget are wanted, the
+    ** loader's chunk is counted as loaded
+    */
+    for (numWanted = 0; numWanted < stream->numChunks; numWanted++)
+    {
+        chunk = &stream->chunks[stream->order[numWanted]];
+
+        if (chunk->state == CHUNK_FAILED)
+        {
+            continue;
+        }
+
+        if (gpuBytes + GetChunkSize(chunk) > stream->gpuBudget)
+        {
+            break;
+        }
+
+        gpuBytes += GetChunkSize(chunk);
+    }
+
+    /* evict the others, a chunk the loader is busy with is evicted once it
+    ** is loaded
+    */
+    for (i = numWanted; i < stream->numChunks; i++)
+    {
+        chunk = &stream->chunks[stream->order[i]];
+
+        if (chunk->state == CHUNK_LOADED || chunk->state == CHUNK_RESIDENT)
+        {
+            EvictChunk(stream, chunk);
+        }
+        else if (chunk->state == CHUNK_QUEUED)
+        {
+            chunk->state = CHUNK_UNLOADED;
+        }
+    }
+
+    /* queue the wanted chunks closest first as long as they fit into the
+    ** host budget with the chunks in host memory
+    */
+    stream->firstQueued = 0;
+    stream->numQueued = 0;
+
+    for (i = 0; i < numWanted; i++)
+    {
+        chunk = &stream->chunks[stream->order[i]];
+
+        if (chunk->state == CHUNK_LOADING || chunk->state == CHUNK_LOADED)
+        {
+            hostBytes += GetChunkSize(chunk);
+        }
+    }
+
+    for (i = 0; i < numWanted; i++)
+    {
+        chunk = &stream->chunks[stream->order[i]];
+
+        if (chunk->state != CHUNK_UNLOADED && chunk->state != CHUNK_QUEUED)
+        {
+            continue;
+        }
+
+        /* one chunk is always let through, it may exceed the budget alone */
+        if (hostBytes && hostBytes + GetChunkSize(chunk) > stream->hostBudget)
+        {
+            chunk->state = CHUNK_UNLOADED;
+            continue;
+        }
+
+        hostBytes += GetChunkSize(chunk);
+        chunk->state = CHUNK_QUEUED;
+        stream->queue[stream->numQueued++] = stream->order[i];
+    }
+
+    if (stream->numQueued)
+    {
+        pthread_cond_signal(&stream->queueCond);
+    }
+
+    pthread_mutex_unlock(&stream->mutex);
+
+    /* the loader does not touch loaded chunks anymore */
+    for (i = 0; i < numWanted; i++)
+    {
+        chunk = &stream->chunks[stream->order[i]];
+
+        pthread_mutex_lock(&stream->mutex);
+
+        if (chunk->state == CHUNK_LOADED && (!uploaded || GetTime() - start < budget))
+        {
+            chunk->state = CHUNK_RESIDENT;
+        }
+        else
+        {
+            numPending += chunk->state != CHUNK_RESIDENT && chunk->state != CHUNK_FAILED;
+            pthread_mutex_unlock(&stream->mutex);
+            continue;
+        }
+
+        pthread_mutex_unlock(&stream->mutex);
+        uploaded = 1;
+
+        if (!ObjRendererMeshUpload(chunk->mesh))
+        {
+            ERR_MSG("Failed to upload a chunk");
+            printf("\t%s\n", chunk->chunk.filename);
+            ObjRendererMeshDestroy(&chunk->mesh);
+            chunk->state = CHUNK_FAILED;
+            continue;
+        }
+
+        if (stream->onResident)
+        {
+            stream->onResident(chunk->mesh, stream->userData);
+        }
+    }
+
+    return numPending;
+}
+
+void ObjRendererStreamDestroy(ObjRendererStreamPtr* stream)
+{
+    StreamChunk* chunk = NULL;
+    unsigned int i = 0;
+
+    assert(stream && *stream);
+
+    /* the loader finishes the chunk it is loading */
+    pthread_mutex_lock(&(*stream)->mutex);
+    (*stream)->quit = 1;
+    pthread_cond_signal(&(*stream)->queueCond);
+    pthread_mutex_unlock(&(*stream)->mutex);
+    pthread_join((*stream)->thread, NULL);
+
+    for (i = 0; i < (*stream)->numChunks; i++)
+    {
+        chunk = &(*stream)->chunks[i];
+
+        if (chunk->mesh)
+        {
+            EvictChunk(*stream, chunk);
+        }
+
+        free(chunk->chunk.filename);
+    }
+
+    pthread_mutex_destroy(&(*stream)->mutex);
+    pthread_cond_destroy(&(*stream)->queueCond);
+    FFThreadPoolDestroy(&(*stream)->pool);
+
+    if ((*stream)->cache)
+    {
+        ObjRendererCacheDestroy(&(*stream)->cache);
+    }
+
+    free((*stream)->chunks);
+    free((*stream)->order);
+    free((*stream)->queue);
+    free(*stream);
+    *stream = NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef OBJRENDERERSTREAM_H
+#define OBJRENDERERSTREAM_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ObjRendererMesh.h"
+#include "ObjRendererCache.h"
+
+/*
+** Streams the chunks of .obj files that were split by ObjRendererChunksSplit
+** in and out by their distance to the camera.
+**
+** The chunks closest to the eye are kept resident as long as their meshes fit
+** into the gpu budget. The meshes are loaded on a background thread into host
+** memory (see ObjRendererMeshLoad), at most as many as fit into the host
+** budget at a time, and uploaded by ObjRendererStreamUpdate on the gl thread
+** within a time budget per call. Chunks that fall out of the budget are
+** evicted, chunks that failed to load are not tried again.
+**
+** The owner learns about uploaded and evicted meshes through callbacks,
+** evicted meshes are destroyed right after their callback.
+*/
+
+#define OBJ_RENDERER_STREAM_HOST_BUDGET (256 << 20)
+#define OBJ_RENDERER_STREAM_GPU_BUDGET (512 << 20)
+
+typedef struct ObjRendererStream* ObjRendererStreamPtr;
+
+typedef void (*ObjRendererStreamCallback)(ObjRendererMesh* mesh, void* userData);
+
+/*
+** Creates the stream and its loader thread. onResident is called for each
+** mesh after it is uploaded, onEvict before it is destroyed. The chunks are
+** converted through a cache in the directory of cache, which may be NULL.
+** Returns NULL if it fails.
+*/
+ObjRendererStreamPtr ObjRendererStreamCreate(
+    ObjRendererStreamCallback onResident,
+    ObjRendererStreamCallback onEvict,
+    void* userData,
+    const ObjRendererCache* cache
+);
+
+/*
+** Adds the chunks listed in the manifest written by ObjRendererChunksSplit.
+** Returns 0 if it fails.
+*/
+int ObjRendererStreamAddChunks(ObjRendererStreamPtr stream, const char* manifest);
+
+/*
+** Sets the bytes of vertices and indices that may be loaded but not uploaded
+** (host) and uploaded (gpu). Initially OBJ_RENDERER_STREAM_HOST_BUDGET and
+** OBJ_RENDERER_STREAM_GPU_BUDGET.
+*/
+void ObjRendererStreamSetBudget(
+    ObjRendererStreamPtr stream,
+    size_t hostBytes,
+    size_t gpuBytes
+);
+
+/*
+** Evicts the chunks that fell out of the gpu budget for the eye position eye,
+** queues the closest chunks for loading and uploads loaded chunks until
+** budget (in seconds) is used up, at least one per call if there is one. Has
+** to be called on the gl thread. Returns the # of chunks within the gpu budget
+** that are not resident yet.
+*/
+unsigned int ObjRendererStreamUpdate(
+    ObjRendererStreamPtr stream,
+    const FxsVector3* eye,
+    double budget
+);
+
+/*
+** Stops loading and evicts all resident chunks. Sets stream to NULL.
+*/
+void ObjRendererStreamDestroy(ObjRendererStreamPtr* stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERSTREAM_H */
@@ -0,0 +1,735 @@
+//
+//  ObjRendererTextures.c
+//  ObjRenderer
+//
+//  Created by Arno in Wolde Luebke on 06.04.14.
+//  Copyright (c) 2014 Arno in Wolde Luebke. All rights reserved.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <memory.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <FF/GLState/GLState.h>
+#include <FF/ThreadPool/ThreadPool.h>
+#include "ObjRendererTextures.h"
+#include "ObjRendererImage.h"
+
+#define ERR_MSG(X) printf("Error in File %s Line %d\n\t%s\n", __FILE__, __LINE__, X);
+
+typedef enum
+{
+    LAYER_PENDING,      /* queued for decoding */
+    LAYER_DECODED,      /* ready for the upload */
+    LAYER_FAILED,
+    LAYER_DONE          /* uploaded or given up */
+}
+LayerState;
+
+/*
+** A diffuse map and the layer of the texture array it goes to. All materials
+** of a mesh with the same map share the layer.
+*/
+typedef struct
+{
+    char* filename;
+    unsigned int width;
+    unsigned int height;
+    GLuint texture;
+    int layer;
+    ObjRendererMaterial** materials;
+    unsigned int numMaterials;
+
+    /* written by the workers, guarded by the mutex */
+    LayerState state;
+    ObjRendererImage image;
+}
+Layer;
+
+/*
+** The layers of one call to ObjRendererTexturesAdd, decoded with one
+** parallel loop.
+*/
+typedef struct Job_
+{
+    struct ObjRendererTextures* textures;
+    Layer** layers;
+    unsigned int numLayers;
+    struct Job_* next;
+}
+Job;
+
+struct ObjRendererTextures
+{
+    /* all layers in the order they were added, owned by the loader */
+    Layer** layers;
+    unsigned int numLayers;
+    unsigned int maxLayers;
+    unsigned int firstPending;  /* layers before it are done */
+
+    GLuint* textures;
+    unsigned int numTextures;
+    GLint maxArrayLayers;
+
+    FFThreadPoolPtr pool;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;
+    Job* firstJob;
+    Job* lastJob;
+    int quit;
+};
+
+static double GetTime()
+{
+    struct timeval time;
+
+    gettimeofday(&time, NULL);
+
+    return time.tv_sec + time.tv_usec*1e-6;
+}
+
+/*
+** Decodes the layers first .. first + count - 1 of a job.
+*/
+static void DecodeLayers(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+)
+{
+    Job* job = (Job*)userData;
+    ObjRendererTexturesPtr textures = job->textures;
+    Layer* layer = NULL;
+    ObjRendererImage image;
+    unsigned int i = 0;
+    int success = 0;
+
+    for (i = first; i < first + count; i++)
+    {
+        layer = job->layers[i];
+        
+        pthread_mutex_lock(&textures->mutex);
+        success = !textures->quit;
+        pthread_mutex_unlock(&textures->mutex);
+        
+        /* skip the rest of the job when textures is destroyed */
+        if (!success)
+        {
+            continue;
+        }
+        
+        success = ObjRendererImageLoad(layer->filename, &image);
+
+        /* the size was read when the array was created, the file may have
+        ** changed since
+        */
+        if (success &&
+            (image.width != layer->width || image.height != layer->height))
+        {
+            ERR_MSG("Diffuse map changed its size while loading");
+            ObjRendererImageRelease(&image);
+            success = 0;
+        }
+
+        pthread_mutex_lock(&textures->mutex);
+        layer->image = image;
+        layer->state = success ? LAYER_DECODED : LAYER_FAILED;
+        pthread_mutex_unlock(&textures->mutex);
+    }
+}
+
+static void* LoaderMain(void* userData)
+{
+    ObjRendererTexturesPtr textures = (ObjRendererTexturesPtr)userData;
+    Job* job = NULL;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&textures->mutex);
+
+        while (!textures->firstJob && !textures->quit)
+        {
+            pthread_cond_wait(&textures->jobCond, &textures->mutex);
+        }
+
+        if (textures->quit)
+        {
+            pthread_mutex_unlock(&textures->mutex);
+            break;
+        }
+
+        job = textures->firstJob;
+        textures->firstJob = job->next;
+
+        if (!textures->firstJob)
+        {
+            textures->lastJob = NULL;
+        }
+
+        pthread_mutex_unlock(&textures->mutex);
+
+        /* one layer per range, the images differ a lot in size */
+        FFThreadPoolParallelFor(textures->pool, job->numLayers, 1, DecodeLayers, job);
+        free(job->layers);
+        free(job);
+    }
+
+    return NULL;
+}
+
+ObjRendererTexturesPtr ObjRendererTexturesCreate()
+{
+    ObjRendererTexturesPtr textures = malloc(sizeof(struct ObjRendererTextures));
+
+    if (!textures)
+    {
+        return NULL;
+    }
+
+    memset(textures, 0, sizeof(struct ObjRendererTextures));
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &textures->maxArrayLayers);
+    textures->pool = FFThreadPoolCreate(0);
+
+    if (!textures->pool)
+    {
+        free(textures);
+        return NULL;
+    }
+
+    pthread_mutex_init(&textures->mutex, NULL);
+    pthread_cond_init(&textures->jobCond, NULL);
+
+    if (pthread_create(&textures->thread, NULL, LoaderMain, textures))
+    {
+        ERR_MSG("Failed to create the texture loader thread");
+        pthread_mutex_destroy(&textures->mutex);
+        pthread_cond_destroy(&textures->jobCond);
+        FFThreadPoolDestroy(&textures->pool);
+        free(textures);
+        return NULL;
+    }
+
+    return textures;
+}
+
+static int CompareLayerSizes(const void* a, const void* b)
+{
+    const Layer* la = *(const Layer* const*)a;
+    const Layer* lb = *(const Layer* const*)b;
+
+    if (la->width != lb->width)
+    {
+        return la->width < lb->width ? -1 : 1;
+    }
+
+    return la->height < lb->height ? -1 : (la->height > lb->height);
+}
+
+static void DestroyLayer(Layer* layer)
+{
+    ObjRendererImageRelease(&layer->image);
+    free(layer->filename);
+    free(layer->materials);
+    free(layer);
+}
+
+/*
+** Finds the layer for the map filename among the first numLayers layers or
+** appends a new one. Returns NULL if it fails.
+*/
+static Layer* GetLayer(
+    Layer** layers,
+    unsigned int* numLayers,
+    const char* filename
+)
+{
+    Layer* layer = NULL;
+    unsigned int i = 0;
+
+    for (i = 0; i < *numLayers; i++)
+    {
+        if (!strcmp(layers[i]->filename, filename))
+        {
+            return layers[i];
+        }
+    }
+
+    layer = malloc(sizeof(Layer));
+
+    if (!layer)
+    {
+        return NULL;
+    }
+
+    memset(layer, 0, sizeof(Layer));
+    layer->filename = strdup(filename);
+    layer->layer = -1;
+
+    if (!layer->filename)
+    {
+        free(layer);
+        return NULL;
+    }
+
+    layers[(*numLayers)++] = layer;
+
+    return layer;
+}
+
+/*
+** Finds the layer of textures for the map filename. Returns NULL if there is
+** none.
+*/
+static Layer* FindLayer(ObjRendererTexturesPtr textures, const char* filename)
+{
+    unsigned int i = 0;
+
+    for (i = 0; i < textures->numLayers; i++)
+    {
+        if (!strcmp(textures->layers[i]->filename, filename))
+        {
+            return textures->layers[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+** Assigns material to layer. Uploaded layers are assigned right away, 
+** pending ones when they are uploaded. Returns 0 if it fails.
+*/
+static int AddMaterial(
+    ObjRendererTexturesPtr textures,
+    Layer* layer,
+    ObjRendererMaterial* material
+)
+{
+    ObjRendererMaterial** materials = NULL;
+    LayerState state = LAYER_PENDING;
+
+    pthread_mutex_lock(&textures->mutex);
+    state = layer->state;
+    pthread_mutex_unlock(&textures->mutex);
+
+    if (state == LAYER_DONE)
+    {
+        material->texture = layer->layer >= 0 ? layer->texture : 0;
+        material->layer = layer->layer;
+        return 1;
+    }
+
+    materials = realloc(
+            layer->materials,
+            (layer->numMaterials + 1)*sizeof(ObjRendererMaterial*)
+        );
+
+    if (!materials)
+    {
+        return 0;
+    }
+
+    layer->materials = materials;
+    layer->materials[layer->numMaterials++] = material;
+
+    return 1;
+}
+
+/*
+** Creates a texture array with numLayers layers of width x height and all
+** mip levels, without data.
+*/
+static GLuint CreateTextureArray(
+    unsigned int width,
+    unsigned int height,
+    unsigned int numLayers
+)
+{
+    unsigned int numLevels = ObjRendererImageGetNumLevels(width, height);
+    unsigned int level = 0;
+    GLuint texture = 0;
+
+    glGenTextures(1, &texture);
+    FFGLStateBindTexture(0, GL_TEXTURE_2D_ARRAY, texture);
+
+    for (level = 0; level < numLevels; level++)
+    {
+        glTexImage3D(
+            GL_TEXTURE_2D_ARRAY,
+            level,
+            GL_RGBA8,
+            width,
+            height,
+            numLayers,
+            0,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            NULL
+        );
+        width = width > 1 ? width/2 : 1;
+        height = height > 1 ? height/2 : 1;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    return texture;
+}
+
+/*
+** Appends the layers of a job to the layers of textures and creates the
+** texture arrays for them. Returns 0 if it fails.
+*/
+static int AddLayers(ObjRendererTexturesPtr textures, Job* job)
+{
+    Layer** layers = NULL;
+    GLuint* names = NULL;
+    unsigned int maxLayers = textures->maxLayers ? textures->maxLayers : 64;
+    unsigned int first = 0;
+    unsigned int end = 0;
+    unsigned int i = 0;
+    GLuint texture = 0;
+
+    while (maxLayers < textures->numLayers + job->numLayers)
+    {
+        maxLayers *= 2;
+    }
+
+    if (maxLayers > textures->maxLayers)
+    {
+        /* the workers only see the layers of their job, not this array */
+        layers = realloc(textures->layers, maxLayers*sizeof(Layer*));
+
+        if (!layers)
+        {
+            return 0;
+        }
+
+        textures->layers = layers;
+        textures->maxLayers = maxLayers;
+    }
+
+    /* at most one array per layer */
+    names = realloc(
+            textures->textures,
+            (textures->numTextures + job->numLayers)*sizeof(GLuint)
+        );
+
+    if (!names)
+    {
+        return 0;
+    }
+
+    textures->textures = names;
+
+    /* an array per size, split if it has too many layers */
+    qsort(job->layers, job->numLayers, sizeof(Layer*), CompareLayerSizes);
+
+    for (first = 0; first < job->numLayers; first = end)
+    {
+        end = first + 1;
+
+        while (end < job->numLayers &&
+            end - first < (unsigned int)textures->maxArrayLayers &&
+            !CompareLayerSizes(&job->layers[first], &job->layers[end]))
+        {
+            end++;
+        }
+
+        texture = CreateTextureArray(
+                job->layers[first]->width,
+                job->layers[first]->height,
+                end - first
+            );
+        textures->textures[textures->numTextures++] = texture;
+
+        for (i = first; i < end; i++)
+        {
+            job->layers[i]->texture = texture;
+            job->layers[i]->layer = (int)(i - first);
+        }
+    }
+
+    return 1;
+}
+
+int ObjRendererTexturesAdd(ObjRendererTexturesPtr textures, ObjRendererMesh* mesh)
+{
+    ObjRendererMaterial* material = NULL;
+    Layer* layer = NULL;
+    Job* job = NULL;
+    unsigned int i = 0;
+
+    assert(textures && mesh);
+
+    job = malloc(sizeof(Job));
+
+    if (!job)
+    {
+        return 0;
+    }
+
+    memset(job, 0, sizeof(Job));
+    job->textures = textures;
+    job->layers = malloc((mesh->numMaterials + 1)*sizeof(Layer*));
+
+    if (!job->layers)
+    {
+        free(job);
+        return 0;
+    }
+
+    for (i = 0; i < mesh->numMaterials; i++)
+    {
+        material = &mesh->materials[i];
+
+        if (!material->diffuseMap)
+        {
+            continue;
+        }
+
+        /* maps that were added before are loaded once */
+        layer = FindLayer(textures, material->diffuseMap);
+
+        if (layer && !AddMaterial(textures, layer, material))
+        {
+            goto error;
+        }
+
+        if (layer)
+        {
+            continue;
+        }
+
+        layer = GetLayer(job->layers, &job->numLayers, material->diffuseMap);
+
+        if (!layer)
+        {
+            goto error;
+        }
+
+        if (!layer->numMaterials &&
+            !ObjRendererImageReadSize(layer->filename, &layer->width, &layer->height))
+        {
+            ERR_MSG("Failed to read the diffuse map");
+            printf("\t%s\n", layer->filename);
+            DestroyLayer(job->layers[--job->numLayers]);
+            continue;
+        }
+
+        if (!AddMaterial(textures, layer, material))
+        {
+            goto error;
+        }
+    }
+
+    if (!job->numLayers)
+    {
+        free(job->layers);
+        free(job);
+        return 1;
+    }
+
+    if (!AddLayers(textures, job))
+    {
+        goto error;
+    }
+
+    memcpy(
+        &textures->layers[textures->numLayers],
+        job->layers,
+        job->numLayers*sizeof(Layer*)
+    );
+    textures->numLayers += job->numLayers;
+
+    pthread_mutex_lock(&textures->mutex);
+
+    if (textures->lastJob)
+    {
+        textures->lastJob->next = job;
+    }
+    else
+    {
+        textures->firstJob = job;
+    }
+
+    textures->lastJob = job;
+    pthread_cond_signal(&textures->jobCond);
+    pthread_mutex_unlock(&textures->mutex);
+
+    return 1;
+
+error:
+
+    ERR_MSG("Failed to allocate memory for the diffuse maps");
+
+    for (i = 0; i < job->numLayers; i++)
+    {
+        DestroyLayer(job->layers[i]);
+    }
+
+    free(job->layers);
+    free(job);
+
+    return 0;
+}
+
+void ObjRendererTexturesRemove(ObjRendererTexturesPtr textures, ObjRendererMesh* mesh)
+{
+    Layer* layer = NULL;
+    unsigned int numMaterials = 0;
+    unsigned int i = 0, j = 0;
+
+    /* the materials are only touched on this thread, done layers do not
+    ** refer to them anymore
+    */
+    for (i = textures->firstPending; i < textures->numLayers; i++)
+    {
+        layer = textures->layers[i];
+        numMaterials = 0;
+
+        for (j = 0; j < layer->numMaterials; j++)
+        {
+            if (layer->materials[j] < mesh->materials ||
+                layer->materials[j] >= mesh->materials + mesh->numMaterials)
+            {
+                layer->materials[numMaterials++] = layer->materials[j];
+            }
+        }
+
+        layer->numMaterials = numMaterials;
+    }
+}
+
+/*
+** Uploads all levels of a decoded layer and assigns it to its materials.
+*/
+static void UploadLayer(Layer* layer)
+{
+    unsigned char* pixels = NULL;
+    unsigned int width = 0, height = 0;
+    unsigned int level = 0;
+    unsigned int i = 0;
+
+    FFGLStateBindTexture(0, GL_TEXTURE_2D_ARRAY, layer->texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (level = 0; level < layer->image.numLevels; level++)
+    {
+        pixels = ObjRendererImageGetLevel(&layer->image, level, &width, &height);
+        glTexSubImage3D(
+            GL_TEXTURE_2D_ARRAY,
+            level,
+            0,
+            0,
+            layer->layer,
+            width,
+            height,
+            1,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            pixels
+        );
+    }
+
+    for (i = 0; i < layer->numMaterials; i++)
+    {
+        layer->materials[i]->texture = layer->texture;
+        layer->materials[i]->layer = layer->layer;
+    }
+}
+
+unsigned int ObjRendererTexturesUpload(ObjRendererTexturesPtr textures, double budget)
+{
+    double start = GetTime();
+    Layer* layer = NULL;
+    LayerState state = LAYER_PENDING;
+    unsigned int numPending = 0;
+    unsigned int i = 0;
+    int uploaded = 0;
+
+    for (i = textures->firstPending; i < textures->numLayers; i++)
+    {
+        layer = textures->layers[i];
+
+        pthread_mutex_lock(&textures->mutex);
+        state = layer->state;
+        pthread_mutex_unlock(&textures->mutex);
+
+        /* the workers do not touch a layer anymore once it is decoded */
+        if (state == LAYER_DECODED && (!uploaded || GetTime() - start < budget))
+        {
+            UploadLayer(layer);
+            ObjRendererImageRelease(&layer->image);
+            uploaded = 1;
+            state = layer->state = LAYER_DONE;
+        }
+        else if (state == LAYER_FAILED)
+        {
+            ERR_MSG("Failed to load the diffuse map");
+            printf("\t%s\n", layer->filename);
+            layer->layer = -1;
+            state = layer->state = LAYER_DONE;
+        }
+
+        if (state != LAYER_DONE)
+        {
+            numPending++;
+        }
+        else if (i == textures->firstPending)
+        {
+            textures->firstPending++;
+        }
+    }
+
+    return numPending;
+}
+
+void ObjRendererTexturesDestroy(ObjRendererTexturesPtr* textures)
+{
+    Job* job = NULL;
+    unsigned int i = 0;
+
+    assert(textures && *textures);
+
+    /* the loader finishes the job it is decoding */
+    pthread_mutex_lock(&(*textures)->mutex);
+    (*textures)->quit = 1;
+    pthread_cond_signal(&(*textures)->jobCond);
+    pthread_mutex_unlock(&(*textures)->mutex);
+    pthread_join((*textures)->thread, NULL);
+
+    while ((*textures)->firstJob)
+    {
+        job = (*textures)->firstJob;
+        (*textures)->firstJob = job->next;
+        free(job->layers);
+        free(job);
+    }
+
+    for (i = 0; i < (*textures)->numLayers; i++)
+    {
+        DestroyLayer((*textures)->layers[i]);
+    }
+
+    for (i = 0; i < (*textures)->numTextures; i++)
+    {
+        FFGLStateDeleteTexture((*textures)->textures[i]);
+    }
+
+    pthread_mutex_destroy(&(*textures)->mutex);
+    pthread_cond_destroy(&(*textures)->jobCond);
+    FFThreadPoolDestroy(&(*textures)->pool);
+    free((*textures)->layers);
+    free((*textures)->textures);
+    free(*textures);
+    *textures = NULL;
+}
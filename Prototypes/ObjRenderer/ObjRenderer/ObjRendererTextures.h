@@ -0,0 +1,65 @@
+#ifndef OBJRENDERERTEXTURES_H
+#define OBJRENDERERTEXTURES_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include "ObjRendererMesh.h"
+
+/*
+** Loads the diffuse maps of the materials of meshes in the background.
+**
+** The images are decoded and their mip levels generated on worker threads
+** (see ObjRendererImage.h). Maps of the same size are packed into the layers
+** of one GL_TEXTURE_2D_ARRAY, so the materials of a mesh mostly share a few
+** textures and draws of different materials do not need to rebind them. The
+** decoded layers are uploaded by ObjRendererTexturesUpload on the gl thread
+** within a time budget per call, so loading does not stall the frames. Each
+** map is loaded once, materials of later meshes that use it share its layer.
+**
+** Until its layer is uploaded a material is drawn with its diffuse color
+** only, its layer is -1.
+*/
+
+typedef struct ObjRendererTextures* ObjRendererTexturesPtr;
+
+/*
+** Creates the texture loader and its threads. Requires a current opengl
+** context. Returns NULL if it fails.
+*/
+ObjRendererTexturesPtr ObjRendererTexturesCreate();
+
+/*
+** Starts loading the diffuse maps of the materials of mesh. Creates the
+** texture arrays, the maps themselves are read on the worker threads. The
+** materials of mesh are updated by ObjRendererTexturesUpload, so mesh must
+** not be destroyed before it is removed (see ObjRendererTexturesRemove) or 
+** textures is destroyed. Returns 0 if it fails.
+*/
+int ObjRendererTexturesAdd(ObjRendererTexturesPtr textures, ObjRendererMesh* mesh);
+
+/*
+** Stops updating the materials of mesh, so that it can be destroyed while 
+** its diffuse maps are loading. The maps are still loaded.
+*/
+void ObjRendererTexturesRemove(ObjRendererTexturesPtr textures, ObjRendererMesh* mesh);
+
+/*
+** Uploads decoded layers until budget (in seconds) is used up, at least one
+** layer per call if there is one. Returns the # of layers that are not
+** uploaded yet.
+*/
+unsigned int ObjRendererTexturesUpload(ObjRendererTexturesPtr textures, double budget);
+
+/*
+** Stops loading and deletes all textures. Sets textures to NULL.
+*/
+void ObjRendererTexturesDestroy(ObjRendererTexturesPtr* textures);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: OBJRENDERERTEXTURES_H */
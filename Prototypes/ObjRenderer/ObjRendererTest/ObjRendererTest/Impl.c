@@ -7,17 +7,35 @@
 //
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/time.h>
 #include <Fxs/OpenGL/Program.h>
+#include <Fxs/Obj/ObjFile.h>
 #include "ObjRendererMesh.h"
+#include "ObjRendererFile.h"
+#include "ObjRendererOctree.h"
+#include "ObjRendererNormals.h"
 #include "FFObjRenderer.h"
+#include <FF/GLState/GLState.h>
+#include <FF/ThreadPool/ThreadPool.h>
+#include <FF/Transforms/Transforms.h>
+
+#define BENCHMARK_RUNS 5
+#define BENCHMARK_QUERIES 10000
+#define BENCHMARK_NODES 100000
+#define BENCHMARK_MAX_DEPTH 6
 
 
 void Init()
 {
-//    ObjRendererMesh* mesh = ObjRendererMeshCreateWithFile("LighthouseColored.obj");
+//    ObjRendererMesh* mesh = ObjRendererMeshCreateWithFile("LighthouseColored.obj", NULL, NULL);
 
     FFObjRendererCreate();
+    FFObjRendererSetCacheDirectory("ObjRendererCache", 256 << 20);
     FFObjRendererLoad("LighthouseColored.obj");
+    FFObjRendererPrintStats();
 
 //    if (!mesh)
 //    {
@@ -25,16 +43,693 @@ void Init()
 //    }
 
     glClearColor(0.0, 0.0, 0.0, 1.0);
-    glEnable(GL_DEPTH_TEST);
+    FFGLStateEnable(GL_DEPTH_TEST);
     
     puts("Hallo, Welt");
 }
 
 int Update(float dt)
 {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    /* at most 2 ms of the frame each for uploading diffuse maps and chunks */
+    FFObjRendererUploadTextures(0.002);
+    FFObjRendererUpdateStreaming(0.002);
+    FFObjRendererPrepareImpostors();
 
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     FFObjRendererRender();
     
     return 0;
-}
\ No newline at end of file
+}
+
+static double GetTime()
+{
+    struct timeval time;
+    
+    gettimeofday(&time, NULL);
+    
+    return time.tv_sec + time.tv_usec*1e-6;
+}
+
+/*
+** Loads filename with FxsObjFile, returns the time it took in seconds.
+*/
+static double TimeFxsObjFile(const char* filename)
+{
+    double start = GetTime();
+    FxsObjFilePtr obj = FxsObjFileCreateWithFile(filename);
+    double end = GetTime();
+    
+    if (!obj)
+    {
+        return -1.0;
+    }
+    
+    FxsObjFileDestroy(&obj);
+    
+    return end - start;
+}
+
+/*
+** Loads filename with ObjRendererFile, returns the time it took in seconds.
+*/
+static double TimeObjRendererFile(const char* filename, FFThreadPoolPtr pool)
+{
+    double start = GetTime();
+    ObjRendererFile* obj = ObjRendererFileCreateWithFile(filename, pool);
+    double end = GetTime();
+    
+    if (!obj)
+    {
+        return -1.0;
+    }
+    
+    ObjRendererFileDestroy(&obj);
+    
+    return end - start;
+}
+
+static void PrintResult(const char* name, double seconds, long size)
+{
+    if (seconds < 0.0)
+    {
+        printf("%-28s failed\n", name);
+        return;
+    }
+    
+    printf("%-28s %8.3f s %8.1f MB/s\n", name, seconds, size/seconds/1e6);
+}
+
+void Benchmark(const char* filename)
+{
+    FFThreadPoolPtr pool = FFThreadPoolCreate(0);
+    FILE* file = fopen(filename, "rb");
+    double fxs = 1e30;
+    double single = 1e30;
+    double parallel = 1e30;
+    double t = 0.0;
+    long size = 0;
+    char name[64];
+    int i = 0;
+    
+    if (!file || !pool)
+    {
+        puts("Failed to open file");
+        FFThreadPoolDestroy(&pool);
+        return;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+    
+    /* best of BENCHMARK_RUNS, the first run also warms the file cache */
+    for (i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        t = TimeFxsObjFile(filename);
+        fxs = t < fxs ? t : fxs;
+        t = TimeObjRendererFile(filename, NULL);
+        single = t < single ? t : single;
+        t = TimeObjRendererFile(filename, pool);
+        parallel = t < parallel ? t : parallel;
+    }
+    
+    printf("%s (%.1f MB)\n", filename, size/1e6);
+    PrintResult("FxsObjFile", fxs, size);
+    PrintResult("ObjRendererFile, 1 thread", single, size);
+    snprintf(name, sizeof(name), "ObjRendererFile, %u threads", 
+        FFThreadPoolGetNumThreads(pool));
+    PrintResult(name, parallel, size);
+    
+    FFThreadPoolDestroy(&pool);
+}
+
+/*
+** Random float in min .. max.
+*/
+static float RandomFloat(float min, float max)
+{
+    return min + (max - min)*(float)rand()/(float)RAND_MAX;
+}
+
+/*
+** Random box inside bounds with sides of fraction of the sides of bounds.
+*/
+static void RandomBox(
+    const ObjRendererBoundingBox* bounds, 
+    float fraction, 
+    ObjRendererBoundingBox* box
+)
+{
+    float w = fraction*(bounds->max.x - bounds->min.x);
+    float h = fraction*(bounds->max.y - bounds->min.y);
+    float d = fraction*(bounds->max.z - bounds->min.z);
+    
+    box->min.x = RandomFloat(bounds->min.x, bounds->max.x - w);
+    box->min.y = RandomFloat(bounds->min.y, bounds->max.y - h);
+    box->min.z = RandomFloat(bounds->min.z, bounds->max.z - d);
+    box->max.x = box->min.x + w;
+    box->max.y = box->min.y + h;
+    box->max.z = box->min.z + d;
+}
+
+void BenchmarkOctree(const char* filename)
+{
+    FFThreadPoolPtr pool = FFThreadPoolCreate(0);
+    ObjRendererMesh* mesh = NULL;
+    ObjRendererOctree* octree = NULL;
+    ObjRendererBoundingBox bounds;
+    ObjRendererBoundingBox box;
+    ObjRendererRayHit hit;
+    FxsVector3 origin;
+    FxsVector3 direction;
+    FFFrustum frustum;
+    float viewProjection[16];
+    unsigned int* clusters = NULL;
+    unsigned long numFound = 0;
+    unsigned int numHits = 0;
+    double build = 1e30;
+    double start = 0.0;
+    double t = 0.0;
+    int i = 0;
+    
+    /* the mesh is not uploaded, no gl context is needed */
+    mesh = ObjRendererMeshLoad(filename, pool, NULL);
+    
+    if (!mesh)
+    {
+        puts("Failed to load mesh");
+        FFThreadPoolDestroy(&pool);
+        return;
+    }
+    
+    for (i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        start = GetTime();
+        ObjRendererMeshBuildOctree(mesh, pool);
+        t = GetTime() - start;
+        build = t < build ? t : build;
+    }
+    
+    octree = mesh->octree;
+    bounds = octree->nodes[0].boundingBox;
+    clusters = malloc((octree->numClusters + 1)*sizeof(unsigned int));
+    srand(1);
+    
+    printf("%s (%u faces)\n", filename, mesh->stats.numFaces);
+    printf("%-28s %8.3f s %8.3f s per million faces\n", "Build", build, 
+        build*1e6/(mesh->stats.numFaces ? mesh->stats.numFaces : 1));
+    printf("%-28s %8u clusters %8u nodes\n", "Octree", octree->numClusters, 
+        octree->numNodes);
+    
+    /* rays from random points on the bounds through random points inside */
+    start = GetTime();
+    
+    for (i = 0; i < BENCHMARK_QUERIES; i++)
+    {
+        RandomBox(&bounds, 0.0f, &box);
+        origin = box.min;
+        origin.z = bounds.max.z + (bounds.max.z - bounds.min.z);
+        RandomBox(&bounds, 0.0f, &box);
+        direction.x = box.min.x - origin.x;
+        direction.y = box.min.y - origin.y;
+        direction.z = box.min.z - origin.z;
+        numHits += ObjRendererOctreeRaycast(octree, &origin, &direction, 1e30f, &hit);
+    }
+    
+    t = GetTime() - start;
+    printf("%-28s %8.3f us per query %8u hits\n", "Ray casts", 
+        t*1e6/BENCHMARK_QUERIES, numHits);
+    
+    /* boxes of a tenth of the size of the mesh */
+    start = GetTime();
+    
+    for (i = 0; i < BENCHMARK_QUERIES; i++)
+    {
+        RandomBox(&bounds, 0.1f, &box);
+        numFound += ObjRendererOctreeQueryBox(octree, &box, clusters);
+    }
+    
+    t = GetTime() - start;
+    printf("%-28s %8.3f us per query %8.1f clusters\n", "Box queries", 
+        t*1e6/BENCHMARK_QUERIES, (double)numFound/BENCHMARK_QUERIES);
+    
+    /* orthographic frustums around boxes of a quarter of the size */
+    numFound = 0;
+    start = GetTime();
+    
+    for (i = 0; i < BENCHMARK_QUERIES; i++)
+    {
+        RandomBox(&bounds, 0.25f, &box);
+        memset(viewProjection, 0, sizeof(viewProjection));
+        viewProjection[0] = 2.0f/(box.max.x - box.min.x + 1e-6f);
+        viewProjection[5] = 2.0f/(box.max.y - box.min.y + 1e-6f);
+        viewProjection[10] = 2.0f/(box.max.z - box.min.z + 1e-6f);
+        viewProjection[12] = -(box.max.x + box.min.x)*0.5f*viewProjection[0];
+        viewProjection[13] = -(box.max.y + box.min.y)*0.5f*viewProjection[5];
+        viewProjection[14] = -(box.max.z + box.min.z)*0.5f*viewProjection[10];
+        viewProjection[15] = 1.0f;
+        FFFrustumSetMatrix(&frustum, viewProjection);
+        numFound += ObjRendererOctreeQueryFrustum(octree, &frustum, clusters);
+    }
+    
+    t = GetTime() - start;
+    printf("%-28s %8.3f us per query %8.1f clusters\n", "Frustum queries", 
+        t*1e6/BENCHMARK_QUERIES, (double)numFound/BENCHMARK_QUERIES);
+    
+    free(clusters);
+    ObjRendererMeshDestroy(&mesh);
+    FFThreadPoolDestroy(&pool);
+}
+
+/*
+** Drops the normals of file that were not read from the file and generates
+** them again, returns the time it took in seconds.
+*/
+static double TimeNormals(
+    ObjRendererFile* file, 
+    unsigned int numNormals, 
+    FFThreadPoolPtr pool
+)
+{
+    double start = 0.0;
+    double end = 0.0;
+    unsigned int i = 0;
+    
+    for (i = 0; i < file->numFaces; i++)
+    {
+        file->faces[i].n0 = file->faces[i].n1 = file->faces[i].n2 = -1;
+    }
+    
+    file->numNormals = numNormals;
+    start = GetTime();
+    
+    if (!ObjRendererGenerateNormals(file, OBJ_RENDERER_CREASE_ANGLE, pool))
+    {
+        return -1.0;
+    }
+    
+    end = GetTime();
+    
+    return end - start;
+}
+
+static void PrintNormalsResult(const char* name, double seconds, unsigned int numFaces)
+{
+    if (seconds < 0.0)
+    {
+        printf("%-28s failed\n", name);
+        return;
+    }
+    
+    printf("%-28s %8.3f s %8.1f M triangles/s\n", name, seconds, 
+        numFaces/seconds/1e6);
+}
+
+void BenchmarkNormals(const char* filename)
+{
+    FFThreadPoolPtr pool = FFThreadPoolCreate(0);
+    ObjRendererFile* file = NULL;
+    unsigned int numNormals = 0;
+    double single = 1e30;
+    double parallel = 1e30;
+    double t = 0.0;
+    char name[64];
+    int i = 0;
+    
+    if (pool)
+    {
+        file = ObjRendererFileCreateWithFile(filename, pool);
+    }
+    
+    if (!file)
+    {
+        puts("Failed to load file");
+        FFThreadPoolDestroy(&pool);
+        return;
+    }
+    
+    /* all faces get generated normals, also the ones that had normals */
+    numNormals = file->numNormals;
+    
+    for (i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        t = TimeNormals(file, numNormals, NULL);
+        single = t < single ? t : single;
+        t = TimeNormals(file, numNormals, pool);
+        parallel = t < parallel ? t : parallel;
+    }
+    
+    printf("%s (%u faces)\n", filename, file->numFaces);
+    PrintNormalsResult("Normals, 1 thread", single, file->numFaces);
+    snprintf(name, sizeof(name), "Normals, %u threads", 
+        FFThreadPoolGetNumThreads(pool));
+    PrintNormalsResult(name, parallel, file->numFaces);
+    
+    ObjRendererFileDestroy(&file);
+    FFThreadPoolDestroy(&pool);
+}
+
+static const char** benchmarkFiles = NULL;
+static unsigned int numBenchmarkFiles = 0;
+
+void SetBenchmarkFiles(const char** filenames, unsigned int numFilenames)
+{
+    benchmarkFiles = filenames;
+    numBenchmarkFiles = numFilenames;
+}
+
+/*
+** Loads the benchmark files and uploads their diffuse maps. Nothing is culled,
+** so every frame draws all render data. Returns 0 if it fails.
+*/
+static int LoadBenchmarkFiles()
+{
+    unsigned int i = 0;
+    
+    FFObjRendererCreate();
+    
+    for (i = 0; i < numBenchmarkFiles; i++)
+    {
+        if (!FFObjRendererLoad(benchmarkFiles[i]))
+        {
+            printf("Failed to load %s\n", benchmarkFiles[i]);
+            FFObjRendererDestroy();
+            return 0;
+        }
+    }
+    
+    while (FFObjRendererUploadTextures(1.0))
+    {
+    }
+    
+    FFObjRendererSetFrustumCulling(0);
+    
+    return 1;
+}
+
+static void PrintStateChanges(const char* name, const FFGLStateStats* stats)
+{
+    printf("%-28s %8.1f issued %8.1f avoided per frame\n", name, 
+        (double)stats->issued/BENCHMARK_RUNS, 
+        (double)stats->avoided/BENCHMARK_RUNS);
+}
+
+void BenchmarkQueue()
+{
+    FFRenderQueuePtr queue = FFRenderQueueCreate(0);
+    FFGLStateStats stats;
+    int batching = 0;
+    int i = 0;
+    
+    if (!queue || !LoadBenchmarkFiles())
+    {
+        FFRenderQueueDestroy(&queue);
+        return;
+    }
+    
+    printf("%u files, average of %d frames after a warm up frame\n", 
+        numBenchmarkFiles, BENCHMARK_RUNS);
+    
+    /* the scene graph order and the batched order of FFObjRendererRender */
+    for (batching = 0; batching < 2; batching++)
+    {
+        FFObjRendererSetBatching(batching);
+        FFObjRendererRender();
+        FFGLStateResetStats();
+        
+        for (i = 0; i < BENCHMARK_RUNS; i++)
+        {
+            FFObjRendererRender();
+        }
+        
+        FFGLStateGetStats(&stats);
+        PrintStateChanges(batching ? "Render, batched" : "Render, scene graph", 
+            &stats);
+    }
+    
+    FFObjRendererSubmit(queue);
+    FFRenderQueueFlush(queue);
+    FFGLStateResetStats();
+    
+    for (i = 0; i < BENCHMARK_RUNS; i++)
+    {
+        FFObjRendererSubmit(queue);
+        FFRenderQueueFlush(queue);
+    }
+    
+    FFGLStateGetStats(&stats);
+    PrintStateChanges("Submit + flush", &stats);
+    
+    FFRenderQueueDestroy(&queue);
+    FFObjRendererDestroy();
+}
+
+/*
+** The command list and culling stats of each thread.
+*/
+typedef struct
+{
+    FFCommandListPtr* lists;
+    FFObjRendererCullingStats* stats;
+}
+RecordJob;
+
+/*
+** Records the meshes first .. first + count - 1 into the list of thread.
+*/
+static void RecordRange(
+    void* userData, 
+    unsigned int first, 
+    unsigned int count, 
+    unsigned int thread
+)
+{
+    RecordJob* job = userData;
+    
+    FFObjRendererRecord(job->lists[thread], first, count, &job->stats[thread]);
+}
+
+/*
+** Records all loaded meshes into the lists of job on numThreads threads 
+** BENCHMARK_RUNS times, returns the best time in seconds or a negative time
+** if it fails.
+*/
+static double TimeRecord(RecordJob* job, unsigned int numThreads)
+{
+    FFThreadPoolPtr pool = FFThreadPoolCreate(numThreads);
+    double best = 1e30;
+    double start = 0.0;
+    double t = 0.0;
+    unsigned int i = 0;
+    int run = 0;
+    
+    if (!pool)
+    {
+        return -1.0;
+    }
+    
+    for (run = 0; run < BENCHMARK_RUNS; run++)
+    {
+        for (i = 0; i < numThreads; i++)
+        {
+            FFCommandListReset(job->lists[i]);
+            memset(&job->stats[i], 0, sizeof(FFObjRendererCullingStats));
+        }
+        
+        start = GetTime();
+        FFThreadPoolParallelFor(pool, FFObjRendererGetNumMeshes(), 1, 
+            RecordRange, job);
+        t = GetTime() - start;
+        best = t < best ? t : best;
+    }
+    
+    FFThreadPoolDestroy(&pool);
+    
+    return best;
+}
+
+void BenchmarkRecord()
+{
+    FFThreadPoolPtr pool = FFThreadPoolCreate(0);
+    RecordJob job;
+    unsigned int maxThreads = 0;
+    unsigned int numThreads = 0;
+    unsigned int numNodes = 0;
+    unsigned int i = 0;
+    double single = 0.0;
+    double t = 0.0;
+    
+    memset(&job, 0, sizeof(RecordJob));
+    
+    if (pool)
+    {
+        maxThreads = FFThreadPoolGetNumThreads(pool);
+        FFThreadPoolDestroy(&pool);
+        job.lists = calloc(maxThreads, sizeof(FFCommandListPtr));
+        job.stats = calloc(maxThreads, sizeof(FFObjRendererCullingStats));
+    }
+    
+    if (!job.lists || !job.stats || !LoadBenchmarkFiles())
+    {
+        free(job.lists);
+        free(job.stats);
+        return;
+    }
+    
+    for (numThreads = 0; numThreads < maxThreads; numThreads++)
+    {
+        job.lists[numThreads] = FFCommandListCreate(0);
+    }
+    
+    printf("%u meshes, recording all of them\n", FFObjRendererGetNumMeshes());
+    
+    /* the work is split by mesh, more threads than meshes do not help */
+    for (numThreads = 1; numThreads <= maxThreads; numThreads++)
+    {
+        t = TimeRecord(&job, numThreads);
+        
+        if (t < 0.0)
+        {
+            printf("%2u threads %23s\n", numThreads, "failed");
+            
+            /* the speedups are relative to 1 thread */
+            if (numThreads == 1)
+            {
+                break;
+            }
+            
+            continue;
+        }
+        
+        single = numThreads == 1 ? t : single;
+        
+        for (i = 0, numNodes = 0; i < numThreads; i++)
+        {
+            numNodes += job.stats[i].numVisibleNodes;
+        }
+        
+        printf("%2u threads %12.3f ms %8.2fx %8u nodes\n", numThreads, 
+            t*1e3, single/t, numNodes);
+    }
+    
+    for (numThreads = 0; numThreads < maxThreads; numThreads++)
+    {
+        FFCommandListDestroy(&job.lists[numThreads]);
+    }
+    
+    free(job.lists);
+    free(job.stats);
+    FFObjRendererDestroy();
+}
+
+/*
+** Random rotation about z and translation.
+*/
+static void RandomTransform(float* m)
+{
+    float angle = RandomFloat(0.0f, 6.2831853f);
+    
+    memset(m, 0, 16*sizeof(float));
+    m[0] = cosf(angle);
+    m[1] = sinf(angle);
+    m[4] = -m[1];
+    m[5] = m[0];
+    m[10] = 1.0f;
+    m[12] = RandomFloat(-10.0f, 10.0f);
+    m[13] = RandomFloat(-10.0f, 10.0f);
+    m[14] = RandomFloat(-10.0f, 10.0f);
+    m[15] = 1.0f;
+}
+
+/*
+** Flags numDirty random nodes (all if numDirty is 0) of transforms as dirty
+** and updates them BENCHMARK_RUNS times. Returns the best time in seconds, 
+** the # of updated nodes is stored in numUpdated.
+*/
+static double TimeTransforms(
+    FFTransformsPtr transforms, 
+    unsigned int numDirty, 
+    unsigned int* numUpdated
+)
+{
+    unsigned int numNodes = FFTransformsGetSize(transforms);
+    unsigned int node = 0;
+    unsigned int i = 0;
+    double best = 1e30;
+    double start = 0.0;
+    double t = 0.0;
+    int run = 0;
+    
+    for (run = 0; run < BENCHMARK_RUNS; run++)
+    {
+        for (i = 0; i < (numDirty ? numDirty : numNodes); i++)
+        {
+            node = numDirty ? (unsigned int)rand() % numNodes : i;
+            FFTransformsSetLocal(transforms, node, 
+                FFTransformsGetLocal(transforms, node));
+        }
+        
+        start = GetTime();
+        *numUpdated = FFTransformsUpdate(transforms);
+        t = GetTime() - start;
+        best = t < best ? t : best;
+    }
+    
+    return best;
+}
+
+void BenchmarkTransforms()
+{
+    FFTransformsPtr transforms = FFTransformsCreate(BENCHMARK_NODES);
+    int stack[BENCHMARK_MAX_DEPTH];
+    float local[16];
+    unsigned int numUpdated = 0;
+    unsigned int depth = 0;
+    unsigned int i = 0;
+    double t = 0.0;
+    
+    if (!transforms)
+    {
+        puts("Failed to create the transforms");
+        return;
+    }
+    
+    /* a scene graph added depth first, each node ends its subtree with a 
+    ** chance of 1 in 5
+    */
+    srand(1);
+    
+    for (i = 0; i < BENCHMARK_NODES; i++)
+    {
+        while (depth && (depth == BENCHMARK_MAX_DEPTH || rand() % 5 == 0))
+        {
+            depth--;
+        }
+        
+        RandomTransform(local);
+        stack[depth] = FFTransformsAdd(transforms, 
+            depth ? stack[depth - 1] : -1, local);
+        
+        if (stack[depth] < 0)
+        {
+            puts("Failed to add a node");
+            FFTransformsDestroy(&transforms);
+            return;
+        }
+        
+        depth++;
+    }
+    
+    FFTransformsUpdate(transforms);
+    printf("%u nodes, depth first, at most %d levels\n", 
+        FFTransformsGetSize(transforms), BENCHMARK_MAX_DEPTH);
+    
+    t = TimeTransforms(transforms, 0, &numUpdated);
+    printf("%-28s %8.3f ms %8u nodes updated\n", "All dirty", t*1e3, 
+        numUpdated);
+    t = TimeTransforms(transforms, 1000, &numUpdated);
+    printf("%-28s %8.3f ms %8u nodes updated\n", "1000 random dirty", t*1e3, 
+        numUpdated);
+    
+    FFTransformsDestroy(&transforms);
+}
@@ -12,4 +12,49 @@
 void Init();
 int Update(float dt);
 
+/*
+** Compares the load times of FxsObjFile and ObjRendererFile for the .obj
+** file filename and prints them.
+*/
+void Benchmark(const char* filename);
+
+/*
+** Prints the build time of the octree of the .obj file filename and the
+** times of ray casts, box and frustum queries against it.
+*/
+void BenchmarkOctree(const char* filename);
+
+/*
+** Prints the time it takes to generate the normals of the .obj file filename,
+** with its own normals left out, on 1 thread and on all cores.
+*/
+void BenchmarkNormals(const char* filename);
+
+/*
+** Prints the time it takes to update the world matrices of a hierarchy of 
+** 100000 transforms (see Transforms.h), with all nodes and with 1000 random
+** nodes and their subtrees dirty.
+*/
+void BenchmarkTransforms();
+
+/*
+** Sets the .obj files the benchmarks below load. They need an opengl context,
+** so they run as the init function of a main loop (see main.c).
+*/
+void SetBenchmarkFiles(const char** filenames, unsigned int numFilenames);
+
+/*
+** Prints the # of issued and avoided opengl state changes per frame of 
+** FFObjRendererRender, without and with batching, and of FFObjRendererSubmit
+** with FFRenderQueueFlush.
+*/
+void BenchmarkQueue();
+
+/*
+** Prints the time it takes to record the draws of all loaded meshes into 
+** command lists on 1 .. # of cores threads. The meshes are split among the
+** threads, so it needs at least as many meshes (files) as threads to scale.
+*/
+void BenchmarkRecord();
+
 #endif
@@ -7,11 +7,73 @@
 //
 
 #include <stdio.h>
+#include <string.h>
 #include <FF/MainLoop/MainLoop.h>
 #include "Impl.h"
 
+static int Quit(float dt)
+{
+    return 1;
+}
+
+/*
+** Runs benchmark with an opengl context and quits after the first frame.
+*/
+static void RunWithContext(void (*benchmark)(void))
+{
+    FFMainLoopCreate("Config.json");
+    FFMainLoopSetInitFunc(benchmark);
+    FFMainLoopSetUpdateFunc(Quit);
+    FFMainLoopRun();
+    FFMainLoopDestroy();
+}
+
 int main(int argc, const char * argv[])
 {
+    /* ObjRendererTest --benchmark file.obj */
+    if (argc == 3 && !strcmp(argv[1], "--benchmark"))
+    {
+        Benchmark(argv[2]);
+        return 0;
+    }
+    
+    /* ObjRendererTest --benchmark-octree file.obj */
+    if (argc == 3 && !strcmp(argv[1], "--benchmark-octree"))
+    {
+        BenchmarkOctree(argv[2]);
+        return 0;
+    }
+    
+    /* ObjRendererTest --benchmark-normals file.obj */
+    if (argc == 3 && !strcmp(argv[1], "--benchmark-normals"))
+    {
+        BenchmarkNormals(argv[2]);
+        return 0;
+    }
+    
+    /* ObjRendererTest --benchmark-transforms */
+    if (argc == 2 && !strcmp(argv[1], "--benchmark-transforms"))
+    {
+        BenchmarkTransforms();
+        return 0;
+    }
+    
+    /* ObjRendererTest --benchmark-queue file.obj ... */
+    if (argc >= 3 && !strcmp(argv[1], "--benchmark-queue"))
+    {
+        SetBenchmarkFiles(argv + 2, argc - 2);
+        RunWithContext(BenchmarkQueue);
+        return 0;
+    }
+    
+    /* ObjRendererTest --benchmark-record file.obj ... */
+    if (argc >= 3 && !strcmp(argv[1], "--benchmark-record"))
+    {
+        SetBenchmarkFiles(argv + 2, argc - 2);
+        RunWithContext(BenchmarkRecord);
+        return 0;
+    }
+    
     FFMainLoopCreate("Config.json");
     FFMainLoopSetInitFunc(Init);
     FFMainLoopSetUpdateFunc(Update);
@@ -0,0 +1,355 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <stdio.h>
+#include "RenderQueue.h"
+#include "../GLState/GLState.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+#define PROGRAM_BITS 10
+#define TEXTURE_BITS 14
+#define VAO_BITS 14
+#define DEPTH_BITS 22
+#define MASK(BITS) ((1ull << (BITS)) - 1)
+
+#define RADIX_BITS 16
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+/*
+** A sort key with the index of its packet.
+*/
+typedef struct
+{
+    uint64_t key;
+    unsigned int packet;
+}
+SortItem;
+
+struct FFRenderQueue
+{
+    FFRenderQueuePacket* packets;
+    float* models;              /* 16 floats per packet */
+    SortItem* items;
+    SortItem* itemsTmp;         /* scratch memory for the radix sort */
+    unsigned int* histogram;
+    unsigned int numPackets;
+    unsigned int capacity;
+};
+
+/*
+** Grows the queue to fit capacity packets. Returns 0 if it fails.
+*/
+static int Reserve(FFRenderQueuePtr queue, unsigned int capacity)
+{
+    FFRenderQueuePacket* packets = NULL;
+    float* models = NULL;
+    SortItem* items = NULL;
+    SortItem* itemsTmp = NULL;
+
+    if (capacity <= queue->capacity)
+    {
+        return 1;
+    }
+
+    packets = realloc(queue->packets, capacity*sizeof(FFRenderQueuePacket));
+    
+    if (packets)
+    {
+        queue->packets = packets;
+    }
+
+    models = realloc(queue->models, 16*capacity*sizeof(float));
+
+    if (models)
+    {
+        queue->models = models;
+    }
+
+    items = realloc(queue->items, capacity*sizeof(SortItem));
+
+    if (items)
+    {
+        queue->items = items;
+    }
+
+    itemsTmp = realloc(queue->itemsTmp, capacity*sizeof(SortItem));
+
+    if (itemsTmp)
+    {
+        queue->itemsTmp = itemsTmp;
+    }
+
+    if (!packets || !models || !items || !itemsTmp)
+    {
+        return 0;
+    }
+
+    queue->capacity = capacity;
+
+    return 1;
+}
+
+FFRenderQueuePtr FFRenderQueueCreate(unsigned int capacity)
+{
+    FFRenderQueuePtr queue = malloc(sizeof(struct FFRenderQueue));
+
+    if (!queue)
+    {
+        return NULL;
+    }
+
+    memset(queue, 0, sizeof(struct FFRenderQueue));
+    queue->histogram = malloc(RADIX_SIZE*sizeof(unsigned int));
+
+    if (!queue->histogram || !Reserve(queue, capacity ? capacity : 64))
+    {
+        FFRenderQueueDestroy(&queue);
+        return NULL;
+    }
+
+    return queue;
+}
+
+void FFRenderQueueDestroy(FFRenderQueuePtr* queue)
+{
+    if (!*queue)
+    {
+        return;
+    }
+
+    free((*queue)->packets);
+    free((*queue)->models);
+    free((*queue)->items);
+    free((*queue)->itemsTmp);
+    free((*queue)->histogram);
+    free(*queue);
+
+    *queue = NULL;
+}
+
+uint64_t FFRenderQueueMakeKey(
+    unsigned int pass,
+    GLuint program,
+    GLuint texture,
+    GLuint vao,
+    float depth
+)
+{
+    uint64_t d = 0;
+    uint64_t state = 0;
+
+    if (depth < 0.0f)
+    {
+        depth = 0.0f;
+    }
+
+    if (depth > 1.0f)
+    {
+        depth = 1.0f;
+    }
+
+    if (pass > FF_RENDER_QUEUE_MAX_PASS)
+    {
+        pass = FF_RENDER_QUEUE_MAX_PASS;
+    }
+
+    d = (uint64_t)(depth*MASK(DEPTH_BITS));
+    state = ((program & MASK(PROGRAM_BITS)) << (TEXTURE_BITS + VAO_BITS)) | 
+        ((texture & MASK(TEXTURE_BITS)) << VAO_BITS) |
+        (vao & MASK(VAO_BITS));
+
+    if (pass < FF_RENDER_QUEUE_PASS_TRANSPARENT)
+    {
+        /* opaque: minimize state changes, then front to back */
+        return ((uint64_t)pass << 60) | (state << DEPTH_BITS) | d;
+    }
+
+    /* transparent: back to front, then state */
+    return ((uint64_t)pass << 60) | 
+        ((MASK(DEPTH_BITS) - d) << (PROGRAM_BITS + TEXTURE_BITS + VAO_BITS)) |
+        state;
+}
+
+float FFRenderQueueComputeDepth(
+    const float* model,
+    const float* view,
+    const float* projection,
+    float x,
+    float y,
+    float z
+)
+{
+    float p[4] = {x, y, z, 1.0f};
+    float q[4];
+    const float* m[3] = {model, view, projection};
+    int i = 0, j = 0;
+
+    for (i = 0; i < 3; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            q[j] = m[i][j]*p[0] + m[i][4 + j]*p[1] + m[i][8 + j]*p[2] + 
+                m[i][12 + j]*p[3];
+        }
+
+        memcpy(p, q, sizeof(p));
+    }
+
+    if (p[3] <= 0.0f)
+    {
+        return 0.0f;  /* behind the eye */
+    }
+
+    return 0.5f*p[2]/p[3] + 0.5f;
+}
+
+int FFRenderQueueSubmit(
+    FFRenderQueuePtr queue,
+    uint64_t key,
+    const FFRenderQueuePacket* packet,
+    const float* model
+)
+{
+    unsigned int idx = queue->numPackets;
+
+    if (idx == queue->capacity && !Reserve(queue, 2*queue->capacity))
+    {
+        ERR_MSG("Warning: Failed to grow the render queue. Dropping packet.");
+        return 0;
+    }
+
+    queue->packets[idx] = *packet;
+
+    if (packet->modelLocation != -1)
+    {
+        memcpy(&queue->models[16*idx], model, 16*sizeof(float));
+    }
+
+    queue->items[idx].key = key;
+    queue->items[idx].packet = idx;
+    queue->numPackets++;
+
+    return 1;
+}
+
+/*
+** LSD radix sort of the sort items by key, 16 bits per pass. Passes where all
+** keys share the same digit are skipped.
+*/
+static void SortItems(FFRenderQueuePtr queue)
+{
+    unsigned int n = queue->numPackets;
+    unsigned int* histogram = queue->histogram;
+    SortItem* src = queue->items;
+    SortItem* dst = queue->itemsTmp;
+    SortItem* tmp = NULL;
+    unsigned int shift = 0, i = 0, digit = 0, sum = 0, count = 0;
+
+    for (shift = 0; shift < 64; shift += RADIX_BITS)
+    {
+        memset(histogram, 0, RADIX_SIZE*sizeof(unsigned int));
+
+        for (i = 0; i < n; i++)
+        {
+            histogram[(src[i].key >> shift) & (RADIX_SIZE - 1)]++;
+        }
+
+        if (histogram[(src[0].key >> shift) & (RADIX_SIZE - 1)] == n)
+        {
+            continue;
+        }
+
+        sum = 0;
+
+        for (i = 0; i < RADIX_SIZE; i++)
+        {
+            count = histogram[i];
+            histogram[i] = sum;
+            sum += count;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            digit = (src[i].key >> shift) & (RADIX_SIZE - 1);
+            dst[histogram[digit]++] = src[i];
+        }
+
+        tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    queue->items = src;
+    queue->itemsTmp = dst;
+}
+
+static void Execute(const FFRenderQueuePacket* packet, const float* model)
+{
+    FFGLStateUseProgram(packet->program);
+    FFGLStatePolygonMode(packet->polygonMode);
+    FFGLStateBindVertexArray(packet->vao);
+
+    if (packet->texture)
+    {
+        FFGLStateBindTexture(0, packet->textureTarget, packet->texture);
+    }
+
+    if (packet->modelLocation != -1)
+    {
+        glUniformMatrix4fv(packet->modelLocation, 1, GL_FALSE, model);
+    }
+
+    if (packet->paramsLocation != -1)
+    {
+        glUniform4fv(packet->paramsLocation, 1, packet->params);
+    }
+
+    switch (packet->drawType)
+    {
+        case FF_RENDER_QUEUE_DRAW_ARRAYS:
+            glDrawArrays(packet->mode, packet->first, packet->count);
+            break;
+        case FF_RENDER_QUEUE_MULTI_DRAW_ARRAYS:
+            glMultiDrawArrays(
+                packet->mode, 
+                packet->firsts, 
+                packet->counts, 
+                packet->drawCount
+            );
+            break;
+        case FF_RENDER_QUEUE_DRAW_ELEMENTS:
+            glDrawElementsBaseVertex(
+                packet->mode,
+                packet->count,
+                packet->indexType,
+                packet->indices,
+                packet->baseVertex
+            );
+            break;
+    }
+}
+
+void FFRenderQueueFlush(FFRenderQueuePtr queue)
+{
+    unsigned int i = 0, idx = 0;
+
+    if (!queue->numPackets)
+    {
+        return;
+    }
+
+    SortItems(queue);
+
+    for (i = 0; i < queue->numPackets; i++)
+    {
+        idx = queue->items[i].packet;
+        Execute(&queue->packets[idx], &queue->models[16*idx]);
+    }
+
+    queue->numPackets = 0;
+}
+
+unsigned int FFRenderQueueGetSize(FFRenderQueuePtr queue)
+{
+    return queue->numPackets;
+}
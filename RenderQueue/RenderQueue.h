@@ -0,0 +1,158 @@
+/*
+ * Render queue. Collects draw packets of all renderers, sorts them by a 64bit
+ * key and executes them in one flush.
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#include <stdint.h>
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES 1
+#endif
+#include <Fxs/OpenGL/glcorearb.h>
+
+/*
+** Passes are executed in ascending order. Packets of opaque passes are sorted
+** by state and then front to back, packets of passes starting with 
+** FF_RENDER_QUEUE_PASS_TRANSPARENT are sorted back to front.
+*/
+#define FF_RENDER_QUEUE_PASS_OPAQUE 0
+#define FF_RENDER_QUEUE_PASS_TRANSPARENT 8
+#define FF_RENDER_QUEUE_MAX_PASS 15
+
+/*
+** Kinds of draw calls a packet can issue.
+*/
+typedef enum
+{
+    FF_RENDER_QUEUE_DRAW_ARRAYS,        /* glDrawArrays(mode, first, count) */
+    FF_RENDER_QUEUE_MULTI_DRAW_ARRAYS,  /* glMultiDrawArrays(mode, firsts, 
+                                        ** counts, drawCount) */
+    FF_RENDER_QUEUE_DRAW_ELEMENTS       /* glDrawElementsBaseVertex(mode, 
+                                        ** count, indexType, indices, 
+                                        ** baseVertex) */
+}
+FFRenderQueueDrawType;
+
+/*
+** A draw packet. It only references opengl objects, submitting it does not
+** issue any opengl calls.
+*/
+typedef struct
+{
+    GLuint program;
+    GLuint vao;
+    GLuint texture;             /* bound to unit 0, 0 if there is none */
+    GLenum textureTarget;
+    GLenum polygonMode;
+
+    FFRenderQueueDrawType drawType;
+    GLenum mode;                /* GL_TRIANGLES, ... */
+    GLint first;
+    GLsizei count;
+    const GLint* firsts;        /* must stay valid until the queue is flushed */
+    const GLsizei* counts;
+    GLsizei drawCount;
+    GLenum indexType;           /* GL_UNSIGNED_INT, ... */
+    const GLvoid* indices;      /* offset into the element array buffer of 
+                                ** the vao */
+    GLint baseVertex;
+
+    GLint modelLocation;        /* location of the model matrix uniform, -1 
+                                ** if the packet does not set it */
+    GLint paramsLocation;       /* location of a vec4 uniform that is set to
+                                ** params, -1 if the packet does not set it */
+    GLfloat params[4];
+}
+FFRenderQueuePacket;
+
+typedef struct FFRenderQueue* FFRenderQueuePtr;
+
+/*
+** Creates a render queue. capacity is a hint for the number of packets per 
+** flush. Returns NULL if it fails.
+*/
+FFRenderQueuePtr FFRenderQueueCreate(unsigned int capacity);
+
+/*
+** Packs the sort key of a packet. Layout from the most significant bit:
+**
+**      pass (4) | program (10) | texture (14) | vao (14) | depth (22)
+**
+** for opaque passes and 
+**
+**      pass (4) | inverted depth (22) | program (10) | texture (14) | vao (14)
+**
+** for transparent passes. OpenGL names are truncated to their bit width, 
+** which can only make the order less optimal, never incorrect. depth is 
+** expected to be in [0, 1], see FFRenderQueueComputeDepth.
+*/
+uint64_t FFRenderQueueMakeKey(
+    unsigned int pass,
+    GLuint program,
+    GLuint texture,
+    GLuint vao,
+    float depth
+);
+
+/*
+** Computes the window depth [0, 1] of point (x, y, z) in model space. The 
+** matrices are opengl (column major) matrices with 16 elements.
+*/
+float FFRenderQueueComputeDepth(
+    const float* model,
+    const float* view,
+    const float* projection,
+    float x,
+    float y,
+    float z
+);
+
+/*
+** Submits a packet with a sort key to the queue. model is a matrix with 16
+** elements that is uploaded to packet->modelLocation before the packet is
+** drawn, it is ignored if packet->modelLocation is -1. Returns 0 if it fails.
+*/
+int FFRenderQueueSubmit(
+    FFRenderQueuePtr queue,
+    uint64_t key,
+    const FFRenderQueuePacket* packet,
+    const float* model
+);
+
+/*
+** Sorts the packets by their keys and executes them. Empties the queue.
+*/
+void FFRenderQueueFlush(FFRenderQueuePtr queue);
+
+/*
+** Gets the # of packets currently in the queue.
+*/
+unsigned int FFRenderQueueGetSize(FFRenderQueuePtr queue);
+
+void FFRenderQueueDestroy(FFRenderQueuePtr* queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: RENDERQUEUE_H */
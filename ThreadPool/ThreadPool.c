@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "ThreadPool.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+/*
+** Arguments of a worker thread.
+*/
+typedef struct
+{
+    FFThreadPoolPtr pool;
+    unsigned int thread;
+}
+Worker;
+
+struct FFThreadPool
+{
+    pthread_t* threads;
+    Worker* workers;
+    unsigned int numThreads;    /* including the calling thread */
+    unsigned int numStarted;    /* # of worker threads that were started */
+
+    pthread_mutex_t mutex;
+    pthread_cond_t jobCond;     /* signals a new job (or shutdown) */
+    pthread_cond_t doneCond;    /* signals that all workers left the job */
+    unsigned int generation;    /* incremented for each job */
+    unsigned int numBusy;       /* # of workers still working on the job */
+    int shutdown;
+
+    /* the current job */
+    FFThreadPoolRangeFunc func;
+    void* userData;
+    unsigned int count;
+    unsigned int grainSize;
+    volatile unsigned int next; /* next element to be processed */
+};
+
+/*
+** Grabs ranges of the current job until there are none left.
+*/
+static void RunJob(FFThreadPoolPtr pool, unsigned int thread)
+{
+    unsigned int first = 0;
+    unsigned int count = 0;
+
+    while (1)
+    {
+        first = __sync_fetch_and_add(&pool->next, pool->grainSize);
+
+        if (first >= pool->count)
+        {
+            return;
+        }
+
+        count = pool->count - first;
+
+        if (count > pool->grainSize)
+        {
+            count = pool->grainSize;
+        }
+
+        pool->func(pool->userData, first, count, thread);
+    }
+}
+
+static void* WorkerMain(void* arg)
+{
+    Worker* worker = (Worker*)arg;
+    FFThreadPoolPtr pool = worker->pool;
+    unsigned int generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (1)
+    {
+        while (!pool->shutdown && pool->generation == generation)
+        {
+            pthread_cond_wait(&pool->jobCond, &pool->mutex);
+        }
+
+        if (pool->shutdown)
+        {
+            break;
+        }
+
+        generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+        
+        RunJob(pool, worker->thread);
+
+        pthread_mutex_lock(&pool->mutex);
+        pool->numBusy--;
+
+        if (!pool->numBusy)
+        {
+            pthread_cond_signal(&pool->doneCond);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+FFThreadPoolPtr FFThreadPoolCreate(unsigned int numThreads)
+{
+    FFThreadPoolPtr pool = NULL;
+    long numCores = 0;
+    unsigned int i = 0;
+
+    if (!numThreads)
+    {
+        numCores = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = numCores > 0 ? (unsigned int)numCores : 1;
+    }
+
+    pool = malloc(sizeof(struct FFThreadPool));
+
+    if (!pool)
+    {
+        return NULL;
+    }
+
+    memset(pool, 0, sizeof(struct FFThreadPool));
+    pool->numThreads = numThreads;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->jobCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+
+    if (numThreads == 1)
+    {
+        return pool;
+    }
+
+    pool->threads = malloc((numThreads - 1)*sizeof(pthread_t));
+    pool->workers = malloc((numThreads - 1)*sizeof(Worker));
+
+    if (!pool->threads || !pool->workers)
+    {
+        FFThreadPoolDestroy(&pool);
+        return NULL;
+    }
+
+    /* the calling thread is thread 0 */
+    for (i = 0; i < numThreads - 1; i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].thread = i + 1;
+
+        if (pthread_create(&pool->threads[i], NULL, WorkerMain, &pool->workers[i]))
+        {
+            ERR_MSG("Warning: Failed to create a worker thread");
+            FFThreadPoolDestroy(&pool);
+            return NULL;
+        }
+
+        pool->numStarted++;
+    }
+
+    return pool;
+}
+
+unsigned int FFThreadPoolGetNumThreads(FFThreadPoolPtr pool)
+{
+    return pool->numThreads;
+}
+
+void FFThreadPoolParallelFor(
+    FFThreadPoolPtr pool,
+    unsigned int count,
+    unsigned int grainSize,
+    FFThreadPoolRangeFunc func,
+    void* userData
+)
+{
+    if (!count)
+    {
+        return;
+    }
+
+    if (!grainSize)
+    {
+        grainSize = 1;
+    }
+
+    /* not worth waking up the workers */
+    if (pool->numStarted == 0 || count <= grainSize)
+    {
+        func(userData, 0, count, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->func = func;
+    pool->userData = userData;
+    pool->count = count;
+    pool->grainSize = grainSize;
+    pool->next = 0;
+    pool->numBusy = pool->numStarted;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->jobCond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    RunJob(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (pool->numBusy)
+    {
+        pthread_cond_wait(&pool->doneCond, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void FFThreadPoolDestroy(FFThreadPoolPtr* pool)
+{
+    unsigned int i = 0;
+
+    if (!*pool)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&(*pool)->mutex);
+    (*pool)->shutdown = 1;
+    pthread_cond_broadcast(&(*pool)->jobCond);
+    pthread_mutex_unlock(&(*pool)->mutex);
+
+    for (i = 0; i < (*pool)->numStarted; i++)
+    {
+        pthread_join((*pool)->threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&(*pool)->mutex);
+    pthread_cond_destroy(&(*pool)->jobCond);
+    pthread_cond_destroy(&(*pool)->doneCond);
+    free((*pool)->threads);
+    free((*pool)->workers);
+    free(*pool);
+
+    *pool = NULL;
+}
@@ -0,0 +1,79 @@
+/*
+ * A pool of worker threads to run loops in parallel. Needs to be linked 
+ * against pthreads.
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+typedef struct FFThreadPool* FFThreadPoolPtr;
+
+/*
+** Function run by FFThreadPoolParallelFor for the range first .. first + 
+** count - 1. thread is the index of the executing thread within 
+** 0 .. FFThreadPoolGetNumThreads() - 1, it can be used to index per thread 
+** data.
+*/
+typedef void (*FFThreadPoolRangeFunc)(
+    void* userData,
+    unsigned int first,
+    unsigned int count,
+    unsigned int thread
+);
+
+/*
+** Creates a thread pool with numThreads threads, including the calling 
+** thread. If numThreads is 0 the number of online cores is used. Returns NULL 
+** if it fails.
+*/
+FFThreadPoolPtr FFThreadPoolCreate(unsigned int numThreads);
+
+/*
+** Gets the # of threads that execute parallel loops, including the calling
+** thread.
+*/
+unsigned int FFThreadPoolGetNumThreads(FFThreadPoolPtr pool);
+
+/*
+** Splits 0 .. count - 1 into ranges of (at most) grainSize elements and runs
+** func for each range on the threads of the pool. The calling thread helps 
+** out. Returns once all ranges are done. 
+**
+** Must not be called from within func, and only from one thread at a time.
+*/
+void FFThreadPoolParallelFor(
+    FFThreadPoolPtr pool,
+    unsigned int count,
+    unsigned int grainSize,
+    FFThreadPoolRangeFunc func,
+    void* userData
+);
+
+/*
+** Stops the worker threads and releases the pool. Sets pool to NULL.
+*/
+void FFThreadPoolDestroy(FFThreadPoolPtr* pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: THREADPOOL_H */
@@ -0,0 +1,302 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <stdio.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAS_SSE2 1
+#endif
+#include "Transforms.h"
+
+#define ERR_MSG(X) printf("In file: %s line: %d\n\t%s\n", __FILE__, __LINE__, X);
+
+struct FFTransforms
+{
+    float* locals;              /* 16 floats per node */
+    float* worlds;              /* 16 floats per node */
+    int* parents;               /* always less than the index of the node */
+    unsigned char* dirty;
+    unsigned int* updated;      /* the nodes of the last update */
+    unsigned int numUpdated;
+    unsigned int numNodes;
+    unsigned int capacity;
+    unsigned int firstDirty;    /* numNodes if no node is dirty */
+};
+
+static const float identity[16] = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f
+    };
+
+/*
+** Grows the arrays to fit capacity nodes. Returns 0 if it fails.
+*/
+static int Reserve(FFTransformsPtr transforms, unsigned int capacity)
+{
+    float* locals = NULL;
+    float* worlds = NULL;
+    int* parents = NULL;
+    unsigned char* dirty = NULL;
+    unsigned int* updated = NULL;
+
+    if (capacity <= transforms->capacity)
+    {
+        return 1;
+    }
+
+    locals = realloc(transforms->locals, 16*capacity*sizeof(float));
+
+    if (locals)
+    {
+        transforms->locals = locals;
+    }
+
+    worlds = realloc(transforms->worlds, 16*capacity*sizeof(float));
+
+    if (worlds)
+    {
+        transforms->worlds = worlds;
+    }
+
+    parents = realloc(transforms->parents, capacity*sizeof(int));
+
+    if (parents)
+    {
+        transforms->parents = parents;
+    }
+
+    dirty = realloc(transforms->dirty, capacity);
+
+    if (dirty)
+    {
+        transforms->dirty = dirty;
+    }
+
+    updated = realloc(transforms->updated, capacity*sizeof(unsigned int));
+
+    if (updated)
+    {
+        transforms->updated = updated;
+    }
+
+    if (!locals || !worlds || !parents || !dirty || !updated)
+    {
+        return 0;
+    }
+
+    transforms->capacity = capacity;
+
+    return 1;
+}
+
+/*
+** Computes result = a*b. Column i of the result is the sum of the columns of
+** a weighted by the elements of column i of b. The sum is added up pairwise,
+** which shortens the chain of dependent adds when a was just computed (a
+** parent right before its child).
+*/
+static void Multiply(float* result, const float* a, const float* b)
+{
+#ifdef HAS_SSE2
+    __m128 a0 = _mm_loadu_ps(a);
+    __m128 a1 = _mm_loadu_ps(a + 4);
+    __m128 a2 = _mm_loadu_ps(a + 8);
+    __m128 a3 = _mm_loadu_ps(a + 12);
+    __m128 column, sum01, sum23;
+    int i = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        /* the elements are broadcast from one load of the column */
+        column = _mm_loadu_ps(b + 4*i);
+        sum01 = _mm_add_ps(
+            _mm_mul_ps(a0, _mm_shuffle_ps(column, column, _MM_SHUFFLE(0, 0, 0, 0))),
+            _mm_mul_ps(a1, _mm_shuffle_ps(column, column, _MM_SHUFFLE(1, 1, 1, 1)))
+        );
+        sum23 = _mm_add_ps(
+            _mm_mul_ps(a2, _mm_shuffle_ps(column, column, _MM_SHUFFLE(2, 2, 2, 2))),
+            _mm_mul_ps(a3, _mm_shuffle_ps(column, column, _MM_SHUFFLE(3, 3, 3, 3)))
+        );
+        _mm_storeu_ps(result + 4*i, _mm_add_ps(sum01, sum23));
+    }
+#else
+    int i = 0, j = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        for (j = 0; j < 4; j++)
+        {
+            result[4*i + j] =
+                (a[j]*b[4*i] + a[4 + j]*b[4*i + 1]) +
+                (a[8 + j]*b[4*i + 2] + a[12 + j]*b[4*i + 3]);
+        }
+    }
+#endif
+}
+
+FFTransformsPtr FFTransformsCreate(unsigned int capacity)
+{
+    FFTransformsPtr transforms = malloc(sizeof(struct FFTransforms));
+
+    if (!transforms)
+    {
+        return NULL;
+    }
+
+    memset(transforms, 0, sizeof(struct FFTransforms));
+
+    if (!Reserve(transforms, capacity ? capacity : 64))
+    {
+        FFTransformsDestroy(&transforms);
+        return NULL;
+    }
+
+    return transforms;
+}
+
+void FFTransformsDestroy(FFTransformsPtr* transforms)
+{
+    if (!*transforms)
+    {
+        return;
+    }
+
+    free((*transforms)->locals);
+    free((*transforms)->worlds);
+    free((*transforms)->parents);
+    free((*transforms)->dirty);
+    free((*transforms)->updated);
+    free(*transforms);
+
+    *transforms = NULL;
+}
+
+/*
+** Flags node as dirty.
+*/
+static void SetDirty(FFTransformsPtr transforms, unsigned int node)
+{
+    transforms->dirty[node] = 1;
+
+    if (node < transforms->firstDirty)
+    {
+        transforms->firstDirty = node;
+    }
+}
+
+int FFTransformsAdd(FFTransformsPtr transforms, int parent, const float* local)
+{
+    unsigned int node = transforms->numNodes;
+
+    if (parent < -1 || parent >= (int)node)
+    {
+        ERR_MSG("Parent does not exist");
+        return -1;
+    }
+
+    if (node == transforms->capacity && !Reserve(transforms, 2*node))
+    {
+        ERR_MSG("Out of memory");
+        return -1;
+    }
+
+    memcpy(&transforms->locals[16*node], local ? local : identity,
+        16*sizeof(float));
+    transforms->parents[node] = parent;
+    transforms->dirty[node] = 0;
+    transforms->numNodes++;
+    SetDirty(transforms, node);
+
+    return (int)node;
+}
+
+void FFTransformsSetLocal(
+    FFTransformsPtr transforms,
+    unsigned int node,
+    const float* local
+)
+{
+    memcpy(&transforms->locals[16*node], local, 16*sizeof(float));
+    SetDirty(transforms, node);
+}
+
+const float* FFTransformsGetLocal(FFTransformsPtr transforms, unsigned int node)
+{
+    return &transforms->locals[16*node];
+}
+
+const float* FFTransformsGetWorld(FFTransformsPtr transforms, unsigned int node)
+{
+    return &transforms->worlds[16*node];
+}
+
+int FFTransformsGetParent(FFTransformsPtr transforms, unsigned int node)
+{
+    return transforms->parents[node];
+}
+
+unsigned int FFTransformsGetSize(FFTransformsPtr transforms)
+{
+    return transforms->numNodes;
+}
+
+unsigned int FFTransformsUpdate(FFTransformsPtr transforms)
+{
+    const int* parents = transforms->parents;
+    unsigned char* dirty = transforms->dirty;
+    const float* locals = transforms->locals;
+    float* worlds = transforms->worlds;
+    unsigned int* updated = transforms->updated;
+    unsigned int first = transforms->firstDirty;
+    unsigned int numUpdated = 0;
+    unsigned int i = 0;
+    int parent = 0;
+
+    /* nodes before the first dirty node can not have a dirty parent */
+    for (i = first; i < transforms->numNodes; i++)
+    {
+        parent = parents[i];
+
+        if (parent >= 0)
+        {
+            dirty[i] |= dirty[parent];
+        }
+
+        if (!dirty[i])
+        {
+            continue;
+        }
+
+        if (parent >= 0)
+        {
+            Multiply(&worlds[16*i], &worlds[16*parent], &locals[16*i]);
+        }
+        else
+        {
+            memcpy(&worlds[16*i], &locals[16*i], 16*sizeof(float));
+        }
+
+        updated[numUpdated++] = i;
+    }
+
+    if (first < transforms->numNodes)
+    {
+        memset(&dirty[first], 0, transforms->numNodes - first);
+    }
+
+    transforms->firstDirty = transforms->numNodes;
+    transforms->numUpdated = numUpdated;
+
+    return numUpdated;
+}
+
+const unsigned int* FFTransformsGetUpdated(
+    FFTransformsPtr transforms,
+    unsigned int* numUpdated
+)
+{
+    *numUpdated = transforms->numUpdated;
+
+    return transforms->updated;
+}
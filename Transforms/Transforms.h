@@ -0,0 +1,112 @@
+/*
+ * A hierarchy of transforms. Computes the world matrices of scene nodes from
+ * their local matrices.
+ * Copyright (C) 2014 Arno in Wolde Luebke
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TRANSFORMS_H
+#define TRANSFORMS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+** The nodes are stored in arrays of local matrices, world matrices, parents
+** and dirty flags rather than as a tree of structs. A node is always added
+** after its parent, so the parent of a node comes before it in the arrays and
+** the world matrices are updated front to back in a single pass: when a node
+** is reached, the world matrix of its parent is up to date.
+**
+** Setting a local matrix flags the node as dirty. The flag is passed on to
+** the children during the update, so only the world matrices of changed nodes
+** and their subtrees are computed. The update starts at the first dirty node.
+** The matrices are multiplied with SSE where available. Adding the nodes
+** depth first keeps the world matrix of a parent in the cache when its
+** children are updated.
+**
+** All matrices are opengl (column major) matrices with 16 elements. The world
+** matrix of a node is the world matrix of its parent times its local matrix.
+*/
+
+typedef struct FFTransforms* FFTransformsPtr;
+
+/*
+** Creates an empty hierarchy. capacity is a hint for the # of nodes. Returns
+** NULL if it fails.
+*/
+FFTransformsPtr FFTransformsCreate(unsigned int capacity);
+
+/*
+** Adds a node with the local matrix local (NULL for the identity) below the
+** node parent, -1 adds a root. Returns the index of the node, or -1 if it
+** fails. Nodes are numbered in the order they are added.
+*/
+int FFTransformsAdd(FFTransformsPtr transforms, int parent, const float* local);
+
+/*
+** Sets the local matrix of node and flags it as dirty.
+*/
+void FFTransformsSetLocal(
+    FFTransformsPtr transforms,
+    unsigned int node,
+    const float* local
+);
+
+/*
+** Gets the local matrix of node.
+*/
+const float* FFTransformsGetLocal(FFTransformsPtr transforms, unsigned int node);
+
+/*
+** Gets the world matrix of node as of the last FFTransformsUpdate.
+*/
+const float* FFTransformsGetWorld(FFTransformsPtr transforms, unsigned int node);
+
+/*
+** Gets the parent of node, -1 for a root.
+*/
+int FFTransformsGetParent(FFTransformsPtr transforms, unsigned int node);
+
+/*
+** Gets the # of nodes.
+*/
+unsigned int FFTransformsGetSize(FFTransformsPtr transforms);
+
+/*
+** Computes the world matrices of the dirty nodes and their subtrees and
+** clears the flags. Returns the # of world matrices computed.
+*/
+unsigned int FFTransformsUpdate(FFTransformsPtr transforms);
+
+/*
+** Gets the nodes whose world matrices the last FFTransformsUpdate computed,
+** in ascending order, e.g. to upload only those. Their # is stored in
+** numUpdated. The array is valid until the next call that changes
+** transforms.
+*/
+const unsigned int* FFTransformsGetUpdated(
+    FFTransformsPtr transforms,
+    unsigned int* numUpdated
+);
+
+void FFTransformsDestroy(FFTransformsPtr* transforms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* end of include guard: TRANSFORMS_H */